@@ -0,0 +1,75 @@
+#include "dem.h"
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <stdlib.h>
+#include <vector>
+
+using namespace gcop;
+using namespace std;
+
+// Micro-benchmark of batch Dem height/normal queries against the scalar
+// Get/GetNormal calls
+int main(int argc, char** argv)
+{
+  int n = (argc > 1 ? atoi(argv[1]) : 4096);         // points per batch
+  int nb = (argc > 2 ? atoi(argv[2]) : 1000);        // number of batches
+  int sz = (argc > 3 ? atoi(argv[3]) : 1024);        // map size in cells
+
+  Dem dem(sz, sz, 1.0);
+  for (int i = 0; i < dem.ni; ++i)
+    for (int j = 0; j < dem.nj; ++j)
+      dem.data[i*dem.nj + j] = 10*sin(0.05*i)*cos(0.03*j);
+  dem.ComputeNormals();
+
+  // points clustered around a footprint, with some outside the map
+  mt19937 gen(0);
+  uniform_real_distribution<double> c(-0.05*sz, 1.05*sz);
+  normal_distribution<double> r(0, 5);
+  vector<double> x(n), y(n), z(n), ns(3*n), zs(n), nss(3*n);
+  vector<unsigned char> valid(n);
+
+  double ts = 0, tb = 0, tns = 0, tnb = 0;
+  double ez = 0, en = 0;
+  int nv = 0, nvs = 0;
+  for (int b = 0; b < nb; ++b) {
+    double cx = c(gen), cy = c(gen);
+    for (int k = 0; k < n; ++k) {
+      x[k] = cx + r(gen);
+      y[k] = cy + r(gen);
+    }
+
+    auto t0 = chrono::steady_clock::now();
+    for (int k = 0; k < n; ++k) {
+      zs[k] = dem.Get(x[k], y[k]);
+      nvs += dem.IsValid(x[k], y[k]);
+    }
+    auto t1 = chrono::steady_clock::now();
+    nv += dem.Get(&z[0], &x[0], &y[0], n, &valid[0]);
+    auto t2 = chrono::steady_clock::now();
+    for (int k = 0; k < n; ++k)
+      zs[k] = dem.GetNormal(&nss[3*k], x[k], y[k]);
+    auto t3 = chrono::steady_clock::now();
+    dem.GetNormal(&z[0], &ns[0], &x[0], &y[0], n, &valid[0]);
+    auto t4 = chrono::steady_clock::now();
+
+    ts += chrono::duration<double>(t1 - t0).count();
+    tb += chrono::duration<double>(t2 - t1).count();
+    tns += chrono::duration<double>(t3 - t2).count();
+    tnb += chrono::duration<double>(t4 - t3).count();
+
+    for (int k = 0; k < n; ++k) {
+      ez = max(ez, fabs(z[k] - zs[k]));
+      for (int l = 0; l < 3; ++l)
+        en = max(en, fabs(ns[3*k + l] - nss[3*k + l]));
+    }
+  }
+
+  double np = (double)n*nb;
+  cout << "points: " << np << " valid: " << nv << " (scalar: " << nvs << ")" << endl;
+  cout << "Get:       scalar " << 1e9*ts/np << " ns/pt, batch " << 1e9*tb/np << " ns/pt, speedup " << ts/tb << endl;
+  cout << "GetNormal: scalar " << 1e9*tns/np << " ns/pt, batch " << 1e9*tnb/np << " ns/pt, speedup " << tns/tnb << endl;
+  cout << "max height difference " << ez << ", max normal difference " << en << endl;
+  return 0;
+}
@@ -0,0 +1,28 @@
+#include "tileddem.h"
+#include <iostream>
+#include <stdlib.h>
+
+using namespace gcop;
+using namespace std;
+
+// Convert a PPM elevation map (e.g. maps/dem.ppm) into a tiled binary Dem
+// that can be memory mapped by TiledDem
+int main(int argc, char** argv)
+{
+  if (argc < 3) {
+    cout << "Usage: " << argv[0] << " <ppm_file> <tiled_file> [cell_size=1] [data_scale=1] [tile_size=64]" << endl;
+    return 1;
+  }
+
+  double cs = (argc > 3 ? atof(argv[3]) : 1);
+  double ds = (argc > 4 ? atof(argv[4]) : 1);
+  int ts = (argc > 5 ? atoi(argv[5]) : 64);
+
+  Dem dem(argv[1], cs, ds);
+  if (!TiledDem::Write(dem, argv[2], ts))
+    return 1;
+
+  TiledDem tdem(argv[2]);
+  cout << "Wrote " << tdem.ni << "x" << tdem.nj << " map in " << tdem.nti << "x" << tdem.ntj << " tiles of size " << tdem.ts << " into " << argv[2] << endl;
+  return 0;
+}
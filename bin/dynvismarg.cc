@@ -0,0 +1,93 @@
+#include <cstdio>
+#include <iostream>
+#include "dynvisins.h"
+#include "utils.h"
+
+using namespace std;
+using namespace gcop;
+using namespace Eigen;
+
+/**
+ * Run an estimator on nb simulated sequences of ns segments each (with the
+ * same random seed), optimizing after each sequence if window is set and
+ * only once at the end otherwise
+ * @return average time per Compute call in seconds, or a negative number
+ *         if a Compute call failed
+ */
+double Run(DynVisIns &vi, DynVisIns &tvi, int nb, int ns, double dt, bool window)
+{
+  srand(0);
+  struct timeval timer;
+  long us = 0;
+  int nc = 0;
+  for (int i = 0; i < nb; ++i) {
+    vi.SimData(tvi, ns, 81, 2, dt);
+    if (window || i == nb - 1) {
+      timer_start(timer);
+      if (!vi.Compute()) {
+        cout << "[E] dynvismarg: Compute failed on sequence #" << i << endl;
+        return -1;
+      }
+      us += timer_us(timer);
+      ++nc;
+    }
+  }
+  return us*1e-6/nc;
+}
+
+/**
+ * Position and rotation RMS errors of the cameras of vi (among those in ids)
+ * with respect to the true ones
+ */
+void Errors(double &ep, double &er, const DynVisIns &vi, const DynVisIns &tvi, const SlotMap<DynVisIns::Camera> &ids)
+{
+  ep = 0;
+  er = 0;
+  SlotMap<DynVisIns::Camera>::const_iterator camIter;
+  for (camIter = ids.begin(); camIter != ids.end(); ++camIter) {
+    const Body3dState &x = vi.cams.find(camIter->first)->second.x;
+    const Body3dState &xt = tvi.cams.find(camIter->first)->second.x;
+    Vector3d e;
+    SO3::Instance().log(e, xt.R.transpose()*x.R);
+    ep += (x.p - xt.p).squaredNorm();
+    er += e.squaredNorm();
+  }
+  ep = sqrt(ep/ids.size());
+  er = sqrt(er/ids.size());
+}
+
+// Compares sliding-window estimation with marginalization to full batch
+// optimization on the same simulated data
+int main(int argc, char** argv)
+{
+  // arguments: number of sequences, segments per sequence, window size
+  int nb = (argc > 1 ? atoi(argv[1]) : 6);
+  int ns = (argc > 2 ? atoi(argv[2]) : 4);
+  int maxCams = (argc > 3 ? atoi(argv[3]) : 8);
+  double dt = .125;
+
+  DynVisIns vi, tvi;
+  vi.maxCams = maxCams;
+  vi.useMarg = true;
+  vi.verbose = false;
+  double tw = Run(vi, tvi, nb, ns, dt, true);
+  if (tw < 0)
+    return 1;
+
+  DynVisIns bvi, btvi;
+  bvi.verbose = false;
+  double tb = Run(bvi, btvi, nb, ns, dt, false);
+  if (tb < 0)
+    return 1;
+
+  double epw, erw, epb, erb;
+  Errors(epw, erw, vi, tvi, vi.cams);
+  Errors(epb, erb, bvi, btvi, vi.cams);
+
+  cout << "window of " << vi.cams.size() << " cams: " << tw << " s per Compute, "
+       << "pos. error=" << epw << " rot. error=" << erw << endl;
+  cout << "batch of " << bvi.cams.size() << " cams: " << tb << " s, "
+       << "pos. error=" << epb << " rot. error=" << erb << endl;
+
+  return 0;
+}
@@ -6,9 +6,8 @@
 #include "utils.h"
 #include "se2.h"
 #include "lqcost.h"
-#include "constraintcost.h"
 #include "multicost.h"
-#include "diskconstraint.h"
+#include "obstaclesetcost.h"
 #include "diskview.h"
 #include "unistd.h"
 
@@ -17,14 +16,14 @@ using namespace Eigen;
 using namespace gcop;
 
 typedef Ddp<GcarState, 4, 2> GcarDdp;
-typedef DiskConstraint<GcarState, 4, 2> GcarDiskConstraint;
-typedef ConstraintCost<GcarState, 4, 2, Dynamic, 1> DiskConstraintCost;
+typedef ObstacleSetCost<GcarState, 4, 2> GcarObstacleSetCost;
 
 
-int GcarStateToVector2d(Vector2d &p, const GcarState &x)
+int GcarStateToVector3d(Vector3d &p, const GcarState &x)
 {
   p[0] = x.g(0,2);   // x.g is the car SE(2) pose matrix 
   p[1] = x.g(1,2);
+  p[2] = 0;
   return 1;  // index where position coordinates start (the car model coordinates are (theta,x,y,v)
 }
 
@@ -103,24 +102,26 @@ void solver_process(Viewer* viewer)
   MultiCost<GcarState, 4, 2> mcost(sys, tf);
   mcost.costs.push_back(&lqcost);
   
-  // make obstacles and add as constarints
+  // make obstacles and add them as a single penalty (only the obstacles
+  // near the car are visited, see obstaclesetbench)
   vector<Disk> disks;
   MakeObstacles(disks, 6, Rd, .3);
-  
-  GcarDiskConstraint* constraints[disks.size()];
-  DiskConstraintCost* dcosts[disks.size()];
+
+  ObstacleSet obstacles(.3);
   DiskView* dviews[disks.size()];
 
   for (int i = 0; i < disks.size(); ++i) {
-    constraints[i] = new GcarDiskConstraint(disks[i], .3);
-    constraints[i]->func = GcarStateToVector2d;    
-    dcosts[i] = new DiskConstraintCost(sys, tf, *constraints[i]);
-    dcosts[i]->b = 1000;
-    mcost.costs.push_back(dcosts[i]);
+    obstacles.Add(disks[i]);
 
     dviews[i] = new DiskView(disks[i]);
     viewer->Add(*dviews[i]);    
   }
+  obstacles.Build();
+
+  GcarObstacleSetCost ocost(sys, tf, obstacles, 2);
+  ocost.func = GcarStateToVector3d;
+  ocost.b = 1000;
+  mcost.costs.push_back(&ocost);
 
   GcarView view(sys, &xs, &us);
   viewer->Add(view);
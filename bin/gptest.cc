@@ -7,6 +7,7 @@
 #include "utils.h"
 
 #include "gp.h"
+#include "sparsegp.h"
 
 using namespace gcop;
 using namespace std;
@@ -18,7 +19,10 @@ using namespace Eigen;
 
 int main(int argc, char** argv)
 {
-  GP gp(2, 200);
+  // optional argument: number of inducing points of a sparse GP
+  int m = (argc > 1 ? atoi(argv[1]) : 0);
+  GP *pgp = (m > 0 ? new SparseGP(2, m, 200) : new GP(2, 200));
+  GP &gp = *pgp;
   gp.sigma = .1;
   gp.Sample();
 
@@ -38,16 +42,21 @@ int main(int argc, char** argv)
   MatrixXd ms(n,n);
   MatrixXd ss(n,n);
 
-  double s = 0;
+  // query all grid points at once
+  MatrixXd X(2, n*n);
+  for(int i = 0; i < n; ++i) {
+    for(int j = 0; j < n; ++j) {
+      X(0, i*n + j) = -2 + ((double)i)/(n-1)*4;
+      X(1, i*n + j) = -2 + ((double)j)/(n-1)*4;
+    }
+  }
 
-  VectorXd x(2);
+  VectorXd mv, sv;
+  gp.Predict(mv, X, &sv);
   for(int i = 0; i < n; ++i) {
-    x(0) = -2 + ((double)i)/(n-1)*4;
     for(int j = 0; j < n; ++j) {
-      x(1) = -2 + ((double)j)/(n-1)*4;
-      
-      ms(j,i) = gp.Predict(x, &s);
-      ss(j,i) = s;
+      ms(j,i) = mv(i*n + j);
+      ss(j,i) = sv(i*n + j);
     }
   }
 
@@ -58,6 +67,8 @@ int main(int argc, char** argv)
   cout << endl;
   cout << ss << endl;
 
+  delete pgp;
+
   return 1;
 
 }
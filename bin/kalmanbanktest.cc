@@ -0,0 +1,95 @@
+#include <iostream>
+#include "utils.h"
+#include "kalmanpredictor.h"
+#include "kalmancorrector.h"
+#include "kalmanbank.h"
+#include "point3d.h"
+#include "point3dgps.h"
+
+using namespace std;
+using namespace gcop;
+using namespace Eigen;
+
+typedef KalmanPredictor<Point3dState, 6, 3, Dynamic> Point3dKalmanPredictor;
+typedef KalmanCorrector<Point3dState, 6, 3, Dynamic, Vector3d, 3> Point3dGpsKalmanCorrector;
+typedef KalmanBank<Point3dState, 6, 3, Dynamic, Vector3d, 3> Point3dGpsKalmanBank;
+
+// Tracks n targets moving with constant velocities using a bank of
+// Point3d/GPS filters and compares its throughput to running
+// the filters one by one
+int main(int argc, char** argv)
+{
+  // arguments: number of filters, number of threads, linear (0 or 1)
+  int n = (argc > 1 ? atoi(argv[1]) : 10000);
+  int nt = (argc > 2 ? atoi(argv[2]) : 1);
+  int N = 100;
+  double dt = .01;
+
+  Point3d point3d;
+  Point3dGps<> gps;
+
+  Point3dKalmanPredictor kp(point3d);
+  Point3dGpsKalmanCorrector kc(point3d.X, gps);
+
+  Point3dGpsKalmanBank bank(point3d, gps, n);
+  bank.linear = (argc > 3 ? atoi(argv[3]) : 1);
+  vector<Point3d> point3ds(nt - 1);
+  vector<Point3dGps<> > gpss(nt - 1);
+  for (int i = 0; i < nt - 1; ++i) {
+    bank.systems.push_back(&point3ds[i]);
+    bank.sensors.push_back(&gpss[i]);
+  }
+
+  vector<Point3dState> xts(n);   // true states
+  vector<Point3dState> xs(n);    // estimates using single filters
+  for (int k = 0; k < n; ++k) {
+    xts[k].q << 10*(RND - .5), 10*(RND - .5), 0;
+    xts[k].v << RND - .5, RND - .5, .1*(RND - .5);
+    xs[k].P.topLeftCorner<3,3>().diagonal().setConstant(.1);
+    xs[k].P.bottomRightCorner<3,3>().diagonal().setConstant(.1);
+    bank.Set(k, xs[k]);
+  }
+
+  vector<Vector3d> us(n, Vector3d::Zero());
+  vector<Vector3d> zs(n);
+
+  struct timeval timer;
+  long tb = 0, ts = 0;
+
+  for (int i = 0; i < N; ++i) {
+    double t = i*dt;
+
+    for (int k = 0; k < n; ++k) {
+      Point3dState xt;
+      point3d.Step(xt, t, xts[k], us[k], dt);
+      xts[k] = xt;
+      zs[k] = xt.q + Vector3d(gps.sxy*randn(), gps.sxy*randn(), gps.sz*randn());
+    }
+
+    timer_start(timer);
+    for (int k = 0; k < n; ++k) {
+      Point3dState x;
+      kp.Predict(x, t, xs[k], us[k], dt);
+      kc.Correct(xs[k], t, x, us[k], zs[k]);
+    }
+    ts += timer_us(timer);
+
+    timer_start(timer);
+    bank.Predict(t, us, dt);
+    bank.Correct(t, us, zs);
+    tb += timer_us(timer);
+  }
+
+  double e = 0;
+  for (int k = 0; k < n; ++k) {
+    Point3dState x;
+    bank.Get(x, k);
+    e = max(e, (x.q - xs[k].q).norm() + (x.v - xs[k].v).norm() + (x.P - xs[k].P).norm());
+  }
+
+  cout << "single filters: " << n*N/(ts*1e-6) << " filters/s" << endl;
+  cout << "filter bank: " << n*N/(tb*1e-6) << " filters/s" << endl;
+  cout << "max difference: " << e << endl;
+
+  return 0;
+}
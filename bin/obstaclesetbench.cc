@@ -0,0 +1,115 @@
+#include "gcar.h"
+#include "se2.h"
+#include "constraintcost.h"
+#include "multicost.h"
+#include "diskconstraint.h"
+#include "obstaclesetcost.h"
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <stdlib.h>
+#include <vector>
+
+using namespace gcop;
+using namespace std;
+using namespace Eigen;
+
+typedef DiskConstraint<GcarState, 4, 2> GcarDiskConstraint;
+typedef ConstraintCost<GcarState, 4, 2, Dynamic, 1> DiskConstraintCost;
+typedef ObstacleSetCost<GcarState, 4, 2> GcarObstacleSetCost;
+
+// Benchmark of the disk avoidance cost of a car: a MultiCost with one
+// ConstraintCost per DiskConstraint against a single ObstacleSetCost, for
+// a growing number of disks at constant density. Reports the time of one
+// cost evaluation with gradient and Hessian and the largest differences.
+int main(int argc, char** argv)
+{
+  // arguments: largest number of disks, number of evaluations
+  int nmax = (argc > 1 ? atoi(argv[1]) : 10000);
+  int ne = (argc > 2 ? atoi(argv[2]) : 10000);
+  double cr = .3;
+
+  Gcar sys;
+  mt19937 gen(0);
+  for (int n = 10; n <= nmax; n *= 10) {
+    // about one disk per 4 square meters
+    double a = 2*sqrt((double)n);
+    uniform_real_distribution<double> c(0, a), r(.1, 1);
+
+    MultiCost<GcarState, 4, 2> mcost(sys, 1);
+    vector<Disk> disks;
+    for (int i = 0; i < n; ++i)
+      disks.push_back(Disk(Vector2d(c(gen), c(gen)), r(gen)));
+    vector<GcarDiskConstraint*> cons(n);
+    vector<DiskConstraintCost*> dcosts(n);
+    for (int i = 0; i < n; ++i) {
+      cons[i] = new GcarDiskConstraint(disks[i], cr);
+      cons[i]->func = [](Vector2d &p, const GcarState &x) {
+        p << x.g(0,2), x.g(1,2);
+        return 1;
+      };
+      dcosts[i] = new DiskConstraintCost(sys, 1, *cons[i]);
+      mcost.costs.push_back(dcosts[i]);
+    }
+
+    auto t0 = chrono::steady_clock::now();
+    ObstacleSet obstacles(cr);
+    for (int i = 0; i < n; ++i)
+      obstacles.Add(disks[i]);
+    obstacles.Build();
+    auto t1 = chrono::steady_clock::now();
+    GcarObstacleSetCost ocost(sys, 1, obstacles, 2);
+    ocost.func = [](Vector3d &p, const GcarState &x) {
+      p << x.g(0,2), x.g(1,2), 0;
+      return 1;
+    };
+
+    // car poses spread over the map
+    vector<GcarState> xs(ne);
+    for (int k = 0; k < ne; ++k) {
+      Vector3d q(2*M_PI*c(gen)/a, c(gen), c(gen));
+      SE2::Instance().q2g(xs[k].g, q);
+    }
+
+    Vector2d u(0, 0);
+    Vector4d Lx, Lxo;
+    Matrix4d Lxx, Lxxo;
+    Vector2d Lu;
+    Matrix2d Luu;
+    Matrix<double, 4, 2> Lxu;
+    vector<double> Ls(ne);
+    double tm = 0, to = 0, eL = 0, eLx = 0;
+    auto t2 = chrono::steady_clock::now();
+    for (int k = 0; k < ne; ++k)
+      Ls[k] = mcost.L(0, xs[k], u, .1, 0, &Lx, &Lxx, &Lu, &Luu, &Lxu);
+    auto t3 = chrono::steady_clock::now();
+    for (int k = 0; k < ne; ++k) {
+      double L = ocost.L(0, xs[k], u, .1, 0, &Lxo, &Lxxo, &Lu, &Luu, &Lxu);
+      eL = max(eL, fabs(L - Ls[k]));
+    }
+    auto t4 = chrono::steady_clock::now();
+    tm = chrono::duration<double>(t3 - t2).count();
+    to = chrono::duration<double>(t4 - t3).count();
+
+    // gradients, outside of the timed loops
+    int nc = 0;
+    for (int k = 0; k < ne; ++k) {
+      nc += (Ls[k] > 0);
+      mcost.L(0, xs[k], u, .1, 0, &Lx, &Lxx, &Lu, &Luu, &Lxu);
+      ocost.L(0, xs[k], u, .1, 0, &Lxo, &Lxxo, &Lu, &Luu, &Lxu);
+      eLx = max(eLx, max((Lx - Lxo).cwiseAbs().maxCoeff(), (Lxx - Lxxo).cwiseAbs().maxCoeff()));
+    }
+
+    cout << "disks: " << n << " build " << 1e3*chrono::duration<double>(t1 - t0).count() << " ms"
+         << ", MultiCost " << 1e9*tm/ne << " ns, ObstacleSetCost " << 1e9*to/ne
+         << " ns, speedup " << tm/to << endl;
+    cout << "  poses in collision " << nc << ", max differences: cost " << eL
+         << ", derivatives " << eLx << endl;
+
+    for (int i = 0; i < n; ++i) {
+      delete dcosts[i];
+      delete cons[i];
+    }
+  }
+  return 0;
+}
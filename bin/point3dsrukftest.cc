@@ -0,0 +1,102 @@
+#include <iostream>
+#include <cmath>
+#include "utils.h"
+#include "kalmanpredictor.h"
+#include "kalmancorrector.h"
+#include "sqrtunscentedfilter.h"
+#include "point3d.h"
+#include "point3dgps.h"
+
+using namespace std;
+using namespace gcop;
+using namespace Eigen;
+
+typedef KalmanPredictor<Point3dState, 6, 3, Dynamic> Point3dKalmanPredictor;
+typedef KalmanCorrector<Point3dState, 6, 3, Dynamic, Vector3d, 3> Point3dGpsKalmanCorrector;
+typedef SqrtUnscentedFilter<Point3dState, 6, 3, Dynamic, Vector3d, 3> Point3dGpsSrukf;
+
+// Runs the square-root UKF side by side with the Kalman filter on the same
+// measurements. The model and sensor are linear, so both should give the
+// same estimates up to round-off.
+int main(int argc, char** argv)
+{
+  Point3d point3d;
+
+  Point3dGps<> gps;
+
+  Point3dKalmanPredictor kp(point3d);
+  Point3dGpsKalmanCorrector kc(point3d.X, gps);
+
+  Point3dGpsSrukf ukf(point3d, gps);
+
+  // optional argument: number of threads used to evaluate sigma points
+  int nt = (argc > 1 ? atoi(argv[1]) : 1);
+  vector<Point3d> point3ds(nt > 1 ? nt - 1 : 0);
+  vector<Point3dGps<> > gpss(point3ds.size());
+  for (int i = 0; i < point3ds.size(); ++i) {
+    ukf.systems.push_back(&point3ds[i]);
+    ukf.sensors.push_back(&gpss[i]);
+  }
+
+  int N = 1000;
+
+  vector<Point3dState> xts(N);   // true states
+  xts[0].v << .1, 0, .2;         // true (initially unknown) velocity
+
+  vector<Point3dState> xs(N);   // UKF estimated trajectory
+  xs[0].P.topLeftCorner<3,3>().diagonal().setConstant(.1);  // q
+  xs[0].P.bottomRightCorner<3,3>().diagonal().setConstant(.1);  // v
+
+  vector<Point3dState> kxs(xs);  // KF estimated trajectory
+
+  double dt = .01;
+
+  struct timeval timer;
+  long kus = 0, uus = 0;
+  double dx = 0, dP = 0;   // max differences between the two filters
+
+  for (int i = 0; i < N-1; ++i) {
+    double t = i*dt;
+
+    // Constant velocity model no acceleration
+    Vector3d u(0, 0, 0); // no inputs
+
+    // generate true
+    point3d.Step(xts[i+1], t, xts[i], u, dt);
+
+    // noisy measurements of position
+    Vector3d z = xts[i+1].q + Vector3d(gps.sxy*randn(), gps.sxy*randn(), gps.sz*randn());
+
+    Point3dState x, kx;
+
+    timer_start(timer);
+    kp.Predict(kx, t, kxs[i], u, dt);
+    kc.Correct(kxs[i+1], t, kx, u, z);
+    kus += timer_us(timer);
+
+    timer_start(timer);
+    ukf.Predict(x, t, xs[i], u, dt);
+    ukf.Correct(xs[i+1], t, x, u, z);
+    uus += timer_us(timer);
+
+    dx = max(dx, max((xs[i+1].q - kxs[i+1].q).cwiseAbs().maxCoeff(),
+                     (xs[i+1].v - kxs[i+1].v).cwiseAbs().maxCoeff()));
+    dP = max(dP, (xs[i+1].P - kxs[i+1].P).cwiseAbs().maxCoeff());
+  }
+
+  cout << "True position: " << xts[N-1].q.transpose() << endl;
+  cout << "Estim position: " << xs[N-1].q.transpose() << endl;
+  cout << "True velocity: " << xts[N-1].v.transpose() << endl;
+  cout << "Estim velocity: " << xs[N-1].v.transpose() << endl;
+
+  cout << "KF took " << kus/(double)(N-1) << " us and SR-UKF " << uus/(double)(N-1)
+       << " us per step." << endl;
+  cout << "max |x_srukf - x_kf| = " << dx << ", max |P_srukf - P_kf| = " << dP << endl;
+
+  // the covariances differ by about 1e-12 with -ffast-math
+  if (!(dx < 1e-9 && dP < 1e-10)) {
+    cout << "[E] point3dsrukftest: SR-UKF and KF estimates differ" << endl;
+    return 1;
+  }
+  return 0;
+}
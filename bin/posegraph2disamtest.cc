@@ -0,0 +1,81 @@
+#include <iomanip>
+#include <iostream>
+#include "posegraph2disam.h"
+#include "utils.h"
+#include "se2.h"
+
+using namespace std;
+using namespace Eigen;
+using namespace gcop;
+
+// rms position error of poses and features between two pose graphs
+void Errors(double &ep, double &ef, const Posegraph2d &pga, const Posegraph2d &pgb)
+{
+  ep = 0;
+  for (int k = 0; k < pga.gs.size(); ++k)
+    ep += (pga.gs[k].block<2,1>(0,2) - pgb.gs[k].block<2,1>(0,2)).squaredNorm();
+  ep = sqrt(ep/pga.gs.size());
+  ef = sqrt((pga.p - pgb.p).squaredNorm()/(pga.p.size()/2));
+}
+
+void Run(int argc, char** argv)
+{
+  int N = 200;
+  double tf = 100;
+  int nf = 2*(N+1);
+
+  Posegraph2d pgt(N, nf);   ///< ground truth
+  Posegraph2d pg(N, nf);    ///< noisy pose graph
+
+  if (argc > 1 && atoi(argv[1]) == 2)
+    Posegraph2d::Synthesize2(pgt, pg, tf);
+  else
+    Posegraph2d::Synthesize(pgt, pg, tf);
+
+  Vector3d co(.01, .01, .01);   // odometry noise
+
+  // incremental: add one pose with its observations at a time
+  Posegraph2dIsam isam;
+  if (argc > 2)
+    isam.relinTol = atof(argv[2]);
+  struct timeval timer;
+  long tmax = 0, ttotal = 0;
+  for (int k = 0; k <= N; ++k) {
+    timer_start(timer);
+    isam.Add(pg, k, co);
+    isam.Update();
+    long te = timer_us(timer);
+    tmax = max(tmax, te);
+    ttotal += te;
+    cout << "Pose #" << k << " took: " << te << " us. eliminated=" << isam.neliminated
+         << " relinearized=" << isam.nrelinearized << endl;
+  }
+  cout << "Incremental: total " << ttotal << " us, max per pose " << tmax << " us." << endl;
+
+  // full batch reference on the same graph
+  Posegraph2dIsam batch;
+  for (int k = 0; k <= N; ++k)
+    batch.Add(pg, k, co);
+  timer_start(timer);
+  int iters = batch.Batch(20);
+  cout << "Batch: " << iters << " iterations took " << timer_us(timer) << " us." << endl;
+
+  Posegraph2d pgi(pg), pgb(pg);
+  isam.Get(pgi);
+  batch.Get(pgb);
+
+  double ep, ef;
+  Errors(ep, ef, pgi, pgb);
+  cout << "Incremental vs batch rms: poses=" << ep << " features=" << ef << endl;
+  Errors(ep, ef, pgb, pgt);
+  cout << "Batch vs true rms: poses=" << ep << " features=" << ef << endl;
+  Errors(ep, ef, pg, pgt);
+  cout << "Odometry vs true rms: poses=" << ep << " features=" << ef << endl;
+}
+
+
+int main(int argc, char** argv)
+{
+  Run(argc, argv);
+  return 0;
+}
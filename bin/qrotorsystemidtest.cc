@@ -23,6 +23,40 @@ void solver_process()
   //SO3
   SO3 &so3 = SO3::Instance();
 
+  if(params.Exists("dataFile") && params.Exists("window"))
+  {
+    //Stream through the log one window at a time
+    string dataFileName;
+    int window = 200;
+    bool binary = false;
+    params.GetString("dataFile",dataFileName);
+    params.GetInt("window",window);
+    params.GetBool("binary",binary);
+    QRotorSystemIDLog log;
+    if(!log.Open(dataFileName, binary))
+      return;
+    vector<QRotorSystemIDMeasurement> first;
+    if(log.Read(first, 1) == 0)
+      return;
+    log.Rewind();
+    x0.Clear();
+    x0.p = first[0].position;
+    so3.q2g(x0.R,first[0].rpy);
+    x0.u<<0,0,first[0].rpy(2);//0,0,yaw
+
+    Matrix7d stdev_gains;
+    Vector6d mean_offsets;
+    QRotorSystemID system_id;
+    params.GetDouble("offsets_period",system_id.offsets_timeperiod);
+    for(int k = 0; system_id.EstimateParameters(log, window, x0, &stdev_gains, &mean_offsets); k++)
+    {
+      cout<<"Window "<<k<<" gains: "<<system_id.qrotor_gains.transpose()<<endl;
+      cout<<"Stdev gains: "<<stdev_gains.diagonal().transpose()<<endl;
+      cout<<"Mean offsets: "<<mean_offsets.transpose()<<endl;
+    }
+    return;
+  }
+
   if(!params.Exists("dataFile"))
   {
     params.GetInt("N", N);
@@ -119,7 +153,15 @@ void solver_process()
   //Create QRotorSystemID:
   QRotorSystemID system_id;
   params.GetDouble("offsets_period",system_id.offsets_timeperiod);
-  system_id.EstimateParameters(systemid_measurements, x0, &stdev_gains, &mean_offsets, &stdev_offsets);
+  struct timeval timer;
+  timer_start(timer);
+  bool res = system_id.EstimateParameters(systemid_measurements, x0, &stdev_gains, &mean_offsets, &stdev_offsets);
+  long us = timer_us(timer);
+  cout<<"Estimated from "<<systemid_measurements.size()<<" measurements in "<<us*1e-6<<" s"<<(res ? "" : " (out of bounds)")<<endl;
+  cout<<"Gains: "<<system_id.qrotor_gains.transpose()<<endl;
+  cout<<"Stdev gains: "<<stdev_gains.diagonal().transpose()<<endl;
+  cout<<"Mean offsets: "<<mean_offsets.transpose()<<endl;
+  cout<<"Stdev offsets: "<<stdev_offsets.diagonal().transpose()<<endl;
 }
 
 
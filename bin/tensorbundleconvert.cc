@@ -0,0 +1,26 @@
+#include "tensor_bundle.h"
+#include <iostream>
+
+using namespace gcop;
+using namespace std;
+
+// Convert a folder of text matrices (e.g. data/tensorflow_model_vars_16_8_tanh)
+// into a binary tensor bundle that can be memory mapped
+int main(int argc, char** argv)
+{
+  if (argc != 3) {
+    cout << "Usage: " << argv[0] << " <text_matrix_folder> <bundle_file>" << endl;
+    return 1;
+  }
+
+  int count = TensorBundle::convertFolder(argv[1], argv[2]);
+  cout << "Converted " << count << " matrices into " << argv[2] << endl;
+
+  TensorBundle bundle(argv[2]);
+  vector<string> names = bundle.names();
+  for (size_t i = 0; i < names.size(); ++i) {
+    TensorBundle::MatrixMap tensor = bundle.get(names[i]);
+    cout << names[i] << ": " << tensor.rows() << "x" << tensor.cols() << endl;
+  }
+  return 0;
+}
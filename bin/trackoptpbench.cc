@@ -0,0 +1,100 @@
+#include "body2dtrack.h"
+#include "kinbodyprojtrack.h"
+#include "utils.h"
+#include <algorithm>
+#include <iostream>
+#include <stdlib.h>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace gcop;
+using namespace std;
+using namespace Eigen;
+
+// Benchmark of the feature tables of the track systems with many
+// landmarks: time to add the poses and observations, and time of the
+// (parallel) least-squares feature estimation Optp given the true poses
+// (including the feature index)
+int main(int argc, char** argv)
+{
+  // arguments: number of landmarks, number of poses, number of threads, Optp repetitions
+  int nf = (argc > 1 ? atoi(argv[1]) : 10000);
+  int N = (argc > 2 ? atoi(argv[2]) : 100);
+  int nt = (argc > 3 ? atoi(argv[3]) : 0);
+  int nr = (argc > 4 ? atoi(argv[4]) : 10);
+  double h = .1;
+#ifdef _OPENMP
+  if (nt > 0)
+    omp_set_num_threads(nt);
+  cout << "threads: " << omp_get_max_threads() << endl;
+#endif
+
+  struct timeval timer;
+  {
+    Body2d<> sys;
+    Body2dTrack pg(sys, nf, 0, N*h);
+    pg.MakeTrue();
+
+    Body2dState x;
+    timer_start(timer);
+    for (int k = 0; k < N; ++k) {
+      pg.Get(x, 5, (k + 1)*h);
+      pg.Add2(Vector3d::Zero(), x, h);
+    }
+    long ta = timer_us(timer);
+
+    vector<Body2dState> xs(pg.xs.size());
+    for (int k = 0; k < xs.size(); ++k)
+      pg.Get(xs[k], 5, k*h);
+    VectorXd p = pg.p;
+    timer_start(timer);
+    for (int r = 0; r < nr; ++r)
+      pg.Optp(p, xs);
+    long to = timer_us(timer);
+
+    double e = 0;
+    for (int l = 0; l < pg.pis.size(); ++l)
+      e = max(e, (p.segment<2>(2*l) - pg.ls[pg.pis[l]]).norm());
+
+    cout << "Body2dTrack: " << N << " poses, " << pg.pis.size() << " features, "
+         << pg.vis.Size() << " observations" << endl;
+    cout << "  Add2: " << ta*1e-3/N << " ms per pose, Optp: " << to*1e-3/nr
+         << " ms, max feature error: " << e << endl;
+  }
+
+  {
+    Kinbody3d<6> sys;
+    KinbodyProjTrack<6> pg(sys, nf, 5, 0, N*h);
+    pg.MakeTrue();
+
+    Matrix4d x;
+    timer_start(timer);
+    for (int k = 0; k < N; ++k) {
+      pg.Get(x, 5, (k + 1)*h);
+      pg.Add2(Matrix<double, 6, 1>::Zero(), x, h);
+    }
+    long ta = timer_us(timer);
+
+    vector<Matrix4d> xs(pg.xs.size());
+    for (int k = 0; k < xs.size(); ++k)
+      pg.Get(xs[k], 5, k*h);
+    VectorXd p = pg.p;
+    timer_start(timer);
+    for (int r = 0; r < nr; ++r)
+      pg.Optp(p, xs);
+    long to = timer_us(timer);
+
+    vector<double> es;
+    for (int l = 0; l < pg.pis.size(); ++l)
+      es.push_back((p.segment<3>(3*l) - pg.ls[pg.pis[l]]).norm());
+    sort(es.begin(), es.end());
+
+    cout << "KinbodyProjTrack: " << N << " poses, " << pg.pis.size() << " features, "
+         << pg.vis.Size() << " observations" << endl;
+    cout << "  Add2: " << ta*1e-3/N << " ms per pose, Optp: " << to*1e-3/nr
+         << " ms, median feature error: " << (es.empty() ? 0 : es[es.size()/2]) << endl;
+  }
+  return 0;
+}
@@ -7,6 +7,6 @@ using namespace std;
 Ba::Ba(Posegraph2d &pg) : 
   pg(pg), sys(), cost(sys, pg.ts.back(), pg), pddp(sys, cost, pg.ts, pg.gs, pg.us, pg.p)
 {
-  
+  pddp.pb = 2;    // eliminate the features as 2x2 blocks
 }
 
@@ -1,8 +1,27 @@
 #include "dynvisins.h"
 #include "utils.h"
+#include <thread>
 
 using namespace gcop;
 
+/**
+ * Residual weight W such that W'*W=inv(P), computed from the Cholesky
+ * factor P=L*L' as W=inv(L) without inverting P. A small diagonal is
+ * added if P is only semidefinite (e.g. if some noise std is zero).
+ * @param W weight matrix
+ * @param P covariance
+ */
+template <typename T>
+static void SqrtInfo(T &W, const T &P)
+{
+  LLT<T> llt(P);
+  if (llt.info() != Eigen::Success) {
+    cout << "[W] SqrtInfo: covariance is not positive definite, adding a noise floor" << endl;
+    llt.compute(P + 1e-12*T::Identity(P.rows(), P.cols()));
+  }
+  W = llt.matrixL().solve(T::Identity(P.rows(), P.cols()));
+}
+
 /**
  * Standard stereo camera residual error
  */
@@ -718,6 +737,103 @@ struct AccCubicError {
   const vector<Vector3d> as;  ///< sequence of angular measurements
 };
 
+/**
+ * Preintegrated IMU error of a segment: the gyro and accelerometer
+ * measurements are integrated once (see InsPreint), and the error compares
+ * the resulting relative rotation, velocity and position to the ones between
+ * the segment end states, regardless of the number of measurements.
+ *
+ * Each measurement is held constant until the next one, so the relative
+ * motion is exact only for piecewise constant readings (the error is of the
+ * order of the IMU period times the change of the readings, unlike the
+ * per-measurement residuals which compare the spline at each measurement
+ * time). The measurements are integrated with the biases vi.bg, vi.ba at
+ * construction; as in the other IMU residuals they are constants of the
+ * problem, and if they are changed afterwards the error uses the first-order
+ * bias correction of InsPreint::Delta rather than re-integrating.
+ */
+struct PreintError {
+
+  /**
+   * @param vi 
+   * @param dt delta-t for this segment
+   * @param ts local times for each measurement (should be in [0,dt])
+   * @param ws the sequence of gyro measurements in this segment
+   * @param as the sequence of accelerometer measurements in this segment
+   */
+  PreintError(const DynVisIns &vi, 
+              double dt,
+              const vector<double> &ts,
+              const vector<Vector3d> &ws,
+              const vector<Vector3d> &as)
+    : vi(vi), 
+      pre(vi.wStd*sqrt(dt/ts.size()), vi.aStd*sqrt(dt/ts.size()), vi.bg, vi.ba)   // densities at the average rate
+  {
+    assert(dt > 0);
+    assert(ts.size() == ws.size() && ts.size() == as.size());
+    assert(ts.size());
+
+    // each measurement is held from the previous one (or the start of the
+    // segment) and the last one until the end of the segment
+    double t = 0;
+    for (int i = 0; i < ts.size(); ++i) {
+      double tb = (i + 1 < ts.size() ? ts[i] : dt);
+      if (tb > t)
+        pre.Integrate(ws[i], as[i], tb - t);
+      t = tb;
+    }
+
+    SqrtInfo(W, pre.P);   // the weight matrix W such that W'*W=inv(P)
+  }
+  
+  /**
+   * Computes the preintegrated IMU error between two states xa and xb
+   * @param res residual
+   */
+  bool operator()(const double* ra_,
+                  const double* pa_,
+                  const double* va_,
+                  const double* rb_,
+                  const double* pb_,
+                  const double* vb_,
+                  double* res) const 
+  {
+    Vector3d ra(ra_);
+    Vector3d rb(rb_);
+    Matrix3d Ra, Rb;
+    if(vi.useCay)
+    {
+      SO3::Instance().cay(Ra, ra);
+      SO3::Instance().cay(Rb, rb);
+    }
+    else
+    {
+      SO3::Instance().exp(Ra, ra);
+      SO3::Instance().exp(Rb, rb);
+    }
+
+    InsPreint::Vector9d e;
+    pre.Error(e, Ra, Vector3d(pa_), Vector3d(va_), Rb, Vector3d(pb_), Vector3d(vb_),
+              vi.bg, vi.ba, vi.g0);
+    e = W*e;
+    memcpy(res, e.data(), 9*sizeof(double));
+    return true;
+  }
+  
+  static ceres::CostFunction* Create(const DynVisIns &vi, 
+                                     double dt,
+                                     const vector<double> &ts,
+                                     const vector<Vector3d> &ws,
+                                     const vector<Vector3d> &as) {
+    return new ceres::NumericDiffCostFunction<PreintError, ceres::CENTRAL, 9, 3, 3, 3, 3, 3, 3>(
+                                                                                        new PreintError(vi, dt, ts, ws, as));
+  }
+  
+  const DynVisIns &vi;
+  InsPreint pre;              ///< preintegrated measurements
+  InsPreint::Matrix9d W;      ///< square root of the inverse covariance of pre
+};
+
 /**
  * Accelerometer error, assuming segment is parametrized as a cubic spline.  
  * Provides analytic jacobians.
@@ -1029,8 +1145,7 @@ struct StatePrior {
              const Body3dState &x0)
     : vi(vi), x0(x0)
   {    
-    LLT<Matrix12d> llt(x0.P.inverse());   // assume P0>0
-    this->W = llt.matrixU();   // the weight matrix W such that W'*W=inv(P0)
+    SqrtInfo(W, x0.P);   // the weight matrix W such that W'*W=inv(P0)
   }
   
   /**
@@ -1118,8 +1233,7 @@ struct FeaturePrior {
              const DynVisIns::Point &p)
     : vi(vi), p(p)
   {    
-    LLT<Matrix3d> llt(p.P.inverse());   // assume P0>0
-    this->W = llt.matrixU();   // the weight matrix W such that W'*W=inv(P0)
+    SqrtInfo(W, p.P);   // the weight matrix W such that W'*W=inv(P0)
   }
   
   /**
@@ -1152,7 +1266,101 @@ struct FeaturePrior {
   Matrix3d W;         ///< residual weight matrix W is such that W'*W=inv(P0)
 };
 
-DynVisIns::DynVisIns() : t(-1), tc(-1), problem(NULL), l_opti_map(NULL), n_good_pnts(0) {
+/** 
+ * Prior residual from marginalization, linear in the state and point
+ * coordinates. Uses analytic Jacobian.
+ */
+struct MargError : public ceres::CostFunction {
+  /**
+   * @param marg marginal prior
+   */
+  MargError(const DynVisIns::MargPrior &marg)
+    : marg(marg)
+  {
+    set_num_residuals(marg.r.size());
+    vector<ceres::int32>* p_block_sizes = mutable_parameter_block_sizes();
+    p_block_sizes->resize(marg.blocks.size());
+    for(int i = 0; i < marg.blocks.size(); i++)
+      (*p_block_sizes)[i] = 3;
+  }
+
+  virtual ~MargError() {}
+
+  /**
+   * @param parameters the 3-dim blocks of the prior
+   * @param res residual e = r + J*(x - xs)
+   * @param jacs jacobian of residuals for each parameter block
+   */
+  virtual bool Evaluate(double const* const* parameters,
+                        double* res,
+                        double** jacs) const 
+  {
+    int n = marg.blocks.size();
+    VectorXd dx(3*n);
+    for (int i = 0; i < n; ++i)
+      dx.segment<3>(3*i) = Vector3d(parameters[i]) - marg.xs.segment<3>(3*i);
+
+    Map<VectorXd>(res, marg.r.size()) = marg.r + marg.J*dx;
+
+    if (jacs)
+      for (int i = 0; i < n; ++i)
+        if (jacs[i])
+          Map<Matrix<double, Dynamic, 3, RowMajor> >(jacs[i], marg.r.size(), 3) = marg.J.middleCols<3>(3*i);
+    return true;
+  }
+
+  DynVisIns::MargPrior marg;   ///< marginal prior
+};
+
+
+/**
+ * Marginal prior e = r + J*dx on the last n = H.rows() - m coordinates of
+ * the quadratic dx'*H*dx/2 + b'*dx after minimizing it over its first m
+ * coordinates, i.e. such that J'*J and J'*r are the Schur complements of H
+ * and b. Directions with relative curvature below eps are dropped.
+ */
+static void SchurPrior(MatrixXd &J, VectorXd &r,
+                       const MatrixXd &H, const VectorXd &b, int m,
+                       double eps = 1e-10)
+{
+  int n = H.rows() - m;
+  if (!n) {
+    J.resize(0, 0);
+    r.resize(0);
+    return;
+  }
+  MatrixXd Hs = H.bottomRightCorner(n, n);
+  VectorXd bs = b.tail(n);
+
+  if (m) {
+    // pseudo-inverse, since e.g. the depth of a point can be unobservable
+    SelfAdjointEigenSolver<MatrixXd> es(H.topLeftCorner(m, m));
+    const VectorXd &d = es.eigenvalues();
+    double dmin = eps*d.cwiseAbs().maxCoeff();
+    VectorXd di = (d.array() > dmin).select(d.cwiseInverse(), 0);
+    MatrixXd HkmV = H.bottomLeftCorner(n, m)*es.eigenvectors();
+    Hs -= HkmV*di.asDiagonal()*HkmV.transpose();
+    bs -= HkmV*di.asDiagonal()*(es.eigenvectors().transpose()*b.head(m));
+  }
+
+  // Hs = V*D*V' = J'*J for J = sqrt(D)*V', and bs = J'*r
+  SelfAdjointEigenSolver<MatrixXd> es(Hs);
+  const VectorXd &d = es.eigenvalues();
+  double dmin = eps*d.cwiseAbs().maxCoeff();
+  int k = 0;
+  for (int i = 0; i < n; ++i)
+    if (d[i] > dmin)
+      ++k;
+  J.resize(k, n);
+  r.resize(k);
+  for (int i = n - k, j = 0; i < n; ++i, ++j) {   // eigenvalues are increasing
+    J.row(j) = sqrt(d[i])*es.eigenvectors().col(i).transpose();
+    r[j] = es.eigenvectors().col(i).dot(bs)/sqrt(d[i]);
+  }
+}
+
+DynVisIns::DynVisIns() : obsBase(0), problem(NULL), v(0), l_opti_map(0), num_opti_cams(0),
+  n_good_pnts(0), priorId(0), t(-1), tc(-1), lastCamId(-1) {
   stereoStd = .05; 
   maxIterations = 50;
   maxCams = 0;
@@ -1161,7 +1369,9 @@ DynVisIns::DynVisIns() : t(-1), tc(-1), problem(NULL), l_opti_map(NULL), n_good_
   useHuberLoss = true;
   removeBehind = false;
   checkPtActiveFlag = false;
-  v = 0;
+  linearSolver = ceres::SPARSE_SCHUR;
+  numThreads = std::max(1u, std::thread::hardware_concurrency());
+  verbose = true;
   
   // initial state / prior info
   x0.Clear();  
@@ -1177,9 +1387,11 @@ DynVisIns::DynVisIns() : t(-1), tc(-1), problem(NULL), l_opti_map(NULL), n_good_
   useCam = true;
   useDyn = true;
   usePrior = true;
+  useMarg = false;
   useFeatPrior = false;
   useCay = false;
   useAnalyticJacs = false;
+  usePreint = false;
 
   optBias = false;
 
@@ -1203,6 +1415,12 @@ DynVisIns::DynVisIns() : t(-1), tc(-1), problem(NULL), l_opti_map(NULL), n_good_
 
 DynVisIns::~DynVisIns()
 {
+  if (problem)
+    delete problem;
+  if (v)
+    delete[] v;
+  if (l_opti_map)
+    delete l_opti_map;
 }
 
 
@@ -1278,9 +1496,13 @@ bool DynVisIns::ProcessCam(double t, const vector<Vector2d> &zcs, const vector<i
   if (camId > 0) {
     cams[camId - 1].dt = t - tc;
     cam.x = cams[camId - 1].x;
+    memcpy(cam.c, cams[camId - 1].c, 12*sizeof(double));
   } else {
     cam.dt = 0;
     cam.x = x0;
+    Vector12d c;
+    FromState(c, x0);
+    memcpy(cam.c, c.data(), 12*sizeof(double));
   }
    // above one could use the propagated state x instead of x0 to initialize using IMU dead-reconing -- only a good idea if initial pose is correct, otherwise accelerometer-based odometry will be off
   
@@ -1293,11 +1515,9 @@ bool DynVisIns::ProcessCam(double t, const vector<Vector2d> &zcs, const vector<i
     const Vector2d &z = zcs[i];
     
     // if this is a new point, then add it to point map
-    if (pnts.find(pntId) == pnts.end()) {
-      
-      Point pnt;
-      pnt.usePrior = false;
-      pnt.active = false;
+    bool isNew = !pnts.count(pntId);
+    Point &pnt = AddObservation(camId, cam, pntId, Vector3d(z[0], z[1], 0), false);
+    if (isNew) {
       //      pnt.l = Vector3d(1,0,0);
       // generate a spherical measurement
       Vector3d lu((zcs[i][0] - K(0,2))/K(0,0),
@@ -1306,11 +1526,7 @@ bool DynVisIns::ProcessCam(double t, const vector<Vector2d> &zcs, const vector<i
       lu = lu/lu.norm(); // unit normal in camera frame
       
       pnt.l = cam.x.p + cam.x.R*Ric*lu; // unit normal in spatial frame
-      
-      pnts[pntId] = pnt;
     } 
-
-    pnts[pntId].zs[camId] = z;
     
     /* covariance of points
        static Vector3d e3(0, 0, 1);
@@ -1327,8 +1543,6 @@ bool DynVisIns::ProcessCam(double t, const vector<Vector2d> &zcs, const vector<i
        
        P.block(15 + i*3, 15 + i*3, 3, 3) = Rl*Pl*Rl.transpose();
     */
-  
-    cam.pntIds.push_back(pntId);
   }
 
   // add camera to map
@@ -1390,9 +1604,13 @@ bool DynVisIns::ProcessStereoCam(double t, const vector<Vector3d> &zcs, const ve
   if (camId > 0) {
     cams[camId - 1].dt = t - tc;
     cam.x = cams[camId - 1].x;
+    memcpy(cam.c, cams[camId - 1].c, 12*sizeof(double));
   } else {
     cam.dt = 0;
     cam.x = x0;
+    Vector12d c;
+    FromState(c, x0);
+    memcpy(cam.c, c.data(), 12*sizeof(double));
   }
    // above one could use the propagated state x instead of x0 to initialize using IMU dead-reconing -- only a good idea if initial pose is correct, otherwise accelerometer-based odometry will be off
   
@@ -1405,19 +1623,10 @@ bool DynVisIns::ProcessStereoCam(double t, const vector<Vector3d> &zcs, const ve
     const Vector3d &z = zcs[i];
     
     // if this is a new point, then add it to point map
-    if (pnts.find(pntId) == pnts.end()) {
-      
-      Point pnt;
-      pnt.usePrior = false;
-      pnt.active = false;
-      
+    bool isNew = !pnts.count(pntId);
+    Point &pnt = AddObservation(camId, cam, pntId, z, true);
+    if (isNew)
       pnt.l = cam.x.p + cam.x.R*Ric*z; // in spatial frame
-      
-      pnts[pntId] = pnt;
-    } 
-
-    pnts[pntId].z3ds[camId] = z;
-    cam.pntIds.push_back(pntId);
   }
 
   // add camera to map
@@ -1426,27 +1635,65 @@ bool DynVisIns::ProcessStereoCam(double t, const vector<Vector3d> &zcs, const ve
   return true;
 }
 
+DynVisIns::Point& DynVisIns::AddObservation(int camId, Camera &cam, int pntId, const Vector3d &z, bool stereo)
+{
+  int i = obsBase + obs.size();
+  if (!cam.nobs)
+    cam.obs0 = i;
+  assert(cam.obs0 + cam.nobs == i);
+  ++cam.nobs;
+
+  cam.pntIds.push_back(pntId);
+
+  Observation o;
+  o.camId = camId;
+  o.pntId = pntId;
+  o.stereo = stereo;
+  o.z = z;
+  o.next = -1;
+  o.rid = 0;
+  obs.push_back(o);
+
+  // append to the observations of the point
+  Point &pnt = pnts[pntId];
+  if (pnt.obs1 >= 0)
+    Obs(pnt.obs1).next = i;
+  else
+    pnt.obs0 = i;
+  pnt.obs1 = i;
+  if (stereo) {
+    ++pnt.nz3d;
+    pnt.z3ds[camId] = z;
+  } else {
+    ++pnt.nz;
+    pnt.zs[camId] = z.head<2>();
+  }
+  return pnt;
+}
+
 void DynVisIns::RemoveBadPoints()
 {
-  map<int, Camera>::iterator camIter;
+  SlotMap<Camera>::iterator camIter;
   for(camIter = cams.begin(); camIter != cams.end(); camIter++)
   {
     Camera &cam = camIter->second;
     Matrix3d R = cam.x.R*Ric;
     // go through all points seen by the camera
-    vector<int>::iterator iter;
-    for (iter = cam.pntIds.begin(); iter != cam.pntIds.end(); ++iter) {
-      int pntId = *iter;
-      Point &pnt = pnts[pntId];
+    for (int i = cam.obs0; i < cam.obs0 + cam.nobs; ++i) {
+      int pntId = Obs(i).pntId;
+      SlotMap<Point>::iterator pntIter = pnts.find(pntId);
+      if (pntId < 0 || pntIter == pnts.end())
+        continue;
+      Point &pnt = pntIter->second;
       // ignore inactive points
-      if((!pnt.active && checkPtActiveFlag) || pnt.zs.size() <=1 || pnt.z3ds.size() <=1)
+      if((!pnt.active && checkPtActiveFlag) || pnt.nz <=1 || pnt.nz3d <=1)
         continue;
       if(removeBehind)
       {
         // remove point if behind camera
         if((R.transpose()*(pnt.l - cam.x.p))(2) < 0)
         {
-          pnts.erase(pntId); 
+          RemovePoint(pntId); 
           cout << "[I] DynVisIns::RemoveCam: pnt id#" << pntId 
             << " is observed behind a camera and removed." << endl;
         }
@@ -1455,56 +1702,130 @@ void DynVisIns::RemoveBadPoints()
   }
 }
 
+void DynVisIns::RemoveResidual(ceres::ResidualBlockId &rid)
+{
+  if (rid && problem)
+    problem->RemoveResidualBlock(rid);
+  rid = 0;
+}
+
 // pnt_zs_removed keeps a set of all the points which had measurements removed yet are still
 //   present in the optimization.
 bool DynVisIns::RemoveCamera(int id, std::set<int>* pnt_zs_removed) 
 {
-  map<int, Camera>::iterator camIter = cams.find(id);
+  SlotMap<Camera>::iterator camIter = cams.find(id);
   if (camIter == cams.end()) {
     cout << "[W] DynVisIns::RemoveCamera: cannot find camera with id#" << id << endl;
     return false;
   }
   Camera &cam = camIter->second;
 
+  // remove the prior (it is added again by Compute) and the segments to and from the camera
+  RemoveResidual(priorId);
+  for (int i = 0; i < cam.rids.size(); ++i)
+    RemoveResidual(cam.rids[i]);
+  cam.rids.clear();
+  SlotMap<Camera>::iterator prevIter = cams.find(id - 1);
+  if (prevIter != cams.end()) {
+    Camera &prev = prevIter->second;
+    for (int i = 0; i < prev.rids.size(); ++i)
+      RemoveResidual(prev.rids[i]);
+    prev.rids.clear();
+  }
+
   // go through all points seen by the camera
-  vector<int>::iterator iter;
-  for (iter = cam.pntIds.begin(); iter != cam.pntIds.end(); ++iter) {
-    int pntId = *iter;
-    Point &pnt = pnts[pntId];
-    pnt.zs.erase(id);  // erase the feature measurement of this point by cam
-    pnt.z3ds.erase(id);  // erase the feature measurement of this point by cam
+  for (int i = cam.obs0; i < cam.obs0 + cam.nobs; ++i) {
+    Observation &o = Obs(i);
+    int pntId = o.pntId;
+    o.camId = -1;
+    if (pntId < 0)   // already removed
+      continue;
+    RemoveResidual(o.rid);
+    Point &pnt = pnts.find(pntId)->second;
+
+    // erase the feature measurement of this point by cam (usually the
+    // first one, since cameras are removed in order)
+    int *prev = &pnt.obs0;
+    int last = -1;
+    while (*prev != i) {
+      last = *prev;
+      prev = &Obs(last).next;
+    }
+    *prev = o.next;
+    if (pnt.obs1 == i)
+      pnt.obs1 = last;
+    if (o.stereo) {
+      --pnt.nz3d;
+      pnt.z3ds.erase(id);
+    } else {
+      --pnt.nz;
+      pnt.zs.erase(id);
+    }
+
     if(pnt_zs_removed)
       pnt_zs_removed->insert(pntId);
-    if (!pnt.zs.size() && !pnt.z3ds.size()) { // if this point now has no measurements then delete it
-      pnts.erase(pntId); 
+    if (!pnt.nz && !pnt.nz3d) { // if this point now has no measurements then delete it
+      RemovePoint(pntId); 
       if(pnt_zs_removed)
         pnt_zs_removed->erase(pntId);
       cout << "[I] DynVisIns::RemoveCam: pnt id#" << pntId << " is invisible and removed." << endl;
+    } else if (problem) {
+      UpdatePoint(pntId, pnt);   // remove it from the problem if it is no longer good
     }
   }
+
   // remove the camera
-  cams.erase(id);
+  if (problem)
+    for (int k = 0; k < 12; k += 3)
+      if (problem->HasParameterBlock(cam.c + k))
+        problem->RemoveParameterBlock(cam.c + k);
+  cams.erase(camIter);
+
+  // drop the removed observations at the front of the table once they are
+  // the majority (so that the table does not grow with the number of cameras)
+  int k = 0;
+  while (k < obs.size() && obs[k].camId < 0)
+    ++k;
+  if (2*k > obs.size()) {
+    obs.erase(obs.begin(), obs.begin() + k);
+    obsBase += k;
+  }
+  return true;
 }
 
 bool DynVisIns::RemovePoint(int id) 
 {
-  // TODO
-  // currently points are being removed dynamically only within ProcessCam if a camera is being removed
+  SlotMap<Point>::iterator pntIter = pnts.find(id);
+  if (pntIter == pnts.end()) {
+    cout << "[W] DynVisIns::RemovePoint: cannot find point with id#" << id << endl;
+    return false;
+  }
+  Point &pnt = pntIter->second;
+
+  // mark its observations as removed (their residuals are removed below)
+  for (int i = pnt.obs0; i >= 0; i = Obs(i).next) {
+    Obs(i).pntId = -1;
+    Obs(i).rid = 0;
+  }
+
+  if (problem && problem->HasParameterBlock(pnt.l.data())) {
+    if (marg.pntIds.count(id))
+      RemoveResidual(priorId);          // it is added again by Compute
+    problem->RemoveParameterBlock(pnt.l.data());   // also removes its residuals
+    --n_good_pnts;
+  }
+  pnts.erase(pntIter);
+  return true;
 }
 
 bool DynVisIns::ResetPrior(int id, std::set<int>* pnt_ids)
 {
-  if (!v) {
-    cout << "[W] DynVisIns::ResetPrior: optimization vector not set!" << endl;
-    return false;
-  }
-
-  if (!ceresActive) {
+  if (!problem || !ceresActive) {
     cout << "[W] DynVisIns::ResetPrior: ceres is not active!" << endl;
     return false;
   }
   
-  map<int, Camera>::iterator camIter = cams.find(id);
+  SlotMap<Camera>::iterator camIter = cams.find(id);
   if (camIter == cams.end()) {
     cout << "[W] DynVisIns::ResetPrior: camera id#" << id << " not found." << endl;
     return false;
@@ -1520,53 +1841,39 @@ bool DynVisIns::ResetPrior(int id, std::set<int>* pnt_ids)
   
   vector<pair<const double*, const double*> > covariance_blocks;
 
-  int ind = (id - camId0)*12;    // index into the CERES opt vector
-
-  //  double *r = this->v + ind;
-  //  double *p = this->v + ind + 3;
-  //  double *dr = this->v + ind + 6;
-  //  double *dp = this->v + ind + 9;
-  
   // go through pairs of (r,p,dr,dp)
   assert(useDyn || useImu);
   for (int i = 0; i < 4; ++i) {
     for (int j = 0; j < 4; ++j) {
-      double *v1 = this->v + ind + 3*i;
-      double *v2 = this->v + ind + 3*j;
+      double *v1 = cam.c + 3*i;
+      double *v2 = cam.c + 3*j;
       covariance_blocks.push_back(make_pair(v1, v2));
     }
   }
 
-  std::vector<int> v_pt_idxs;
+  std::vector<int> pt_ids;
   if(pnt_ids)
   {
     set<int>::iterator pntIter;
     for(pntIter = pnt_ids->begin(); pntIter != pnt_ids->end(); pntIter++)
     {
-      // TODO: could have an inverse map available to avoid this search...
-      int v_pt_idx;
-      for(v_pt_idx = 0; v_pt_idx < l_opti_map->size(); ++v_pt_idx)
-      {
-        if(l_opti_map->at(v_pt_idx) == *pntIter)
-          break;
-      }
-      if(v_pt_idx == l_opti_map->size())
+      SlotMap<Point>::iterator iter = pnts.find(*pntIter);
+      if(iter == pnts.end() || !problem->HasParameterBlock(iter->second.l.data()))
       {
-        if(pnts.find(*pntIter) != pnts.end() && pnts[*pntIter].active)
+        if(iter != pnts.end() && iter->second.active)
         {
           cout << "[W] DynVisIns::ResetPrior: failed to find ptId " << *pntIter 
-            << " in previous optimization vector (pnt.active = "<< pnts[*pntIter].active 
+            << " in previous optimization (pnt.active = "<< iter->second.active 
             << ")...skipping." << endl;
         }
         continue;
       }
-      double *vpt = this->v + 12*num_opti_cams + v_pt_idx*3;
+      const double *vpt = iter->second.l.data();
       covariance_blocks.push_back(make_pair(vpt,vpt));
-      v_pt_idxs.push_back(v_pt_idx);
+      pt_ids.push_back(*pntIter);
     }
   }  
   
-  assert(problem);
   //CHECK(covariance.Compute(covariance_blocks, problem));
   if(!covariance.Compute(covariance_blocks, problem))
   {
@@ -1577,28 +1884,359 @@ bool DynVisIns::ResetPrior(int id, std::set<int>* pnt_ids)
   Matrix<double, 3, 3, RowMajor> M;
   for (int i = 0; i < 4; ++i) {
     for (int j = 0; j < 4; ++j) {
-      double *v1 = this->v + ind + 3*i;
-      double *v2 = this->v + ind + 3*j;
+      double *v1 = cam.c + 3*i;
+      double *v2 = cam.c + 3*j;
       covariance.GetCovarianceBlock(v1, v2, M.data());
       x0.P.block<3,3>(3*i, 3*j) = M;
     }
   }  
   
-  if(pnt_ids)
+  for (int i = 0; i < pt_ids.size(); ++i) {
+    Point &pnt = pnts[pt_ids[i]];
+    covariance.GetCovarianceBlock(pnt.l.data(), pnt.l.data(), M.data());
+    //cout << "[I] DynVisIns::ResetPrior: set pt " << pt_ids[i]
+    //  << " prior to " << std::endl << M << std::endl;
+    pnt.P = M;
+    pnt.usePrior = true;
+
+    // replace the feature prior in the problem
+    if (useFeatPrior) {
+      RemoveResidual(pnt.priorId);
+      pnt.priorId = problem->AddResidualBlock(FeaturePrior::Create(*this, pnt),
+                                              NULL,
+                                              pnt.l.data());
+    }
+  }
+  return true;
+}
+
+bool DynVisIns::Marginalize(int id)
+{
+  if (!problem || !ceresActive) {
+    cout << "[W] DynVisIns::Marginalize: no previous optimization!" << endl;
+    return false;
+  }
+
+  // blocks to marginalize: cameras before id and points observed only by
+  // them, and the keys (see MargPrior) of all blocks that may remain
+  vector<double*> pbs;
+  set<double*> mset;
+  map<const double*, pair<int, int> > keys;
+  set<int> pids = marg.pntIds;
+  SlotMap<Camera>::iterator camIter;
+  for (camIter = cams.begin(); camIter != cams.end(); ++camIter) {
+    Camera &cam = camIter->second;
+    for (int k = 0; k < 12; k += 3) {
+      if (camIter->first < id)
+        pbs.push_back(cam.c + k);
+      keys[cam.c + k] = make_pair(camIter->first, k);
+    }
+    if (camIter->first < id)
+      for (int i = cam.obs0; i < cam.obs0 + cam.nobs; ++i)
+        if (Obs(i).pntId >= 0)
+          pids.insert(Obs(i).pntId);
+  }
+
+  set<int>::iterator idIter;
+  for (idIter = pids.begin(); idIter != pids.end(); ++idIter) {
+    SlotMap<Point>::iterator pntIter = pnts.find(*idIter);
+    if (pntIter == pnts.end())
+      continue;
+    Point &pnt = pntIter->second;
+    bool seen = (pnt.obs1 >= 0 && Obs(pnt.obs1).camId >= id);   // by a remaining camera
+    if (!seen)
+      pbs.push_back(pnt.l.data());
+    keys[pnt.l.data()] = make_pair(-1, *idIter);
+  }
+
+  // keep only blocks that were optimized
+  int nm = 0;
+  for (int i = 0; i < pbs.size(); ++i)
+    if (problem->HasParameterBlock(pbs[i]))
+      pbs[nm++] = pbs[i];
+  pbs.resize(nm);
+  mset.insert(pbs.begin(), pbs.end());
+
+  // all residuals involving these blocks and the remaining blocks they involve
+  vector<ceres::ResidualBlockId> rbs, rids;
+  set<ceres::ResidualBlockId> rset;
+  vector<double*> bs;
+  for (int i = 0; i < nm; ++i) {
+    problem->GetResidualBlocksForParameterBlock(pbs[i], &rids);
+    for (int j = 0; j < rids.size(); ++j) {
+      if (!rset.insert(rids[j]).second)
+        continue;
+      rbs.push_back(rids[j]);
+      problem->GetParameterBlocksForResidualBlock(rids[j], &bs);
+      for (int k = 0; k < bs.size(); ++k)
+        if (mset.insert(bs[k]).second)
+          pbs.push_back(bs[k]);
+    }
+  }
+
+  MargPrior mp;
+  mp.xs.resize(3*(pbs.size() - nm));
+  for (int i = nm; i < pbs.size(); ++i) {
+    assert(keys.find(pbs[i]) != keys.end());
+    const pair<int, int> &key = keys[pbs[i]];
+    mp.blocks.push_back(key);
+    if (key.first < 0)
+      mp.pntIds.insert(key.second);
+    mp.xs.segment<3>(3*(i - nm)) = Vector3d(pbs[i]);
+  }
+
+  // linearize (including the loss functions) with the marginalized blocks first
+  ceres::Problem::EvaluateOptions options;
+  options.parameter_blocks = pbs;
+  options.residual_blocks = rbs;
+  vector<double> res;
+  ceres::CRSMatrix jac;
+  if (!problem->Evaluate(options, NULL, &res, NULL, &jac)) {
+    cout << "[W] DynVisIns::Marginalize: failed to evaluate residuals!" << endl;
+    return false;
+  }
+
+  // H = J'*J and b = J'*r using the sparse rows of J
+  int n = 3*pbs.size();
+  MatrixXd H = MatrixXd::Zero(n, n);
+  VectorXd b = VectorXd::Zero(n);
+  for (int i = 0; i < jac.num_rows; ++i)
+    for (int j = jac.rows[i]; j < jac.rows[i + 1]; ++j) {
+      int c = jac.cols[j];
+      b[c] += jac.values[j]*res[i];
+      for (int k = jac.rows[i]; k <= j; ++k)
+        H(max(c, jac.cols[k]), min(c, jac.cols[k])) += jac.values[j]*jac.values[k];
+    }
+  H = H.selfadjointView<Eigen::Lower>();
+
+  SchurPrior(mp.J, mp.r, H, b, 3*nm);
+
+  cout << "[I] DynVisIns::Marginalize: marginalized " << nm << " blocks from " << rbs.size() 
+       << " residuals into a prior on " << mp.blocks.size() << " blocks of rank " << mp.r.size() << endl;
+
+  marg = mp;
+  return true;
+}
+
+
+void DynVisIns::AddSegment(int id, Camera &cam)
+{
+  SlotMap<Camera>::iterator nextIter = cams.find(id + 1);
+  if (nextIter == cams.end())
+    return;
+
+  double *xa = cam.c;
+  double *xb = nextIter->second.c;
+
+  if (useImu && usePreint) {
+    assert(cam.ts.size());
+    assert(cam.dt > 0);
+
+    ceres::CostFunction* preintCost = PreintError::Create(*this, cam.dt, cam.ts, cam.ws, cam.as);
+    cam.rids.push_back(problem->AddResidualBlock(preintCost,
+                                                 NULL /* squared loss */,
+                                                 xa, xa + 3, xa + 9,
+                                                 xb, xb + 3, xb + 9));
+  } else if (useImu) {
+    assert(cam.ts.size());
+    assert(cam.dt > 0);
+      
+    ceres::CostFunction* gyroCost;
+    if(useAnalyticJacs)
+    {
+      gyroCost = new AnalyticGyroCubicError(*this, cam.dt, cam.ts, cam.ws);
+    }
+    else
+    {
+      gyroCost = GyroCubicError::Create(*this, cam.dt, cam.ts, cam.ws);
+    }
+    
+    cam.rids.push_back(problem->AddResidualBlock(gyroCost,
+                                                 NULL /* squared loss */,
+                                                 xa, xa + 6, xb, xb + 6));
+    
+    ceres::CostFunction* accCost;
+    if(useAnalyticJacs)
+    {
+      accCost = new AnalyticAccCubicError(*this, cam.dt, cam.ts, cam.as);
+    }
+    else
+    {
+      accCost = AccCubicError::Create(*this, cam.dt, cam.ts, cam.as);
+    }
+    
+    cam.rids.push_back(problem->AddResidualBlock(accCost,
+                                                 NULL /* squared loss */,
+                                                 xa, xa + 3, xa + 6, xa + 9,
+                                                 xb, xb + 3, xb + 6, xb + 9));
+    // could also add some box constraints on the state?
+  }
+  
+  if (useDyn) {
+    assert(cam.dt > 0);
+
+    ceres::CostFunction* rotCost = CvCubicRotError::Create(*this, cam.dt);    
+    cam.rids.push_back(problem->AddResidualBlock(rotCost,
+                                                 NULL /* squared loss */,
+                                                 xa, xa + 6, xb, xb + 6));
+    
+    ceres::CostFunction* posCost = CvCubicPosError::Create(*this, cam.dt);    
+    cam.rids.push_back(problem->AddResidualBlock(posCost,
+                                                 NULL /* squared loss */,
+                                                 xa + 3, xa + 9, xb + 3, xb + 9));
+  }
+}
+
+
+void DynVisIns::UpdatePoint(int id, Point &pnt)
+{
+  double *l = pnt.l.data();
+
+  if (!IsGood(id, pnt)) {
+    if (problem->HasParameterBlock(l)) {
+      if (marg.pntIds.count(id))
+        RemoveResidual(priorId);     // it is added again by Compute
+      problem->RemoveParameterBlock(l);    // also removes its residuals
+      for (int i = pnt.obs0; i >= 0; i = Obs(i).next)
+        Obs(i).rid = 0;
+      pnt.priorId = 0;
+      --n_good_pnts;
+    }
+    return;
+  }
+
+  if (!problem->HasParameterBlock(l)) {
+    problem->AddParameterBlock(l, 3);
+    if (pnt.nz) {
+      // for now restrict point coordinates to [-200,200] meters, assuming we're in a small room
+      for (int i = 0; i < 3; ++i) {
+        problem->SetParameterLowerBound(l, i, -200);
+        problem->SetParameterUpperBound(l, i, 200);
+      }
+    }
+    ++n_good_pnts;
+  }
+
+  if(useFeatPrior && pnt.usePrior && !pnt.priorId)
   {
-    Matrix<double, 3, 3, RowMajor> M;
-    for (int i = 0; i < v_pt_idxs.size(); ++i) {
-      double *vpt = this->v + 12*num_opti_cams + v_pt_idxs[i]*3;
-      covariance.GetCovarianceBlock(vpt, vpt, M.data());
-      //cout << "[I] DynVisIns::ResetPrior: set pt " << l_opti_map->at(v_pt_idxs[i]) 
-      //  << " prior to " << std::endl << M << std::endl;
-      pnts[l_opti_map->at(v_pt_idxs[i])].P = M;
-      pnts[l_opti_map->at(v_pt_idxs[i])].usePrior = true;
-    }  
+    ceres::CostFunction* cost = FeaturePrior::Create(*this, pnt);
+    pnt.priorId = problem->AddResidualBlock(cost,
+                                            NULL,
+                                            l);
+  }
+
+  // add the observations that are not in the problem yet
+  for (int i = pnt.obs0; i >= 0; i = Obs(i).next) {
+    Observation &o = Obs(i);
+    SlotMap<Camera>::iterator camIter = cams.find(o.camId);
+    if (o.rid || camIter == cams.end())
+      continue;
+
+    ceres::CostFunction* cost_function;
+    if (o.stereo)
+    {
+      cost_function = StereoError::Create(*this, o.z);
+    }
+    else if(useAnalyticJacs)
+    {
+      cost_function = new AnalyticPerspError(*this, o.z.head<2>());
+    }
+    else
+    {
+      cost_function =
+        //        sphMeas ?
+        //        SphError::Create(*this, lus[i]) :
+        PerspError::Create(*this, o.z.head<2>());
+    }
+    
+    double *x = camIter->second.c;
+    
+    if(useHuberLoss)
+    {  
+      o.rid = problem->AddResidualBlock(cost_function,
+                                        new ceres::HuberLoss(2.0),
+                                        x, x + 3, l);
+    }
+    else
+    {
+      o.rid = problem->AddResidualBlock(cost_function,
+                                        NULL,
+                                        x, x + 3, l);
+    }
   }
 }
 
 
+void DynVisIns::AddPrior()
+{
+  RemoveResidual(priorId);
+
+  if (!useMarg || !marg.blocks.size()) {
+    if (usePrior && cams.size()) {
+      int id = camId0;
+      while (!cams.count(id))
+        ++id;
+      double *x = cams.find(id)->second.c;   // first camera in the window
+      ceres::CostFunction* cost = StatePrior::Create(*this, x0);
+      priorId = problem->AddResidualBlock(cost,
+                                          NULL,
+                                          x, x + 3, x + 6, x + 9);
+    }
+    return;
+  }
+
+  // blocks of the prior in the problem (the ones removed since are
+  // marginalized out of the prior)
+  vector<double*> bs;
+  vector<int> drops, inds;   // blocks of the prior to drop and to keep
+  for (int i = 0; i < marg.blocks.size(); ++i) {
+    const pair<int, int> &block = marg.blocks[i];
+    double *b = 0;
+    if (block.first >= 0) {
+      SlotMap<Camera>::iterator camIter = cams.find(block.first);
+      if (camIter != cams.end())
+        b = camIter->second.c + block.second;
+    } else {
+      SlotMap<Point>::iterator pntIter = pnts.find(block.second);
+      if (pntIter != pnts.end())
+        b = pntIter->second.l.data();
+    }
+    if (!b || !problem->HasParameterBlock(b)) {
+      drops.push_back(i);
+      continue;
+    }
+    bs.push_back(b);
+    inds.push_back(i);
+  }
+
+  int nd = drops.size();
+  if (nd) {
+    // reorder the blocks and use the quadratic J'*J, J'*r of the old prior
+    inds.insert(inds.begin(), drops.begin(), drops.end());
+    PermutationMatrix<Dynamic> Pm(3*inds.size());
+    MargPrior mp;
+    for (int i = 0; i < inds.size(); ++i) {
+      for (int k = 0; k < 3; ++k)
+        Pm.indices()[3*inds[i] + k] = 3*i + k;
+      if (i >= nd)
+        mp.blocks.push_back(marg.blocks[inds[i]]);
+    }
+    MatrixXd J = marg.J*Pm.transpose();
+    VectorXd xs = Pm*marg.xs;
+    SchurPrior(mp.J, mp.r, J.transpose()*J, J.transpose()*marg.r, 3*nd);
+    mp.xs = xs.tail(mp.J.cols());
+    for (int i = 0; i < mp.blocks.size(); ++i)
+      if (mp.blocks[i].first < 0)
+        mp.pntIds.insert(mp.blocks[i].second);
+    marg = mp;
+    cout << "[I] DynVisIns::AddPrior: dropped " << nd << " removed blocks from the marginal prior" << endl;
+  }
+
+  if (marg.r.size())
+    priorId = problem->AddResidualBlock(new MargError(marg), NULL, bs);
+}
+
+
 bool DynVisIns::Compute() {
 
   if(useAnalyticJacs && !useCay)
@@ -1607,37 +2245,64 @@ bool DynVisIns::Compute() {
     assert(useCay);
   }
 
+  if (!problem) {
+    ceres::Problem::Options problemOptions;
+    problemOptions.enable_fast_removal = true;  // residuals and parameters are removed incrementally
+    problem = new ceres::Problem(problemOptions);
+  }
+
+  // points whose residuals may need to be added or removed
+  set<int> pntIds = marg.pntIds;
+
   // check if cams within current window
   // reset feature and state priors if removing cams
-  if  (maxCams > 0 && v && cams.size() > maxCams) {
-    //assert(cams.size() == maxCams + 1);
-    std::set<int> pnt_zs_removed;
+  if  (maxCams > 0 && ceresActive && cams.size() > maxCams) {
     int newCamId0 = cams.size() - maxCams + camId0;
     cout << "[I] DynVisIns::Compute: maxCams=" << maxCams << " window reached. Removing " 
       << cams.size() - maxCams << " cams. New cam id0=" << newCamId0 << endl;
-    if(usePrior && cams.size() - maxCams >= maxCams)
+    if((usePrior || useMarg) && cams.size() - maxCams >= maxCams)
     {
       std::cout << "[E] DynVisIns::Compute: cannot remove all cams from previous optimization and still set a prior."
         << std::endl;
        return false;
     }
-    for(int i = camId0; i < newCamId0; ++i)
-    {
-      if(useFeatPrior)
-      {
-        RemoveCamera(i, &pnt_zs_removed);
-      }
-      else
-      {
-        RemoveCamera(i);
+
+    bool margd = false;
+    if (useMarg) {
+      // fold the removed cams and the points seen only by them into the marginal prior
+      margd = Marginalize(newCamId0);
+      if (margd) {
+        pntIds.insert(marg.pntIds.begin(), marg.pntIds.end());
+      } else if (!usePrior) {
+        cout << "[E] DynVisIns::Compute: failed to marginalize cams before id#" << newCamId0 << endl;
+        return false;
+      } else {
+        cout << "[W] DynVisIns::Compute: failed to marginalize cams before id#" << newCamId0
+             << ", resetting the state prior instead" << endl;
+        marg = MargPrior();
       }
     }
 
-    // if prior is used then reset it to cam at the end of the new window
-    if (usePrior)
-    {
-      if(useFeatPrior)
-      {
+    if (!margd && usePrior) {
+      // reset the prior to cam at the end of the new window (before the
+      // removed cams are taken out of the problem)
+      if (useFeatPrior) {
+        // points which will have measurements removed yet remain in the optimization
+        std::set<int> pnt_zs_removed;
+        for (int id = camId0; id < newCamId0; ++id) {
+          SlotMap<Camera>::iterator camIter = cams.find(id);
+          if (camIter == cams.end())
+            continue;
+          const Camera &cam = camIter->second;
+          for (int i = cam.obs0; i < cam.obs0 + cam.nobs; ++i) {
+            SlotMap<Point>::iterator pntIter = pnts.find(Obs(i).pntId);
+            if (Obs(i).pntId < 0 || pntIter == pnts.end())
+              continue;
+            const Point &pnt = pntIter->second;
+            if (Obs(pnt.obs1).camId >= newCamId0)
+              pnt_zs_removed.insert(Obs(i).pntId);
+          }
+        }
         ResetPrior(newCamId0, &pnt_zs_removed);
       }
       else
@@ -1645,24 +2310,56 @@ bool DynVisIns::Compute() {
         ResetPrior(newCamId0);
       }
     }
+
+    for(int i = camId0; i < newCamId0; ++i)
+      RemoveCamera(i);
+
     camId0 = newCamId0;
   }
 
   RemoveBadPoints();
-      
-  // Find all points to be used in optimization
-  n_good_pnts = 0;
-  vector<pair<int,Point&>> gpoints;
-  map<int, Point>::iterator gpntIter;
-  for (gpntIter = pnts.begin(); gpntIter != pnts.end(); ++gpntIter) {
-    // only consider points with >1 observations
-    if((gpntIter->second.zs.size() > 1 || gpntIter->second.z3ds.size() > 1)  
-      && (!checkPtActiveFlag || gpntIter->second.active))
-    {
-      gpoints.push_back(pair<int,Point&>(gpntIter->first, gpntIter->second));
+
+  // for efficiency, instead of computing a projected covariance on the tangent 
+  // of the unit sphere, that needs to be recomputed for every measurement
+  // since the projection depends on the measurement,
+  // we assume a constant ball of radius sphStd, averaged on the u-v plane
+  sphStd = pxStd/sqrt(fx*fx + fy*fy)/2;
+
+  // add the cameras (and the segments ending at them) since the last call
+  SlotMap<Camera>::iterator camIter;
+  for (int id = max(lastCamId, camId0); id <= this->camId; ++id) {
+    camIter = cams.find(id);
+    if (camIter == cams.end())
+      continue;
+    Camera &cam = camIter->second;
+    if (camIter->first > lastCamId) {
+      for (int k = 0; k < 12; k += 3)
+        problem->AddParameterBlock(cam.c + k, 3);
+      for (int i = cam.obs0; i < cam.obs0 + cam.nobs; ++i)
+        if (Obs(i).pntId >= 0)
+          pntIds.insert(Obs(i).pntId);
+    }
+    // ignore last frame
+    if (camIter->first != this->camId && !cam.rids.size())
+      AddSegment(camIter->first, cam);
+  }
+  lastCamId = this->camId;
+
+  // add the new observations
+  if (useCam) {
+    SlotMap<Point>::iterator pntIter;
+    if (checkPtActiveFlag) {
+      for (pntIter = pnts.begin(); pntIter != pnts.end(); ++pntIter)
+        UpdatePoint(pntIter->first, pntIter->second);
+    } else {
+      set<int>::iterator idIter;
+      for (idIter = pntIds.begin(); idIter != pntIds.end(); ++idIter) {
+        pntIter = pnts.find(*idIter);
+        if (pntIter != pnts.end())
+          UpdatePoint(pntIter->first, pntIter->second);
+      }
     }
   }
-  n_good_pnts = gpoints.size();
 
   if(n_good_pnts < minPnts)
   {
@@ -1671,283 +2368,124 @@ bool DynVisIns::Compute() {
     return false;
   }
 
-  if(problem)
-    delete problem;
+  AddPrior();
+    
+  ceres::Solver::Options options;
+  options.linear_solver_type = linearSolver;
+  if (linearSolver == ceres::ITERATIVE_SCHUR)
+    options.preconditioner_type = ceres::SCHUR_JACOBI;
+
+  // eliminate the points first; the points in the marginal prior are
+  // coupled by it, so they are kept with the cams for group 0 to remain
+  // an independent set as required by the Schur solvers
+  ceres::ParameterBlockOrdering *ordering = new ceres::ParameterBlockOrdering;
+  SlotMap<Point>::iterator pntIter;
+  for (pntIter = pnts.begin(); pntIter != pnts.end(); ++pntIter)
+    if (problem->HasParameterBlock(pntIter->second.l.data()))
+      ordering->AddElementToGroup(pntIter->second.l.data(),
+                                  marg.pntIds.count(pntIter->first) ? 1 : 0);
+  for (camIter = cams.begin(); camIter != cams.end(); ++camIter)
+    for (int k = 0; k < 12; k += 3)
+      ordering->AddElementToGroup(camIter->second.c + k, 1);
+  options.linear_solver_ordering.reset(ordering);
+
+  options.num_threads = numThreads;
+  options.num_linear_solver_threads = numThreads;
+  options.minimizer_progress_to_stdout = verbose;
+  options.max_num_iterations = maxIterations;
+
+  ceres::Solver::Summary summary;
+  ceres::Solve(options, problem, &summary);
+  if (verbose)
+    std::cout << summary.FullReport() << "\n";  
 
-  problem = new ceres::Problem();
+  // the parameters are only updated by ceres if the solution is usable
+  if (!summary.IsSolutionUsable()) {
+    cout << "[E] DynVisIns::Compute: solver failed: " << summary.message << endl;
+    return false;
+  }
+  if (summary.termination_type == ceres::NO_CONVERGENCE)
+    cout << "[W] DynVisIns::Compute: solver did not converge: " << summary.message << endl;
+  
+  for (camIter = cams.begin(); camIter != cams.end(); ++camIter)
+    ToState(camIter->second.x, Vector12d(camIter->second.c));
+  ceresActive = true;
 
+  // the optimization vector of the last solution
+  int ng = 0;
+  for (pntIter = pnts.begin(); pntIter != pnts.end(); ++pntIter)
+    if (IsGood(pntIter->first, pntIter->second))
+      ++ng;
   if (v)
     delete[] v;
   if (l_opti_map)
     delete l_opti_map;
-
-  v = new double[12*cams.size() + 3*n_good_pnts + (optBias ? 6 : 0)];
-  l_opti_map = new std::vector<int>(n_good_pnts);  
+  v = new double[12*cams.size() + 3*ng + (optBias ? 6 : 0)];
+  l_opti_map = new std::vector<int>(ng);
   num_opti_cams = cams.size();
-
   ToVec(v, l_opti_map);
-  if (useCam) {
-    // for efficiency, instead of computing a projected covariance on the tangent 
-    // of the unit sphere, that needs to be recomputed for every measurement
-    // since the projection depends on the measurement,
-    // we assume a constant ball of radius sphStd, averaged on the u-v plane
-    sphStd = pxStd/sqrt(fx*fx + fy*fy)/2;
-    
-    assert(this->pnts.size());
-    
-    
-    // first iterate through points 
-    //map<int, Point>::iterator pntIter;
-    //int i = 0;
-    //for (pntIter = pnts.begin(); pntIter != pnts.end(); ++pntIter) {
-    for (int i = 0; i < gpoints.size(); i++) {
-      int pntId = gpoints[i].first;
-      Point &pnt = gpoints[i].second;
-      if(pnt.zs.size() <= 1 && pnt.z3ds.size() <= 1) 
-      {
-        cout << "[I] DynVisIns::Compute: pntId=" << pntId << " only has one observation...skipping." << endl;
-        continue;
-      }
-      if(checkPtActiveFlag && !pnt.active)
-      {
-        cout << "[I] DynVisIns::Compute: pntId=" << pntId << " not active...skipping." << endl;
-        continue;
-      }
-      double *l = v + 12*cams.size() + 3*i;
-
-      if(useFeatPrior && pnt.usePrior)
-      {
-        ceres::CostFunction* cost = FeaturePrior::Create(*this, pnt);
-        problem->AddResidualBlock(cost,
-                                 NULL,
-                                 l);
-      }
-
-      //std::cout << "pnt #" << pntId << " obs=" << pnt.zs.size() << std::endl;
-      map<int, Vector2d>::iterator zIter;
-      for (zIter = pnt.zs.begin(); zIter != pnt.zs.end(); ++zIter) {//int i = 0; i < pnt.zs.size(); ++i) {
-        int camId = zIter->first;
-        Vector2d &z = zIter->second;
-        ceres::CostFunction* cost_function;
-        if(useAnalyticJacs)
-        {
-          cost_function = new AnalyticPerspError(*this, z);
-        }
-        else
-        {
-          cost_function =
-            //        sphMeas ?
-            //        SphError::Create(*this, lus[i]) :
-            PerspError::Create(*this, z);
-        }
-        
-        double *x = v + 12*(camId - camId0);
-        
-        //        assert(zCamInds[i] < xs.size());
-        //        assert(zInds[i] < ls.size());
-        
-        
-        //      ceres::LossFunction *loss_function = new ceres::HuberLoss(100.0);
-        //      ceres::LossFunctionWrapper* loss_function(new ceres::HuberLoss(1.0), ceres::TAKE_OWNERSHIP);
-        if(useHuberLoss)
-        {  
-          problem->AddResidualBlock(cost_function,
-                                   new ceres::HuberLoss(2.0),
-                                   x, x + 3, l);
-        }
-        else
-        {
-          problem->AddResidualBlock(cost_function,
-                                   NULL,
-                                   x, x + 3, l);
-        }
 
-        // for now restrict point coordinates to [-20,20] meters, assuming we're in a small room
-        problem->SetParameterLowerBound(l, 0, -200);
-        problem->SetParameterLowerBound(l, 1, -200);
-        problem->SetParameterLowerBound(l, 2, -200);
-        problem->SetParameterUpperBound(l, 0, 200);
-        problem->SetParameterUpperBound(l, 1, 200);
-        problem->SetParameterUpperBound(l, 2, 200);      
-      }
+  return true;
+}
 
-      map<int, Vector3d>::iterator z3dIter;
-      for (z3dIter = pnt.z3ds.begin(); z3dIter != pnt.z3ds.end(); ++z3dIter) 
-      {
-        int camId = z3dIter->first;
-        Vector3d &z = z3dIter->second;
-        ceres::CostFunction* cost_function;
-        //if(useAnalyticJacs)
-        //{
-        //  cost_function = new AnalyticPerspError(*this, z);
-        //}
-        //else
-        //{
-          cost_function =
-            //        sphMeas ?
-            //        SphError::Create(*this, lus[i]) :
-            StereoError::Create(*this, z);
-        //}
-        
-        double *x = v + 12*(camId - camId0);
-        
-        //        assert(zCamInds[i] < xs.size());
-        //        assert(zInds[i] < ls.size());
-        
-        
-        //      ceres::LossFunction *loss_function = new ceres::HuberLoss(100.0);
-        //      ceres::LossFunctionWrapper* loss_function(new ceres::HuberLoss(1.0), ceres::TAKE_OWNERSHIP);
-        if(useHuberLoss)
-        {  
-          problem->AddResidualBlock(cost_function,
-                                   new ceres::HuberLoss(2.0),
-                                   x, x + 3, l);
-        }
-        else
-        {
-          problem->AddResidualBlock(cost_function,
-                                   NULL,
-                                   x, x + 3, l);
-        }
 
-        // for now restrict point coordinates to [-20,20] meters, assuming we're in a small room
-        //problem->SetParameterLowerBound(l, 0, -20);
-        //problem->SetParameterLowerBound(l, 1, -20);
-        //problem->SetParameterLowerBound(l, 2, -20);
-        //problem->SetParameterUpperBound(l, 0, 20);
-        //problem->SetParameterUpperBound(l, 1, 20);
-        //problem->SetParameterUpperBound(l, 2, 20);      
-      }
-      //++i;
-    }
+bool DynVisIns::ToVec(double *v, vector<int>* l_map) {
+  Vector12d c;
+  int i = 0;
+  for (int id = camId0; id <= camId; ++id) {
+    SlotMap<Camera>::const_iterator camIter = cams.find(id);
+    if (camIter == cams.end())
+      continue;
+    FromState(c, camIter->second.x);
+    memcpy(v + 12*i, c.data(), 12*sizeof(double));
+    ++i;
   }
 
-  if (useImu) {
-    //    assert(xs.size() >= tss.size());
-    //    assert(dts.size() == tss.size());
-    
-    map<int, Camera>::iterator camIter;
-    for (camIter = cams.begin(); camIter != cams.end(); ++camIter) {
-
-      int camId = camIter->first;
-      Camera &cam = camIter->second;
-
-      // ignore last frame
-      if (camId == this->camId)
-        continue;
-      
-      assert(cam.ts.size());
-      assert(cam.dt > 0);
-      //    for (int i = 0; i < tss.size(); ++i) {
-      //      vector<double> &ts = tss[i];
-      //      vector<Vector3d> &ws = wss[i];
-      //      vector<Vector3d> &as = ass[i];
-      //      assert(ts.size() == ws.size());
-      //      assert(ts.size() == as.size());
-      
-      ceres::CostFunction* gyroCost;
-      if(useAnalyticJacs)
-      {
-        gyroCost = new AnalyticGyroCubicError(*this, cam.dt, cam.ts, cam.ws);
-      }
-      else
-      {
-        gyroCost = GyroCubicError::Create(*this, cam.dt, cam.ts, cam.ws);
-      }
-      
-      double *xa = v + 12*(camId - camId0);
-      double *xb = v + 12*(camId + 1 - camId0);
-      
-      problem->AddResidualBlock(gyroCost,
-                               NULL /* squared loss */,
-                               xa, xa + 6, xb, xb + 6);
-      
-      ceres::CostFunction* accCost;
-      if(useAnalyticJacs)
-      {
-        accCost = new AnalyticAccCubicError(*this, cam.dt, cam.ts, cam.as);
-      }
-      else
-      {
-        accCost = AccCubicError::Create(*this, cam.dt, cam.ts, cam.as);
-      }
-      
-      problem->AddResidualBlock(accCost,
-                               NULL /* squared loss */,
-                               xa, xa + 3, xa + 6, xa + 9,
-                               xb, xb + 3, xb + 6, xb + 9);        
-      // could also add some box constraints on the state?
+  int i0 = 12*i;
+  i = 0;
+  SlotMap<Point>::const_iterator pntIter;
+  for (pntIter = pnts.begin(); pntIter != pnts.end(); ++pntIter) {
+    // Only consider points with at least two observations
+    if (!IsGood(pntIter->first, pntIter->second))
+      continue;
+    if (i == l_map->size()) {
+      cout << "[E] DynVisIns::ToVec: more than " << l_map->size() << " good points" << endl;
+      return false;
     }
+    memcpy(v + i0 + 3*i, pntIter->second.l.data(), 3*sizeof(double));
+    l_map->at(i) = pntIter->first;
+    ++i;
   }
-  
-  if (useDyn) {
-    
-    //    assert(xs.size() == dts.size() + 1);
-    map<int, Camera>::iterator camIter;
-    for (camIter = cams.begin(); camIter != cams.end(); ++camIter) {
+  if (i != l_map->size()) {
+    cout << "[E] DynVisIns::ToVec: " << i << " good points instead of " << l_map->size() << endl;
+    return false;
+  }
+  return true;
+}
 
-      
-      int camId = camIter->first;
-      Camera &cam = camIter->second;
 
-      // ignore last frame
-      if (camId == this->camId)
-        continue;
-      
-      assert(cam.dt > 0);
-
-      //    for (int i = 0; i < tss.size(); ++i) {
-      //      vector<double> &ts = tss[i];
-      //      vector<Vector3d> &ws = wss[i];
-      //      vector<Vector3d> &as = ass[i];
-      //      assert(ts.size() == ws.size());
-      //      assert(ts.size() == as.size());
-    
-        //    for (int i = 0; i < dts.size(); ++i) {
-        //      assert(dts[i] > 0);
-      
-      double *xa = v + 12*(camId - camId0);
-      double *xb = v + 12*(camId + 1 - camId0);
-      
-      ceres::CostFunction* rotCost = CvCubicRotError::Create(*this, cam.dt);    
-      problem->AddResidualBlock(rotCost,
-                               NULL /* squared loss */,
-                               xa, xa + 6, xb, xb + 6);
-      
-      ceres::CostFunction* posCost = CvCubicPosError::Create(*this, cam.dt);    
-      problem->AddResidualBlock(posCost,
-                               NULL /* squared loss */,
-                               xa + 3, xa + 9, xb + 3, xb + 9);
-      
-      // could also add some box constraints on the state?
-    }
+bool DynVisIns::FromVec(const double *v, const vector<int>* l_map) {
+  int i = 0;
+  for (int id = camId0; id <= camId; ++id) {
+    SlotMap<Camera>::iterator camIter = cams.find(id);
+    if (camIter == cams.end())
+      continue;
+    Camera &cam = camIter->second;
+    ToState(cam.x, Vector12d(v + 12*i));
+    memcpy(cam.c, v + 12*i, 12*sizeof(double));   // the coordinates in the problem
+    ++i;
   }
 
-  if (usePrior) {
-    ceres::CostFunction* cost = StatePrior::Create(*this, x0);
-    problem->AddResidualBlock(cost,
-                             NULL,
-                             v, v + 3, v + 6, v + 9);
+  int i0 = 12*i;
+  for (int i = 0; i < l_map->size(); ++i) {
+    SlotMap<Point>::iterator pntIter = pnts.find(l_map->at(i));
+    if (pntIter == pnts.end()) {
+      cout << "[W] DynVisIns::FromVec: cannot find point with id#" << l_map->at(i) << endl;
+      continue;
+    }
+    pntIter->second.l = Vector3d(v + i0 + 3*i);
   }
-    
-  ceres::Solver::Options options;
-  // options.linear_solver_type = ceres::DENSE_SCHUR;
-  options.linear_solver_type = ceres::SPARSE_NORMAL_CHOLESKY;
-  options.minimizer_progress_to_stdout = true;
-  options.max_num_iterations = maxIterations;
-
-  ceres::Solver::Summary summary;
-  ceres::Solve(options, problem, &summary);
-  std::cout << summary.FullReport() << "\n";  
-  
-  FromVec(v, l_opti_map);
-  ceresActive = true;
-
-  //  delete[] v;
-  //  v = 0;
-
   return true;
-  
 }
 
 /*
@@ -1973,8 +2511,8 @@ void hermite3(Vector3d &c1, Vector3d &c2, Vector3d &c3,
   K(1,0) = 0; K(1,1) = fy; K(1,2) = cy;
 
   // tvi is the "true" VI estimator
-  map<int, Camera> &cams = tvi.cams;
-  map<int, Point> &pnts = tvi.pnts;
+  SlotMap<Camera> &cams = tvi.cams;
+  SlotMap<Point> &pnts = tvi.pnts;
 
   //  this->ls.resize(ls.size());
 
@@ -2083,22 +2621,18 @@ void hermite3(Vector3d &c1, Vector3d &c2, Vector3d &c3,
   
   // generate feature meas
   if (useCam)  {
-    map<int, Camera>::iterator camIter;
-
-    for (camIter = cams.begin(); camIter != cams.end(); ++camIter){
-      int camId = camIter->first;
-      Camera &cam = camIter->second;
+    for (int camId = 0; camId <= tvi.camId; ++camId){
+      Camera &cam = cams[camId];
       Body3dState &x = cam.x;
-      map<int, Point>::iterator pntIter;
+      SlotMap<Point>::iterator pntIter;
       for (pntIter = pnts.begin(); pntIter != pnts.end(); ++pntIter) {
         int pntId = pntIter->first;
         Point &pnt = pntIter->second;
         Matrix3d R = x.R*Ric;  // camera rotation
         Vector3d r = R.transpose()*(pnt.l - x.p);
         
-        this->pnts[pntId].zs[camId] = K*(r/r[2]);
-
-        cam.pntIds.push_back(pntId);
+        Vector2d z = K*(r/r[2]);
+        AddObservation(camId, this->cams[camId], pntId, Vector3d(z[0], z[1], 0), false);
         // spherical measurements
         //        this->lus.push_back(r/r.norm());      
         
@@ -2143,13 +2677,13 @@ void hermite3(Vector3d &c1, Vector3d &c2, Vector3d &c3,
 bool DynVisIns::MakeFeatures(vector<Vector2d> &zs, 
                              vector<int> &pntIds,
                              const Body3dState &x, 
-                             const map<int, Point> &pnts)
+                             const SlotMap<Point> &pnts)
 {
   int l = 780;
   int h = 560;
   zs.clear();
   pntIds.clear();
-  map<int, Point>::const_iterator pntIter;
+  SlotMap<Point>::const_iterator pntIter;
   for (pntIter = pnts.begin(); pntIter != pnts.end(); ++pntIter) {
     int pntId = pntIter->first;
     const Point &pnt = pntIter->second;
@@ -2187,8 +2721,8 @@ bool DynVisIns::SimData(DynVisIns &tvi, int ns, int np, int ni, double dt)
   K(1,0) = 0; K(1,1) = fy; K(1,2) = cy;
 
   // tvi is the "true" VI estimator
-  map<int, Camera> &cams = tvi.cams;
-  map<int, Point> &pnts = tvi.pnts;
+  SlotMap<Camera> &cams = tvi.cams;
+  SlotMap<Point> &pnts = tvi.pnts;
 
   // number of features on each side of grid
   int n1 = sqrt(np);
@@ -5,10 +5,13 @@
 #include <cstdio>
 #include <iostream>
 #include <map>
+#include <set>
 
 
 #include <fstream>
 #include "body3d.h"
+#include "inspreint.h"
+#include "slotmap.h"
 #include <Eigen/Dense>
 
 #include "ceres/ceres.h"
@@ -33,6 +36,9 @@ using namespace Eigen;
  * v is the rate of change of p (i.e. the spatial velocity). 
  *
  * Adding likelihoods for IMU data, dynamics, or a given prior are optional.
+ * The IMU data of a segment is either compared to the cubic trajectory at every
+ * measurement or, if usePreint is set, preintegrated once (see InsPreint) into a
+ * single residual per segment whose cost does not depend on the IMU rate.
  * Camera feature data is required since it forms the basis for the representation and 
  * optimization. All likelihood factors are computed in closed form without approximations.
  * 
@@ -43,41 +49,100 @@ using namespace Eigen;
 class DynVisIns {
 public:
   
+  /**
+   * A feature measurement of a point by a camera. The observations of all
+   * cameras are stored in a single table (see obs), where the ones of each
+   * camera are contiguous (i.e. the rows of a CSR table) and the ones of
+   * each point are linked in the order of camera ids.
+   */
+  struct Observation {
+    int camId;               ///< camera id (-1 if removed)
+    int pntId;               ///< point id
+    bool stereo;             ///< whether this is a 3d (stereo) or 2d (perspective) measurement
+    Vector3d z;              ///< 3d feature, or 2d feature in the first two coordinates
+    int next;                ///< index of the next observation of the point (-1 if none)
+    ceres::ResidualBlockId rid;   ///< feature residual in the problem (0 if none)
+  };
+
   struct Point {
     Vector3d l;              ///< the point 3d coordinates
     Matrix3d P;              ///< the covariance matrix of the point 3d coordinates
     bool usePrior;           ///< should a prior be set based on the point covariance?
     bool active;           ///< should this point be used in the optimization?
-    map<int, Vector2d> zs;   ///< map of 2d feature measurements indexed by camera id
-    map<int, Vector3d> z3ds;   ///< map of 3d feature measurements indexed by camera id
+    int nz;                  ///< number of 2d feature measurements
+    int nz3d;                ///< number of 3d feature measurements
+    map<int, Vector2d> zs;   ///< map of 2d feature measurements indexed by camera id (the same measurements as in obs, which is what the estimator uses)
+    map<int, Vector3d> z3ds;   ///< map of 3d feature measurements indexed by camera id (as zs)
+    int obs0;                ///< index of the first observation (-1 if none)
+    int obs1;                ///< index of the last observation (-1 if none)
+    ceres::ResidualBlockId priorId;          ///< feature prior residual in the problem (0 if none)
+
+    Point() : usePrior(false), active(false), nz(0), nz3d(0), obs0(-1), obs1(-1), priorId(0) {}
   };
 
   struct Camera {
     Body3dState x;              ///< the point 3d coordinates
-    vector<int> pntIds;         ///< list of points observed by this camera
+    double c[12];               ///< optimized coordinates (r,p,dr,v) of x
+    vector<int> pntIds;         ///< list of points observed by this camera (the point ids of its observations, including removed points)
+    int obs0;                   ///< index of the first observation of the camera
+    int nobs;                   ///< number of observations of the camera (stored after obs0)
+    vector<ceres::ResidualBlockId> rids;   ///< IMU and dynamics residuals (of the segment to the next camera) in the problem
 
     double dt;                 ///< delta t to next camera
 
     vector<double> ts;        ///< local times (within each segment) at which IMU measurements arrived
     vector<Vector3d> ws;      ///< accumulated IMU gyro readings from last cam frame
     vector<Vector3d> as;      ///< accumulated IMU acc readings from last cam frame    
+
+    Camera() : obs0(0), nobs(0) {}
   };
   
-  map<int, Point> pnts;   ///< all points
+  SlotMap<Point> pnts;    ///< all points (by id)
   
   int camId;              ///< current camera id (incremented after a frame is added)
   int camId0;             ///< starting camera id (pointing to begining of window)
-  map<int, Camera> cams;  ///< cameras
+  SlotMap<Camera> cams;   ///< cameras (by id)
+
+  vector<Observation> obs;   ///< all observations, ordered by camera: observation with index i is obs[i - obsBase]
+  int obsBase;               ///< index of the first stored observation (removed ones at the front are dropped)
+
+  /**
+   * Observation with index i
+   */
+  Observation& Obs(int i) { return obs[i - obsBase]; }
+  const Observation& Obs(int i) const { return obs[i - obsBase]; }
+
+  /**
+   * Prior on the cameras and points remaining in the window obtained by
+   * marginalizing the ones that left it (see useMarg). It is the
+   * linearized residual e = r + J*(x - xs), where x stacks the 3-dim
+   * blocks (r, p, dr or v of a camera, or the coordinates of a point)
+   * that were connected to the marginalized variables.
+   */
+  struct MargPrior {
+    vector<pair<int, int> > blocks;  ///< (camera id, offset 0, 3, 6 or 9) or (-1, point id) of each block of x
+    set<int> pntIds;                 ///< ids of the points in blocks
+    VectorXd xs;                     ///< linearization point
+    VectorXd r;                      ///< residual at xs
+    MatrixXd J;                      ///< Jacobian
+  };
+
+  MargPrior marg;         ///< prior from marginalized cameras and points
 
   int maxCams;            ///< max length of camera sequence (0 by default indicating no limit)
 
-  ceres::Problem* problem;  ///< the ceres problem
-  bool ceresActive;       ///< whether ceres has been called on the current opt vector
+  ceres::Problem* problem;  ///< the ceres problem (kept across calls to Compute, with the coordinates of cams and points as parameters)
+  bool ceresActive;       ///< whether ceres has been called on the current problem
 
-  double *v;             ///< the full ceres optimization vector
+  double *v;             ///< the full ceres optimization vector as of the last successful Compute (see ToVec; the estimator itself keeps the coordinates in cams and pnts)
   std::vector<int> *l_opti_map;             ///< maps pnts in optimization vector back to pntIds
   int num_opti_cams;     ///< number of cameras used in the last optimization
-  int n_good_pnts;        ///< number of good points in the last optimization
+  int n_good_pnts;        ///< number of good points, i.e. points in the problem
+  ceres::ResidualBlockId priorId;   ///< state or marginal prior residual in the problem (0 if none)
+
+  ceres::LinearSolverType linearSolver;   ///< SPARSE_SCHUR (default) or ITERATIVE_SCHUR (for large problems)
+  int numThreads;         ///< number of threads used by ceres (the number of cores by default)
+  bool verbose;           ///< print solver progress and summary (true by default)
 
   double pxStd;          ///< std dev of pixels
   double stereoStd;      ///< std dev of stereo measurements
@@ -108,8 +173,10 @@ public:
   bool useCam;     ///< process cam? 
   bool useDyn;     ///< use dynamics?
   bool useAnalyticJacs;     ///< use analytic jacobians?
+  bool usePreint;  ///< use one preintegrated IMU residual per segment instead of residuals at every IMU measurement (false by default)
   bool useCay;      ///< use cayley map instead of exponential map?
   bool usePrior;   ///< whether to enforce prior using x0
+  bool useMarg;    ///< marginalize cameras and points leaving the window (see maxCams) into marg instead of dropping them and resetting the prior with ResetPrior (false by default)
   bool useFeatPrior;   ///< whether to enforce feature prior
   bool useHuberLoss;   ///< use huber loss for feature residuals?
   bool optBias;    ///< to optimize over biases?
@@ -124,8 +191,14 @@ public:
 
   
   /**
-   * Estimate trajectory and points
-   * @return true on success
+   * Estimate trajectory and points. The ceres problem is kept between calls:
+   * the residuals of new cameras, points and observations are added to it,
+   * while those of removed cameras and points are removed as soon as they
+   * are removed. The options (useImu, useDyn, etc...) should not be changed
+   * after the first call.
+   * @return true on success, false if there are too few points, the
+   * marginalization failed (without usePrior) or the solver failed, in
+   * which case the cams are not updated
    */
   bool Compute();
 
@@ -156,7 +229,7 @@ public:
   bool RemoveCamera(int id, std::set<int>* pnt_zs_removed = NULL);
 
   /**
-   * Remove a point
+   * Remove a point and its observations
    * @param id point id
    * @return true on success
    */
@@ -174,6 +247,19 @@ public:
    */
   bool ResetPrior(int id, std::set<int>* pnts = NULL);
 
+  /**
+   * Marginalize all cameras with id less than id, and the points observed
+   * only by them, into the prior marg. This uses the linearization of all
+   * residuals involving them (including the current marg) at the solution
+   * of the last optimization. The cameras and points are not removed.
+   * This is called internally by Compute when useMarg is set and the
+   * window of maxCams cameras is exceeded; if it fails, Compute resets the
+   * state prior with ResetPrior if usePrior is set and returns false otherwise.
+   * @param id id of the first camera to keep
+   * @return true on success
+   */
+  bool Marginalize(int id);
+
   /**
    * Process IMU measurement
    * @param t time
@@ -189,7 +275,7 @@ public:
   bool MakeFeatures(vector<Vector2d> &zs, 
                     vector<int> &pntIds,
                     const Body3dState &x, 
-                    const map<int, Point> &pnts);
+                    const SlotMap<Point> &pnts);
 
   /**
    * Generate synthetic cam and IMU data and store in a provided "true" system tvi
@@ -206,71 +292,21 @@ public:
   bool LoadFile(const char* filename);
 
   /**
-   * Convert from stl/Eigen data structures to ceres optimization vector
-   * @param v ceres optimization vector
+   * Convert from stl/Eigen data structures to ceres optimization vector: the
+   * coordinates of the cameras in id order followed by those of the good points
+   * @param v ceres optimization vector (of size 12*cams.size() + 3*l_map->size())
+   * @param l_map ids of the points in v (its size should be the number of good points)
    * @return true if success
    */
-  bool ToVec(double *v, vector<int>* l_map) {
-    Vector12d c;
-    map<int, Camera>::iterator camIter;
-    int i = 0;
-    for (camIter = cams.begin(); camIter != cams.end(); ++camIter, ++i) {
-      FromState(c, camIter->second.x);
-      memcpy(v + 12*i, c.data(), 12*sizeof(double));
-    }
-
-    int i0 = 12*cams.size(); 
-    map<int, Point>::iterator pntIter;
-    i=0;
-    for (pntIter = pnts.begin(); pntIter != pnts.end(); ++pntIter) {
-      // Only consider points with at least two observations
-      if((pntIter->second.zs.size() > 1 || pntIter->second.z3ds.size() > 1)  
-        && (!checkPtActiveFlag || pntIter->second.active))
-      {
-        memcpy(v + i0 + 3*i, pntIter->second.l.data(), 3*sizeof(double));
-        l_map->at(i) = pntIter->first;
-        ++i;
-      }
-    }
-    assert(i == l_map->size());
-
-    //    if (optBias) {
-    //      memcpy(v + 12*xs.size() + 3*ls.size(), bg.data(), 3*sizeof(double));
-    //      memcpy(v + 12*xs.size() + 3*ls.size() + 3, ba.data(), 3*sizeof(double));
-    //    }    
-    return true;
-  }
-  
+  bool ToVec(double *v, vector<int>* l_map);
 
   /**
    * Convert from ceres optimization vector to stl/Eigen data structures
    * @param v ceres optimization vector
+   * @param l_map ids of the points in v, as set by ToVec
    * @return true if success
    */
-  bool FromVec(const double *v, const vector<int>* l_map) {
-    //    xs.resize(cams.size();
-    map<int, Camera>::iterator camIter;
-    int i=0;
-    for (camIter = cams.begin(); camIter != cams.end(); ++camIter, ++i) {
-      ToState(camIter->second.x, Vector12d(v + 12*i));
-      //      xs[i] = camIter->second.x;
-    }
-
-    int i0 = 12*cams.size(); 
-    //map<int, Point>::iterator pntIter;
-    //i = 0;
-    //for (pntIter = pnts.begin(); pntIter != pnts.end(); ++pntIter, ++i) {
-    for (int i = 0; i < l_map->size(); ++i) {
-      pnts[l_map->at(i)].l = Vector3d(v + i0 + 3*i);
-    }
-
-    //    if (optBias) {
-    //      bg = Vector3d(v + 12*xs.size() + 3*ls.size());
-    //      ba = Vector3d(v + 12*xs.size() + 3*ls.size() + 3);
-    //    }
-
-    return true;
-  }
+  bool FromVec(const double *v, const vector<int>* l_map);
 
   void ToState(Body3dState &x, 
                       const Vector3d &r,
@@ -337,9 +373,52 @@ public:
     c.segment<3>(6) = D*x.w;
     c.tail<3>() = x.v;
   }
+  /**
+   * Whether a point is used in the optimization, i.e. if it has more than
+   * one observation or is part of the marginal prior (and is active when
+   * checkPtActiveFlag is set)
+   * @param id point id
+   * @param pnt point
+   */
+  bool IsGood(int id, const Point &pnt) const {
+    return (pnt.nz > 1 || pnt.nz3d > 1 || marg.pntIds.count(id))
+      && (!checkPtActiveFlag || pnt.active);
+  }
+
 private:
   void RemoveBadPoints();
 
+  /**
+   * Add an observation of point pntId (created if new) by camera camId
+   * (the observations of a camera must be added consecutively)
+   * @return the point
+   */
+  Point& AddObservation(int camId, Camera &cam, int pntId, const Vector3d &z, bool stereo);
+
+  /**
+   * Add the IMU and dynamics residuals of the segment from camera id to the next camera
+   */
+  void AddSegment(int id, Camera &cam);
+
+  /**
+   * Add the point and its new observations to the problem if it is good, or
+   * remove it from the problem otherwise
+   */
+  void UpdatePoint(int id, Point &pnt);
+
+  /**
+   * Remove a residual from the problem (if set) and reset its id
+   */
+  void RemoveResidual(ceres::ResidualBlockId &rid);
+
+  /**
+   * Add the state prior or (if useMarg is set and the prior marg is not
+   * empty) the marginal prior to the problem
+   */
+  void AddPrior();
+
+  int lastCamId;   ///< id of the last camera added to the problem
+
 };
 
 }
@@ -21,6 +21,24 @@ namespace gcop {
   /**
    * Parameter-dependent differential dynamic programming 
    *
+   * The parameters are optimized together with the controls by augmenting
+   * the state with them. By default the value function is dense in the
+   * parameters. When the parameters consist of many independent blocks of
+   * which only a few are involved at each time (e.g. feature positions in
+   * bundle adjustment) setting pb to the block size keeps only its state
+   * and state-parameter parts during the backward pass, and accumulates its
+   * parameter part as a block-diagonal matrix minus Ws'*Ws, where Ws is a
+   * dense (N*c) x m matrix. The parameters are then solved for by
+   * eliminating the blocks and factoring the dense (N*c) x (N*c) matrix
+   * S = I - Ws*inv(D)*Ws' (Woodbury identity). This takes O(N*c*m + N^2*c^2)
+   * memory instead of O(m^2), and O(N^3*c^3 + N^2*c^2*m) time per iteration
+   * instead of O(m^3), so it pays off when m is much larger than N*c. Ws
+   * and the state-parameter part (n x m) are still dense, so the memory
+   * grows with N*m (e.g. 4.8GB for N=1000, c=3 and 10^5 planar features). It
+   * requires the cost to provide block derivatives through Cost::Lb, no
+   * dynamic parameters, and m divisible by pb; otherwise the dense
+   * parameters are used.
+   *
    * Authors: Marin Kobilarov, Matthew Sheckells
    */
   template <typename T, int n = Dynamic, int c = Dynamic, int np = Dynamic> 
@@ -94,9 +112,33 @@ namespace gcop {
      */
     void Backward();
 
+    /**
+     *  Backward pass for block-sparse parameters (pb > 0). Falls back to
+     *  dense parameters (setting pb to 0) if they are not supported
+     */
+    void BackwardSparse();
+
+    /**
+     * Solve (Ppp + nu*I)*dp = -vp for block-sparse parameters, where the
+     * value function Hessian Ppp = blkdiag(Dp) - Ws'*Ws
+     * @param nu regularization
+     * @return false if Ppp + nu*I is not positive definite
+     */
+    bool SolveSparse(double nu);
+
+    /**
+     * Factor Quu + mu*I, increasing mu until it is positive definite
+     * @param llt resulting factorization
+     * @param Quu control Hessian of the Q-function
+     * @param k time step
+     * @return false if mu exceeded its maximum
+     */
+    bool FactorQuu(LLT<Matrixcd> &llt, const Matrixcd &Quu, int k);
+
 
     int m;         ///< parameter space dimension
     int dynParams; ///< number of dynamic parameters (that the dynamics depend on)
+    int pb;        ///< size of independent parameter blocks (0 for dense parameters)
     
     VectorXd &p;  ///< reference to parameters being optimized
     VectorXd dp;  ///< computed parameter increment      
@@ -121,6 +163,10 @@ namespace gcop {
 
     VectorXd v;
     MatrixXd P;
+
+    MatrixXd Pxp;  ///< state-parameter part of the value function Hessian (pb > 0)
+    MatrixXd Dp;   ///< diagonal blocks of its parameter part (pb x pb blocks side by side)
+    MatrixXd Ws;   ///< its parameter part is blkdiag(Dp) - Ws'*Ws
     
     double nu;    ///< current regularization factor nu
     double nu0;   ///< minimum regularization factor nu
@@ -148,12 +194,9 @@ namespace gcop {
                               vector<Matrix<double, c, 1> > &us,
                               Matrix<double, np, 1> &p, int dynParams, bool update) : 
     Ddp<T, n, c, np>(sys, cost, ts, xs, us, &p, false),
-    m(p.size()), dynParams(dynParams), p(p), dp(m), Cs(this->N), 
+    m(p.size()), dynParams(dynParams), pb(0), p(p), dp(m), Cs(this->N), 
     nu(1e-3), nu0(1e-3), dnu0(2) {
     
-    Lxa.resize(sys.X.n + m);
-    Lxxa.resize(sys.X.n + m, sys.X.n + m);
-    Lxua.resize(sys.X.n + m, sys.U.n);
     Kuxs.resize(this->N);   
  
     for (int i = 0; i < this->N; ++i) {
@@ -189,6 +232,11 @@ namespace gcop {
   
   template <typename T, int n, int c, int np> 
     void PDdp<T, n, c, np>::Backward() {
+
+    if (pb) {
+      BackwardSparse();
+      return;
+    }
     
     int N = this->us.size();
 
@@ -220,9 +268,10 @@ namespace gcop {
     Lp.resize(m);
     Lpp.resize(m,m);
     Lpx.resize(m,n);
-    
-    cout << "u=" << u.transpose() << endl;
-    //    cout << "x=" << ((Body2dState&)x).first << " " << (x.second << endl;
+
+    Lxa.resize(this->sys.X.n + m);
+    Lxxa.resize(this->sys.X.n + m, this->sys.X.n + m);
+    Lxua.resize(this->sys.X.n + m, this->sys.U.n);
 
     Lxs.clear();
     Lxxs.clear();
@@ -285,15 +334,12 @@ namespace gcop {
     
     MatrixXd Qxx = MatrixXd::Zero(this->sys.X.n + m, this->sys.X.n+m);
     Matrixcd Quu;
-    Matrixcd Quum;
     MatrixXd Quxm =  MatrixXd::Zero(this->sys.U.n, this->sys.X.n+m);
     MatrixXd Qux = MatrixXd::Zero(this->sys.U.n, this->sys.X.n+m);
 
     MatrixXd Aat = MatrixXd::Zero(this->sys.X.n + m, this->sys.X.n+m);
     MatrixXd At = MatrixXd::Zero(this->sys.X.n, this->sys.X.n);
     MatrixXd Bt = MatrixXd::Zero(this->sys.U.n, this->sys.X.n);
-    
-    Matrixcd Ic = MatrixXd::Identity(this->sys.U.n, this->sys.U.n);
 
     for (int k = N - 1; k >=0; --k) {
       t = this->ts[k];
@@ -340,9 +386,6 @@ namespace gcop {
       
       Qx = Lxa + Aat*v;
       Qu = Lu + Bt*v.head(n);
-      cout << "Lu=" << Lu.transpose() << endl;
-      cout << "Bt=" << Bt << endl;
-      cout << "v=" << v.transpose() << endl;
 
       Qxx = Lxxa + Aat*P*Aa;
       Quu = Luu + Bt*P.block(0,0,n,n)*B;
@@ -351,13 +394,10 @@ namespace gcop {
       if(dynParams)
         Qux.block(0,n,c,dynParams) +=  Bt*P.block(0,0,n,n)*this->Cs[k];     
 
-      double dmu = 1;
-      
       LLT<Matrixcd> llt;
       
       printDebug = false;
      
-      double mu = this->mu;
       if (this->debug) {
         if (!pdX(P)) {
         //  cout << "P[" << k << "] is not pd =" << endl << P << endl;
@@ -393,60 +433,9 @@ namespace gcop {
       }
 
 
-      while (1) {
-        Quum = Quu + mu*Ic;
-        
-        // From https://homes.cs.washington.edu/~todorov/papers/TassaIROS12.pdf
-        //MatrixXd Pm = P+mu*MatrixXd::Identity(n+m,n+m);
-        //Quum = Luu + Bt*Pm.block(0,0,n,n)*B;
-        llt.compute(Quum);
-        
-        // if OK, then reduce mu and break
-        if (llt.info() == Eigen::Success) {
-          
-          //Quxm.block(0,0,c,n) =  Bt*Pm.block(0,0,n,n)*A;     // assume Lux = 0
-          //Quxm.block(0,n,c,m) =  Bt*Pm.block(0,n,n,m);     
-          //if(dynParams)
-          //  Quxm.block(0,n,c,dynParams) +=  Bt*Pm.block(0,0,n,n)*this->Cs[k];     
-
-          // Tassa and Todorov recently proposed this quadratic rule, seems pretty good
-          dmu = min(1/this->dmu0, dmu/this->dmu0);
-          if (mu*dmu > this->mu0)
-          { 
-             mu = mu*dmu;
-          }
-          else
-          {
-             mu = this->mu0;
-          }
-          break;
-        }
-        else
-        {
-          // if negative then increase mu
-          dmu = max(this->dmu0, dmu*this->dmu0);
-          mu = max(this->mu0, mu*dmu);   
-        }
-
-        if (this->debug)
-          cout << "[I] PDdp::Backward: increased mu=" << mu << " at k=" << k << endl;
-        printDebug = true;
-
-        if (mu > this->mumax) {
-          cout << "[W] PDdp::Backward: mu= " << mu << " exceeded maximum !" << endl;
-          if (this->debug)
-            getchar();
-          break;
-        }
-
-      }
-
-      
-      if(mu > this->mumax)
+      if (!FactorQuu(llt, Quu, k))
         break;
 
-      cout << "Qu=" << Qu.transpose() << endl;
-
       ku = -llt.solve(Qu);
       Kux = -llt.solve(Qux);
       //Kux = -llt.solve(Quxm);
@@ -470,6 +459,204 @@ namespace gcop {
     
   }
   
+  template <typename T, int n, int c, int np> 
+    bool PDdp<T, n, c, np>::FactorQuu(LLT<Matrixcd> &llt, const Matrixcd &Quu, int k) {
+
+    Matrixcd Ic = MatrixXd::Identity(this->sys.U.n, this->sys.U.n);
+    double mu = this->mu;
+    double dmu = 1;
+
+    while (1) {
+      llt.compute(Quu + mu*Ic);
+      
+      // if OK, then reduce mu and break
+      if (llt.info() == Eigen::Success) {
+        // Tassa and Todorov recently proposed this quadratic rule, seems pretty good
+        dmu = min(1/this->dmu0, dmu/this->dmu0);
+        if (mu*dmu > this->mu0)
+          mu = mu*dmu;
+        else
+          mu = this->mu0;
+        return true;
+      }
+
+      // if negative then increase mu
+      dmu = max(this->dmu0, dmu*this->dmu0);
+      mu = max(this->mu0, mu*dmu);   
+
+      if (this->debug)
+        cout << "[I] PDdp::Backward: increased mu=" << mu << " at k=" << k << endl;
+      printDebug = true;
+
+      if (mu > this->mumax) {
+        cout << "[W] PDdp::Backward: mu= " << mu << " exceeded maximum !" << endl;
+        if (this->debug)
+          getchar();
+        return false;
+      }
+    }
+  }
+
+
+  template <typename T, int n, int c, int np> 
+    void PDdp<T, n, c, np>::BackwardSparse() {
+
+    if (pb <= 0 || dynParams || m % pb) {
+      cout << "[E] PDdp::BackwardSparse: block size pb=" << pb << " does not divide m=" << m
+           << " or there are dynParams=" << dynParams << " dynamic parameters, using dense parameters" << endl;
+      pb = 0;
+      Backward();
+      return;
+    }
+
+    int N = this->us.size();
+    int nx = this->sys.X.n;
+    int nc = this->sys.U.n;
+
+    double t = this->ts.back();
+    const T &x = this->xs.back();
+    const Vectorcd &u = this->us.back();
+
+    Vectornd Lx;
+    Matrixnd Lxx;
+    Vectorcd Lu;
+    Matrixcd Luu;
+    Matrixncd Lxu;
+    vector<int> ls;
+    VectorXd Lp;
+    MatrixXd Lpp;
+    Matrix<double, Dynamic, n> Lpx;
+
+    // value function: v = (vx, vp), P = [Pxx, Pxp; Pxp', blkdiag(Dp) - Ws'*Ws]
+    v.setZero(nx + m);
+    Matrixnd Pxx;
+    Pxp.setZero(nx, m);
+    Dp.setZero(pb, m);
+    Ws.setZero(N*nc, m);
+
+    double L = this->cost.Lb(t, x, u, 0, &p, pb, 
+                             &Lx, &Lxx, 0, 0, 0, 
+                             ls, Lp, Lpp, Lpx);
+    this->V = L;
+    this->dV.setZero();
+
+    v.head(nx) = Lx;
+    Pxx = Lxx;
+    for (int j = 0; j < ls.size(); ++j) {
+      v.segment(nx + pb*ls[j], pb) += Lp.segment(pb*j, pb);
+      Dp.middleCols(pb*ls[j], pb) += Lpp.middleCols(pb*j, pb);
+      Pxp.middleCols(pb*ls[j], pb) += Lpx.middleRows(pb*j, pb).transpose();
+    }
+
+    Vectornd Qx;
+    Vectorcd Qu;
+    Matrixnd Qxx;
+    Matrixcd Quu;
+    Matrixcnd Qux;
+    MatrixXd Qup;
+
+    for (int k = N - 1; k >=0; --k) {
+      t = this->ts[k];
+      const T &x = this->xs[k];
+      const Vectorcd &u = this->us[k];
+      double h = this->ts[k+1] - this->ts[k];
+      assert(h >0);
+
+      L = this->cost.Lb(t, x, u, h, &p, pb,
+                        &Lx, &Lxx, &Lu, &Luu, &Lxu,
+                        ls, Lp, Lpp, Lpx);
+      this->V += L;
+
+      const Matrixnd &A = this->As[k];
+      const Matrixncd &B = this->Bs[k];
+
+      Qx = Lx + A.transpose()*v.head(nx);
+      Qu = Lu + B.transpose()*v.head(nx);
+      Qxx = Lxx + A.transpose()*Pxx*A;
+      Quu = Luu + B.transpose()*Pxx*B;
+      Qux = B.transpose()*Pxx*A;     // assume Lux = 0
+      Qup = B.transpose()*Pxp;
+
+      LLT<Matrixcd> llt;
+      if (!FactorQuu(llt, Quu, k))
+        break;
+
+      Vectorcd &ku = this->kus[k];
+      MatrixXd &Kux = Kuxs[k];
+      ku = -llt.solve(Qu);
+      Kux.leftCols(nx) = -llt.solve(Qux);
+      Kux.rightCols(m) = -llt.solve(Qup);
+
+      assert(!std::isnan(ku[0]));
+
+      // the parameter part of P only changes by -Qup'*inv(Quu)*Qup, which is kept in factored form
+      v.head(nx) = Qx + Kux.leftCols(nx).transpose()*Qu;
+      v.tail(m) += Kux.rightCols(m).transpose()*Qu;
+      Pxx = Qxx + Kux.leftCols(nx).transpose()*Qux;
+      Pxp = A.transpose()*Pxp + Kux.leftCols(nx).transpose()*Qup;
+      Ws.middleRows(nc*k, nc) = llt.matrixL().solve(Qup);
+
+      for (int j = 0; j < ls.size(); ++j) {
+        v.segment(nx + pb*ls[j], pb) += Lp.segment(pb*j, pb);
+        Dp.middleCols(pb*ls[j], pb) += Lpp.middleCols(pb*j, pb);
+        Pxp.middleCols(pb*ls[j], pb) += Lpx.middleRows(pb*j, pb).transpose();
+      }
+
+      this->dV[0] += ku.dot(Qu);
+      this->dV[1] += ku.dot(Quu*ku/2);
+    }
+    
+    if (this->debug)
+      cout << "[I] PDdp::BackwardSparse: current V=" << this->V << endl;
+  }
+
+
+  template <typename T, int n, int c, int np> 
+    bool PDdp<T, n, c, np>::SolveSparse(double nu) {
+
+    int nb = m/pb;
+    int r = Ws.rows();
+    const MatrixXd Ib = MatrixXd::Identity(pb, pb);
+
+    // eliminate the parameter blocks: inverse of D = blkdiag(Dp) + nu*I
+    MatrixXd Di(pb, m);
+    LLT<MatrixXd> lltb;
+    for (int l = 0; l < nb; ++l) {
+      lltb.compute(Dp.middleCols(pb*l, pb) + nu*Ib);
+      if (lltb.info() != Eigen::Success)
+        return false;
+      Di.middleCols(pb*l, pb) = lltb.solve(Ib);
+    }
+
+    VectorXd y(m);    // inv(D)*vp
+    for (int l = 0; l < nb; ++l)
+      y.segment(pb*l, pb) = Di.middleCols(pb*l, pb)*v.segment(this->sys.X.n + pb*l, pb);
+
+    if (r < m) {
+      // inv(D - Ws'*Ws) = inv(D) + inv(D)*Ws'*inv(S)*Ws*inv(D), with S = I - Ws*inv(D)*Ws'
+      MatrixXd Y(r, m);
+      for (int l = 0; l < nb; ++l)
+        Y.middleCols(pb*l, pb) = Ws.middleCols(pb*l, pb)*Di.middleCols(pb*l, pb);
+      MatrixXd S = MatrixXd::Identity(r, r);
+      S.noalias() -= Y*Ws.transpose();
+      LLT<MatrixXd> llt(S);
+      if (llt.info() != Eigen::Success)
+        return false;
+      dp = -(y + Y.transpose()*llt.solve(Ws*y));
+    } else {
+      // more low-rank terms than parameters: solve densely
+      MatrixXd Ppp = -Ws.transpose()*Ws;
+      for (int l = 0; l < nb; ++l)
+        Ppp.block(pb*l, pb*l, pb, pb) += Dp.middleCols(pb*l, pb) + nu*Ib;
+      LLT<MatrixXd> llt(Ppp);
+      if (llt.info() != Eigen::Success)
+        return false;
+      dp = -llt.solve(v.tail(m));
+    }
+    return true;
+  }
+
+  
   template <int n = Dynamic, int c = Dynamic> 
     Matrix<double, n, c> sym(const Matrix<double, n, c> &A) { return A+A.transpose(); };
   
@@ -496,12 +683,20 @@ namespace gcop {
     Vectormd bp = v.tail(m);
 
     while (1) {
-      Matrixmd Apm = P.block(n,n,m,m);
-      Apm.diagonal() = Apm.diagonal().array() + nu;
+      bool pd;
+      if (pb) {
+        pd = SolveSparse(nu);
+      } else {
+        Matrixmd Apm = P.block(n,n,m,m);
+        Apm.diagonal() = Apm.diagonal().array() + nu;
       
-      llt.compute(Apm);
+        llt.compute(Apm);
+        pd = (llt.info() == Eigen::Success);
+        if (pd)
+          dp = -llt.solve(bp);
+      }
       // if OK, then reduce mu and break
-      if (llt.info() == Eigen::Success) {
+      if (pd) {
         dnu = min(1/this->dnu0, dnu/this->dnu0);
         if (nu*dnu > this->nu0)
           nu *= dnu;
@@ -519,8 +714,6 @@ namespace gcop {
       }
     }
 
-    dp = -llt.solve(bp);
-
     // measured change in V
     double dVm = 1;      
 
@@ -552,8 +745,6 @@ namespace gcop {
         assert(!std::isnan(dxa[0]));        
         assert(!std::isnan(a));        
 
-        cout << this->kus[k] << " " << Kuxs[k] << " " << dxa << endl;
-
         du = a*this->kus[k] + Kuxs[k]*dxa;
         assert(!std::isnan(du[0]));
         un = u + du;
@@ -0,0 +1,651 @@
+#include "posegraph2disam.h"
+#include "se2.h"
+#include <iostream>
+#include <algorithm>
+#include <set>
+
+using namespace gcop;
+using namespace Eigen;
+using namespace std;
+
+Posegraph2dIsam::Posegraph2dIsam(double cp) :
+  cp(cp), cprior(1e-6, 1e-6, 1e-6), relinTol(.01), wildfireTol(1e-4),
+  neliminated(0), nrelinearized(0), npos(0), stamp(0)
+{
+}
+
+int Posegraph2dIsam::AddVariable(int dim)
+{
+  int i = vars.size();
+  vars.push_back(Variable());
+  Variable &v = vars.back();
+  v.dim = dim;
+  v.g.setIdentity();
+  v.p.setZero();
+  v.delta.setZero();
+  v.clique = -1;
+  v.pos = -1;
+  v.mark = -1;
+  v.solved = -1;
+  v.change = 0;
+  newVars.push_back(i);
+  return i;
+}
+
+void Posegraph2dIsam::AddPose(int k, const Matrix3d &g)
+{
+  if (k >= poses.size())
+    poses.resize(k + 1, -1);
+  assert(poses[k] < 0);
+  poses[k] = AddVariable(3);
+  vars[poses[k]].g = g;
+}
+
+void Posegraph2dIsam::AddFeature(int l, const Vector2d &p)
+{
+  if (l >= features.size())
+    features.resize(l + 1, -1);
+  assert(features[l] < 0);
+  features[l] = AddVariable(2);
+  vars[features[l]].p = p;
+}
+
+void Posegraph2dIsam::AddFactor(const Factor &f)
+{
+  int i = factors.size();
+  vars[f.a].factors.push_back(i);
+  if (f.b >= 0)
+    vars[f.b].factors.push_back(i);
+  factors.push_back(f);
+  newFactors.push_back(i);
+}
+
+void Posegraph2dIsam::AddPrior(int k, const Matrix3d &g, const Vector3d &c)
+{
+  Factor f;
+  f.type = PRIOR;
+  f.a = poses[k];
+  f.b = -1;
+  f.m = g;
+  f.w = c.cwiseSqrt().cwiseInverse();
+  AddFactor(f);
+}
+
+void Posegraph2dIsam::AddOdometry(int ka, int kb, const Matrix3d &m, const Vector3d &c)
+{
+  Factor f;
+  f.type = ODOMETRY;
+  f.a = poses[ka];
+  f.b = poses[kb];
+  f.m = m;
+  f.w = c.cwiseSqrt().cwiseInverse();
+  AddFactor(f);
+}
+
+void Posegraph2dIsam::AddObservation(int k, int l, const Vector2d &z)
+{
+  Factor f;
+  f.type = OBSERVATION;
+  f.a = poses[k];
+  f.b = features[l];
+  f.z = z;
+  f.w.setConstant(1/sqrt(cp));
+  AddFactor(f);
+}
+
+int Posegraph2dIsam::Linearize(Matrix3d &Ja, Matrix3d &Jb, Vector3d &e, const Factor &f) const
+{
+  SE2 &se2 = SE2::Instance();
+  // linearize at the linearization points (the solution is delta from them)
+  const Matrix3d &ga = vars[f.a].g;
+  Matrix3d gi;
+  Vector3d v;
+
+  if (f.type == PRIOR) {
+    // e = log(m^-1*ga), de/dxia ~ I
+    se2.inv(gi, f.m);
+    se2.log(v, gi*ga);
+    e = f.w.cwiseProduct(v);
+    Ja = f.w.asDiagonal();
+    return 3;
+  }
+
+  const Variable &b = vars[f.b];
+
+  if (f.type == ODOMETRY) {
+    // e = log(m^-1*ga^-1*gb), de/dxia ~ -Ad(gb^-1*ga), de/dxib ~ I
+    const Matrix3d &gb = b.g;
+    Matrix3d gai, gbi, A;
+    se2.inv(gi, f.m);
+    se2.inv(gai, ga);
+    se2.log(v, gi*gai*gb);
+    se2.inv(gbi, gb);
+    se2.Ad(A, gbi*ga);
+    e = f.w.cwiseProduct(v);
+    Ja = -(f.w.asDiagonal()*A);
+    Jb = f.w.asDiagonal();
+    return 3;
+  }
+
+  // e = R'*(p - x) - z
+  const Matrix2d &R = ga.topLeftCorner<2,2>();
+  Vector2d q = R.transpose()*(b.p - ga.block<2,1>(0,2));
+  double w = f.w[0];
+  e.head<2>() = w*(q - f.z);
+  Ja(0,0) = w*q[1]; Ja(0,1) = -w; Ja(0,2) = 0;
+  Ja(1,0) = -w*q[0]; Ja(1,1) = 0; Ja(1,2) = -w;
+  Jb.topLeftCorner<2,2>() = w*R.transpose();
+  return 2;
+}
+
+void Posegraph2dIsam::Relinearize(int i)
+{
+  Variable &v = vars[i];
+  if (v.dim == 3) {
+    Matrix3d dg;
+    SE2::Instance().exp(dg, v.delta);
+    v.g = v.g*dg;
+  } else {
+    v.p += v.delta.head<2>();
+  }
+  v.delta.setZero();
+}
+
+int Posegraph2dIsam::NewClique()
+{
+  int c;
+  if (freeCliques.size()) {
+    c = freeCliques.back();
+    freeCliques.pop_back();
+  } else {
+    c = cliques.size();
+    cliques.push_back(Clique());
+  }
+  Clique &cl = cliques[c];
+  cl.frontals.clear();
+  cl.children.clear();
+  cl.parent = -1;
+  cl.marked = false;
+  return c;
+}
+
+void Posegraph2dIsam::MarkUp(int c, vector<int> &removed)
+{
+  for (; c >= 0 && !cliques[c].marked; c = cliques[c].parent) {
+    cliques[c].marked = true;
+    removed.push_back(c);
+  }
+}
+
+void Posegraph2dIsam::MarkDown(int i, int c, vector<int> &removed)
+{
+  // by the running intersection property only the subtrees whose root has
+  // i in its separator involve i
+  const vector<int> &children = cliques[c].children;
+  for (int j = 0; j < children.size(); ++j) {
+    Clique &cl = cliques[children[j]];
+    const vector<int> &sep = vars[cl.frontals.back()].parents;
+    if (find(sep.begin(), sep.end(), i) == sep.end())
+      continue;
+    if (!cl.marked) {
+      cl.marked = true;
+      removed.push_back(children[j]);
+    }
+    MarkDown(i, children[j], removed);
+  }
+}
+
+void Posegraph2dIsam::Order(vector<int> &order, const vector<int> &vs,
+                            const vector<char> &last, const vector<int> &orphans)
+{
+  int n = vs.size();
+
+  // graph of the variables to eliminate: their factors and the
+  // information passed on by the subtrees that are kept
+  vector< set<int> > adj(n);
+  for (int j = 0; j < n; ++j) {
+    const vector<int> &fs = vars[vs[j]].factors;
+    for (int s = 0; s < fs.size(); ++s) {
+      const Factor &f = factors[fs[s]];
+      int o = (f.a == vs[j]) ? f.b : f.a;
+      if (o >= 0 && vars[o].mark == stamp)
+        adj[j].insert(index[o]);
+    }
+  }
+  for (int j = 0; j < orphans.size(); ++j) {
+    const vector<int> &sep = vars[cliques[orphans[j]].frontals.back()].parents;
+    for (int s = 0; s < sep.size(); ++s)
+      for (int t = 0; t < sep.size(); ++t)
+        if (s != t)
+          adj[index[sep[s]]].insert(index[sep[t]]);
+  }
+
+  // greedy minimum degree, with the variables of the new factors last
+  // (ties are broken in favor of older variables)
+  vector<char> done(n, 0);
+  int nfirst = 0;
+  for (int j = 0; j < n; ++j)
+    nfirst += !last[j];
+
+  order.clear();
+  for (int it = 0; it < n; ++it) {
+    int best = -1;
+    for (int j = 0; j < n; ++j) {
+      if (done[j] || (nfirst > 0 && last[j]))
+        continue;
+      if (best < 0 || adj[j].size() < adj[best].size())
+        best = j;
+    }
+    const set<int> &nb = adj[best];
+    for (set<int>::const_iterator a = nb.begin(); a != nb.end(); ++a) {
+      adj[*a].erase(best);
+      for (set<int>::const_iterator b = nb.begin(); b != nb.end(); ++b)
+        if (*a != *b)
+          adj[*a].insert(*b);
+    }
+    adj[best].clear();
+    done[best] = 1;
+    nfirst -= !last[best];
+    order.push_back(vs[best]);
+  }
+}
+
+void Posegraph2dIsam::Eliminate(int i)
+{
+  Variable &v = vars[i];
+
+  // this variable followed by all variables connected to it (all of which
+  // are eliminated later)
+  vector< pair<int, int> > ps(1, make_pair(v.pos, i));
+  for (int j = 0; j < v.pfactors.size(); ++j) {
+    const Factor &f = factors[v.pfactors[j]];
+    ps.push_back(make_pair(vars[f.a].pos, f.a));
+    if (f.b >= 0)
+      ps.push_back(make_pair(vars[f.b].pos, f.b));
+  }
+  for (int j = 0; j < v.pmessages.size(); ++j) {
+    const vector<int> &parents = vars[v.pmessages[j]].parents;
+    for (int s = 0; s < parents.size(); ++s)
+      ps.push_back(make_pair(vars[parents[s]].pos, parents[s]));
+  }
+  sort(ps.begin(), ps.end());
+  ps.erase(unique(ps.begin(), ps.end()), ps.end());
+
+  vector<int> keys(ps.size());
+  int n = 0;
+  for (int j = 0; j < ps.size(); ++j) {
+    keys[j] = ps[j].second;
+    offsets[keys[j]] = n;
+    n += vars[keys[j]].dim;
+  }
+
+  // Gauss-Newton system H*delta = g on the clique
+  MatrixXd H = MatrixXd::Zero(n, n);
+  VectorXd g = VectorXd::Zero(n);
+
+  Matrix3d Ja, Jb;
+  Vector3d e;
+  for (int j = 0; j < v.pfactors.size(); ++j) {
+    const Factor &f = factors[v.pfactors[j]];
+    int r = Linearize(Ja, Jb, e, f);
+    int oa = offsets[f.a], da = vars[f.a].dim;
+    const Block<Matrix3d> A = Ja.topLeftCorner(r, da);
+    H.block(oa, oa, da, da) += A.transpose()*A;
+    g.segment(oa, da) -= A.transpose()*e.head(r);
+    if (f.b >= 0) {
+      int ob = offsets[f.b], db = vars[f.b].dim;
+      const Block<Matrix3d> B = Jb.topLeftCorner(r, db);
+      H.block(ob, ob, db, db) += B.transpose()*B;
+      H.block(oa, ob, da, db) += A.transpose()*B;
+      H.block(ob, oa, db, da) += B.transpose()*A;
+      g.segment(ob, db) -= B.transpose()*e.head(r);
+    }
+  }
+
+  for (int j = 0; j < v.pmessages.size(); ++j) {
+    const Variable &c = vars[v.pmessages[j]];
+    int oj = 0;
+    for (int s = 0; s < c.parents.size(); ++s) {
+      int ds = vars[c.parents[s]].dim;
+      int os = offsets[c.parents[s]];
+      int ot = 0;
+      for (int t = 0; t < c.parents.size(); ++t) {
+        int dt = vars[c.parents[t]].dim;
+        H.block(os, offsets[c.parents[t]], ds, dt) += c.H.block(oj, ot, ds, dt);
+        ot += dt;
+      }
+      g.segment(os, ds) += c.b.segment(oj, ds);
+      oj += ds;
+    }
+  }
+
+  // conditional on the parents and information passed on to them
+  int di = v.dim;
+  int dp = n - di;
+  LLT<MatrixXd> llt(H.topLeftCorner(di, di));
+  if (llt.info() != Success) {
+    cout << "[W] Posegraph2dIsam::Eliminate: variable " << i << " is not constrained" << endl;
+    llt.compute(H.topLeftCorner(di, di) + 1e-9*MatrixXd::Identity(di, di));
+  }
+  v.R = llt.matrixU();
+  v.S = llt.matrixL().solve(H.topRightCorner(di, dp));
+  v.d = llt.matrixL().solve(g.head(di));
+  v.H = H.bottomRightCorner(dp, dp) - v.S.transpose()*v.S;
+  v.b = g.tail(dp) - v.S.transpose()*v.d;
+  v.parents.assign(keys.begin() + 1, keys.end());
+
+  // the first parent is eliminated next among them
+  if (v.parents.size())
+    vars[v.parents[0]].pmessages.push_back(i);
+}
+
+void Posegraph2dIsam::Solve(int i)
+{
+  Variable &v = vars[i];
+  VectorXd r = v.d;
+  int o = 0;
+  for (int j = 0; j < v.parents.size(); ++j) {
+    const Variable &p = vars[v.parents[j]];
+    r -= v.S.middleCols(o, p.dim)*p.delta.head(p.dim);
+    o += p.dim;
+  }
+  VectorXd delta = v.R.triangularView<Upper>().solve(r);
+  v.change = (delta - v.delta.head(v.dim)).lpNorm<Infinity>();
+  v.delta.head(v.dim) = delta;
+  v.solved = stamp;
+  touched.push_back(i);
+}
+
+void Posegraph2dIsam::Backsubstitute(int c, bool force)
+{
+  const Clique &cl = cliques[c];
+  if (!force) {
+    // wildfire: skip the subtree if its separator did not change
+    const vector<int> &sep = vars[cl.frontals.back()].parents;
+    bool changed = false;
+    for (int j = 0; j < sep.size() && !changed; ++j) {
+      const Variable &s = vars[sep[j]];
+      changed = (s.solved == stamp && s.change > wildfireTol);
+    }
+    if (!changed)
+      return;
+  }
+  for (int j = cl.frontals.size() - 1; j >= 0; --j)
+    Solve(cl.frontals[j]);
+  for (int j = 0; j < cl.children.size(); ++j)
+    Backsubstitute(cl.children[j], false);
+}
+
+void Posegraph2dIsam::Update(vector<int> &vs, const vector<int> &orphans)
+{
+  int n = vs.size();
+  neliminated = n;
+  sort(vs.begin(), vs.end());
+
+  ++stamp;
+  index.resize(vars.size());
+  offsets.resize(vars.size());
+  for (int j = 0; j < n; ++j) {
+    vars[vs[j]].mark = stamp;
+    index[vs[j]] = j;
+  }
+
+  // variables of the new factors and new variables are eliminated last so
+  // that the next update only needs to remove the top of the tree
+  vector<char> last(n, 0);
+  for (int j = 0; j < newFactors.size(); ++j) {
+    const Factor &f = factors[newFactors[j]];
+    last[index[f.a]] = 1;
+    if (f.b >= 0)
+      last[index[f.b]] = 1;
+  }
+  for (int j = 0; j < newVars.size(); ++j)
+    last[index[newVars[j]]] = 1;
+
+  vector<int> order;
+  Order(order, vs, last, orphans);
+
+  for (int j = 0; j < n; ++j) {
+    Variable &v = vars[order[j]];
+    v.pos = npos++;
+    v.pfactors.clear();
+    v.pmessages.clear();
+    v.clique = -1;
+  }
+
+  // each factor among the variables to eliminate goes to the first of its
+  // variables (the others are summarized by the subtrees that are kept),
+  // and the information from each kept subtree to the first of its separator
+  for (int j = 0; j < n; ++j) {
+    const vector<int> &fs = vars[vs[j]].factors;
+    for (int s = 0; s < fs.size(); ++s) {
+      const Factor &f = factors[fs[s]];
+      if (f.b < 0)
+        vars[f.a].pfactors.push_back(fs[s]);
+      else if (f.a == vs[j] && vars[f.b].mark == stamp)
+        vars[vars[f.a].pos < vars[f.b].pos ? f.a : f.b].pfactors.push_back(fs[s]);
+    }
+  }
+  for (int j = 0; j < orphans.size(); ++j) {
+    int i = cliques[orphans[j]].frontals.back();
+    const vector<int> &sep = vars[i].parents;
+    int p = sep[0];
+    for (int s = 1; s < sep.size(); ++s)
+      if (vars[sep[s]].pos < vars[p].pos)
+        p = sep[s];
+    vars[p].pmessages.push_back(i);
+  }
+
+  for (int j = 0; j < n; ++j)
+    Eliminate(order[j]);
+
+  // assemble the cliques from the last eliminated variable: a variable
+  // joins the clique of its first parent if its conditional involves
+  // exactly the variables of that clique
+  vector<int> roots;
+  for (int j = n - 1; j >= 0; --j) {
+    Variable &v = vars[order[j]];
+    if (v.parents.empty()) {
+      v.clique = NewClique();
+      cliques[v.clique].frontals.push_back(order[j]);
+      roots.push_back(v.clique);
+      continue;
+    }
+    int c = vars[v.parents[0]].clique;
+    Clique &cl = cliques[c];
+    if (cl.frontals[0] == v.parents[0] &&
+        v.parents.size() == cl.frontals.size() + vars[cl.frontals.back()].parents.size()) {
+      cl.frontals.insert(cl.frontals.begin(), order[j]);
+      v.clique = c;
+    } else {
+      v.clique = NewClique();
+      cliques[v.clique].frontals.push_back(order[j]);
+      cliques[v.clique].parent = c;
+      cliques[c].children.push_back(v.clique);
+    }
+  }
+
+  // reattach the kept subtrees below the first variable of their separator
+  for (int j = 0; j < orphans.size(); ++j) {
+    const vector<int> &sep = vars[cliques[orphans[j]].frontals.back()].parents;
+    int p = sep[0];
+    for (int s = 1; s < sep.size(); ++s)
+      if (vars[sep[s]].pos < vars[p].pos)
+        p = sep[s];
+    cliques[orphans[j]].parent = vars[p].clique;
+    cliques[vars[p].clique].children.push_back(orphans[j]);
+  }
+
+  // back-substitution, continuing into the kept subtrees only while their
+  // separators change
+  for (int j = 0; j < roots.size(); ++j)
+    Backsubstitute(roots[j], true);
+}
+
+void Posegraph2dIsam::Update()
+{
+  // fluid relinearization: only variables solved for since the last check can have moved
+  nrelinearized = 0;
+  sort(touched.begin(), touched.end());
+  touched.erase(unique(touched.begin(), touched.end()), touched.end());
+  vector<int> relin;
+  for (int j = 0; j < touched.size(); ++j) {
+    int i = touched[j];
+    if (vars[i].delta.lpNorm<Infinity>() > relinTol) {
+      Relinearize(i);
+      relin.push_back(i);
+    }
+  }
+  touched.clear();
+  nrelinearized = relin.size();
+
+  // remove the top of the tree involving the new factors and the
+  // relinearized variables
+  vector<int> removed;
+  for (int j = 0; j < newFactors.size(); ++j) {
+    const Factor &f = factors[newFactors[j]];
+    MarkUp(vars[f.a].clique, removed);
+    if (f.b >= 0)
+      MarkUp(vars[f.b].clique, removed);
+  }
+  for (int j = 0; j < relin.size(); ++j) {
+    int c = vars[relin[j]].clique;
+    MarkUp(c, removed);
+    MarkDown(relin[j], c, removed);
+  }
+
+  vector<int> vs(newVars), orphans;
+  for (int j = 0; j < removed.size(); ++j) {
+    const Clique &cl = cliques[removed[j]];
+    vs.insert(vs.end(), cl.frontals.begin(), cl.frontals.end());
+    for (int s = 0; s < cl.children.size(); ++s)
+      if (!cliques[cl.children[s]].marked)
+        orphans.push_back(cl.children[s]);
+  }
+  for (int j = 0; j < removed.size(); ++j) {
+    cliques[removed[j]].marked = false;
+    freeCliques.push_back(removed[j]);
+  }
+
+  neliminated = 0;
+  if (vs.size())
+    Update(vs, orphans);
+  newFactors.clear();
+  newVars.clear();
+}
+
+int Posegraph2dIsam::Batch(int iters, double eps)
+{
+  touched.clear();
+  newFactors.clear();
+  newVars.clear();
+  vector<int> vs, orphans;
+  for (int it = 0; it < iters; ++it) {
+    for (int i = 0; i < vars.size(); ++i)
+      Relinearize(i);
+    cliques.clear();
+    freeCliques.clear();
+    vs.resize(vars.size());
+    for (int i = 0; i < vars.size(); ++i)
+      vs[i] = i;
+    Update(vs, orphans);
+
+    double dmax = 0;
+    for (int i = 0; i < vars.size(); ++i)
+      dmax = max(dmax, vars[i].delta.lpNorm<Infinity>());
+    if (dmax < eps)
+      return it + 1;
+  }
+  return iters;
+}
+
+void Posegraph2dIsam::GetPose(Matrix3d &g, int k) const
+{
+  const Variable &v = vars[poses[k]];
+  Matrix3d dg;
+  SE2::Instance().exp(dg, v.delta);
+  g = v.g*dg;
+}
+
+bool Posegraph2dIsam::GetFeature(Vector2d &p, int l) const
+{
+  if (l >= features.size() || features[l] < 0)
+    return false;
+  const Variable &v = vars[features[l]];
+  p = v.p + v.delta.head<2>();
+  return true;
+}
+
+void Posegraph2dIsam::AddObservations(int k, const Matrix3d &g, const vector< pair<int, Vector2d> > &I)
+{
+  const Matrix2d &R = g.topLeftCorner<2,2>();
+  const Vector2d &x = g.block<2,1>(0,2);
+  for (int j = 0; j < I.size(); ++j) {
+    int l = I[j].first;
+    const Vector2d &z = I[j].second;
+    if (l >= features.size() || features[l] < 0)
+      AddFeature(l, x + R*z);
+    AddObservation(k, l, z);
+  }
+}
+
+void Posegraph2dIsam::Add(const Posegraph2d &pg, int k, const Vector3d &co)
+{
+  cp = pg.cp;
+  Matrix3d g;
+  if (k == 0) {
+    g = pg.gs[0];
+    AddPose(0, g);
+    AddPrior(0, g, cprior);
+  } else {
+    Matrix3d m, ga;
+    SE2::Instance().cay(m, (pg.ts[k] - pg.ts[k-1])*pg.us[k-1]);
+    GetPose(ga, k-1);
+    g = ga*m;
+    AddPose(k, g);
+    AddOdometry(k-1, k, m, co);
+  }
+  AddObservations(k, g, pg.Is[k]);
+}
+
+void Posegraph2dIsam::Add(const Body2dGraph &pg, int k)
+{
+  cp = pg.cp;
+  Matrix3d g;
+  if (k == 0) {
+    g = pg.xs[0].first;
+    AddPose(0, g);
+    AddPrior(0, g, cprior);
+  } else {
+    double h = pg.ts[k] - pg.ts[k-1];
+    Matrix3d m, ga;
+    SE2::Instance().cay(m, h*(pg.odometry ? pg.vs[k] : pg.xs[k].second));
+    GetPose(ga, k-1);
+    g = ga*m;
+    AddPose(k, g);
+    AddOdometry(k-1, k, m, h*h*pg.cv);
+  }
+  AddObservations(k, g, pg.Is[k]);
+}
+
+void Posegraph2dIsam::Get(Posegraph2d &pg) const
+{
+  for (int k = 0; k < poses.size() && k < pg.gs.size(); ++k)
+    if (poses[k] >= 0)
+      GetPose(pg.gs[k], k);
+  Vector2d p;
+  for (int l = 0; 2*l < pg.p.size(); ++l)
+    if (GetFeature(p, l))
+      pg.p.segment<2>(2*l) = p;
+}
+
+void Posegraph2dIsam::Get(Body2dGraph &pg) const
+{
+  for (int k = 0; k < poses.size() && k < pg.xs.size(); ++k)
+    if (poses[k] >= 0)
+      GetPose(pg.xs[k].first, k);
+  Vector2d p;
+  for (int l = 0; 2*pg.extforce + 2*l < pg.p.size(); ++l)
+    if (GetFeature(p, l))
+      pg.p.segment<2>(2*pg.extforce + 2*l) = p;
+}
@@ -0,0 +1,272 @@
+#ifndef GCOP_POSEGRAPH2DISAM_H
+#define GCOP_POSEGRAPH2DISAM_H
+
+#include <Eigen/Dense>
+#include <vector>
+#include "posegraph2d.h"
+#include "body2dgraph.h"
+
+namespace gcop {
+
+  using namespace std;
+  using namespace Eigen;
+
+  /**
+   * Incremental smoothing of 2d pose graphs with point features (iSAM2,
+   * Kaess et al, "iSAM2: Incremental Smoothing and Mapping Using the Bayes
+   * Tree", 2012).
+   *
+   * The square-root information matrix is kept as a Bayes tree: each clique
+   * holds the conditionals of its frontal variables given its separator,
+   * together with the information it passes on to its parent. New factors
+   * and variables that moved more than relinTol from their linearization
+   * point (fluid relinearization) only remove the cliques on their path to
+   * the root (and, for relinearized variables, the cliques below that
+   * involve them). The removed variables are ordered again by greedy
+   * minimum degree, with the variables of the new factors last, and
+   * eliminated together with the cached information of the subtrees that
+   * are kept. Back-substitution only continues into subtrees whose
+   * separator changed by more than wildfireTol. When exploring, the removed
+   * part stays a short window at the end of the trajectory and adding a
+   * pose with its observations takes roughly constant time.
+   *
+   * Batch runs full Gauss-Newton iterations on the same graph (ordered by
+   * minimum degree without constraints) and is the accuracy reference.
+   */
+  class Posegraph2dIsam {
+  public:
+
+    /**
+     * Incremental smoother
+     * @param cp noise covariance of feature observations (assume spherical)
+     */
+    Posegraph2dIsam(double cp = .01);
+
+    /**
+     * Add a pose
+     * @param k pose index
+     * @param g initial pose estimate
+     */
+    void AddPose(int k, const Matrix3d &g);
+
+    /**
+     * Add a feature
+     * @param l feature index
+     * @param p initial feature position estimate
+     */
+    void AddFeature(int l, const Vector2d &p);
+
+    /**
+     * Add a prior on a pose
+     * @param k pose index
+     * @param g prior pose
+     * @param c prior covariance (diagonal, in the pose frame)
+     */
+    void AddPrior(int k, const Matrix3d &g, const Vector3d &c);
+
+    /**
+     * Add a relative pose measurement
+     * @param ka first pose index
+     * @param kb second pose index
+     * @param m measured relative pose gb = ga*m
+     * @param c measurement covariance (diagonal)
+     */
+    void AddOdometry(int ka, int kb, const Matrix3d &m, const Vector3d &c);
+
+    /**
+     * Add a feature observation (with covariance cp)
+     * @param k pose index
+     * @param l feature index
+     * @param z measured feature position in the pose frame
+     */
+    void AddObservation(int k, int l, const Vector2d &z);
+
+    /**
+     * Incorporate the variables and measurements added since the last
+     * update, relinearize variables that moved more than relinTol and
+     * update the estimate
+     */
+    void Update();
+
+    /**
+     * Full batch Gauss-Newton, relinearizing and eliminating all variables
+     * @param iters maximum number of iterations
+     * @param eps stop when no variable moves more than eps
+     * @return number of iterations
+     */
+    int Batch(int iters = 10, double eps = 1e-6);
+
+    /**
+     * @param g estimated pose
+     * @param k pose index
+     */
+    void GetPose(Matrix3d &g, int k) const;
+
+    /**
+     * @param p estimated feature position
+     * @param l feature index
+     * @return false if the feature has not been added
+     */
+    bool GetFeature(Vector2d &p, int l) const;
+
+    /**
+     * Add pose k of a pose graph, its odometry from pose k-1 and its
+     * feature observations. Pose 0 is fixed by a prior. Other poses are
+     * initialized from the current estimate of the previous pose and
+     * features from their first observation. Poses must be added in order.
+     * @param pg pose graph
+     * @param k pose index
+     * @param co covariance of the relative motion between consecutive poses (diagonal)
+     */
+    void Add(const Posegraph2d &pg, int k, const Vector3d &co);
+
+    /**
+     * Same for the graph used by Body2dSlam. The relative motion between
+     * consecutive poses is obtained from the odometry velocity measurements
+     * (or from the velocities of the graph states if there is no odometry).
+     * @param pg pose graph
+     * @param k pose index
+     */
+    void Add(const Body2dGraph &pg, int k);
+
+    /**
+     * Copy the estimated poses and features to a pose graph
+     * @param pg pose graph
+     */
+    void Get(Posegraph2d &pg) const;
+
+    /**
+     * Copy the estimated poses and features to a pose graph (the
+     * velocities and external force are left unchanged)
+     * @param pg pose graph
+     */
+    void Get(Body2dGraph &pg) const;
+
+    double cp;             ///< noise covariance of feature observations (assume spherical)
+
+    Vector3d cprior;       ///< covariance of the prior on the first pose added using Add
+
+    double relinTol;       ///< relinearize variables that moved more than this
+
+    double wildfireTol;    ///< stop back-substitution for changes smaller than this
+
+    int neliminated;       ///< number of variables eliminated in the last update
+
+    int nrelinearized;     ///< number of variables relinearized in the last update
+
+  protected:
+
+    enum { PRIOR, ODOMETRY, OBSERVATION };
+
+    struct Factor {
+      int type;            ///< PRIOR, ODOMETRY or OBSERVATION
+      int a;               ///< first variable
+      int b;               ///< second variable (-1 for priors)
+      Matrix3d m;          ///< measured pose or relative pose
+      Vector2d z;          ///< measured feature position in the pose frame
+      Vector3d w;          ///< residual weights (inverse stdev)
+    };
+
+    struct Variable {
+      int dim;             ///< 3 for poses, 2 for features
+      Matrix3d g;          ///< linearization point of a pose
+      Vector2d p;          ///< linearization point of a feature
+      Vector3d delta;      ///< current update from the linearization point
+      vector<int> factors; ///< factors involving this variable
+
+      int clique;          ///< clique in which this is a frontal variable (-1 if not eliminated)
+      int pos;             ///< position in the elimination order
+      vector<int> parents; ///< variables in the conditional (in elimination order)
+      MatrixXd R;          ///< conditional R*delta + S*delta_parents = d
+      MatrixXd S;
+      VectorXd d;
+      MatrixXd H;          ///< information passed on to the parents: H*delta_parents = b
+      VectorXd b;
+
+      vector<int> pfactors;  ///< factors to eliminate with this variable
+      vector<int> pmessages; ///< variables whose passed-on information is eliminated with this one
+      int mark;            ///< update in which this variable was eliminated
+      int solved;          ///< update in which this variable was last solved for
+      double change;       ///< change of delta when it was last solved for
+    };
+
+    struct Clique {
+      vector<int> frontals;///< frontal variables (in elimination order)
+      int parent;          ///< parent clique (-1 for a root)
+      vector<int> children;///< child cliques
+      bool marked;         ///< to be removed in the current update
+    };
+
+    int AddVariable(int dim);
+
+    void AddFactor(const Factor &f);
+
+    /**
+     * Whitened residual e and its Jacobians with respect to the variables of factor f
+     * @return number of residuals
+     */
+    int Linearize(Matrix3d &Ja, Matrix3d &Jb, Vector3d &e, const Factor &f) const;
+
+    void Relinearize(int i);
+
+    int NewClique();
+
+    /**
+     * Mark clique c and its ancestors for removal
+     */
+    void MarkUp(int c, vector<int> &removed);
+
+    /**
+     * Mark the cliques below c involving variable i for removal
+     */
+    void MarkDown(int i, int c, vector<int> &removed);
+
+    /**
+     * Minimum degree elimination order of variables vs, with the variables
+     * flagged last eliminated at the end
+     * @param order elimination order
+     * @param vs variables to eliminate (sorted)
+     * @param last flags for vs
+     * @param orphans kept subtrees whose separators are among vs
+     */
+    void Order(vector<int> &order, const vector<int> &vs,
+               const vector<char> &last, const vector<int> &orphans);
+
+    void Eliminate(int i);
+
+    void Solve(int i);
+
+    /**
+     * Back-substitution in the subtree of clique c
+     * @param c clique
+     * @param force solve even if the separator did not change
+     */
+    void Backsubstitute(int c, bool force);
+
+    /**
+     * Eliminate variables vs, rebuild the top of the tree, reattach the
+     * kept subtrees and solve
+     */
+    void Update(vector<int> &vs, const vector<int> &orphans);
+
+    void AddObservations(int k, const Matrix3d &g, const vector< pair<int, Vector2d> > &I);
+
+    vector<Variable> vars; ///< variables
+    vector<Factor> factors;///< factors
+    vector<Clique> cliques;///< cliques of the Bayes tree
+    vector<int> freeCliques; ///< removed cliques to reuse
+
+    vector<int> poses;     ///< variable of each pose (-1 if not added)
+    vector<int> features;  ///< variable of each feature (-1 if not added)
+
+    vector<int> newVars;   ///< variables added since the last update
+    vector<int> newFactors;///< factors added since the last update
+    vector<int> touched;   ///< variables solved for since the last relinearization check
+    int npos;              ///< next position in the elimination order
+    int stamp;             ///< current update
+    vector<int> index;     ///< index of each variable among those eliminated
+    vector<int> offsets;   ///< offset of each variable in the current clique
+  };
+}
+
+#endif
@@ -15,6 +15,7 @@ Bulletrccar::Bulletrccar(BulletWorld&		m_world_, vector<double> *zs_) :
   ,m_defaultContactProcessingThreshold(1e5)
   , gain_cmdvelocity(1), kp_torque(25), kp_steer(0.1), initialz(0.15)
   ,m_world(m_world_), zs(zs_), reset_drivevel(false), initialstate(0)
+  ,snapshotreset(false), resetsnapshotvalid(false)
 {
 //,rightIndex(0),upIndex(1),forwardIndex(2)
   if(!m_world.IsZupAxis())
@@ -313,6 +314,7 @@ double Bulletrccar::Step(Vector4d &xb, const Vector2d &u,
 //Finds the closest car pose corresponding to the given pose
 void Bulletrccar::setinitialstate(const Bulletrccar::CarState &inputstate, Vector4d &x)
 {
+  resetsnapshotvalid = false;
   if(!initialstate)
     initialstate = new Bulletrccar::CarState;
   //Copy initialstate to inputstate:
@@ -384,6 +386,7 @@ void Bulletrccar::setinitialstate(const Bulletrccar::CarState &inputstate, Vecto
 }
 void Bulletrccar::setinitialstate(Vector4d &x)
 {
+  resetsnapshotvalid = false;
   if(!initialstate)
     initialstate = new Bulletrccar::CarState;
   initialstate->cartransform = m_carChassis->getWorldTransform();
@@ -422,8 +425,11 @@ void Bulletrccar::setinitialstate(Vector4d &x)
 
 bool Bulletrccar::Reset(const Vector4d &x, double t)
 {
-  if(m_world.m_dynamicsWorld)
+  bool restored = m_world.m_dynamicsWorld && snapshotreset && resetsnapshotvalid && resetx == x && Restore(resetsnapshot);
+  if(!restored && m_world.m_dynamicsWorld)
   {
+    //Full reset, also when the snapshot could not be restored
+    resetsnapshotvalid = false;
     gVehicleSteering = 0;
     gEngineForce = 0;
     gBreakingForce = 0;
@@ -580,6 +586,12 @@ bool Bulletrccar::Reset(const Vector4d &x, double t)
     //}
     //set reset_drivevel to true:
     reset_drivevel = true;
+
+    if(snapshotreset)
+    {
+      resetsnapshotvalid = Save(resetsnapshot);
+      resetx = x;
+    }
   }
   this->x = x;
   this->t = t;
@@ -590,6 +602,43 @@ bool Bulletrccar::Reset(const Vector4d &x, double t)
       (*zs)[0] = initialz;
     count_zs = 0;
   }
+  return true;
+}
+
+bool Bulletrccar::Save(Snapshot &snapshot) const
+{
+  if(!m_world.Save(snapshot.world))
+    return false;
+  snapshot.wheels.clear();
+  for(int i = 0; i < m_vehicle->getNumWheels(); i++)
+  {
+    snapshot.wheels.push_back(m_vehicle->m_wheelInfo[i]);
+  }
+  snapshot.gVehicleSteering = gVehicleSteering;
+  snapshot.gEngineForce = gEngineForce;
+  snapshot.gBreakingForce = gBreakingForce;
+  return true;
+}
+
+bool Bulletrccar::Restore(const Snapshot &snapshot)
+{
+  if(snapshot.wheels.size() != m_vehicle->getNumWheels())
+  {
+    cerr<<"[E] Bulletrccar::Restore: snapshot has "<<snapshot.wheels.size()<<" wheels instead of "<<m_vehicle->getNumWheels()<<endl;
+    return false;
+  }
+  if(!m_world.Restore(snapshot.world))
+    return false;
+  for(int i = 0; i < m_vehicle->getNumWheels(); i++)
+  {
+    m_vehicle->m_wheelInfo[i] = snapshot.wheels[i];
+  }
+  gVehicleSteering = snapshot.gVehicleSteering;
+  gEngineForce = snapshot.gEngineForce;
+  gBreakingForce = snapshot.gBreakingForce;
+  //The vehicle speed is only updated when stepping: use the chassis velocity for the first step
+  reset_drivevel = true;
+  return true;
 }
 
 bool Bulletrccar::NoiseMatrix(Matrix4d &Q, double t, const Vector4d &x, const Vector2d &u,
@@ -44,6 +44,16 @@ namespace gcop {
       btVector3 carangularvel;
     };
 
+			/** Snapshot of the car, its wheels and the world it lies in
+			 */
+    struct Snapshot{
+      BulletWorld::State world;///< State of all the rigid bodies in the world
+      btAlignedObjectArray<btWheelInfo> wheels;///< Wheel state (suspension, rotation, steering and contact info)
+      double gVehicleSteering;///< Vehicle steering angle
+      double gEngineForce;///< Engine torque
+      double gBreakingForce;///< Breaking force
+    };
+
 		/** Constructor. Each bullet system takes in a world in which it lies. 
 		 * @param m_world 		World class in which the current system lies. Only systems in one world can interact with each other
 		 * @param zs_					Vector of car heights along the trajectory used for display purposes.
@@ -91,6 +101,19 @@ namespace gcop {
 
     bool Reset(const Vector4d &x, double t = 0);
 
+		/** Save the full state of the car and of its world
+		 * @param snapshot  saved state
+		 * @return false if the world state could not be saved
+		 */
+    bool Save(Snapshot &snapshot) const;
+
+		/** Restore a state saved using Save. This is much cheaper than Reset and deterministic:
+		 * stepping from a restored state always gives the same result
+		 * @param snapshot  saved state
+		 * @return false if the world or the car do not match the snapshot
+		 */
+    bool Restore(const Snapshot &snapshot);
+
 		/** Set the intial state of the car to given full state. This overrides the reset state of the car and allows to use full state
 		*  #TODO Use full stat of the car directly
 		*/
@@ -155,6 +178,11 @@ namespace gcop {
     btVehicleRaycaster*	m_vehicleRayCaster;///< Raycaster which gives the point of contact of the vehicle wheels
     BulletWorld &m_world;//< Parent world to which the car belongs
     CarState *initialstate;///< Initialstate if passed is stored here
+
+    bool snapshotreset;///< Take a snapshot at the first Reset and restore it on later Resets to the same state instead of rebuilding the vehicle (the car parameters should not change in between)
+    Snapshot resetsnapshot;///< Snapshot restored by Reset
+    Vector4d resetx;///< State of the reset snapshot
+    bool resetsnapshotvalid;///< Whether the reset snapshot has been taken
   };
 }
 
@@ -17,6 +17,48 @@ GP::~GP()
 }
 
 
+/**
+ * Invert a lower-triangular matrix in place (recursively, so that most of
+ * the work is done in matrix products)
+ */
+static void TriInv(Ref<MatrixXd> L)
+{
+  int n = L.rows();
+  if (n <= 64) {
+    MatrixXd I = MatrixXd::Identity(n, n);
+    L.triangularView<Eigen::Lower>().solveInPlace(I);
+    L.triangularView<Eigen::Lower>() = I;
+    return;
+  }
+  int n1 = n/2, n2 = n - n1;
+  TriInv(L.topLeftCorner(n1, n1));
+  TriInv(L.bottomRightCorner(n2, n2));
+  // [A 0; B C]^{-1} = [inv(A) 0; -inv(C)*B*inv(A) inv(C)]
+  MatrixXd B = -(L.bottomRightCorner(n2, n2).triangularView<Eigen::Lower>()*L.bottomLeftCorner(n2, n1));
+  L.bottomLeftCorner(n2, n1).noalias() = B*L.topLeftCorner(n1, n1).triangularView<Eigen::Lower>();
+}
+
+
+/**
+ * Lower half of L'*L for a lower-triangular L, computed in place
+ */
+static void TriTransProd(Ref<MatrixXd> L)
+{
+  int n = L.rows();
+  if (n <= 64) {
+    MatrixXd P = L.triangularView<Eigen::Lower>().transpose()*L.triangularView<Eigen::Lower>().toDenseMatrix();
+    L.triangularView<Eigen::Lower>() = P;
+    return;
+  }
+  int n1 = n/2, n2 = n - n1;
+  // [A 0; B C]'*[A 0; B C] = [A'*A + B'*B  B'*C; C'*B  C'*C]
+  TriTransProd(L.topLeftCorner(n1, n1));
+  L.topLeftCorner(n1, n1).selfadjointView<Eigen::Lower>().rankUpdate(L.bottomLeftCorner(n2, n1).transpose());
+  L.bottomLeftCorner(n2, n1) = L.bottomRightCorner(n2, n2).triangularView<Eigen::Lower>().transpose()*L.bottomLeftCorner(n2, n1);
+  TriTransProd(L.bottomRightCorner(n2, n2));
+}
+
+
 void GP::Sample()
 {
   for (int j = 0; j < Xs.cols(); ++j) {
@@ -101,92 +143,165 @@ void GP::Train(const MatrixXd &Xs, const VectorXd &fs)
 {
   this->Xs = Xs;
   this->fs = fs;
-  K.resize(Xs.cols(), Xs.rows());
-  Ki.resize(Xs.cols(), Xs.rows());
+  K.resize(Xs.cols(), Xs.cols());
+  Ki.resize(Xs.cols(), Xs.cols());
   Train();
 }
 
 
 void GP::Train()
 {
-  //  MatrixXd K(n,n);
   n = Xs.cols();
-  
-  for (int i = 0; i < n; ++i) {
-    for (int j = 0; j < n; ++j) { 
-      if (i==j && sigma > 0)
-        K(i,j) = SqExp(Xs.col(i), Xs.col(j)) + sigma*sigma;
-      else
-        K(i,j) = SqExp(Xs.col(i), Xs.col(j));
-    }
-  }
+
+  SqExp(K, Xs, Xs);
+  if (sigma > 0)
+    K.diagonal().array() += sigma*sigma;
 
   LLT<MatrixXd> lltOfA(K); // compute the Cholesky decomposition of A
   L = lltOfA.matrixL();
 
-  //  a = L.triangularView<Eigen::Lower>().solveInPlace(f);
-
   a = lltOfA.solve(fs);
 
   if (!cf)
     Ki = K.inverse();
+}
 
-  //  MatrixXd L = trans(chol(K));
-  //  a = trans(S.L)\(S.L\S.fs);
-
-
-  // S.lp = -S.fs'*S.a - sum(log(diag(S.L))) - S.n/2*log(2*pi);
-  
-  //  a = inv(sympd(K))*fs;
 
+double GP::LogL(double dll[2])
+{
+  if (dll) {
+    Vector3d dl;
+    double ll = LogL(dl);
+    dll[0] = dl[0];
+    dll[1] = dl[1];
+    return ll;
+  }
 
-  //\  lp = -dot(fs, a) - sum(log(diag(L))) - n/2.0*log(2*M_PI);
- 
+  n = Xs.cols();
+  return -L.diagonal().array().log().sum() - fs.dot(a)/2 - n*log(2*M_PI)/2;
 }
 
 
-double GP::LogL(double dll[2])
+double GP::LogL(Vector3d &dll)
 {
-  if (dll) {
-    MatrixXd dKdl(n,n); // der wrt l
-    MatrixXd dKds(n,n); // der wrt s
-    for (int i = 0; i < n; ++i) {
-      for (int j = 0; j < n; ++j) {
-        VectorXd d = Xs.col(i) - Xs.col(j);
-        double dn = d.dot(d);
-        double se = s*s*exp(-dn/(2*l*l));
-        dKdl(i,j) = se*dn/(l*l*l);
-        dKds(i,j) = se*2/s;
-      }
-    }
+  n = Xs.cols();
 
-    dll[0] = (a*a.transpose()*dKdl - L.transpose().triangularView<Eigen::Upper>().solve(L.triangularView<Eigen::Lower>().solve(dKdl))).trace()/2;
-    
-    dll[1] = (a*a.transpose()*dKds - L.transpose().triangularView<Eigen::Upper>().solve(L.triangularView<Eigen::Lower>().solve(dKds))).trace()/2;    
+  // dlogL/dp = tr((a*a' - inv(K))*dK/dp)/2, only the lower half of
+  // W = a*a' - inv(K) is formed
+  MatrixXd W;
+  if (cf) {
+    W = L;
+    TriInv(W);
+    TriTransProd(W);
+    W = -W;
+  } else {
+    W = -Ki;
   }
-  
-  double w = 0;
-  for (int i = 0; i < n; ++i)
-    w += log(L(i,i));
-  
-  return -w - fs.dot(a) - n*log(2*M_PI)/2;
+  W.selfadjointView<Eigen::Lower>().rankUpdate(a);
+
+  MatrixXd D;
+  SqDist(D, Xs, Xs);
+
+  double s2 = (sigma > 0 ? sigma*sigma : 0);
+  double wk = 0, wkd = 0;
+#pragma omp parallel for reduction(+:wk,wkd) schedule(dynamic, 16)
+  for (int j = 0; j < n; ++j) {
+    double wkj = W(j,j)*(K(j,j) - s2), wkdj = 0;
+    for (int i = j + 1; i < n; ++i) {
+      double w = 2*W(i,j)*K(i,j);
+      wkj += w;
+      wkdj += w*D(i,j);
+    }
+    wk += wkj;
+    wkd += wkdj;
+  }
+
+  dll[0] = wkd/(2*l*l*l);
+  dll[1] = wk/s;
+  dll[2] = (sigma > 0 ? sigma*W.trace() : 0);
+
+  return GP::LogL();
 }
 
 
-double GP::OptParams()
+double GP::OptParams(int iters, bool noise)
 {
-  double llmax = 0;
-  double lmax = l;
-  double dl = .01;
-  for (l = dl; l < 5; l += dl) {
-    Train();
-    double ll = LogL();
-    if (llmax < ll) {
-      llmax = ll;
-      lmax = l;
+  int np = (noise && sigma > 0) ? 3 : 2;
+
+  // optimize over the logarithms of the parameters (which keeps them
+  // positive), minimizing f = -logL
+  VectorXd p = VectorXd::Zero(np), g = VectorXd::Zero(np);
+  VectorXd pn = VectorXd::Zero(np), gn = VectorXd::Zero(np);
+  p(0) = log(l);
+  p(1) = log(s);
+  if (np > 2)
+    p(2) = log(sigma);
+
+  struct Eval {
+    GP &gp;
+    double operator()(VectorXd &g, const VectorXd &p) {
+      gp.l = exp(p(0));
+      gp.s = exp(p(1));
+      if (p.size() > 2)
+        gp.sigma = exp(p(2));
+      gp.Train();
+      Vector3d dll;
+      double ll = gp.LogL(dll);
+      g(0) = -dll(0)*gp.l;
+      g(1) = -dll(1)*gp.s;
+      if (p.size() > 2)
+        g(2) = -dll(2)*gp.sigma;
+      return std::isfinite(ll) ? -ll : INFINITY;
+    }
+  } eval = {*this};
+
+  double f = eval(g, p);
+  MatrixXd H = MatrixXd::Identity(np, np);  // inverse Hessian approximation
+
+  for (int it = 0; it < iters && std::isfinite(f); ++it) {
+    VectorXd dp = -H*g;
+    if (g.dot(dp) >= 0) {   // not a descent direction
+      H.setIdentity();
+      dp = -g;
+    }
+    // do not change any parameter by more than a factor of e per step
+    double dpn = dp.cwiseAbs().maxCoeff();
+    if (dpn > 1)
+      dp /= dpn;
+
+    // backtracking line search
+    double t = 1, fn = INFINITY;
+    for (; t > 1e-6; t /= 2) {
+      pn = p + t*dp;
+      fn = eval(gn, pn);
+      if (fn <= f + 1e-4*t*g.dot(dp))
+        break;
     }
+    if (t <= 1e-6) {
+      // the GP was last trained with a rejected step
+      eval(g, p);
+      break;
+    }
+
+    VectorXd sp = pn - p;
+    VectorXd y = gn - g;
+    double sy = sp.dot(y);
+    if (sy > 1e-12) {
+      if (!it)
+        H *= sy/y.dot(y);
+      double r = 1/sy;
+      MatrixXd A = MatrixXd::Identity(np, np) - r*sp*y.transpose();
+      H = A*H*A.transpose() + r*sp*sp.transpose();
+    }
+
+    bool done = (f - fn < 1e-6*(1 + fabs(f)) || gn.cwiseAbs().maxCoeff() < 1e-6);
+    p = pn;
+    f = fn;
+    g = gn;
+    if (done)
+      break;
   }
-  l = lmax;
+
   return l;
 }
 
@@ -219,6 +334,26 @@ double GP::Predict(const VectorXd &x, double *s) const
 
 
 
+void GP::Predict(VectorXd &ms, const MatrixXd &X, VectorXd *ss) const
+{
+  MatrixXd Ks;
+  SqExp(Ks, Xs, X);
+  ms = Ks.transpose()*a;
+
+  if (ss) {
+    if (cf) {
+      L.triangularView<Eigen::Lower>().solveInPlace(Ks);
+      *ss = (s*s - Ks.colwise().squaredNorm().array()).matrix().transpose();
+    } else {
+      *ss = (s*s - (Ks.array()*(Ki*Ks).array()).colwise().sum()).matrix().transpose();
+    }
+
+    if (sigma > 0)
+      ss->array() += sigma*sigma;
+  }
+}
+
+
 double GP::SqExp(const VectorXd &xa, const VectorXd &xb) const
 {
   VectorXd d = xa - xb;
@@ -226,6 +361,30 @@ double GP::SqExp(const VectorXd &xa, const VectorXd &xb) const
 }
 
 
+void GP::SqDist(MatrixXd &D, const MatrixXd &Xa, const MatrixXd &Xb)
+{
+  D.noalias() = Xa.transpose()*Xb;
+  VectorXd na = Xa.colwise().squaredNorm().transpose();
+  int nb = Xb.cols();
+#pragma omp parallel for if (D.size() > 16384)
+  for (int j = 0; j < nb; ++j) {
+    // round-off can make the distance of nearby points slightly negative
+    D.col(j) = (na.array() + Xb.col(j).squaredNorm() - 2*D.col(j).array()).max(0);
+  }
+}
+
+
+void GP::SqExp(MatrixXd &K, const MatrixXd &Xa, const MatrixXd &Xb) const
+{
+  SqDist(K, Xa, Xb);
+  int nb = Xb.cols();
+  double c = -1/(2*l*l);
+#pragma omp parallel for if (K.size() > 16384)
+  for (int j = 0; j < nb; ++j)
+    K.col(j) = (K.col(j).array()*c).exp()*(s*s);
+}
+
+
 double GP::PI(const VectorXd &x, double fmin) const
 {
   double s;
@@ -34,21 +34,21 @@ namespace gcop {
      * @param f value
      * @param true if OK
      */
-    bool Add(const Eigen::VectorXd &x,
-             double f);    
+    virtual bool Add(const Eigen::VectorXd &x,
+                     double f);    
     
     /**
      * Train using current data
      */
-    void Train();
+    virtual void Train();
     
     /**
      * Train GP using a given dataset (xs, fs)
      * @param d-n matrix of data vectors
      * @param n-vector of values
      */
-    void Train(const Eigen::MatrixXd &Xs, 
-               const Eigen::VectorXd &fs);
+    virtual void Train(const Eigen::MatrixXd &Xs, 
+                       const Eigen::VectorXd &fs);
     
     /**
      * Predict value at point x
@@ -56,8 +56,20 @@ namespace gcop {
      * @param s pointer to predicted covariance (optional)
      * @return predicted mean
      */
-    double Predict(const Eigen::VectorXd &x, 
-                   double *s = 0) const;
+    virtual double Predict(const Eigen::VectorXd &x, 
+                           double *s = 0) const;
+
+    /**
+     * Predict values at several points at once. The kernel between the
+     * data and all query points is evaluated as a single matrix product,
+     * which is much faster than calling Predict on each point.
+     * @param ms predicted means (resized to the number of points)
+     * @param X d-q matrix of query points
+     * @param ss pointer to predicted covariances (optional)
+     */
+    virtual void Predict(Eigen::VectorXd &ms,
+                         const Eigen::MatrixXd &X,
+                         Eigen::VectorXd *ss = 0) const;
     
     /**
      * Square exponential kernel
@@ -67,13 +79,44 @@ namespace gcop {
      */
     double SqExp(const Eigen::VectorXd &xa, 
                  const Eigen::VectorXd &xb) const;
+
+    /**
+     * Square exponential kernel between two sets of points, computed
+     * using |xa - xb|^2 = |xa|^2 + |xb|^2 - 2 xa'*xb
+     * @param K na-nb matrix of correlations
+     * @param Xa d-na matrix of points
+     * @param Xb d-nb matrix of points
+     */
+    void SqExp(Eigen::MatrixXd &K,
+               const Eigen::MatrixXd &Xa,
+               const Eigen::MatrixXd &Xb) const;
     
+    /**
+     * Squared distances between two sets of points
+     * @param D na-nb matrix of squared distances
+     * @param Xa d-na matrix of points
+     * @param Xb d-nb matrix of points
+     */
+    static void SqDist(Eigen::MatrixXd &D,
+                       const Eigen::MatrixXd &Xa,
+                       const Eigen::MatrixXd &Xb);
+
     /**
      * Loglikelihood
      * @param dll derivative of log-liklihood w.r. to l and s
      * @return log-likelihood
      */
-    double LogL(double dll[2] = 0);
+    virtual double LogL(double dll[2] = 0);
+
+    /**
+     * Loglikelihood and its derivative w.r.t. l, s and sigma. The Cholesky
+     * factor computed in Train is reused, so the cost is that of inverting
+     * the kernel matrix using triangular solves.
+     * @param dll derivative of log-liklihood w.r. to l, s and sigma
+     *        (the last one is 0 if sigma <= 0)
+     * @return log-likelihood
+     */
+    virtual double LogL(Eigen::Vector3d &dll);
 
     /**
      * Probability of improvement over a given value fmin
@@ -84,10 +127,16 @@ namespace gcop {
     double PI(const Eigen::VectorXd &x, double fmin) const;
 
     /**
-     * Optimize GP parameters. This is currently done naively
-     * using a grid enumeration over l and s
+     * Optimize GP parameters l, s and (optionally) sigma by maximizing the
+     * log-likelihood using BFGS over their logarithms with analytic
+     * gradients. The GP is trained with the optimal parameters on return.
+     * Each iteration factors and inverts the kernel matrix, about n^3
+     * flops, and typically 10-20 iterations are needed.
+     * @param iters maximum number of iterations
+     * @param noise whether to also optimize sigma (only if sigma > 0)
+     * @return optimal l
      */
-    double OptParams();
+    double OptParams(int iters = 50, bool noise = true);
        
     int d;  ///< dimension
     int n;  ///< number of data points
@@ -109,7 +158,7 @@ namespace gcop {
     
     bool cf;   ///< propagate cholesky factor L rather than K^{-1}
 
-    bool eps;  ///< prohibit adding points that are eps-close in L_2 to existing data 
+    double eps;  ///< prohibit adding points that are eps-close in L_2 to existing data 
     
   };
 }
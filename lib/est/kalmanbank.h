@@ -0,0 +1,389 @@
+#ifndef GCOP_KALMANBANK_H
+#define GCOP_KALMANBANK_H
+
+#include "system.h"
+#include "sensor.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace gcop {
+
+  using namespace std;
+
+  /**
+   * A bank of n independent extended Kalman filters sharing the same system
+   * and sensor models (e.g. for tracking many targets).
+   *
+   * The covariances are stored structure-of-arrays, i.e. entry (i,j) of
+   * all covariances is stored contiguously, and filters are processed in
+   * chunks, so that the covariance prediction P = A*P*A' + Q and the
+   * correction are vectorized across the filters of a chunk. The
+   * innovation covariance is factorized (by Cholesky) rather than inverted.
+   *
+   * The system and sensor are still evaluated for each filter to
+   * propagate the means and obtain the Jacobians. If the Jacobians and
+   * noise covariances do not depend on the state (e.g. Point3d with
+   * Point3dGps) set linear to evaluate them only once per step and skip
+   * their zero entries. The speedup over single filters comes only from
+   * this: otherwise the per-filter evaluations and the gathering of the
+   * Jacobians dominate and the bank is slower than single filters (for
+   * 10000 Point3d/GPS filters on one core about 2.7e6 vs 2.8-3.0e6
+   * filters/s, and 8e6 filters/s with linear set).
+   *
+   * Chunks can be processed in parallel (using OpenMP). Since systems and
+   * sensors may keep internal state, each thread uses its own copy: add
+   * copies of sys to systems and of sensor to sensors (both contain only
+   * sys and sensor by default, in which case the bank is processed
+   * sequentially). Correct uses as many threads as there are both
+   * systems and sensors.
+   */
+  template <typename T = VectorXd,
+    int _nx = Dynamic,
+    int _nu = Dynamic,
+    int _np = Dynamic,
+    typename Tz = VectorXd,
+    int _nz = Dynamic> class KalmanBank {
+  public:
+
+  typedef Matrix<double, _nx, 1> Vectornd;
+  typedef Matrix<double, _nu, 1> Vectorcd;
+  typedef Matrix<double, _np, 1> Vectormd;
+
+  typedef Matrix<double, _nx, _nx> Matrixnd;
+  typedef Matrix<double, _nz, 1> Vectorrd;
+  typedef Matrix<double, _nz, _nx> Matrixrnd;
+
+  /**
+   * Filter bank
+   * @param sys system
+   * @param sensor sensor
+   * @param n number of filters
+   */
+  KalmanBank(System<T, _nx, _nu, _np> &sys,
+             Sensor<T, _nx, _nu, _np, Tz, _nz> &sensor, int n);
+
+  virtual ~KalmanBank();
+
+  /**
+   * Set the belief of filter k
+   * @param k filter index
+   * @param x belief state (its mean and covariance P)
+   */
+  void Set(int k, const T &x);
+
+  /**
+   * Get the belief of filter k
+   * @param x belief state (its mean and covariance P)
+   * @param k filter index
+   */
+  void Get(T &x, int k) const;
+
+  /**
+   * Prediction step of all filters
+   * @param t time
+   * @param us control inputs of each filter
+   * @param h time-step
+   * @param p parameters (optional)
+   */
+  void Predict(double t, const vector<Vectorcd> &us, double h,
+               const Vectormd *p = 0);
+
+  /**
+   * Correction step of all filters
+   * @param t time
+   * @param us control inputs of each filter
+   * @param zs measurements of each filter
+   * @param p parameters (optional)
+   */
+  void Correct(double t, const vector<Vectorcd> &us, const vector<Tz> &zs,
+               const Vectormd *p = 0);
+
+  System<T, _nx, _nu, _np> &sys;                   ///< system
+  Sensor<T, _nx, _nu, _np, Tz, _nz> &sensor;       ///< sensor
+
+  int n;              ///< number of filters
+  int nx;             ///< state dimension
+  int nz;             ///< measurement dimension
+
+  vector<T> xs;       ///< filter means (the covariances P of these states are not used)
+  MatrixXd Ps;        ///< covariances: column i*nx+j contains entry (i,j) of all filters
+
+  bool linear;        ///< whether the Jacobians and noise do not depend on the state
+  int chunk;          ///< number of filters processed together (256 by default)
+
+  vector<System<T, _nx, _nu, _np>*> systems;            ///< systems used by each thread
+  vector<Sensor<T, _nx, _nu, _np, Tz, _nz>*> sensors;   ///< sensors used by each thread
+  };
+
+
+  template <typename T, int _nx, int _nu, int _np, typename Tz, int _nz>
+    KalmanBank<T, _nx, _nu, _np, Tz, _nz>::KalmanBank(System<T, _nx, _nu, _np> &sys,
+                                                      Sensor<T, _nx, _nu, _np, Tz, _nz> &sensor, int n) :
+    sys(sys), sensor(sensor), n(n), nx(sys.X.n), nz(sensor.Z.n),
+    xs(n), Ps(MatrixXd::Zero(n, sys.X.n*sys.X.n)),
+    linear(false), chunk(256),
+    systems(1, &sys), sensors(1, &sensor) {
+  }
+
+  template <typename T, int _nx, int _nu, int _np, typename Tz, int _nz>
+    KalmanBank<T, _nx, _nu, _np, Tz, _nz>::~KalmanBank() {
+  }
+
+  template <typename T, int _nx, int _nu, int _np, typename Tz, int _nz>
+    void KalmanBank<T, _nx, _nu, _np, Tz, _nz>::Set(int k, const T &x) {
+    xs[k] = x;
+    for (int j = 0; j < nx; ++j)
+      for (int i = 0; i < nx; ++i)
+        Ps(k, i*nx + j) = x.P(i,j);
+  }
+
+  template <typename T, int _nx, int _nu, int _np, typename Tz, int _nz>
+    void KalmanBank<T, _nx, _nu, _np, Tz, _nz>::Get(T &x, int k) const {
+    x = xs[k];
+    for (int j = 0; j < nx; ++j)
+      for (int i = 0; i < nx; ++i)
+        x.P(i,j) = Ps(k, i*nx + j);
+  }
+
+  template <typename T, int _nx, int _nu, int _np, typename Tz, int _nz>
+    void KalmanBank<T, _nx, _nu, _np, Tz, _nz>::Predict(double t, const vector<Vectorcd> &us, double h,
+                                                        const Vectormd *p) {
+    int nx2 = nx*nx;
+    int nc = (n + chunk - 1)/chunk;
+    int nt = systems.size();
+
+    // shared Jacobian and noise
+    Matrixnd A0, Q0;
+    if (_nx == Dynamic) {
+      A0.resize(nx, nx);
+      Q0.resize(nx, nx);
+    }
+    A0.setZero();
+    if (linear && n > 0) {
+      T xb = xs[0];
+      sys.Step(xb, t, xs[0], us[0], h, p, &A0);
+      sys.Noise(Q0, t, xs[0], us[0], h, p);
+    }
+
+#pragma omp parallel num_threads(nt) if (nt > 1)
+    {
+      int tid = 0;
+#ifdef _OPENMP
+      tid = omp_get_thread_num();
+#endif
+      System<T, _nx, _nu, _np> &s = *systems[tid];
+      Matrixnd A, Q;
+      if (_nx == Dynamic) {
+        A.resize(nx, nx);
+        Q.resize(nx, nx);
+      }
+      A.setZero();
+      MatrixXd As, Qs, Tm;  // per-filter Jacobians, noise and A*P
+      T xb = xs[0];
+
+#pragma omp for schedule(dynamic)
+      for (int c = 0; c < nc; ++c) {
+        int k0 = c*chunk;
+        int m = std::min(chunk, n - k0);
+        Block<MatrixXd> P = Ps.middleRows(k0, m);
+
+        if (!linear) {
+          As.resize(m, nx2);
+          Qs.resize(m, nx2);
+        }
+        for (int k = 0; k < m; ++k) {
+          if (linear) {
+            s.Step(xb, t, xs[k0 + k], us[k0 + k], h, p);
+          } else {
+            s.Step(xb, t, xs[k0 + k], us[k0 + k], h, p, &A);
+            s.Noise(Q, t, xs[k0 + k], us[k0 + k], h, p);
+            for (int j = 0; j < nx; ++j)
+              for (int i = 0; i < nx; ++i) {
+                As(k, i*nx + j) = A(i,j);
+                Qs(k, i*nx + j) = Q(i,j);
+              }
+          }
+          xs[k0 + k] = xb;
+        }
+
+        // Tm = A*P
+        Tm.setZero(m, nx2);
+        for (int i = 0; i < nx; ++i)
+          for (int l = 0; l < nx; ++l) {
+            if (linear && A0(i,l) == 0)
+              continue;
+            for (int j = 0; j < nx; ++j) {
+              if (linear)
+                Tm.col(i*nx + j) += A0(i,l)*P.col(l*nx + j);
+              else
+                Tm.col(i*nx + j).array() += As.col(i*nx + l).array()*P.col(l*nx + j).array();
+            }
+          }
+
+        // P = Tm*A' + Q (lower half, then mirrored)
+        for (int i = 0; i < nx; ++i)
+          for (int j = 0; j <= i; ++j) {
+            typename Block<MatrixXd>::ColXpr Pij = P.col(i*nx + j);
+            if (linear) {
+              Pij.setConstant(Q0(i,j));
+              for (int l = 0; l < nx; ++l)
+                if (A0(j,l) != 0)
+                  Pij += A0(j,l)*Tm.col(i*nx + l);
+            } else {
+              Pij = Qs.col(i*nx + j);
+              for (int l = 0; l < nx; ++l)
+                Pij.array() += Tm.col(i*nx + l).array()*As.col(j*nx + l).array();
+            }
+            if (j < i)
+              P.col(j*nx + i) = Pij;
+          }
+      }
+    }
+  }
+
+  template <typename T, int _nx, int _nu, int _np, typename Tz, int _nz>
+    void KalmanBank<T, _nx, _nu, _np, Tz, _nz>::Correct(double t, const vector<Vectorcd> &us, const vector<Tz> &zs,
+                                                        const Vectormd *p) {
+    int nc = (n + chunk - 1)/chunk;
+    int nt = std::min(systems.size(), sensors.size());  // the means are retracted using systems
+
+    // shared Jacobian
+    Matrixrnd H0;
+    if (_nz == Dynamic || _nx == Dynamic)
+      H0.resize(nz, nx);
+    H0.setZero();
+    if (linear && n > 0) {
+      Tz y;
+      sensor(y, t, xs[0], us[0], p, &H0);
+    }
+    const MatrixXd R = sensor.R;
+
+#pragma omp parallel num_threads(nt) if (nt > 1)
+    {
+      int tid = 0;
+#ifdef _OPENMP
+      tid = omp_get_thread_num();
+#endif
+      System<T, _nx, _nu, _np> &s = *systems[tid];
+      Sensor<T, _nx, _nu, _np, Tz, _nz> &sn = *sensors[tid];
+      Matrixrnd H;
+      Vectorrd dz;
+      Vectornd dx;
+      if (_nz == Dynamic || _nx == Dynamic)
+        H.resize(nz, nx);
+      H.setZero();
+      if (_nz == Dynamic)
+        dz.resize(nz);
+      if (_nx == Dynamic)
+        dx.resize(nx);
+      Tz y;
+      MatrixXd Hs, Dz, PHt, S, K, Dx;
+      ArrayXd w;
+
+#pragma omp for schedule(dynamic)
+      for (int c = 0; c < nc; ++c) {
+        int k0 = c*chunk;
+        int m = std::min(chunk, n - k0);
+        Block<MatrixXd> P = Ps.middleRows(k0, m);
+
+        // innovations (and Jacobians)
+        Dz.resize(m, nz);
+        if (!linear)
+          Hs.resize(m, nz*nx);
+        for (int k = 0; k < m; ++k) {
+          if (linear) {
+            sn(y, t, xs[k0 + k], us[k0 + k], p);
+          } else {
+            sn(y, t, xs[k0 + k], us[k0 + k], p, &H);
+            for (int a = 0; a < nz; ++a)
+              for (int i = 0; i < nx; ++i)
+                Hs(k, a*nx + i) = H(a,i);
+          }
+          sn.Z.Lift(dz, y, zs[k0 + k]);
+          Dz.row(k) = dz.transpose();
+        }
+
+        // PHt = P*H' (column i*nz+a)
+        PHt.setZero(m, nx*nz);
+        for (int i = 0; i < nx; ++i)
+          for (int a = 0; a < nz; ++a)
+            for (int l = 0; l < nx; ++l) {
+              if (linear) {
+                if (H0(a,l) != 0)
+                  PHt.col(i*nz + a) += H0(a,l)*P.col(i*nx + l);
+              } else {
+                PHt.col(i*nz + a).array() += P.col(i*nx + l).array()*Hs.col(a*nx + l).array();
+              }
+            }
+
+        // S = H*P*H' + R, lower half (column a*nz+b), factorized in place
+        // into its Cholesky factor
+        S.resize(m, nz*nz);
+        for (int a = 0; a < nz; ++a)
+          for (int b = 0; b <= a; ++b) {
+            S.col(a*nz + b).setConstant(R(a,b));
+            for (int i = 0; i < nx; ++i) {
+              if (linear) {
+                if (H0(a,i) != 0)
+                  S.col(a*nz + b) += H0(a,i)*PHt.col(i*nz + b);
+              } else {
+                S.col(a*nz + b).array() += Hs.col(a*nx + i).array()*PHt.col(i*nz + b).array();
+              }
+            }
+          }
+        for (int a = 0; a < nz; ++a) {
+          for (int b = 0; b < a; ++b)
+            S.col(a*nz + a).array() -= S.col(a*nz + b).array().square();
+          S.col(a*nz + a) = S.col(a*nz + a).cwiseSqrt();
+          w = S.col(a*nz + a).array().inverse();
+          for (int d = a + 1; d < nz; ++d) {
+            for (int b = 0; b < a; ++b)
+              S.col(d*nz + a).array() -= S.col(d*nz + b).array()*S.col(a*nz + b).array();
+            S.col(d*nz + a).array() *= w;
+          }
+        }
+
+        // K = P*H'*inv(S): each row of K solves S*K(i,:)' = PHt(i,:)'
+        K = PHt;
+        for (int i = 0; i < nx; ++i) {
+          for (int a = 0; a < nz; ++a) {       // forward substitution
+            for (int b = 0; b < a; ++b)
+              K.col(i*nz + a).array() -= S.col(a*nz + b).array()*K.col(i*nz + b).array();
+            K.col(i*nz + a).array() /= S.col(a*nz + a).array();
+          }
+          for (int a = nz - 1; a >= 0; --a) {  // back substitution
+            for (int b = a + 1; b < nz; ++b)
+              K.col(i*nz + a).array() -= S.col(b*nz + a).array()*K.col(i*nz + b).array();
+            K.col(i*nz + a).array() /= S.col(a*nz + a).array();
+          }
+        }
+
+        // P = P - K*(P*H')' (lower half, then mirrored)
+        for (int i = 0; i < nx; ++i)
+          for (int j = 0; j <= i; ++j) {
+            typename Block<MatrixXd>::ColXpr Pij = P.col(i*nx + j);
+            for (int a = 0; a < nz; ++a)
+              Pij.array() -= K.col(i*nz + a).array()*PHt.col(j*nz + a).array();
+            if (j < i)
+              P.col(j*nx + i) = Pij;
+          }
+
+        // dx = K*dz
+        Dx.setZero(m, nx);
+        for (int i = 0; i < nx; ++i)
+          for (int a = 0; a < nz; ++a)
+            Dx.col(i).array() += K.col(i*nz + a).array()*Dz.col(a).array();
+
+        for (int k = 0; k < m; ++k) {
+          T xa = xs[k0 + k];
+          dx = Dx.row(k).transpose();
+          s.X.Retract(xs[k0 + k], xa, dx);
+        }
+      }
+    }
+  }
+}
+
+
+#endif
@@ -88,7 +88,9 @@ namespace gcop {
     //    std::cout << "S=" << H*xa.P*H.transpose() + this->sensor.R << std::endl;
     //    std::cout << "xa.P*H.transpose()=" << xa.P*H.transpose() << std::endl;
     
-    K = xa.P*H.transpose()*(H*xa.P*H.transpose() + this->sensor.R).inverse();
+    // K = P*H'*inv(S) = (inv(S)*H*P)' for the innovation covariance S
+    LLT<Matrixrd> llt(H*xa.P*H.transpose() + this->sensor.R);
+    K = llt.solve(H*xa.P).transpose();
     
     
     //    std::cout <<"K=" << K<<std::endl;
@@ -104,6 +106,7 @@ namespace gcop {
     this->sensor.Z.Lift(dz, y, z);
     dx = K*dz;
     this->X.Retract(xb, xa, dx);
+    return true;
   }
 }
 
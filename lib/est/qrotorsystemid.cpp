@@ -1,4 +1,5 @@
 #include "qrotorsystemid.h"
+#include <thread>
 #define ONEDEG M_PI/180
 
 using namespace gcop;
@@ -30,7 +31,10 @@ QRotorSystemID::QRotorSystemID():qrotor_gains(7), offsets_timeperiod(0.1), CSVFo
     stdev_initial_state_prior<<0.05,0.05,0.05, 0.1,0.1,0.1, 2*ONEDEG,2*ONEDEG,2*ONEDEG, 10*ONEDEG,10*ONEDEG,10*ONEDEG, ONEDEG,ONEDEG,ONEDEG;
     stdev_position = 0.2;
     stdev_rpy = 4*ONEDEG;
-    options.linear_solver_type = ceres::DENSE_SCHUR;
+    stdev_dynamics<<1e-3,1e-3,1e-3, 1e-3,1e-3,1e-3, 0.01*ONEDEG,0.01*ONEDEG,0.01*ONEDEG, 0.01*ONEDEG,0.01*ONEDEG,0.01*ONEDEG, 0.01*ONEDEG,0.01*ONEDEG,0.01*ONEDEG;
+    options.linear_solver_type = ceres::SPARSE_NORMAL_CHOLESKY;//States are coupled only to neighbors
+    options.num_threads = std::max(1u, std::thread::hardware_concurrency());
+    options.num_linear_solver_threads = options.num_threads;
     options.minimizer_progress_to_stdout = false;//Quiet mode
 }
 
@@ -44,11 +48,10 @@ bool QRotorSystemID::VerifyParams()
   return true;
 }
 
-bool QRotorSystemID::EstimateParameters(const vector<QRotorSystemIDMeasurement> &inputs, QRotorIDState &initial_state, Matrix7d *stdev_gains, Vector6d *offsets, Matrix6d *stdev_offsets){
+bool QRotorSystemID::EstimateParameters(const vector<QRotorSystemIDMeasurement> &inputs, QRotorIDState &initial_state, Matrix7d *stdev_gains, Vector6d *offsets, Matrix6d *stdev_offsets, QRotorIDState *final_state){
   bool res = VerifyParams();
   ceres::Problem problem;
-  ceres::CostFunction *measurement_error_inst = MeasurementError::Create(inputs,initial_state,*this);
-  //Create Prior for params:
+  int number_of_measurements = inputs.size();
   int number_offsets = std::ceil((inputs.back().t -inputs.front().t)/offsets_timeperiod);//Offsets change every 0.1 secs
   if(verbose)
   {
@@ -57,41 +60,52 @@ bool QRotorSystemID::EstimateParameters(const vector<QRotorSystemIDMeasurement>
     cout<<"Number of Offsets: "<<number_offsets<<endl;
   }
 
-  //Initial State guess = initial state_prior
-  double initial_state_prior[15];
-  memcpy(initial_state_prior, initial_state.p.data(),3*sizeof(double));
-  memcpy(initial_state_prior+3, initial_state.v.data(),3*sizeof(double));
-  Vector3d rpy;
-  SO3::Instance().g2q(rpy,initial_state.R);
-  memcpy(initial_state_prior+6, rpy.data(),3*sizeof(double));
-  memcpy(initial_state_prior+9, initial_state.w.data(),3*sizeof(double));
-  memcpy(initial_state_prior+12, initial_state.u.data(),3*sizeof(double));
-  //DEBUG:
-  /*cout<<"Initial State: "<<endl;
-  for(int i = 0; i < 15; i++)
-      cout<<initial_state_prior[i]<<endl;
-      */
   //Guess for gains
   Vector7d qrotor_newgains = qrotor_gains;//Set the new gains to prior
   double *qrotor_gains_prior_data = qrotor_newgains.data();
   //Guess for Offsets:
   offsets_matrix.resize(6, number_offsets);
   offsets_matrix.colwise() = offsets_prior;
-  /*cout<<"Offsets: "<<endl<<offsets_matrix<<endl;
-  double *offsets_prior_guess = (double*)malloc(6*number_offsets*sizeof(double));
-  double *offsets_prior_ref = offsets_prior_guess;
-  for(int j = 0; j < number_offsets; j++)
+
+  //Offsets used in each interval:
+  vector<int> offset_index(number_of_measurements - 1);
+  double offsets_prevtime = inputs.at(0).t;
+  int offset_count = 0;
+  for(int i = 0; i < number_of_measurements-1; i++)
   {
-      memcpy(offsets_prior_ref, offsets_prior.data(),6*sizeof(double));
-      offsets_prior_ref  = offsets_prior_ref+6;
+    if((inputs[i].t - offsets_prevtime) >= offsets_timeperiod)
+    {
+      offset_count++;
+      offsets_prevtime = inputs[i].t;
+    }
+    offset_index[i] = std::min(offset_count, number_offsets - 1);
   }
-  */
-  vector<double *> parameter_blocks;
-  parameter_blocks.push_back(initial_state_prior);
-  parameter_blocks.push_back(qrotor_gains_prior_data);
-  parameter_blocks.push_back(offsets_matrix.data());
 
-  problem.AddResidualBlock(measurement_error_inst,NULL,parameter_blocks);
+  //Guess for states (p, v, rpy, w, u) at each measurement: rollout from initial state using prior gains and offsets
+  vector<double> states(15*number_of_measurements);
+  Vector3d rpy;
+  SO3::Instance().g2q(rpy,initial_state.R);
+  memcpy(&states[0], initial_state.p.data(),3*sizeof(double));
+  memcpy(&states[3], initial_state.v.data(),3*sizeof(double));
+  memcpy(&states[6], rpy.data(),3*sizeof(double));
+  memcpy(&states[9], initial_state.w.data(),3*sizeof(double));
+  memcpy(&states[12], initial_state.u.data(),3*sizeof(double));
+  for(int i = 0; i < number_of_measurements-1; i++)
+    Step(&states[15*(i+1)], &states[15*i], inputs[i].control, inputs[i+1].t - inputs[i].t, qrotor_gains.data(), offsets_prior.data());
+
+  //Residuals:
+  problem.AddResidualBlock(InitialStateError::Create(initial_state, stdev_initial_state_prior), NULL, &states[0]);
+  for(int i = 0; i < number_of_measurements-1; i++)
+  {
+    const QRotorSystemIDMeasurement &current_meas = inputs[i];
+    const QRotorSystemIDMeasurement &next_meas = inputs[i+1];
+    problem.AddResidualBlock(IntervalError::Create(current_meas.control, next_meas.t - current_meas.t, stdev_dynamics), NULL,
+                             &states[15*i], &states[15*(i+1)], qrotor_gains_prior_data, offsets_matrix.data() + 6*offset_index[i]);
+    problem.AddResidualBlock(MeasurementError::Create(next_meas, stdev_position, stdev_rpy), NULL, &states[15*(i+1)]);
+  }
+  problem.AddResidualBlock(ParameterPrior<7>::Create(qrotor_gains, qrotor_gains_residualgain), NULL, qrotor_gains_prior_data);
+  for(int i = 0; i < number_offsets; i++)
+    problem.AddResidualBlock(ParameterPrior<6>::Create(offsets_prior, offsets_prior_residualgain), NULL, offsets_matrix.data() + 6*i);
 
   ceres::Solve(options,&problem,&summary);
   qrotor_gains = qrotor_newgains;//Update Prior
@@ -103,6 +117,16 @@ bool QRotorSystemID::EstimateParameters(const vector<QRotorSystemIDMeasurement>
     std::cout<<"Important Params: "<<std::endl;
     std::cout<<qrotor_newgains.transpose().format(CSVFormat)<<std::endl;
   }
+  if(final_state != NULL)
+  {
+    const double *xf = &states[15*(number_of_measurements-1)];
+    final_state->Clear();
+    final_state->p = Map<const Vector3d>(xf);
+    final_state->v = Map<const Vector3d>(xf + 3);
+    SO3::Instance().q2g(final_state->R, Map<const Vector3d>(xf + 6));
+    final_state->w = Map<const Vector3d>(xf + 9);
+    final_state->u = Map<const Vector3d>(xf + 12);
+  }
   //cout<<"Offsets: "<<endl<<offsets_matrix<<endl;
   //Mean of Offsets:
   //Map<MatrixXd> offsets_matrix(offsets_prior_guess,number_offsets,6);
@@ -111,7 +135,12 @@ bool QRotorSystemID::EstimateParameters(const vector<QRotorSystemIDMeasurement>
     if(verbose)
       std::cout<<"Mean offsets: "<<mean_offsets.transpose().format(CSVFormat)<<std::endl;
     *offsets  = mean_offsets;
-    if(stdev_offsets != NULL)
+    if(stdev_offsets != NULL && offsets_matrix.cols() < 2)
+    {
+      //The sample covariance needs two offsets: fall back to the prior
+      *stdev_offsets = offsets_prior_residualgain.inverse();
+    }
+    else if(stdev_offsets != NULL)
     {
       MatrixXd centered = offsets_matrix.colwise() - mean_offsets;
       Matrix6d cov = (centered * centered.transpose() + lambda_regularization_*Matrix6d::Identity()) / double(offsets_matrix.cols() - 1);
@@ -126,7 +155,7 @@ bool QRotorSystemID::EstimateParameters(const vector<QRotorSystemIDMeasurement>
   }
     //Evaluate Covariance of computed parameters TODO
     vector<pair<const double *,const double *> >covariance_blocks;
-    covariance_blocks.push_back(make_pair(parameter_blocks[1], parameter_blocks[1]));//Corresponding to Gains
+    covariance_blocks.push_back(make_pair(qrotor_gains_prior_data, qrotor_gains_prior_data));//Corresponding to Gains
     ceres::Covariance covariance(cov_options);
     bool cov_res = covariance.Compute(covariance_blocks,&problem);
     if(!cov_res)
@@ -136,7 +165,7 @@ bool QRotorSystemID::EstimateParameters(const vector<QRotorSystemIDMeasurement>
     else
     {
         Matrix<double,7,7,RowMajor> cov_gains;
-        covariance.GetCovarianceBlock(parameter_blocks[1],parameter_blocks[1],cov_gains.data());
+        covariance.GetCovarianceBlock(qrotor_gains_prior_data,qrotor_gains_prior_data,cov_gains.data());
         //cout<<"Covariance of Gains: "<<endl<<cov_gains<<endl;
         SelfAdjointEigenSolver<Matrix7d> es(cov_gains);
         if(stdev_gains != NULL)
@@ -157,3 +186,34 @@ bool QRotorSystemID::EstimateParameters(const vector<QRotorSystemIDMeasurement>
     }
     return res;
 }
+
+bool QRotorSystemID::EstimateParameters(QRotorSystemIDLog &log, int window_size, QRotorIDState &state, Matrix7d *stdev_gains, Vector6d *offsets, Matrix6d *stdev_offsets)
+{
+  //Windows overlap by one measurement so that the interval between them is not lost
+  vector<QRotorSystemIDMeasurement> new_measurements;
+  if(log.Read(new_measurements, window_size) == 0)
+    return false;
+  if(!window_.empty())
+    window_.erase(window_.begin(), window_.end() - 1);
+  window_.insert(window_.end(), new_measurements.begin(), new_measurements.end());
+  if(window_.size() < 2)
+    return false;
+
+  //The gains covariance is always computed since it is the prior of the next window. It is left at the
+  //prior stdev if the covariance cannot be computed
+  Matrix7d window_stdev_gains = qrotor_gains_residualgain.inverse();
+  Vector6d mean_offsets;
+  QRotorIDState final_state;
+  bool res = EstimateParameters(window_, state, &window_stdev_gains, &mean_offsets, stdev_offsets, &final_state);
+  //Only the gains covariance is carried over (see the header): the offsets and final state are passed on
+  //with their fixed prior covariances (offsets_prior_residualgain, stdev_initial_state_prior)
+  offsets_prior = mean_offsets;
+  state = final_state;
+  if(stdev_gains != NULL)
+    *stdev_gains = window_stdev_gains;
+  if(offsets != NULL)
+    *offsets = mean_offsets;
+  if(!res)
+    cout<<"[W] QRotorSystemID::EstimateParameters: parameters out of bounds in window ending at t = "<<window_.back().t<<endl;
+  return true;
+}
@@ -12,26 +12,25 @@
  * @brief The QRotorSystemID class
  * This class does a MLE estimation of quadrotor system parameters. In particular this uses
  * the Quad rotor model and identify parameters based on measured position and rpy data.
+ *
+ * The states at all measurement times are estimated together with the parameters (multiple shooting):
+ * each measurement and each interval between consecutive measurements is a separate small residual
+ * block with automatic derivatives, so that the problem is sparse and its evaluation parallel.
  */
 
 #include "qrotoridmodel.h"
+#include "qrotorsystemidlog.h"
 #include "so3.h"
 #include <Eigen/Dense>
 
 #include "ceres/ceres.h" //Nonlinear Least Squares Optimization Package
+#include "ceres/rotation.h"
 
 namespace gcop {
 
 using namespace std;
 using namespace Eigen;
 
-struct QRotorSystemIDMeasurement {
-    Vector3d position;///< Position
-    Vector3d rpy;///< Measured rpy
-    Vector4d control;///< Input rpyt command
-    double t;///< Measured time
-};
-
 class QRotorSystemID
 {
 protected:
@@ -41,7 +40,43 @@ public:
     typedef Matrix<double,7,7> Matrix7d;
     typedef Matrix<double,6,6> Matrix6d;
 
-    bool EstimateParameters(const vector<QRotorSystemIDMeasurement> &inputs, QRotorIDState &initial_state, Matrix7d *stdev_gains = 0, Vector6d *offsets = 0, Matrix6d *stdev_offsets = 0);
+    /**
+     * @brief Estimate the parameters from a batch of measurements
+     * @param inputs Measurements
+     * @param initial_state Initial state guess (prior)
+     * @param stdev_gains Stdeviation of estimated gains. If provided, the gains covariance is also used as the prior for the next call
+     * @param offsets Mean of the estimated offsets
+     * @param stdev_offsets Stdeviation of the estimated offsets (the prior stdev if there are less than two offsets)
+     * @param final_state Estimated state at the last measurement
+     * @return true if the estimated parameters are within bounds
+     */
+    bool EstimateParameters(const vector<QRotorSystemIDMeasurement> &inputs, QRotorIDState &initial_state, Matrix7d *stdev_gains = 0, Vector6d *offsets = 0, Matrix6d *stdev_offsets = 0, QRotorIDState *final_state = 0);
+
+    /**
+     * @brief Estimate the parameters from the next window of a log. Only one window of measurements
+     * is in memory at a time: the gains estimate and covariance, the mean offsets and the last state of each
+     * window are carried over as the priors of the next one (recursive estimation).
+     *
+     * This is an approximation of a batch estimate over the whole log: only the gains covariance is
+     * propagated. The prior on the state at the start of the next window uses stdev_initial_state_prior and
+     * the prior on the offsets uses offsets_prior_residualgain, i.e. their estimated covariances and the
+     * correlations between gains, offsets and state are dropped. Results thus depend (mildly) on window_size.
+     * @param log Measurement log
+     * @param window_size Number of new measurements per window
+     * @param state Initial state guess of the first window. Replaced by the estimated state at the end of the window
+     * @param stdev_gains Stdeviation of estimated gains
+     * @param offsets Mean of the estimated offsets
+     * @param stdev_offsets Stdeviation of the estimated offsets
+     * @return false at the end of the log. Estimates out of bounds only print a warning and still return true,
+     * so that loops over the log (see bin/qrotorsystemidtest.cc) process the remaining windows, which may bring
+     * the estimates back within bounds
+     */
+    bool EstimateParameters(QRotorSystemIDLog &log, int window_size, QRotorIDState &state, Matrix7d *stdev_gains = 0, Vector6d *offsets = 0, Matrix6d *stdev_offsets = 0);
+
+    /**
+     * @brief Start over for a new log (the current parameter estimates are kept as priors)
+     */
+    void ResetWindow() { window_.clear(); }
 public:
     MatrixXd offsets_matrix;///< Offsets matrix from Optimization
     Vector7d qrotor_gains;///< Parameter vector of kt, kp, kd
@@ -53,6 +88,7 @@ public:
     Vector15d stdev_initial_state_prior;///< stdeviation on initial state prior
     double stdev_position;///< Stdeviation on position measurement
     double stdev_rpy;///< Stdeviation on rpy measurement
+    Vector15d stdev_dynamics;///< Stdeviation of the dynamics error between the states (p, v, rpy, w, u) at consecutive measurements
     double offsets_timeperiod;///< Time periof for offsets
     static QRotorIDModel sys_;///< Reference system for which parameters are optimized over
     bool verbose;///< To print debug outputs or not
@@ -62,148 +98,226 @@ protected:
     ceres::Covariance::Options cov_options;
     ceres::Solver::Summary summary;
     const IOFormat CSVFormat;
+    vector<QRotorSystemIDMeasurement> window_;///< Measurements of the current window
     /**
     * @brief Verify the parameters are between lb and ub
     *
     * @return true if parameters are in between lb and ub
     */
     bool VerifyParams();
+
     /**
-      * Standard stereo camera residual error
-      */
-    struct MeasurementError {
-      MeasurementError(const vector<QRotorSystemIDMeasurement> &inputs, const QRotorIDState &initial_state, const QRotorSystemID &parent_class)
-        : inputs_(inputs), parent_(parent_class)
-          ,so3(SO3::Instance()), initial_state_prior_(initial_state) {
+     * @brief Wrap an angle difference to [-pi, pi]
+     */
+    template <typename T>
+    static T WrapAngle(const T &a)
+    {
+      return (a > T(M_PI))?(a - T(2*M_PI)):(a < T(-M_PI))?(a + T(2*M_PI)):a;
+    }
 
-          number_offsets = std::ceil((inputs_.back().t -inputs_.front().t)/parent_.offsets_timeperiod);//Offsets change every 0.1 secs
-          //DEBUG:
-          //cout<<"Number of Offsets: "<<number_offsets<<endl;
+    /**
+     * @brief Templated version of QRotorIDModel::Step (with parameters) on states
+     * parametrized as (p, v, rpy, w, u), so that it can be used with automatic differentiation
+     * @param xb Resulting state
+     * @param xa Initial state
+     * @param control Input rpyt command
+     * @param h Time step
+     * @param gains kt, kp, kd
+     * @param offsets a0, tau0
+     */
+    template <typename T>
+    static void Step(T *xb, const T *xa, const Vector4d &control, double h, const T *gains, const T *offsets)
+    {
+      const T *p = xa, *v = xa + 3, *rpy = xa + 6, *w = xa + 9, *u = xa + 12;
+      T *pb = xb, *vb = xb + 3, *rpyb = xb + 6, *wb = xb + 9, *ub = xb + 12;
+
+      T rpy_cmd[3], erpy[3];
+      for(int i = 0; i < 3; i++)
+      {
+        rpy_cmd[i] = WrapAngle(u[i] + T(control[i+1]*h));
+        erpy[i] = WrapAngle(rpy[i] - rpy_cmd[i]);
       }
 
-      inline void setInitialState(double const* p, QRotorIDState &initial_state) const
+      //Convert omega to rpydot
+      T sr = sin(rpy[0]), cr = cos(rpy[0]), tp = tan(rpy[1]), cp = cos(rpy[1]);
+      T erpydot[3];
+      erpydot[0] = w[0] + sr*tp*w[1] + cr*tp*w[2] - T(control[1]);
+      erpydot[1] = cr*w[1] - sr*w[2] - T(control[2]);
+      erpydot[2] = (sr*w[1] + cr*w[2])/cp - T(control[3]);
+
+      //Rotation from rpy (as in SO3::q2g)
+      T R[3][3];
       {
-          initial_state.p = Vector3d(p[0], p[1], p[2]);
-          initial_state.v = Vector3d(p[3],p[4],p[5]);
-          Vector3d rpy(p[6],p[7],p[8]);
-          so3.q2g(initial_state.R, rpy);
-          initial_state.w = Vector3d(p[9],p[10],p[11]);
-          initial_state.u = Vector3d(p[12],p[13],p[14]);
+        T ca = cos(rpy[2]), sa = sin(rpy[2]), cb = cos(rpy[1]), sb = sin(rpy[1]), cg = cos(rpy[0]), sg = sin(rpy[0]);
+        R[0][0] = ca*cb; R[0][1] = ca*sb*sg - sa*cg; R[0][2] = ca*sb*cg + sa*sg;
+        R[1][0] = sa*cb; R[1][1] = sa*sb*sg + ca*cg; R[1][2] = sa*sb*cg - ca*sg;
+        R[2][0] = -sb;   R[2][1] = cb*sg;            R[2][2] = cb*cg;
+      }
+
+      //Translational Part
+      const T *a0 = offsets, *tau0 = offsets + 3;
+      for(int i = 0; i < 3; i++)
+      {
+        T acc = (gains[0]*T(control[0]))*R[i][2] + R[i][0]*a0[0] + R[i][1]*a0[1] + R[i][2]*a0[2];
+        if(i == 2)
+          acc = acc + T(-9.81);
+        vb[i] = v[i] + T(h)*acc;
+        pb[i] = p[i] + T(0.5*h)*(vb[i] + v[i]);
+      }
+
+      //Rotational Part
+      T aa[3];
+      for(int i = 0; i < 3; i++)
+      {
+        T omegadot = -gains[1+i]*erpy[i] - gains[4+i]*erpydot[i] + tau0[i];
+        wb[i] = w[i] + T(h)*omegadot;
+        aa[i] = T(0.5*h)*(wb[i] + w[i]);
+      }
+      T dR[9];
+      ceres::AngleAxisToRotationMatrix(aa, dR);   // column major
+      T Rb[3][3];
+      for(int i = 0; i < 3; i++)
+        for(int j = 0; j < 3; j++)
+          Rb[i][j] = R[i][0]*dR[3*j] + R[i][1]*dR[3*j+1] + R[i][2]*dR[3*j+2];
+
+      //rpy (as in SO3::g2q)
+      rpyb[0] = atan2(Rb[2][1], Rb[2][2]);
+      rpyb[1] = atan2(-Rb[2][0], sqrt(Rb[2][1]*Rb[2][1] + Rb[2][2]*Rb[2][2]));
+      rpyb[2] = atan2(Rb[1][0], Rb[0][0]);
+      for(int i = 0; i < 3; i++)
+        ub[i] = rpy_cmd[i];
+    }
+
+    /**
+      * Dynamics error between the states at consecutive measurements
+      */
+    struct IntervalError {
+      IntervalError(const Vector4d &control, double h, const Vector15d &stdev_dynamics)
+        : control_(control), h_(h), stdev_dynamics_(stdev_dynamics) {
       }
 
       /**
        * @brief operator ()
-       * @param p_ Input Parameters (kt, kp, kd, offsets)
-       * @param res Output Residual based on measurements and parameters
+       * @param xa State at current measurement (p, v, rpy, w, u)
+       * @param xb State at next measurement
+       * @param gains kt, kp, kd
+       * @param offsets Offsets used in this interval
+       * @param res Difference between the propagated and the next state
        * @return  true
        */
-      bool operator()(double const* const* p_, double* res) const
+      template <typename T>
+      bool operator()(const T *xa, const T *xb, const T *gains, const T *offsets, T *res) const
       {
-        //Sample a trajectory using the given parameters from the system
-        int number_of_controls = inputs_.size();
-        const double *first_block = p_[0];// Initial State
-        const double *second_block = p_[1];//kt, kp, etc
-        const double *third_block = p_[2];//Offsets
-        QRotorIDState state, temp_state;// Iterating state for trajectory
-        setInitialState(first_block,state);// From parameters
-        //DEBUG:
-        //cout<<"Initial State"<<endl;
-        //cout<<state.p.transpose()<<" "<<state.v.transpose()<<" "<<state.w.transpose()<<" "<<state.u.transpose()<<endl;
-        //Find difference between the given state and initial state prior:
-        Vector15d prior_res;
-        sys_.X.Lift(prior_res,initial_state_prior_,state);
-        prior_res = prior_res.cwiseQuotient(parent_.stdev_initial_state_prior);
-        Matrix<double,13,1> sys_params;
-        for(int i = 0; i < 7; i++)
-            sys_params[i] = second_block[i];//kt, kp, kd etc
-        double offsets_prevtime = inputs_.at(0).t;
-        const double *offsets_ref = third_block;
-        double *offsets_dest_ref = sys_params.data()+7;
-        memcpy(offsets_dest_ref,offsets_ref,6*sizeof(double));
-        //int offset_count = 0;//Offset being used
-        //cout<<"Offset count: "<<offset_count<<endl;//DEBUG
-
-        double * res_ref = res;//Residual Reference to Copy to
-        Vector3d current_rpy;
-        for(int i = 0; i < number_of_controls-1; i++)
+        T x[15];
+        Step(x, xa, control_, h_, gains, offsets);
+        for(int i = 0; i < 15; i++)
         {
-            //DEBUG
-            //cout<<"Index step: "<<i<<endl;
-            const QRotorSystemIDMeasurement &current_meas = inputs_.at(i);
-            const QRotorSystemIDMeasurement &next_meas = inputs_.at(i+1);
-            //DEBUG
-            //cout<<"Current time, prev_offset_time: "<<current_meas.t<<" "<<offsets_prevtime<<endl;
-            if((current_meas.t - offsets_prevtime) >= parent_.offsets_timeperiod)
-            {
-                offsets_ref = offsets_ref + 6;
-
-                for(int i = 0; i < 6; i++)
-                  sys_params[7+i] = offsets_ref[i];//kt, kp, kd etc
-                //memcpy(offsets_dest_ref,offsets_ref,6*sizeof(double));
-                offsets_prevtime = current_meas.t;
-                //offset_count++;
-                //cout<<"Offset count: "<<offset_count<<endl;//DEBUG
-            }
-            double h = next_meas.t - current_meas.t;
-            sys_.Step(temp_state,current_meas.t,state,current_meas.control,h,&sys_params,0,0,0);
-            state = temp_state;
-            so3.g2q(current_rpy, state.R);
-            //Find residual for each measurement:
-            for(int j = 0; j < 3; j++)
-            {
-                res_ref[j] = (1/parent_.stdev_position)*(state.p[j] - next_meas.position[j]);
-                double error_angle = current_rpy[j] - next_meas.rpy[j];
-                error_angle = (error_angle > M_PI)?(error_angle - 2*M_PI):(error_angle < -M_PI)?(error_angle +2*M_PI):error_angle;
-                res_ref[j+3] = (1/parent_.stdev_rpy)*error_angle;
-            }
-            res_ref = res_ref+6;
+          T e = x[i] - xb[i];
+          if((i >= 6 && i < 9) || i >= 12)//angles (rpy and u)
+            e = WrapAngle(e);
+          res[i] = e/T(stdev_dynamics_[i]);
         }
-        //Residual for initial state
-        memcpy(res_ref,prior_res.data(),15*sizeof(double));
-        res_ref = res_ref + 15;
-
-        //Residual for gains
-        Map<const Vector7d> qrotor_gains(second_block);
-        Map<Vector7d> residual_gains(res_ref);
-        residual_gains = parent_.qrotor_gains_residualgain*(qrotor_gains - parent_.qrotor_gains);
-        res_ref = res_ref+7;
-
-        //Offsets:
-        offsets_ref = third_block;
-        for(int i = 0; i < number_offsets; i++)
+        return true;
+      }
+
+      static ceres::CostFunction* Create(const Vector4d &control, double h, const Vector15d &stdev_dynamics) {
+        return new ceres::AutoDiffCostFunction<IntervalError, 15, 15, 15, 7, 6>(new IntervalError(control, h, stdev_dynamics));
+      }
+      Vector4d control_;///< Input rpyt command
+      double h_;///< Time step
+      Vector15d stdev_dynamics_;///< Stdeviation of the dynamics error
+    };
+
+    /**
+      * Position and rpy measurement error
+      */
+    struct MeasurementError {
+      MeasurementError(const QRotorSystemIDMeasurement &meas, double stdev_position, double stdev_rpy)
+        : meas_(meas), stdev_position_(stdev_position), stdev_rpy_(stdev_rpy) {
+      }
+
+      template <typename T>
+      bool operator()(const T *x, T *res) const
+      {
+        for(int j = 0; j < 3; j++)
         {
-            Map<const Vector6d> current_offsets(offsets_ref);
-            Map<Vector6d> offset_res(res_ref);
-            offset_res = parent_.offsets_prior_residualgain*(current_offsets - parent_.offsets_prior);
-            //if(i != number_offsets)
-            //{
-            res_ref = res_ref + 6;//Size of offset
-            offsets_ref = offsets_ref+ 6;
-            //}
+          res[j] = (x[j] - T(meas_.position[j]))/T(stdev_position_);
+          res[j+3] = WrapAngle(x[6+j] - T(meas_.rpy[j]))/T(stdev_rpy_);
         }
+        return true;
+      }
+
+      static ceres::CostFunction* Create(const QRotorSystemIDMeasurement &meas, double stdev_position, double stdev_rpy) {
+        return new ceres::AutoDiffCostFunction<MeasurementError, 6, 15>(new MeasurementError(meas, stdev_position, stdev_rpy));
+      }
+      QRotorSystemIDMeasurement meas_;///< Measurement
+      double stdev_position_;///< Stdeviation on position measurement
+      double stdev_rpy_;///< Stdeviation on rpy measurement
+    };
+
+    /**
+      * Gaussian prior residual W*(x - x0) on an n-dim parameter block
+      */
+    template <int n>
+    struct ParameterPrior {
+      ParameterPrior(const Matrix<double, n, 1> &x0, const Matrix<double, n, n> &W)
+        : x0_(x0), W_(W) {
+      }
 
+      template <typename T>
+      bool operator()(const T *x, T *res) const
+      {
+        for(int i = 0; i < n; i++)
+        {
+          res[i] = T(0);
+          for(int j = 0; j < n; j++)
+            res[i] = res[i] + T(W_(i,j))*(x[j] - T(x0_[j]));
+        }
         return true;
       }
 
-      static ceres::CostFunction* Create(const vector<QRotorSystemIDMeasurement> &inputs, const QRotorIDState &initial_state, const QRotorSystemID &parent) {
+      static ceres::CostFunction* Create(const Matrix<double, n, 1> &x0, const Matrix<double, n, n> &W) {
+        return new ceres::AutoDiffCostFunction<ParameterPrior, n, n>(new ParameterPrior(x0, W));
+      }
+      Matrix<double, n, 1> x0_;///< Prior mean
+      Matrix<double, n, n> W_;///< Inverse square root of prior covariance
+    };
 
-        ceres::DynamicNumericDiffCostFunction<MeasurementError,ceres::CENTRAL> *costFunctor = new ceres::DynamicNumericDiffCostFunction<MeasurementError, ceres::CENTRAL>(
-                  new MeasurementError(inputs, initial_state, parent));
+    /**
+      * Prior error on the initial state
+      */
+    struct InitialStateError {
+      InitialStateError(const QRotorIDState &initial_state, const Vector15d &stdev_initial_state_prior)
+        : so3(SO3::Instance()), initial_state_prior_(initial_state), stdev_(stdev_initial_state_prior) {
+      }
+
+      inline void setInitialState(double const* p, QRotorIDState &initial_state) const
+      {
+          initial_state.p = Vector3d(p[0], p[1], p[2]);
+          initial_state.v = Vector3d(p[3],p[4],p[5]);
+          Vector3d rpy(p[6],p[7],p[8]);
+          so3.q2g(initial_state.R, rpy);
+          initial_state.w = Vector3d(p[9],p[10],p[11]);
+          initial_state.u = Vector3d(p[12],p[13],p[14]);
+      }
+
+      bool operator()(const double *p, double *res) const
+      {
+        QRotorIDState state;
+        setInitialState(p, state);
+        Vector15d prior_res;
+        sys_.X.Lift(prior_res,initial_state_prior_,state);
+        Map<Vector15d> residual(res);
+        residual = prior_res.cwiseQuotient(stdev_);
+        return true;
+      }
 
-        int number_offsets = std::ceil((inputs.back().t -inputs.front().t)/parent.offsets_timeperiod);//Offsets change every 0.1 secs
-        int number_of_parameters = 22+6*number_offsets;
-        costFunctor->AddParameterBlock(15);//15 for initial state
-        costFunctor->AddParameterBlock(7);//7 for kt, kp, etc;
-        costFunctor->AddParameterBlock(6*number_offsets);
-        int number_of_residuals = 6*(inputs.size()-1) + number_of_parameters;
-        costFunctor->SetNumResiduals(number_of_residuals);
-        return costFunctor;
+      static ceres::CostFunction* Create(const QRotorIDState &initial_state, const Vector15d &stdev_initial_state_prior) {
+        return new ceres::NumericDiffCostFunction<InitialStateError, ceres::CENTRAL, 15, 15>(new InitialStateError(initial_state, stdev_initial_state_prior));
       }
-      const vector<QRotorSystemIDMeasurement> &inputs_;
-      const QRotorIDState &initial_state_prior_;
       SO3 &so3;
-      int number_offsets;///<  Number of offsets
-      const QRotorSystemID &parent_;
+      QRotorIDState initial_state_prior_;///< Initial state prior
+      Vector15d stdev_;///< stdeviation on initial state prior
     };
 };
 }
@@ -0,0 +1,146 @@
+#include "qrotorsystemidlog.h"
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace gcop;
+using namespace std;
+using namespace Eigen;
+
+QRotorSystemIDLog::QRotorSystemIDLog():data_(0), size_(0), pos_(0), binary_(false), fd_(-1)
+{
+}
+
+QRotorSystemIDLog::~QRotorSystemIDLog()
+{
+  Close();
+}
+
+bool QRotorSystemIDLog::Open(const string &filename, bool binary)
+{
+  Close();
+  fd_ = open(filename.c_str(), O_RDONLY);
+  if(fd_ < 0)
+  {
+    cerr<<"[E] QRotorSystemIDLog::Open: cannot open "<<filename<<endl;
+    return false;
+  }
+  struct stat st;
+  if(fstat(fd_, &st) < 0)
+  {
+    Close();
+    return false;
+  }
+  size_ = st.st_size;
+  if(size_ > 0)
+  {
+    void *data = mmap(0, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+    if(data == MAP_FAILED)
+    {
+      cerr<<"[E] QRotorSystemIDLog::Open: cannot map "<<filename<<endl;
+      Close();
+      return false;
+    }
+    madvise(data, size_, MADV_SEQUENTIAL);//Read once front to back
+    data_ = (const char *)data;
+  }
+  pos_ = 0;
+  binary_ = binary;
+  return true;
+}
+
+void QRotorSystemIDLog::Close()
+{
+  if(data_)
+    munmap((void *)data_, size_);
+  if(fd_ >= 0)
+    close(fd_);
+  data_ = 0;
+  size_ = 0;
+  pos_ = 0;
+  fd_ = -1;
+}
+
+bool QRotorSystemIDLog::ParseLine(QRotorSystemIDMeasurement &measurement, const char *line, size_t length)
+{
+  //Copy to a terminated buffer since the mapped data is not
+  char buf[512];
+  if(length >= sizeof(buf))
+    length = sizeof(buf) - 1;
+  memcpy(buf, line, length);
+  buf[length] = 0;
+
+  double values[11];
+  char *s = buf, *end;
+  for(int i = 0; i < 11; i++)
+  {
+    while(*s == ' ' || *s == '\t' || *s == ',' || *s == '\r')
+      s++;
+    values[i] = strtod(s, &end);
+    if(end == s)
+      return false;
+    s = end;
+  }
+  measurement.t = values[0];
+  measurement.position = Map<Vector3d>(values + 1);
+  measurement.rpy = Map<Vector3d>(values + 4);
+  measurement.control = Map<Vector4d>(values + 7);
+  return true;
+}
+
+int QRotorSystemIDLog::Read(vector<QRotorSystemIDMeasurement> &measurements, int n)
+{
+  measurements.clear();
+  QRotorSystemIDMeasurement measurement;
+  if(binary_)
+  {
+    const size_t record_size = 11*sizeof(double);
+    while((int)measurements.size() < n && pos_ + record_size <= size_)
+    {
+      double values[11];
+      memcpy(values, data_ + pos_, record_size);
+      pos_ += record_size;
+      measurement.t = values[0];
+      measurement.position = Map<Vector3d>(values + 1);
+      measurement.rpy = Map<Vector3d>(values + 4);
+      measurement.control = Map<Vector4d>(values + 7);
+      measurements.push_back(measurement);
+    }
+  }
+  else
+  {
+    while((int)measurements.size() < n && pos_ < size_)
+    {
+      const char *line = data_ + pos_;
+      const char *eol = (const char *)memchr(line, '\n', size_ - pos_);
+      size_t length = eol ? eol - line : size_ - pos_;
+      pos_ += length + (eol ? 1 : 0);
+      if(ParseLine(measurement, line, length))//Skip empty or invalid lines
+        measurements.push_back(measurement);
+    }
+  }
+  return measurements.size();
+}
+
+bool QRotorSystemIDLog::WriteBinary(const string &filename, const vector<QRotorSystemIDMeasurement> &measurements)
+{
+  ofstream ofile(filename.c_str(), ios::binary);
+  if(!ofile.is_open())
+    return false;
+  for(size_t i = 0; i < measurements.size(); i++)
+  {
+    const QRotorSystemIDMeasurement &measurement = measurements[i];
+    double values[11];
+    values[0] = measurement.t;
+    Map<Vector3d>(values + 1) = measurement.position;
+    Map<Vector3d>(values + 4) = measurement.rpy;
+    Map<Vector4d>(values + 7) = measurement.control;
+    ofile.write((const char *)values, sizeof(values));
+  }
+  return ofile.good();
+}
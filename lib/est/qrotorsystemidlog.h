@@ -0,0 +1,92 @@
+// This file is part of libgcop, a library for Geometric Control, Optimization, and Planning (GCOP)
+//
+// Copyright (C) 2004-2014 Marin Kobilarov <marin(at)jhu.edu>
+//
+// This Source Code Form is subject to the terms of the Mozilla
+// Public License v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#ifndef QROTORSYSTEMIDLOG_H
+#define QROTORSYSTEMIDLOG_H
+/**
+ * @brief The QRotorSystemIDLog class
+ * Reads quadrotor system identification measurements from a log file in chunks, without loading
+ * the whole file in memory. The file is memory-mapped and parsed on demand.
+ *
+ * Text logs have one measurement per line: t, position (3), rpy (3), control (4) separated by
+ * spaces, tabs or commas (the format of data/QuadSystemIDMeasurements*.csv). Binary logs are
+ * sequences of the same 11 values as native doubles.
+ */
+
+#include <Eigen/Dense>
+#include <vector>
+#include <string>
+
+namespace gcop {
+
+using namespace std;
+using namespace Eigen;
+
+struct QRotorSystemIDMeasurement {
+    Vector3d position;///< Position
+    Vector3d rpy;///< Measured rpy
+    Vector4d control;///< Input rpyt command
+    double t;///< Measured time
+};
+
+class QRotorSystemIDLog
+{
+public:
+    QRotorSystemIDLog();
+    ~QRotorSystemIDLog();
+
+    /**
+     * @brief Open a log file
+     * @param filename Log file
+     * @param binary Whether the log is binary or text
+     * @return true on success
+     */
+    bool Open(const string &filename, bool binary = false);
+
+    /**
+     * @brief Close the log file
+     */
+    void Close();
+
+    /**
+     * @brief Read the next measurements
+     * @param measurements Read measurements (cleared first)
+     * @param n Maximum number of measurements to read
+     * @return Number of read measurements (0 at the end of the log)
+     */
+    int Read(vector<QRotorSystemIDMeasurement> &measurements, int n);
+
+    /**
+     * @brief Go back to the start of the log
+     */
+    void Rewind() { pos_ = 0; }
+
+    /**
+     * @brief Write measurements to a binary log
+     * @param filename Log file
+     * @param measurements Measurements
+     * @return true on success
+     */
+    static bool WriteBinary(const string &filename, const vector<QRotorSystemIDMeasurement> &measurements);
+
+protected:
+    /**
+     * @brief Parse one text line
+     * @return true if the line contains a measurement
+     */
+    static bool ParseLine(QRotorSystemIDMeasurement &measurement, const char *line, size_t length);
+
+    const char *data_;///< Mapped file contents
+    size_t size_;///< File size
+    size_t pos_;///< Current position in file
+    bool binary_;///< Whether the log is binary
+    int fd_;///< File descriptor
+};
+}
+
+#endif // QROTORSYSTEMIDLOG_H
@@ -0,0 +1,278 @@
+#include <iostream>
+#include <cmath>
+#include "sparsegp.h"
+
+using namespace gcop;
+using namespace Eigen;
+
+SparseGP::SparseGP(int d, int m, int n, Type type) :
+  GP(d), m(m), type(type), Zs(d, 0), jitter(1e-8),
+  fLf(0), ldL(0), tr(0)
+{
+  Xs.resize(d, n);
+  fs.resize(n);
+  this->n = n;
+}
+
+SparseGP::~SparseGP()
+{
+}
+
+
+double SparseGP::Noise() const
+{
+  return std::max(sigma*sigma, jitter*s*s);
+}
+
+
+void SparseGP::SelectInducing()
+{
+  n = Xs.cols();
+  int nz = std::min(m, n);
+  Zs.resize(d, nz);
+  if (!nz)
+    return;
+
+  // squared distance of each point to the closest selected point
+  VectorXd ds = VectorXd::Constant(n, INFINITY);
+  int j = 0;
+  for (int k = 0; k < nz; ++k) {
+    Zs.col(k) = Xs.col(j);
+    ds = ds.cwiseMin((Xs.colwise() - Xs.col(j)).colwise().squaredNorm().transpose());
+    ds.maxCoeff(&j);
+  }
+}
+
+
+void SparseGP::Train(const MatrixXd &Xs, const VectorXd &fs)
+{
+  this->Xs = Xs;
+  this->fs = fs;
+  SelectInducing();
+  Train();
+}
+
+
+void SparseGP::Train()
+{
+  n = Xs.cols();
+  if (!Zs.cols())
+    SelectInducing();
+  int nz = Zs.cols();
+
+  MatrixXd Kmm;
+  SqExp(Kmm, Zs, Zs);
+  Kmm.diagonal().array() += jitter*s*s;
+  Lm.compute(Kmm);
+
+  // V = inv(Lm)*Kmn, so that Qnn = V'*V
+  MatrixXd V;
+  SqExp(V, Zs, Xs);
+  Lm.matrixL().solveInPlace(V);
+
+  double sn2 = Noise();
+  ArrayXd kq = (s*s - V.colwise().squaredNorm().array()).max(0);
+  ArrayXd ls = (type == FITC ? (kq + sn2).eval() : ArrayXd::Constant(n, sn2));
+  ArrayXd li = ls.inverse();
+
+  // B = I + V*inv(Lambda)*V'
+  MatrixXd B = MatrixXd::Identity(nz, nz);
+  B.selfadjointView<Eigen::Lower>().rankUpdate(V*li.sqrt().matrix().asDiagonal());
+  Lb.compute(B);
+
+  c = V*(li*fs.array()).matrix();
+  fLf = (li*fs.array().square()).sum();
+  ldL = ls.log().sum();
+  tr = kq.sum();
+
+  Solve();
+}
+
+
+void SparseGP::Solve()
+{
+  w = Lb.solve(c);
+  Lm.matrixU().solveInPlace(w);
+}
+
+
+bool SparseGP::Add(const VectorXd &x, double f)
+{
+  int n = Xs.cols();
+
+  if (eps > 0)
+    for (int i = 0; i < n; ++i)
+      if ((x - Xs.col(i)).norm() < eps)
+        return false;
+
+  fs.conservativeResize(n + 1);
+  fs[n] = f;
+
+  Xs.conservativeResize(d, n + 1);
+  Xs.col(n) = x;
+  this->n = n + 1;
+
+  // not enough inducing points yet: use x as one and retrain
+  if (Zs.cols() < m) {
+    Zs.conservativeResize(d, Zs.cols() + 1);
+    Zs.col(Zs.cols() - 1) = x;
+    Train();
+    return true;
+  }
+
+  MatrixXd u;
+  SqExp(u, Zs, x);
+  Lm.matrixL().solveInPlace(u);
+
+  double kq = std::max(s*s - u.squaredNorm(), 0.0);
+  double ls = (type == FITC ? kq + Noise() : Noise());
+
+  Lb.rankUpdate(u.col(0), 1/ls);
+  c += u.col(0)*(f/ls);
+  fLf += f*f/ls;
+  ldL += log(ls);
+  tr += kq;
+
+  Solve();
+  return true;
+}
+
+
+double SparseGP::Predict(const VectorXd &x, double *s) const
+{
+  MatrixXd k;
+  SqExp(k, Zs, x);
+  double mx = k.col(0).dot(w);
+
+  if (s) {
+    Lm.matrixL().solveInPlace(k);
+    double kk = k.squaredNorm();
+    Lb.matrixL().solveInPlace(k);
+    *s = this->s*this->s - kk + k.squaredNorm();
+
+    if (sigma > 0)
+      *s += sigma*sigma;
+  }
+
+  return mx;
+}
+
+
+void SparseGP::Predict(VectorXd &ms, const MatrixXd &X, VectorXd *ss) const
+{
+  MatrixXd Ks;
+  SqExp(Ks, Zs, X);
+  ms = Ks.transpose()*w;
+
+  if (ss) {
+    Lm.matrixL().solveInPlace(Ks);
+    ArrayXd kk = Ks.colwise().squaredNorm().transpose();
+    Lb.matrixL().solveInPlace(Ks);
+    *ss = (s*s - kk + Ks.colwise().squaredNorm().transpose().array()).matrix();
+
+    if (sigma > 0)
+      ss->array() += sigma*sigma;
+  }
+}
+
+
+double SparseGP::LogL(Vector3d &dll)
+{
+  n = Xs.cols();
+  int nz = Zs.cols();
+
+  // dlogL/dp = (a'*dC*a - tr(inv(C)*dC))/2 for C = Qnn + Lambda and
+  // a = inv(C)*fs, where dQnn = dKnm*U + U'*dKmn - U'*dKmm*U with
+  // U = inv(Kmm)*Kmn. Only m-n matrices are formed, using
+  // inv(C) = inv(Lambda) - inv(Lambda)*V'*inv(B)*V*inv(Lambda) as in Train.
+  MatrixXd Kmm, Dmm, Kmn, Dmn;
+  SqExp(Kmm, Zs, Zs);
+  SqDist(Dmm, Zs, Zs);
+  SqExp(Kmn, Zs, Xs);
+  SqDist(Dmn, Zs, Xs);
+
+  MatrixXd V = Lm.matrixL().solve(Kmn);
+  MatrixXd U = Lm.matrixU().solve(V);
+
+  double sn2 = Noise();
+  ArrayXd kq = s*s - V.colwise().squaredNorm().array();
+  ArrayXd kp = (kq > 0).cast<double>();   // where kq is not clipped
+  kq = kq.max(0);
+  ArrayXd ls = (type == FITC ? (kq + sn2).eval() : ArrayXd::Constant(n, sn2));
+  ArrayXd li = ls.inverse();
+
+  VectorXd a = (li*(fs - V.transpose()*Lb.solve(c)).array()).matrix();
+  VectorXd b = U*a;
+
+  // G = U*inv(C) = inv(Lm)'*inv(B)*V*inv(Lambda), H = G*U' and diag(inv(C))
+  MatrixXd G = V*li.matrix().asDiagonal();
+  Lb.matrixL().solveInPlace(G);
+  ArrayXd ci = li - G.colwise().squaredNorm().transpose().array();
+  Lb.matrixU().solveInPlace(G);
+  Lm.matrixU().solveInPlace(G);
+  MatrixXd H = G*U.transpose();
+
+  // derivatives of Kmm, Kmn, diag(Knn) and of the noise variance
+  // (which is either sigma^2 or jitter*s^2)
+  bool js = (jitter*s*s > sigma*sigma);
+  MatrixXd dKmm, dKmn;
+  for (int i = 0; i < 3; ++i) {
+    double dkd, dsn2;
+    if (i == 0) {
+      dKmm = Kmm.cwiseProduct(Dmm)/(l*l*l);
+      dKmn = Kmn.cwiseProduct(Dmn)/(l*l*l);
+      dkd = 0;
+      dsn2 = 0;
+    } else if (i == 1) {
+      dKmm = 2/s*Kmm;
+      dKmm.diagonal().array() += 2*jitter*s;
+      dKmn = 2/s*Kmn;
+      dkd = 2*s;
+      dsn2 = (js ? 2*jitter*s : 0);
+    } else {
+      dll[2] = 0;
+      if (sigma <= 0)
+        break;
+      dKmm.setZero(nz, nz);
+      dKmn.setZero(nz, n);
+      dkd = 0;
+      dsn2 = (js ? 0 : 2*sigma);
+    }
+
+    ArrayXd dQd = 2*(dKmn.cwiseProduct(U)).colwise().sum().transpose().array() -
+      (U.cwiseProduct(dKmm*U)).colwise().sum().transpose().array();
+    double aQa = 2*b.dot(dKmn*a) - b.dot(dKmm*b);
+    double trQ = 2*G.cwiseProduct(dKmn).sum() - H.cwiseProduct(dKmm).sum();
+    ArrayXd dkq = kp*(dkd - dQd);
+    ArrayXd dl = (type == FITC ? (dkq + dsn2).eval() : ArrayXd::Constant(n, dsn2));
+
+    dll[i] = (aQa - trQ)/2 + ((a.array().square() - ci)*dl).sum()/2;
+
+    if (type == VFE)
+      dll[i] += -dkq.sum()/(2*sn2) + kq.sum()*dsn2/(2*sn2*sn2);
+  }
+
+  return SparseGP::LogL();
+}
+
+
+double SparseGP::LogL(double dll[2])
+{
+  if (dll) {
+    Vector3d dl;
+    double ll = LogL(dl);
+    dll[0] = dl[0];
+    dll[1] = dl[1];
+    return ll;
+  }
+
+  // using det(Qnn + Lambda) = det(Lambda)*det(B) and the Woodbury identity
+  VectorXd v = Lb.matrixL().solve(c);
+  double ll = -(fLf - v.squaredNorm())/2 - ldL/2 -
+    Lb.matrixLLT().diagonal().array().log().sum() - n*log(2*M_PI)/2;
+
+  if (type == VFE)
+    ll -= tr/(2*Noise());
+
+  return ll;
+}
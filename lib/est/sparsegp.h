@@ -0,0 +1,131 @@
+// This file is part of libgcop, a library for Geometric Control, Optimization, and Planning (GCOP)
+//
+// Copyright (C) 2004-2014 Marin Kobilarov <marin(at)jhu.edu>
+//
+// This Source Code Form is subject to the terms of the Mozilla
+// Public License v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#ifndef GCOP_SPARSEGP_H
+#define GCOP_SPARSEGP_H
+
+#include "gp.h"
+
+namespace gcop {
+
+  /**
+   * Sparse GP based on m inducing points Zs (FITC or VFE approximation).
+   *
+   * Only m-m matrices are formed: training costs O(n m^2), adding a point
+   * costs O(m^2) (a rank-one update of the Cholesky factor), and
+   * predicting the mean at a point costs O(m). The data are still stored
+   * in Xs and fs, while K, Ki, L and a of GP are not used.
+   *
+   * The inducing points are chosen among the data by SelectInducing
+   * (greedily taking the point farthest from the ones already chosen)
+   * unless they are set directly. While fewer than m inducing points are
+   * available, each added point also becomes an inducing point.
+   *
+   * With m >= n and the inducing points equal to the data both
+   * approximations give the same predictions as GP.
+   */
+  class SparseGP : public GP {
+  public:
+
+    enum Type { FITC, VFE };
+
+    /**
+     * Initialize a sparse GP with dimension d and m inducing points
+     * @param d dimension
+     * @param m number of inducing points
+     * @param n number of points (optional)
+     * @param type approximation type
+     */
+    SparseGP(int d, int m, int n = 0, Type type = FITC);
+
+    virtual ~SparseGP();
+
+    /**
+     * Add a new data point in O(m^2)
+     * @param x data vector
+     * @param f value
+     * @return true if OK
+     */
+    bool Add(const Eigen::VectorXd &x,
+             double f);
+
+    /**
+     * Train using current data and inducing points (these are
+     * selected first if none are set)
+     */
+    void Train();
+
+    /**
+     * Select inducing points among the data and train
+     * @param d-n matrix of data vectors
+     * @param n-vector of values
+     */
+    void Train(const Eigen::MatrixXd &Xs,
+               const Eigen::VectorXd &fs);
+
+    /**
+     * Choose min(m,n) inducing points among the data, starting with the
+     * first one and then adding the point farthest from the selected ones
+     */
+    void SelectInducing();
+
+    double Predict(const Eigen::VectorXd &x,
+                   double *s = 0) const;
+
+    void Predict(Eigen::VectorXd &ms,
+                 const Eigen::MatrixXd &X,
+                 Eigen::VectorXd *ss = 0) const;
+
+    /**
+     * Approximate log-likelihood (for VFE this is the variational lower bound)
+     * @param dll derivative of log-liklihood w.r. to l and s
+     * @return log-likelihood
+     */
+    double LogL(double dll[2] = 0);
+
+    /**
+     * Approximate log-likelihood and its analytic derivative w.r.t. l, s
+     * and sigma, in O(n m^2) using the factors computed in Train (the
+     * inducing points are held fixed)
+     * @param dll derivative of log-liklihood w.r. to l, s and sigma
+     *        (the last one is 0 if sigma <= 0)
+     * @return log-likelihood
+     */
+    double LogL(Eigen::Vector3d &dll);
+
+    int m;              ///< number of inducing points
+    Type type;          ///< approximation type
+
+    Eigen::MatrixXd Zs; ///< inducing points
+
+    double jitter;      ///< relative diagonal regularization of the inducing points covariance
+
+  protected:
+    /**
+     * Noise variance (at least jitter*s^2 to keep the problem well-posed)
+     */
+    double Noise() const;
+
+    /**
+     * Recompute the mean weights w from c
+     */
+    void Solve();
+
+    Eigen::LLT<Eigen::MatrixXd> Lm;  ///< Cholesky factor of Kmm
+    Eigen::LLT<Eigen::MatrixXd> Lb;  ///< Cholesky factor of B = I + V*inv(Lambda)*V', V = inv(Lm)*Kmn
+
+    Eigen::VectorXd c;  ///< V*inv(Lambda)*fs
+    Eigen::VectorXd w;  ///< weights of the predicted mean, i.e. m(x) = k(Zs,x)'*w
+
+    double fLf;         ///< fs'*inv(Lambda)*fs
+    double ldL;         ///< log(det(Lambda))
+    double tr;          ///< trace(Knn - Qnn)
+  };
+}
+
+#endif
@@ -0,0 +1,285 @@
+#ifndef GCOP_SQRTUNSCENTEDFILTER_H
+#define GCOP_SQRTUNSCENTEDFILTER_H
+
+#include "predictor.h"
+#include "corrector.h"
+#include "unscentedbase.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace gcop {
+
+  using namespace std;
+
+  /**
+   * Square-root unscented Kalman filter.
+   *
+   * Instead of refactoring the covariance at every step, the filter
+   * propagates its lower-triangular square root S (P = S*S') using a QR
+   * decomposition of the weighted sigma point deviations and rank-one
+   * updates. The factor of the last computed belief is cached, so that
+   * alternating Predict and Correct calls never factorize the covariance.
+   * The covariance P of the returned beliefs is still set (as S*S') and a
+   * belief with any other P is factorized first. If round-off makes a
+   * covariance indefinite the filter falls back to a clamped eigenvalue
+   * decomposition rather than failing.
+   *
+   * Sigma points can be propagated and measured in parallel (using OpenMP).
+   * Since systems and sensors may keep internal state, each thread uses its
+   * own copy: add copies of sys to systems and of sensor to sensors (both
+   * contain only sys and sensor by default, in which case the evaluation
+   * is sequential).
+   */
+  template <typename T = VectorXd,
+    int _nx = Dynamic,
+    int _nu = Dynamic,
+    int _np = Dynamic,
+    typename Tz = VectorXd,
+    int _nz = Dynamic> class SqrtUnscentedFilter :
+    public Predictor<T, _nx, _nu, _np>,
+    public Corrector<T, _nx, _nu, _np, Tz, _nz>,
+    public UnscentedBase<T, _nx> {
+  public:
+
+  typedef Matrix<double, _nx, 1> Vectornd;
+  typedef Matrix<double, _nu, 1> Vectorcd;
+  typedef Matrix<double, _np, 1> Vectormd;
+
+  typedef Matrix<double, _nx, _nx> Matrixnd;
+  typedef Matrix<double, _nx, _nz> Matrixnrd;
+
+  typedef Matrix<double, _nz, 1> Vectorrd;
+  typedef Matrix<double, _nz, _nz> Matrixrd;
+
+  SqrtUnscentedFilter(System<T, _nx, _nu, _np> &sys,
+                      Sensor<T, _nx, _nu, _np, Tz, _nz> &sensor);
+
+  virtual ~SqrtUnscentedFilter();
+
+  virtual bool Predict(T& xb, double t, const T &xa,
+                       const Vectorcd &u, double h,
+                       const Vectormd *p = 0, bool cov = true);
+
+  virtual bool Correct(T& xb, double t, const T &xa,
+                       const Vectorcd &u, const Tz &z,
+                       const Vectormd *p = 0, bool cov = true);
+
+  vector<System<T, _nx, _nu, _np>*> systems;            ///< systems used to propagate sigma points in parallel
+  vector<Sensor<T, _nx, _nu, _np, Tz, _nz>*> sensors;   ///< sensors used to measure sigma points in parallel
+
+  protected:
+
+  /**
+   * Set the square root A of the covariance of x, reusing the cached one
+   * if x is the last computed belief
+   */
+  void Factor(const T &x);
+
+  /**
+   * Cache the square root A as the one of belief x and set x.P
+   */
+  void Store(T &x);
+
+  vector<T> Xps;    ///< predicted state sigma points
+  vector<Tz> Zs;    ///< measurement sigma points
+  vector<Vectornd> dxs;  ///< sigma point state deviations
+
+  Matrixnd Q;       ///< discrete-time process noise covariance
+  Matrixnd Sq;      ///< square root of Q
+  Matrixrd Sr;      ///< square root of the sensor noise covariance
+  Matrixrd Sz;      ///< square root of the measurement covariance
+  Matrixnrd Pxz;    ///< state-measurement cross covariance
+
+  Matrixnd Sc;      ///< cached square root of the last computed belief covariance
+  Matrixnd Pc;      ///< last computed belief covariance
+  bool cached;      ///< whether Sc and Pc are set
+  };
+
+
+  template <typename T, int _nx, int _nu, int _np, typename Tz, int _nz>
+    SqrtUnscentedFilter<T, _nx, _nu, _np, Tz, _nz>::SqrtUnscentedFilter(System<T, _nx, _nu, _np> &sys,
+                                                                        Sensor<T, _nx, _nu, _np, Tz, _nz> &sensor) :
+    Predictor<T, _nx, _nu, _np>(sys),
+    Corrector<T, _nx, _nu, _np, Tz, _nz>(sys.X, sensor),
+    UnscentedBase<T, _nx>(sys.X),
+    systems(1, &sys),
+    sensors(1, &sensor),
+    Xps(2*sys.X.n + 1),
+    Zs(2*sys.X.n + 1),
+    dxs(2*sys.X.n + 1),
+    cached(false) {
+
+    if (_nx == Dynamic) {
+      Q.resize(sys.X.n, sys.X.n);
+      Sq.resize(sys.X.n, sys.X.n);
+      Sc.resize(sys.X.n, sys.X.n);
+      Pc.resize(sys.X.n, sys.X.n);
+    }
+    Q.setZero();
+    if (_nz == Dynamic) {
+      Sr.resize(sensor.Z.n, sensor.Z.n);
+      Sz.resize(sensor.Z.n, sensor.Z.n);
+    }
+    if (_nx == Dynamic || _nz == Dynamic) {
+      Pxz.resize(sys.X.n, sensor.Z.n);
+    }
+  }
+
+  template <typename T, int _nx, int _nu, int _np, typename Tz, int _nz>
+    SqrtUnscentedFilter<T, _nx, _nu, _np, Tz, _nz>::~SqrtUnscentedFilter() {
+  }
+
+  template <typename T, int _nx, int _nu, int _np, typename Tz, int _nz>
+    void SqrtUnscentedFilter<T, _nx, _nu, _np, Tz, _nz>::Factor(const T &x) {
+    if (cached && x.P == Pc)
+      this->A = Sc;
+    else
+      this->Sqrt(this->A, x.P);
+  }
+
+  template <typename T, int _nx, int _nu, int _np, typename Tz, int _nz>
+    void SqrtUnscentedFilter<T, _nx, _nu, _np, Tz, _nz>::Store(T &x) {
+    x.P = this->A*this->A.transpose();
+    Sc = this->A;
+    Pc = x.P;
+    cached = true;
+  }
+
+  template <typename T, int _nx, int _nu, int _np, typename Tz, int _nz>
+    bool SqrtUnscentedFilter<T, _nx, _nu, _np, Tz, _nz>::Predict(T& xb, double t, const T &xa,
+                                                                 const Vectorcd &u, double h,
+                                                                 const Vectormd *p, bool cov) {
+    int n = this->L;
+    int N = 2*n + 1;
+
+    Factor(xa);
+    this->Points(this->Xs, xa, this->A);
+
+    int nt = systems.size();
+#pragma omp parallel for num_threads(nt) if (nt > 1)
+    for (int i = 0; i < N; ++i) {
+      int k = 0;
+#ifdef _OPENMP
+      k = omp_get_thread_num();
+#endif
+      systems[k]->Step(Xps[i], t, this->Xs[i], u, h, p);
+    }
+
+    // average difference
+    Vectornd dx;
+    dx.setZero();
+    for (int i = 0; i < N; ++i) {
+      this->sys.X.Lift(dxs[i], Xps[0], Xps[i]);
+      dx = dx + this->Ws[i]*dxs[i];   ///< average in exponential coordinates
+    }
+    this->sys.X.Retract(xb, Xps[0], dx);
+
+    for (int i = 0; i < N; ++i)
+      this->sys.X.Lift(dxs[i], xb, Xps[i]);   ///< variation from propagated mean
+
+    this->sys.Noise(Q, t, xa, u, h, p);
+    this->Sqrt(Sq, Q);
+
+    // P = M*M' + Wc[0]*dxs[0]*dxs[0]' for M = [sqrt(Wc[1])*dxs[1:2n], Sq],
+    // and M' = Q*R gives M*M' = R'*R
+    MatrixXd Mt(3*n, n);
+    double sw = sqrt(this->Wc[1]);
+    for (int i = 1; i < N; ++i)
+      Mt.row(i - 1) = sw*dxs[i].transpose();
+    Mt.bottomRows(n) = Sq.transpose();
+    HouseholderQR<MatrixXd> qr(Mt);
+    this->A = qr.matrixQR().topRows(n).template triangularView<Eigen::Upper>().transpose();
+    for (int j = 0; j < n; ++j)
+      if (this->A(j,j) < 0)
+        this->A.col(j) = -this->A.col(j);
+
+    Matrixnd A0 = this->A;
+    Vectornd v = dxs[0];
+    if (!this->RankUpdate(this->A, v, this->Wc[0]))
+      this->Sqrt(this->A, (A0*A0.transpose() + this->Wc[0]*dxs[0]*dxs[0].transpose()).eval());
+
+    Store(xb);
+    return true;
+  }
+
+  template <typename T, int _nx, int _nu, int _np, typename Tz, int _nz>
+    bool SqrtUnscentedFilter<T, _nx, _nu, _np, Tz, _nz>::Correct(T& xb, double t, const T &xa,
+                                                                 const Vectorcd &u, const Tz &z,
+                                                                 const Vectormd *p, bool cov) {
+    int n = this->L;
+    int N = 2*n + 1;
+    int nz = this->sensor.Z.n;
+
+    Factor(xa);
+    this->Points(this->Xs, xa, this->A);
+
+    int nt = sensors.size();
+#pragma omp parallel for num_threads(nt) if (nt > 1)
+    for (int i = 0; i < N; ++i) {
+      int k = 0;
+#ifdef _OPENMP
+      k = omp_get_thread_num();
+#endif
+      (*sensors[k])(Zs[i], t, this->Xs[i], u, p);
+    }
+
+    Vectorrd zm;
+    if (_nz == Dynamic)
+      zm.resize(nz);
+    zm.setZero();
+    for (int i = 0; i < N; ++i)
+      zm = zm + this->Ws[i]*Zs[i];
+
+    // Sz from the QR decomposition of [sqrt(Wc[1])*dzs[1:2n], Sr]' (as in
+    // Predict) and the cross covariance Pxz
+    this->Sqrt(Sr, this->sensor.R);
+    MatrixXd Mt(2*n + nz, nz);
+    double sw = sqrt(this->Wc[1]);
+    Pxz.setZero();
+    Vectorrd dz0;
+    for (int i = 0; i < N; ++i) {
+      Vectorrd dz = Zs[i] - zm;
+      this->sys.X.Lift(dxs[i], xa, this->Xs[i]);      // variations from mean
+      Pxz = Pxz + this->Wc[i]*dxs[i]*dz.transpose();
+      if (i)
+        Mt.row(i - 1) = sw*dz.transpose();
+      else
+        dz0 = dz;
+    }
+    Mt.bottomRows(nz) = Sr.transpose();
+    HouseholderQR<MatrixXd> qr(Mt);
+    Sz = qr.matrixQR().topRows(nz).template triangularView<Eigen::Upper>().transpose();
+    for (int j = 0; j < nz; ++j)
+      if (Sz(j,j) < 0)
+        Sz.col(j) = -Sz.col(j);
+
+    Matrixrd Sz0 = Sz;
+    Vectorrd v = dz0;
+    if (!this->RankUpdate(Sz, v, this->Wc[0]))
+      this->Sqrt(Sz, (Sz0*Sz0.transpose() + this->Wc[0]*dz0*dz0.transpose()).eval());
+
+    // K = Pxz*inv(Sz*Sz')
+    Matrixnrd K = Sz.transpose().template triangularView<Eigen::Upper>().solve(Sz.template triangularView<Eigen::Lower>().solve(Pxz.transpose())).transpose();
+
+    Vectornd dx = K*(z - zm);
+    this->sys.X.Retract(xb, xa, dx);
+
+    // P = P - (K*Sz)*(K*Sz)' using one rank-one downdate per measurement
+    Matrixnrd U = K*Sz;
+    Matrixnd A0 = this->A;
+    for (int j = 0; j < nz; ++j) {
+      Vectornd uj = U.col(j);
+      if (!this->RankUpdate(this->A, uj, -1)) {
+        this->Sqrt(this->A, (A0*A0.transpose() - U*U.transpose()).eval());
+        break;
+      }
+    }
+
+    Store(xb);
+    return true;
+  }
+}
+
+
+#endif
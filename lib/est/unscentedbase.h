@@ -26,6 +26,38 @@ namespace gcop {
    */
   void Points(vector<T> &xs,
               const T& x);
+
+  /**
+   * Compute 2*L+1 sigma points given mean x and a square root S of its
+   * covariance, i.e. x.P = S*S'
+   * @param Xs a vector of 2*L+1 states
+   * @param x mean state
+   * @param S the square root of the covariance
+   */
+  void Points(vector<T> &xs,
+              const T& x, const Matrixnd &S);
+
+  /**
+   * Lower-triangular square root S of a covariance P, i.e. P = S*S'.
+   * If P is not positive definite (due to round-off) its eigenvalues
+   * are clamped to a small positive value.
+   * @param S square root
+   * @param P covariance
+   * @return true if P was positive definite
+   */
+  template <typename M>
+    static bool Sqrt(M &S, const M &P);
+
+  /**
+   * Rank-one update of a lower-triangular square root S, so that on
+   * return S*S' is the old S*S' + w*v*v'
+   * @param S square root
+   * @param v vector (modified)
+   * @param w weight (can be negative)
+   * @return false if the result is not positive definite (S is then invalid)
+   */
+  template <typename M, typename V>
+    static bool RankUpdate(M &S, V &v, double w);
   
   Manifold<T, _nx> &X; ///< manifold
 
@@ -83,31 +115,67 @@ namespace gcop {
   template <typename T, int _nx> 
     void UnscentedBase<T, _nx>::Points(vector<T> &Xs,
                                        const T &x) {
-    Xs[0] = x;
-    
-    A = x.P.llt().matrixL().transpose();
-    bool pd = true;
-    
-    if (!pd) {
-      cout << "[W] UKF::Predict: Cholesky failed!" << endl;
+    if (!Sqrt(A, x.P)) {
+      cout << "[W] UKF::Points: Cholesky failed!" << endl;
     }
-    
-    //    cout << "A=" << A << endl;
+    Points(Xs, x, A);
+  }
+
+  template <typename T, int _nx> 
+    void UnscentedBase<T, _nx>::Points(vector<T> &Xs,
+                                       const T &x, const Matrixnd &S) {
+    Xs[0] = x;
     
     for (int i = 0; i < L; ++i) {
-      Vectornd dx = sqrt(L+l)*A.col(i);
-      Vectornd dxm = -sqrt(L+l)*A.col(i);
+      Vectornd dx = sqrt(L+l)*S.col(i);
+      Vectornd dxm = -sqrt(L+l)*S.col(i);
       
       this->X.Retract(Xs[i + 1], x, dx);
-      /*
-      cout << "#i=" << i << endl;
-      cout << "x.R=" << x.R << endl;
-      cout << "dx=" << dx.transpose() << endl;
-      cout << "R=" << Xs[i+1].R << endl;
-      */
       this->X.Retract(Xs[i + 1 + L], x, dxm);
     }
   }
+
+  template <typename T, int _nx> template <typename M>
+    bool UnscentedBase<T, _nx>::Sqrt(M &S, const M &P) {
+    LLT<M> llt(P);
+    if (llt.info() == Eigen::Success) {
+      S = llt.matrixL();
+      return true;
+    }
+
+    // P = V*D*V' = (V*sqrt(D))*(V*sqrt(D))' and then triangularize
+    // using (V*sqrt(D))' = Q*R, i.e. P = R'*R
+    SelfAdjointEigenSolver<M> es(P);
+    double e = 1e-12*es.eigenvalues().cwiseAbs().maxCoeff();
+    M B = (es.eigenvectors()*es.eigenvalues().cwiseMax(e).cwiseSqrt().asDiagonal()).transpose();
+    HouseholderQR<M> qr(B);
+    S = qr.matrixQR().template triangularView<Eigen::Upper>().transpose();
+    for (int j = 0; j < S.cols(); ++j)
+      if (S(j,j) < 0)
+        S.col(j) = -S.col(j);
+    return false;
+  }
+
+  template <typename T, int _nx> template <typename M, typename V>
+    bool UnscentedBase<T, _nx>::RankUpdate(M &S, V &v, double w) {
+    int n = S.rows();
+    double sg = (w < 0 ? -1 : 1);
+    v *= sqrt(fabs(w));
+    for (int k = 0; k < n; ++k) {
+      double r2 = S(k,k)*S(k,k) + sg*v(k)*v(k);
+      if (!(r2 > 0) || !(S(k,k) > 0))
+        return false;
+      double r = sqrt(r2);
+      double c = r/S(k,k);
+      double s = v(k)/S(k,k);
+      S(k,k) = r;
+      if (k < n - 1) {
+        S.col(k).tail(n - k - 1) = (S.col(k).tail(n - k - 1) + sg*s*v.tail(n - k - 1))/c;
+        v.tail(n - k - 1) = c*v.tail(n - k - 1) - s*S.col(k).tail(n - k - 1);
+      }
+    }
+    return true;
+  }
 }
 
 
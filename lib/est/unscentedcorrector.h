@@ -57,7 +57,7 @@ namespace gcop {
   template <typename T, int _nx, int _nu, int _np, typename Tz, int _nz> 
     UnscentedCorrector<T, _nx, _nu, _np, Tz, _nz>::UnscentedCorrector(System<T, _nx, _nu, _np>  &sys, 
                                                                       Sensor<T, _nx, _nu, _np, Tz, _nz> &sensor) : 
-    Corrector<T, _nx, _nu, _np, Tz, _nz>(sys, sensor),
+    Corrector<T, _nx, _nu, _np, Tz, _nz>(sys.X, sensor),
     UnscentedBase<T, _nx>(sys.X),
     Zs(2*sys.X.n + 1) {
     
@@ -89,7 +89,7 @@ namespace gcop {
     vector<Vectornd> dxs(2*this->L+1);
 
     for (int i = 0; i < 2*this->L+1; ++i) {
-      sensor(Zs[i], t, this->Xs[i], u, p);
+      this->sensor(Zs[i], t, this->Xs[i], u, p);
       zm = zm + this->Ws[i]*Zs[i];
       //      dx = dx + Ws[i]*dxs[i];
       //cout << "Zs["<<i<<"]=" << Zs[i].transpose() << endl;
@@ -107,7 +107,7 @@ namespace gcop {
 
     for (int i = 0; i < 2*this->L+1; ++i) {
       Vectorrd dz = Zs[i] - zm;
-      this->sys.X.Lift(dxs[i], xa, this->Xs[i]);      // variations from mean
+      UnscentedBase<T, _nx>::X.Lift(dxs[i], xa, this->Xs[i]);      // variations from mean
       /*
       Vector3d rpy;
       SO3::Instance().g2q(rpy, Xs[i].R);
@@ -133,7 +133,7 @@ namespace gcop {
     cout << "K=" << K << endl;
     
     dx = K*(z - zm);
-    this->sys.X.Retract(xb, xa, dx);
+    UnscentedBase<T, _nx>::X.Retract(xb, xa, dx);
     
     xb.P = xa.P - K*Pzz*K.transpose();
     //    xb.P = xa.P - K*Pxz.transpose();
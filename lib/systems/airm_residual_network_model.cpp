@@ -28,7 +28,8 @@ AirmResidualNetworkModel::AirmResidualNetworkModel(
                    lb, ub, false),
       quad_system_(parameters, kp_rpy, kd_rpy, lb.segment<6>(0),
                    ub.segment<6>(0), false),
-      nn_layers_(nn_layers), yaw_offset_(yaw_offset) {
+      nn_layers_(nn_layers), fused_network_(nn_layers),
+      yaw_offset_(yaw_offset) {
   std::cout << "Setting control bounds" << std::endl;
   // Set control bounds
   (this->U).lb = lb;
@@ -68,6 +69,17 @@ MX AirmResidualNetworkModel::propagateNetwork(MX &input) {
   return output;
 }
 
+Eigen::MatrixXd
+AirmResidualNetworkModel::propagateNetworkNative(const MatrixXd &inputs) const {
+  return fused_network_.transform(inputs);
+}
+
+void AirmResidualNetworkModel::propagateNetworkNative(const VectorXd &input,
+                                                      VectorXd &output,
+                                                      MatrixXd *jacobian) const {
+  fused_network_.transform(input, output, jacobian);
+}
+
 void AirmResidualNetworkModel::generateResidualInputs(
     QuadInputs &quad_inputs, MX &joint_accelerations, const MX &quad_states,
     const MX &joint_states, const MX &controls, const MX &p,
@@ -2,6 +2,7 @@
 #define AIRMRESIDUALNETWORKMODEL_H
 #include "aerial_manipulation_feedforward_system.h"
 #include "fully_connected_layer.h"
+#include "fused_network.h"
 
 namespace gcop {
 class AirmResidualNetworkModel : public CasadiSystem<> {
@@ -22,6 +23,10 @@ private:
    * @brief nn_layers_ Fully connected layers
    */
   std::vector<FullyConnectedLayer> nn_layers_;
+  /**
+   * @brief Native version of nn_layers_ with batch normalization folded in
+   */
+  FusedNetworkXd fused_network_;
 
   double yaw_offset_;
   /**
@@ -83,6 +88,24 @@ public:
    */
   casadi::MX propagateNetwork(casadi::MX &input);
 
+  /**
+   * @brief propagate a batch of inputs through the network natively without
+   * building a casadi graph
+   * @param inputs Network inputs stored column-wise
+   * @return Network outputs stored column-wise
+   */
+  Eigen::MatrixXd propagateNetworkNative(const Eigen::MatrixXd &inputs) const;
+
+  /**
+   * @brief propagate a single input through the network natively
+   * @param input Input vector to the network
+   * @param output Output of the network
+   * @param jacobian The jacobian of output wrt input if provided
+   */
+  void propagateNetworkNative(const Eigen::VectorXd &input,
+                              Eigen::VectorXd &output,
+                              Eigen::MatrixXd *jacobian = 0) const;
+
   /**
    * @brief casadiStep Step function
    * @param h The timestep
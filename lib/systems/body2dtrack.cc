@@ -16,13 +16,14 @@ Body2dTrack::Body2dTrack(Body2d<> &sys, int nf, double t0, double tf,
   sys(sys), t0(t0), tf(tf), r(r), w(4), dmax(10),
   odometry(odometry), extforce(extforce), forces(forces),
   ts(1,t0), ls(nf), observed(nf, false), p(extforce*2), pr(.75),
-  Is(1), Js(nf), cis(nf), cp(.01), cv(0.05, 0.1, 0.1), cw(.5, 2, 2)
+  vis(nf), cis(nf), cp(.01), cv(0.05, 0.1, 0.1), cw(.5, 2, 2)
 {
   Body2dState x;
   Get(x, 5, t0);
   xs.push_back(x);
   xos.push_back(x);
   vs.push_back(x.second);
+  vis.AddPose();
 }
 
 
@@ -80,40 +81,38 @@ void Body2dTrack::Add(const Vector3d &u, const Body2dState &x, double h)
   const Matrix2d &R = x.first.topLeftCorner<2,2>();
   const Vector2d &px = x.first.block<2,1>(0,2);
   
-  Is.resize(Is.size()+1);
-  assert(k == Is.size()-1);
+  vis.AddPose();
+  assert(k == vis.Poses()-1);
 
-  for (int l = 0; l < ls.size(); ++l) {
+  vector<int> fs;
+  Visibility<2>::Near(fs, ls, px, dmax);
+  
+  for (int j = 0; j < fs.size(); ++j) {
+    int l = fs[j];
     const Vector2d &pf = ls[l];
-    //p.segment<2>(2*extforce + 2*l);
-    
-    double d = (px - pf).norm();
-    if (d < dmax) {
-      // add to feature vector if not observed
-      if (!observed[l]) {
-        if (!init) {
-          p.resize(2);
-          init= true;
-        } else {
-          p.conservativeResize(p.size() + 2);
-        }
-        p.tail<2>() = pf;
-        pis.push_back(l);
-        observed[l] = true;
-        cis[l] = p.size()/2-1;
+    // add to feature vector if not observed
+    if (!observed[l]) {
+      if (!init) {
+        p.resize(2);
+        init= true;
+      } else {
+        p.conservativeResize(p.size() + 2);
       }
-
-      Vector2d z = R.transpose()*(pf - px);
-      z(0) += sqrt(cp)*random_normal();
-      z(1) += sqrt(cp)*random_normal();
-      
-      //        zs[k].push_back();      // add feature l to pose k
-      
-      Is[k].push_back(make_pair(l, z)); // add feature l to pose k      
-      Js[l].push_back(make_pair(k, z)); // add pose k to feature l
-      
-      //        cout << "k=" << k << " l=" << l << " d=" << d << endl;
+      p.tail<2>() = pf;
+      pis.push_back(l);
+      observed[l] = true;
+      cis[l] = p.size()/2-1;
     }
+
+    Vector2d z = R.transpose()*(pf - px);
+    z(0) += sqrt(cp)*random_normal();
+    z(1) += sqrt(cp)*random_normal();
+    
+    //        zs[k].push_back();      // add feature l to pose k
+    
+    vis.Add(l, z);          // add feature l to pose k
+    
+    //        cout << "k=" << k << " l=" << l << " d=" << d << endl;
   }
 }
 
@@ -168,45 +167,43 @@ void Body2dTrack::Add2(const Vector3d &u, const Body2dState &x, double h)
   const Matrix2d &R = x.first.topLeftCorner<2,2>();
   const Vector2d &px = x.first.block<2,1>(0,2);
   
-  Is.resize(Is.size()+1);
-  assert(k == Is.size()-1);
+  vis.AddPose();
+  assert(k == vis.Poses()-1);
 
-  for (int l = 0; l < ls.size(); ++l) {
+  vector<int> fs;
+  Visibility<2>::Near(fs, ls, px, dmax);
+  
+  for (int j = 0; j < fs.size(); ++j) {
+    int l = fs[j];
     const Vector2d &pf = ls[l];
-    //p.segment<2>(2*extforce + 2*l);
-    
-    double d = (px - pf).norm();
-    if (d < dmax) {
 
-      Vector2d z = R.transpose()*(pf - px);
-      z(0) += sqrt(cp)*random_normal();
-      z(1) += sqrt(cp)*random_normal();
-      
-      // add to feature vector if not observed
-      if (!observed[l]) {
-        if (!init) {
-          p.resize(2);
-          init= true;
-        } else {
-          p.conservativeResize(p.size() + 2);
-        }
-        
-        const Matrix2d &Rn = xs.back().first.topLeftCorner<2,2>();
-        const Vector2d &pxn = xs.back().first.block<2,1>(0,2);
-       
-        // Initialize feature location from estimated position
-        p.tail<2>() = Rn*z + pxn;
-        //p.tail<2>() = pf;
-        pis.push_back(l);
-        observed[l] = true;
-        cis[l] = p.size()/2-1;
+    Vector2d z = R.transpose()*(pf - px);
+    z(0) += sqrt(cp)*random_normal();
+    z(1) += sqrt(cp)*random_normal();
+    
+    // add to feature vector if not observed
+    if (!observed[l]) {
+      if (!init) {
+        p.resize(2);
+        init= true;
+      } else {
+        p.conservativeResize(p.size() + 2);
       }
       
-      Is[k].push_back(make_pair(l, z)); // add feature l to pose k      
-      Js[l].push_back(make_pair(k, z)); // add pose k to feature l
-      
-      //        cout << "k=" << k << " l=" << l << " d=" << d << endl;
+      const Matrix2d &Rn = xs.back().first.topLeftCorner<2,2>();
+      const Vector2d &pxn = xs.back().first.block<2,1>(0,2);
+     
+      // Initialize feature location from estimated position
+      p.tail<2>() = Rn*z + pxn;
+      //p.tail<2>() = pf;
+      pis.push_back(l);
+      observed[l] = true;
+      cis[l] = p.size()/2-1;
     }
+    
+    vis.Add(l, z);          // add feature l to pose k
+    
+    //        cout << "k=" << k << " l=" << l << " d=" << d << endl;
   }
 }
 
@@ -228,20 +225,21 @@ void Body2dTrack::MakeTrue()
 
 void Body2dTrack::Optp(VectorXd &p, const vector<Body2dState> &xs)
 {
+  vis.Index();
+
   int nf = (p.size() - extforce*2)/2;
+#pragma omp parallel for if (nf > 256)
   for (int l = 0; l < nf; ++l) {
-    const vector< pair<int,Vector2d> > &J = Js[l];
-    assert(J.size());
-    Vector2d pf;// = Vector2d::Zero();
-		pf.setZero();
-    for (int j = 0; j < J.size(); ++j) {
-      int k = J[j].first;
-      const Vector2d &z = J[j].second;
-      const Matrix2d &R = xs[k].first.topLeftCorner<2,2>();
-      const Vector2d &x = xs[k].first.block<2,1>(0,2);
-      pf = pf + x + R*z;
+    int f = pis[l];
+    int j0 = vis.js[f], j1 = vis.js[f+1];
+    assert(j1 > j0);
+    Vector2d pf = Vector2d::Zero();
+    for (int j = j0; j < j1; ++j) {
+      int i = vis.os[j];
+      const Matrix3d &g = xs[vis.ks[i]].first;
+      pf += g.block<2,1>(0,2) + g.topLeftCorner<2,2>()*vis.zs[i];
     }
-    p.segment<2>(2*extforce + 2*l) = pf/J.size();
+    p.segment<2>(2*extforce + 2*l) = pf/(j1 - j0);
   }
 }
 
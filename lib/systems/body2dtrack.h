@@ -5,6 +5,7 @@
 #include <vector>
 #include <type_traits>
 #include "body2d.h"
+#include "visibility.h"
 
 namespace gcop {
   
@@ -39,6 +40,7 @@ namespace gcop {
 
     /**
      * Given a sequence of poses gs, compute the optimal feature locations p
+     * (each feature is solved independently, in parallel)
      * @param p a vector of feature locations
      * @param gs a given vector of poses in SE(2)
      */
@@ -90,9 +92,8 @@ namespace gcop {
 
     double pr;     ///< feature radius
 
-    vector< vector<pair<int, Vector2d> > > Is;  ///< N+1-vector of vectors of visible pose-to-feature indices
+    Visibility<2> vis;     ///< feature observations of each pose (and observations of each feature)
 
-    vector< vector<pair<int, Vector2d> > > Js;  ///< nf-vector of vectors of feature-to-pose indices indices
     vector<int> cis;       ///< if observed then this should map into the corresponding value in p
 
         
@@ -1,6 +1,7 @@
 #ifndef GCOP_CASADI_SYSTEM_H
 #define GCOP_CASADI_SYSTEM_H
 
+#include "code_generation_cache.h"
 #include "gcop_conversions.h"
 #include "loop_timer.h"
 #include "system.h"
@@ -46,7 +47,8 @@ public:
         generate_state_gradients_(generate_state_gradients),
         generate_parameter_gradients_(generate_parameter_gradients),
         use_code_generation_(use_code_generation),
-        step_function_instantiated_(false) {}
+        step_function_instantiated_(false),
+        batch_step_function_instantiated_(false), batch_size_(0) {}
 
   /**
    * @brief casadiStep
@@ -94,18 +96,30 @@ public:
     if (use_code_generation_) {
       std::cout << "Generating code" << std::endl;
       string function_name = step_function_.name();
-      step_function_.generate(function_name);
-      string compile_command = ("gcc -fPIC -shared -O3 -march=corei7 -ffast-math " + function_name +
-                                ".c -o " + function_name + ".so");
-      int flag = std::system(compile_command.c_str());
-      casadi_assert(flag == 0, "Compilation failed");
+      cs::CodeGenerator generator(function_name);
+      generator.add(step_function_);
+      string library_path = code_generation_cache_.getLibrary(generator.dump());
+      if (code_generation_cache_.lastLookupWasHit()) {
+        std::cout << "Found compiled library in cache" << std::endl;
+      }
       std::cout << "Creating external function" << std::endl;
-      step_function_ = cs::external(function_name);
+      step_function_ = cs::external(function_name, library_path);
     }
     step_function_instantiated_ = true;
     std::cout << "Done instantiating function" << std::endl;
   }
 
+  /**
+   * @brief setCodeGenerationCache Set the cache used to store libraries
+   * compiled from the step function when code generation is enabled
+   *
+   * Should be called before instantiateStepFunction
+   * @param cache The code generation cache
+   */
+  void setCodeGenerationCache(const CodeGenerationCache &cache) {
+    code_generation_cache_ = cache;
+  }
+
   /**
    * @brief Step Perform a single step of the dynamics
    * @param xb  The state at the next step
@@ -171,6 +185,108 @@ public:
     copy_loop_timer_.loop_end();
   }
 
+  /**
+   * @brief instantiateBatchStepFunction map the step function over a batch of
+   * samples
+   *
+   * The step function has to be instantiated first. The mapped function
+   * shares the time, time step and parameters across the batch while the
+   * states and controls are stacked column-wise (one column per sample).
+   * @param batch_size Number of samples evaluated in a single call
+   * @param parallelization Either "serial", "unroll" or "thread"
+   */
+  void instantiateBatchStepFunction(int batch_size,
+                                    std::string parallelization = "serial") {
+    if (!step_function_instantiated_) {
+      throw std::runtime_error("Step function should be instantiated before "
+                               "the batch step function");
+    }
+    if (batch_size < 1) {
+      throw std::runtime_error("Batch size should be greater than 0: " +
+                               std::to_string(batch_size));
+    }
+    if (parallelization != "serial" && parallelization != "unroll" &&
+        parallelization != "thread") {
+      throw std::runtime_error("Unknown parallelization: " + parallelization);
+    }
+    // Inputs t, h, p are not repeated across the batch
+    batch_step_function_ =
+        step_function_.map(casadiStepName() + "_batch", parallelization,
+                           batch_size, {0, 1, 4}, {});
+    batch_size_ = batch_size;
+    batch_step_function_instantiated_ = true;
+  }
+
+  /**
+   * @brief batchStep Perform a single step of the dynamics for a batch of
+   * states and controls
+   *
+   * The jacobians of the samples are concatenated horizontally i.e the
+   * jacobian of the k^th sample wrt current state is As->middleCols(k*nx, nx)
+   * @param xbs  The states at the next step (nx x batch_size)
+   * @param t The current time
+   * @param xas The current states of the system (nx x batch_size)
+   * @param us  The current controls (nu x batch_size)
+   * @param h  The time step for integration
+   * @param p  The parameters shared by all samples. If not provided will use
+   * default parameters
+   * @param As The jacobians wrt current states (nx x nx*batch_size)
+   * @param Bs The jacobians wrt controls (nx x nu*batch_size)
+   * @param Cs The jacobians wrt parameters (nx x np*batch_size)
+   */
+  void batchStep(MatrixXd &xbs, double t, const MatrixXd &xas,
+                 const MatrixXd &us, double h, const Vectormd *p = 0,
+                 MatrixXd *As = 0, MatrixXd *Bs = 0, MatrixXd *Cs = 0) {
+    if (!batch_step_function_instantiated_) {
+      throw std::runtime_error("Batch step function is not instantiated");
+    }
+    if (xas.rows() != this->X.n || xas.cols() != batch_size_ ||
+        us.rows() != this->U.n || us.cols() != batch_size_) {
+      throw std::runtime_error("Batch states/controls size mismatch");
+    }
+    copy_loop_timer_.loop_start();
+    std::vector<cs::DM> args;
+    args.push_back(cs::DM(t));
+    args.push_back(cs::DM(h));
+    args.push_back(conversions::convertEigenToDM(xas));
+    args.push_back(conversions::convertEigenToDM(us));
+    if (p == 0) {
+      args.push_back(conversions::convertEigenToDM(default_parameters_));
+    } else {
+      args.push_back(conversions::convertEigenToDM(*p));
+    }
+    copy_loop_timer_.loop_pause();
+
+    fun_loop_timer_.loop_start();
+    std::vector<cs::DM> result = batch_step_function_(args);
+    fun_loop_timer_.loop_end();
+
+    copy_loop_timer_.loop_start();
+    xbs = conversions::convertDMToEigen(result.at(0));
+    if (generate_state_gradients_) {
+      if (As != 0) {
+        (*As) = conversions::convertDMToEigen(result.at(1));
+      }
+      if (Bs != 0) {
+        (*Bs) = conversions::convertDMToEigen(result.at(2));
+      }
+    }
+    if (generate_parameter_gradients_) {
+      if (Cs != 0) {
+        int ind = generate_state_gradients_ ? 3 : 1;
+        (*Cs) = conversions::convertDMToEigen(result.at(ind));
+      }
+    }
+    copy_loop_timer_.loop_end();
+  }
+
+  /**
+   * @brief batchSize
+   * @return The number of samples evaluated by batchStep (0 if the batch step
+   * function is not instantiated)
+   */
+  int batchSize() const { return batch_size_; }
+
 private:
   /**
    * @brief Default system parameters
@@ -184,6 +300,18 @@ private:
    * @brief The instantiated step function
    */
   cs::Function step_function_;
+  /**
+   * @brief Flag to check if the batch step function is created
+   */
+  bool batch_step_function_instantiated_;
+  /**
+   * @brief Number of samples evaluated by the batch step function
+   */
+  int batch_size_;
+  /**
+   * @brief The step function mapped over a batch of states and controls
+   */
+  cs::Function batch_step_function_;
   /**
    * @brief Flag to specify if state gradients should be generated
    */
@@ -196,6 +324,10 @@ private:
    * @brief Flag to specify whether code generation should be used
    */
   bool use_code_generation_;
+  /**
+   * @brief Cache of compiled step functions shared across processes
+   */
+  CodeGenerationCache code_generation_cache_;
 
 public:
   /**
@@ -0,0 +1,134 @@
+#include "code_generation_cache.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace gcop;
+
+CodeGenerationCache::CodeGenerationCache(std::string cache_folder,
+                                         std::string compiler,
+                                         std::string compiler_flags)
+    : cache_folder_(cache_folder), compiler_(compiler),
+      compiler_flags_(compiler_flags), last_lookup_hit_(false) {
+  if (cache_folder_.empty()) {
+    cache_folder_ = defaultCacheFolder();
+  }
+}
+
+std::string CodeGenerationCache::defaultCacheFolder() {
+  const char *cache_env = std::getenv("GCOP_CODEGEN_CACHE");
+  if (cache_env != 0 && cache_env[0] != '\0') {
+    return std::string(cache_env);
+  }
+  const char *xdg_env = std::getenv("XDG_CACHE_HOME");
+  if (xdg_env != 0 && xdg_env[0] != '\0') {
+    return std::string(xdg_env) + "/gcop";
+  }
+  const char *home_env = std::getenv("HOME");
+  if (home_env != 0 && home_env[0] != '\0') {
+    return std::string(home_env) + "/.cache/gcop";
+  }
+  return "/tmp/gcop_cache";
+}
+
+uint64_t CodeGenerationCache::fnv1a(const std::string &data, uint64_t seed) {
+  uint64_t hash = seed;
+  for (unsigned char c : data) {
+    hash ^= c;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+std::string CodeGenerationCache::hashKey(const std::string &source) const {
+  // Native code is only valid on the host it was compiled for
+  std::string host;
+  if (compiler_flags_.find("-march=native") != std::string::npos) {
+    char hostname[256] = {0};
+    gethostname(hostname, sizeof(hostname) - 1);
+    host = hostname;
+  }
+  std::string data = compiler_ + '\0' + compiler_flags_ + '\0' + host + '\0' +
+                     std::to_string(source.size()) + '\0' + source;
+  char key[33];
+  std::snprintf(key, sizeof(key), "%016llx%016llx",
+                (unsigned long long)fnv1a(data, 14695981039346656037ULL),
+                (unsigned long long)fnv1a(data, 0x9e3779b97f4a7c15ULL));
+  return std::string(key);
+}
+
+std::string CodeGenerationCache::libraryPath(const std::string &source) const {
+  return cache_folder_ + "/" + hashKey(source) + ".so";
+}
+
+bool CodeGenerationCache::lastLookupWasHit() const { return last_lookup_hit_; }
+
+const std::string &CodeGenerationCache::cacheFolder() const {
+  return cache_folder_;
+}
+
+void CodeGenerationCache::createFolder(const std::string &folder_path) {
+  std::string::size_type pos = 0;
+  do {
+    pos = folder_path.find('/', pos + 1);
+    std::string sub_path = folder_path.substr(0, pos);
+    if (mkdir(sub_path.c_str(), 0755) != 0 && errno != EEXIST) {
+      throw std::runtime_error("Cannot create folder: " + sub_path);
+    }
+  } while (pos != std::string::npos);
+}
+
+std::string CodeGenerationCache::getLibrary(const std::string &source) {
+  std::string library_path = libraryPath(source);
+  if (access(library_path.c_str(), R_OK) == 0) {
+    last_lookup_hit_ = true;
+    return library_path;
+  }
+  last_lookup_hit_ = false;
+  createFolder(cache_folder_);
+  // Unique temporary files so that concurrent builders do not collide
+  std::string prefix = library_path.substr(0, library_path.size() - 3);
+  std::string source_template = prefix + "_XXXXXX.c";
+  std::string temp_template = prefix + "_XXXXXX.so";
+  std::vector<char> source_path(source_template.begin(),
+                                source_template.end());
+  source_path.push_back('\0');
+  std::vector<char> temp_path(temp_template.begin(), temp_template.end());
+  temp_path.push_back('\0');
+  int source_fd = mkstemps(source_path.data(), 2);
+  if (source_fd < 0) {
+    throw std::runtime_error("Cannot create file in: " + cache_folder_);
+  }
+  close(source_fd);
+  int temp_fd = mkstemps(temp_path.data(), 3);
+  if (temp_fd < 0) {
+    unlink(source_path.data());
+    throw std::runtime_error("Cannot create file in: " + cache_folder_);
+  }
+  close(temp_fd);
+  {
+    std::ofstream ofile(source_path.data());
+    ofile << source;
+  }
+  std::string compile_command =
+      (compiler_ + " -fPIC -shared " + compiler_flags_ + " '" +
+       source_path.data() + "' -o '" + temp_path.data() + "'");
+  int flag = std::system(compile_command.c_str());
+  unlink(source_path.data());
+  if (flag != 0) {
+    unlink(temp_path.data());
+    throw std::runtime_error("Compilation failed: " + compile_command);
+  }
+  // rename is atomic: either the old or the new library is seen by readers
+  if (std::rename(temp_path.data(), library_path.c_str()) != 0) {
+    unlink(temp_path.data());
+    throw std::runtime_error("Cannot install library: " + library_path);
+  }
+  return library_path;
+}
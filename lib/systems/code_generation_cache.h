@@ -0,0 +1,101 @@
+#ifndef CODEGENERATIONCACHE_H
+#define CODEGENERATIONCACHE_H
+#include <cstdint>
+#include <string>
+
+namespace gcop {
+/**
+ * @brief A persistent on-disk cache of shared libraries compiled from
+ * generated C code.
+ *
+ * The libraries are content addressed i.e the file name is a hash of the C
+ * source, the compiler and the compiler flags. A library is compiled into a
+ * temporary file inside the cache folder and then atomically renamed to its
+ * final name, so several processes can build the same library concurrently
+ * and readers never see a partially written file.
+ */
+class CodeGenerationCache {
+public:
+  /**
+   * @brief CodeGenerationCache Constructor
+   * @param cache_folder The folder to store compiled libraries. If empty uses
+   * defaultCacheFolder()
+   * @param compiler The C compiler to use
+   * @param compiler_flags Flags passed to the compiler in addition to
+   * "-fPIC -shared"
+   */
+  CodeGenerationCache(std::string cache_folder = "",
+                      std::string compiler = "gcc",
+                      std::string compiler_flags = "-O3 -march=native "
+                                                   "-ffast-math");
+
+  /**
+   * @brief getLibrary Find the shared library for a C source in the cache,
+   * compiling it if not present
+   *
+   * Throws a runtime error if compilation fails
+   * @param source The C source code
+   * @return Full path to the compiled shared library
+   */
+  std::string getLibrary(const std::string &source);
+
+  /**
+   * @brief hashKey
+   * @param source The C source code
+   * @return The key used to store the library compiled from source
+   */
+  std::string hashKey(const std::string &source) const;
+
+  /**
+   * @brief libraryPath
+   * @param source The C source code
+   * @return The path where the library compiled from source is stored
+   */
+  std::string libraryPath(const std::string &source) const;
+
+  /**
+   * @brief lastLookupWasHit
+   * @return True if the last call to getLibrary found the library in the
+   * cache
+   */
+  bool lastLookupWasHit() const;
+
+  /**
+   * @brief cacheFolder
+   * @return The folder where libraries are stored
+   */
+  const std::string &cacheFolder() const;
+
+  /**
+   * @brief defaultCacheFolder
+   *
+   * Uses $GCOP_CODEGEN_CACHE if set, otherwise $XDG_CACHE_HOME/gcop or
+   * $HOME/.cache/gcop. Falls back to /tmp/gcop_cache
+   * @return The default cache folder
+   */
+  static std::string defaultCacheFolder();
+
+private:
+  /**
+   * @brief createFolder Create the folder and its parents if they do not
+   * exist
+   * @param folder_path The folder to create
+   */
+  static void createFolder(const std::string &folder_path);
+
+  /**
+   * @brief fnv1a 64 bit FNV-1a hash
+   * @param data The data to hash
+   * @param seed The initial hash value
+   * @return The hash
+   */
+  static uint64_t fnv1a(const std::string &data, uint64_t seed);
+
+  std::string cache_folder_;   ///< Folder where the libraries are stored
+  std::string compiler_;       ///< C compiler
+  std::string compiler_flags_; ///< Flags passed to the compiler
+  bool last_lookup_hit_;       ///< Whether the last lookup was a cache hit
+};
+}
+
+#endif // CODEGENERATIONCACHE_H
@@ -61,6 +61,14 @@ namespace gcop {
     return (*this)(g, t, x, ub, 0, dgdx);
   }
 
+  /**
+   * Whether operator() computes the Jacobian dgdx analytically. Otherwise
+   * users of the constraint (e.g. ConstraintCost) approximate it using
+   * finite differences.
+   * @return true if dgdx is provided
+   */
+  virtual bool HasJacobian() const { return false; }
+
   int ng;        ///< constraint dimension
   
   private:
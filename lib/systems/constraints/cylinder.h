@@ -28,8 +28,10 @@ namespace gcop {
                   double t, const T &x, const Vectorcd &u,
                   const Vectormd *p = 0, 
                   Matrixgxd *dgdx = 0, Matrixgud *dgdu = 0,
-                  Matrixgpd *dgdp = 0);    
-  
+                  Matrixgpd *dgdp = 0);
+
+  bool HasJacobian() const { return true; }
+
   Vector3d o;      ///< origin of base
   double r;        ///< radius
   double h;        ///< height
@@ -70,11 +72,9 @@ namespace gcop {
       if (dgdx) {
         dgdx->resize(1, _nx);
         dgdx->setZero();
-        if (g[0] > 0)
-          dgdx->row(0).head(3) = -v/v.norm();
-        else
-          dgdx->row(0).head(3) = v/v.norm();
+        dgdx->row(0).segment(3,3) = -v/v.norm();  // position is at index 3 as in Shell
       }
+      return g[0] <= 0;
     }
 };
 
@@ -0,0 +1,113 @@
+#ifndef GCOP_DEMSDFCONSTRAINT_H
+#define GCOP_DEMSDFCONSTRAINT_H
+
+#include "constraint.h"
+#include "positionframe.h"
+#include "demsdf.h"
+#include "body3dmanifold.h"
+#include <type_traits>
+
+namespace gcop {
+
+  /**
+   * Terrain avoidance constraint using a precomputed signed distance field
+   * of a Dem. Each evaluation is a constant time lookup which also provides
+   * the analytic gradient, so it can be used as a drop-in replacement of
+   * PqpDem in ConstraintCost without finite differences.
+   *
+   * The constraint is g = cr + sd - d(p) <= 0, where d(p) is the signed
+   * distance from the system position p to the terrain.
+   */
+  template <typename T = VectorXd,
+    int _nx = Dynamic,
+    int _nu = Dynamic,
+    int _np = Dynamic>
+    class DemSdfConstraint : public Constraint<T, _nx, _nu, _np, 1> {
+  public:
+
+  // function mapping from T to Body3dState and returning the workspace dimension of T (either 2 or 3)
+  typedef std::function< int(Body3dState&, const T& ) > ToBody3dState;
+
+  typedef Matrix<double, 1, 1> Vectorgd;
+  typedef Matrix<double, 1, _nx> Matrixgxd;
+  typedef Matrix<double, 1, _nu> Matrixgud;
+  typedef Matrix<double, 1, _np> Matrixgpd;
+
+  typedef Matrix<double, _nx, 1> Vectornd;
+  typedef Matrix<double, _nu, 1> Vectorcd;
+  typedef Matrix<double, _np, 1> Vectormd;
+
+  /**
+   * Terrain constraint
+   * @param sdf signed distance field of the terrain
+   * @param cr collision radius
+   * @param sd additional safety distance
+   */
+  DemSdfConstraint(const DemSdf& sdf, double cr = 0.1, double sd = 0.0);
+
+  bool operator()(Vectorgd &g,
+                  double t, const T &x, const Vectorcd &u,
+                  const Vectormd *p = 0,
+                  Matrixgxd *dgdx = 0, Matrixgud *dgdu = 0,
+                  Matrixgpd *dgdp = 0);
+
+  bool operator()(Vectorgd &g,
+                  double t, const T &x,
+                  Matrixgxd *dgdx = 0) {
+    Vectorcd u;
+    return this->operator ()(g, t, x, u, 0, dgdx);
+  }
+
+  bool HasJacobian() const { return true; }
+
+  const DemSdf& sdf;  ///< signed distance field of the terrain
+
+  double cr;       ///< collision radius
+  double sd;       ///< additional safety distance
+
+  Body3dState xb;  ///< body state for collision purposes
+
+  ToBody3dState func;
+  };
+
+
+  template <typename T, int _nx, int _nu, int _np>
+    DemSdfConstraint<T, _nx, _nu, _np>::DemSdfConstraint(const DemSdf& sdf, double cr, double sd) :
+    Constraint<T, _nx, _nu, _np, 1>(), sdf(sdf), cr(cr), sd(sd)
+  {
+  }
+
+  template <typename T, int _nx, int _nu, int _np>
+    bool DemSdfConstraint<T, _nx, _nu, _np>::operator()(Vectorgd &g,
+                                                        double t, const T &x, const Vectorcd &u,
+                                                        const Vectormd *rho,
+                                                        Matrixgxd *dgdx, Matrixgud *dgdu,
+                                                        Matrixgpd *dgdp)
+  {
+    Vector3d p;
+    int dim = 3;
+
+    if (!std::is_same<T, Body3dState>::value) {
+      dim = func(xb, x);
+      p = xb.p;
+    } else {
+      p = ((const Body3dState&)x).p;
+    }
+
+    Vector3d dp;
+    double d = sdf.Distance(p, dgdx ? &dp : 0);
+
+    g[0] = cr + sd - d;
+
+    if (dgdx) {
+      dgdx->setZero();
+      if (dim == 3)
+        dgdx->segment(3,3) = -dp;
+      if (dim == 2)
+        dgdx->segment(1,2) = -PositionFrame2d(x).transpose()*dp.head<2>();  // in the frame in which x is perturbed
+    }
+    return (g[0] < 0);
+  }
+};
+
+#endif
@@ -2,6 +2,7 @@
 #define GCOP_DISKCONSTRAINT_H
 
 #include "constraint.h"
+#include "positionframe.h"
 #include "disk.h"
 
 namespace gcop {
@@ -32,7 +33,9 @@ namespace gcop {
                   const Vectormd *p = 0, 
                   Matrixgxd *dgdx = 0, Matrixgud *dgdu = 0,
                   Matrixgpd *dgdp = 0);
-  
+
+  bool HasJacobian() const { return true; }
+
   const Disk &disk;   ///< disk
   double cr;          ///< collision radius
 
@@ -76,12 +79,11 @@ namespace gcop {
       g[0] = disk.r - d; // must be negative for non-collision
       
       if (dgdx) {
-        dgdx->Zero();
-        if (g[0] > 0)
-          dgdx->segment(gi, 2) = -v/v.norm();
-        else
-          dgdx->segment(gi, 2) = v/v.norm();
+        dgdx->setZero();
+        // position gradient in the frame in which the state is perturbed
+        dgdx->segment(gi, 2) = -PositionFrame2d(x).transpose()*v/v.norm();
       }
+      return g[0] <= 0;
     }
 };
 
@@ -0,0 +1,154 @@
+#include "obstacleset.h"
+#include <cmath>
+#include <algorithm>
+
+using namespace gcop;
+using namespace Eigen;
+using namespace std;
+
+ObstacleSet::ObstacleSet(double cr, double cs) :
+  cr(cr), cs(cs), x0(0), y0(0), ni(0), nj(0), ccs(cs)
+{
+}
+
+int ObstacleSet::Add(const Sphere &sphere)
+{
+  Obstacle ob = {SPHERE, sphere.o, sphere.r, 0};
+  obstacles.push_back(ob);
+  return obstacles.size() - 1;
+}
+
+int ObstacleSet::Add(const Disk &disk)
+{
+  Obstacle ob = {DISK, Vector3d(disk.o[0], disk.o[1], 0), disk.r, 0};
+  obstacles.push_back(ob);
+  return obstacles.size() - 1;
+}
+
+int ObstacleSet::AddCylinder(const Vector3d &o, double r, double h)
+{
+  Obstacle ob = {CYLINDER, o, r, h};
+  obstacles.push_back(ob);
+  return obstacles.size() - 1;
+}
+
+void ObstacleSet::Build()
+{
+  starts.clear();
+  ids.clear();
+  ni = nj = 0;
+  int n = obstacles.size();
+  if (!n)
+    return;
+
+  // bounds of the inflated footprints
+  double x1 = -INFINITY, y1 = -INFINITY;
+  x0 = y0 = INFINITY;
+  double rs = 0;
+  for (int i = 0; i < n; ++i) {
+    const Obstacle &ob = obstacles[i];
+    double r = ob.r + cr;
+    x0 = min(x0, ob.o[0] - r);
+    y0 = min(y0, ob.o[1] - r);
+    x1 = max(x1, ob.o[0] + r);
+    y1 = max(y1, ob.o[1] + r);
+    rs += r;
+  }
+
+  // by default a cell fits about one inflated obstacle, but the grid
+  // should not have many more cells than obstacles
+  cs = ccs > 0 ? ccs : 2*rs/n;
+  double area = (x1 - x0)*(y1 - y0);
+  if (area > 16*n*cs*cs)
+    cs = sqrt(area/(16*n));
+  nj = max(1, (int)ceil((x1 - x0)/cs));
+  ni = max(1, (int)ceil((y1 - y0)/cs));
+
+  // count the obstacles in each cell and then fill in the lists
+  starts.assign(ni*nj + 1, 0);
+  for (int pass = 0; pass < 2; ++pass) {
+    vector<int> next;
+    if (pass) {
+      for (int c = 0; c < ni*nj; ++c)
+        starts[c + 1] += starts[c];
+      ids.resize(starts[ni*nj]);
+      next.assign(starts.begin(), starts.end() - 1);
+    }
+    for (int k = 0; k < n; ++k) {
+      const Obstacle &ob = obstacles[k];
+      double r = ob.r + cr;
+      int j0 = max(0, (int)floor((ob.o[0] - r - x0)/cs));
+      int j1 = min(nj - 1, (int)floor((ob.o[0] + r - x0)/cs));
+      int i0 = max(0, (int)floor((ob.o[1] - r - y0)/cs));
+      int i1 = min(ni - 1, (int)floor((ob.o[1] + r - y0)/cs));
+      for (int i = i0; i <= i1; ++i) {
+        for (int j = j0; j <= j1; ++j) {
+          if (pass)
+            ids[next[i*nj + j]++] = k;
+          else
+            ++starts[i*nj + j + 1];
+        }
+      }
+    }
+  }
+}
+
+double ObstacleSet::Evaluate(int id, const Vector3d &p, Vector3d *dg) const
+{
+  const Obstacle &ob = obstacles[id];
+  Vector3d v = p - ob.o;
+  if (ob.type == DISK || (ob.type == CYLINDER && p[2] < ob.o[2] + ob.h && p[2] > ob.o[2]))
+    v[2] = 0;
+  double d = v.norm();
+  if (dg) {
+    if (d > 1e-12)
+      *dg = -v/d;
+    else
+      dg->setZero();
+  }
+  return ob.r + cr - d;
+}
+
+int ObstacleSet::Query(vector<Penetration> &ps, const Vector3d &p, double gmin) const
+{
+  ps.clear();
+  if (!ni)
+    return 0;
+  int j = (int)floor((p[0] - x0)/cs);
+  int i = (int)floor((p[1] - y0)/cs);
+  if (i < 0 || i >= ni || j < 0 || j >= nj)
+    return 0;
+  int c = i*nj + j;
+  Penetration pen;
+  for (int k = starts[c]; k < starts[c + 1]; ++k) {
+    pen.id = ids[k];
+    pen.g = Evaluate(pen.id, p, &pen.dg);
+    if (pen.g > gmin)
+      ps.push_back(pen);
+  }
+  return ps.size();
+}
+
+double ObstacleSet::MaxPenetration(const Vector3d &p, Vector3d *dg) const
+{
+  double gm = -cr;
+  if (dg)
+    dg->setZero();
+  if (!ni)
+    return gm;
+  int j = (int)floor((p[0] - x0)/cs);
+  int i = (int)floor((p[1] - y0)/cs);
+  if (i < 0 || i >= ni || j < 0 || j >= nj)
+    return gm;
+  int c = i*nj + j;
+  Vector3d dgk;
+  for (int k = starts[c]; k < starts[c + 1]; ++k) {
+    double g = Evaluate(ids[k], p, &dgk);
+    if (g > gm) {
+      gm = g;
+      if (dg)
+        *dg = dgk;
+    }
+  }
+  return gm;
+}
@@ -0,0 +1,124 @@
+#ifndef GCOP_OBSTACLESET_H
+#define GCOP_OBSTACLESET_H
+
+#include <Eigen/Dense>
+#include <vector>
+#include "sphere.h"
+#include "disk.h"
+
+namespace gcop {
+
+  /**
+   * A set of spherical, disk-shaped and cylindrical obstacles stored in a
+   * uniform grid over the xy-plane so that collision queries only visit the
+   * obstacles near the query point.
+   *
+   * Each obstacle is inserted into all grid cells overlapping its footprint
+   * inflated by the collision radius cr, so that a query point only needs
+   * to check the obstacles listed in its own cell. The cost of a query thus
+   * depends on the local obstacle density rather than on the total number
+   * of obstacles.
+   *
+   * The penetration of a body of radius cr at position p into obstacle i is
+   * g_i = r_i + cr - d_i(p), where d_i is the distance from p to the center
+   * of a sphere, to the axis of a disk (an infinite vertical cylinder), or to
+   * the axis of a finite vertical cylinder (as in Cylinder), so that g_i <= 0
+   * means no collision as in SphereConstraint and DiskConstraint.
+   *
+   * Usage: add the obstacles and call Build before querying.
+   */
+  class ObstacleSet {
+  public:
+
+    enum Type { SPHERE, DISK, CYLINDER };
+
+    /**
+     * An obstacle
+     */
+    struct Obstacle {
+      Type type;          ///< type
+      Eigen::Vector3d o;  ///< center (sphere), center with z=0 (disk) or origin of base (cylinder)
+      double r;           ///< radius
+      double h;           ///< height (cylinder only)
+    };
+
+    /**
+     * Penetration into a single obstacle
+     */
+    struct Penetration {
+      int id;                 ///< obstacle index
+      double g;               ///< penetration (positive if in collision)
+      Eigen::Vector3d dg;     ///< gradient of g wrt the query position
+    };
+
+    /**
+     * Obstacle set
+     * @param cr collision radius of the body
+     * @param cs grid cell size (if non-positive it is chosen automatically in Build)
+     */
+    ObstacleSet(double cr = .5, double cs = 0);
+
+    int Add(const Sphere &sphere);
+
+    int Add(const Disk &disk);
+
+    /**
+     * Add a vertical cylinder
+     * @param o origin of base
+     * @param r radius
+     * @param h height
+     * @return obstacle index
+     */
+    int AddCylinder(const Eigen::Vector3d &o, double r, double h);
+
+    /**
+     * Build the grid. Must be called after adding or changing obstacles or
+     * after changing cr.
+     */
+    void Build();
+
+    /**
+     * Penetrations of a body at position p into nearby obstacles
+     * @param ps penetrations with g > gmin (cleared first)
+     * @param p position of the body
+     * @param gmin only obstacles with penetration above gmin are returned
+     *        (all of them if gmin >= 0, otherwise only the ones listed in
+     *        the grid cell of p)
+     * @return number of penetrations
+     */
+    int Query(std::vector<Penetration> &ps, const Eigen::Vector3d &p, double gmin = 0) const;
+
+    /**
+     * Largest penetration of a body at position p into any obstacle
+     * @param p position of the body
+     * @param dg gradient of the penetration wrt p (optional)
+     * @return penetration (its sign is exact, but a negative value is only
+     *         a bound for obstacles not listed in the cell of p), or -cr
+     *         if no obstacles are near p
+     */
+    double MaxPenetration(const Eigen::Vector3d &p, Eigen::Vector3d *dg = 0) const;
+
+    /**
+     * Penetration into a single obstacle
+     * @param dg gradient wrt p (optional)
+     */
+    double Evaluate(int id, const Eigen::Vector3d &p, Eigen::Vector3d *dg = 0) const;
+
+    double cr;                        ///< collision radius
+    double cs;                        ///< grid cell size
+
+    std::vector<Obstacle> obstacles;  ///< obstacles
+
+    double x0;                        ///< grid origin x-coordinate
+    double y0;                        ///< grid origin y-coordinate
+    int ni;                           ///< number of grid rows (along y)
+    int nj;                           ///< number of grid columns (along x)
+    std::vector<int> starts;          ///< start of each cell's obstacle list in ids (ni*nj+1 values)
+    std::vector<int> ids;             ///< obstacle indices of all cells
+
+  protected:
+    double ccs;                       ///< cell size requested in the constructor
+  };
+}
+
+#endif
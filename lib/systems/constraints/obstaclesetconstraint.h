@@ -0,0 +1,97 @@
+#ifndef GCOP_OBSTACLESETCONSTRAINT_H
+#define GCOP_OBSTACLESETCONSTRAINT_H
+
+#include "constraint.h"
+#include "positionframe.h"
+#include "obstacleset.h"
+
+namespace gcop {
+
+  /**
+   * Collision avoidance constraint for a whole ObstacleSet, i.e. a single
+   * constraint g = max_i g_i <= 0 over the penetrations g_i into each
+   * obstacle, with an analytic gradient. Only the obstacles near the
+   * system position are checked.
+   *
+   * See ObstacleSetCost for a penalty on all penetrations at once.
+   */
+  template <typename T = VectorXd,
+    int _nx = Dynamic,
+    int _nu = Dynamic,
+    int _np = Dynamic>
+    class ObstacleSetConstraint : public Constraint<T, _nx, _nu, _np, 1> {
+  public:
+
+  // function mapping from T to a position and returning the index where the gradient should start
+  typedef std::function< int(Vector3d&, const T& ) > ToVector3d;
+
+  typedef Matrix<double, 1, 1> Vectorgd;
+  typedef Matrix<double, 1, _nx> Matrixgxd;
+  typedef Matrix<double, 1, _nu> Matrixgud;
+  typedef Matrix<double, 1, _np> Matrixgpd;
+
+  typedef Matrix<double, _nx, 1> Vectornd;
+  typedef Matrix<double, _nu, 1> Vectorcd;
+  typedef Matrix<double, _np, 1> Vectormd;
+
+  /**
+   * Obstacle set constraint
+   * @param obstacles obstacle set (already built)
+   * @param dim workspace dimension (2 for planar systems, in which case
+   *        only the x and y gradient components are used)
+   */
+  ObstacleSetConstraint(const ObstacleSet &obstacles, int dim = 3);
+
+  bool operator()(Vectorgd &g,
+                  double t, const T &x, const Vectorcd &u,
+                  const Vectormd *p = 0,
+                  Matrixgxd *dgdx = 0, Matrixgud *dgdu = 0,
+                  Matrixgpd *dgdp = 0);
+
+  bool HasJacobian() const { return true; }
+
+  const ObstacleSet &obstacles;   ///< obstacles
+  int dim;                        ///< workspace dimension (2 or 3)
+
+  ToVector3d func;                ///< function converting from a generic state T to Vector3d
+  };
+
+
+  template <typename T, int _nx, int _nu, int _np>
+    ObstacleSetConstraint<T, _nx, _nu, _np>::ObstacleSetConstraint(const ObstacleSet &obstacles, int dim) :
+    Constraint<T, _nx, _nu, _np, 1>(), obstacles(obstacles), dim(dim)
+  {
+  }
+
+  template <typename T, int _nx, int _nu, int _np>
+    bool ObstacleSetConstraint<T, _nx, _nu, _np>::operator()(Vectorgd &g,
+                                                             double t, const T &x, const Vectorcd &u,
+                                                             const Vectormd *rho,
+                                                             Matrixgxd *dgdx, Matrixgud *dgdu,
+                                                             Matrixgpd *dgdp)
+    {
+      int gi = 0; // index where gradient should start
+
+      Vector3d p;
+      if (!std::is_same<T, Vector3d>::value) {
+        gi = func(p, x);
+      } else {
+        p = (Vector3d&)x;
+      }
+
+      Vector3d dg;
+      g[0] = obstacles.MaxPenetration(p, dgdx ? &dg : 0);
+
+      if (dgdx) {
+        dgdx->setZero();
+        if (dim == 2)
+          dgdx->segment(gi, 2) = PositionFrame2d(x).transpose()*dg.head<2>();  // in the frame in which x is perturbed
+        else
+          dgdx->segment(gi, dim) = dg.head(dim);
+      }
+      return g[0] <= 0;
+    }
+};
+
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef GCOP_POSITIONFRAME_H
+#define GCOP_POSITIONFRAME_H
+
+#include <Eigen/Dense>
+#include "gcarmanifold.h"
+#include "body2dmanifold.h"
+
+namespace gcop {
+
+  using namespace Eigen;
+
+  /**
+   * Rotation from the frame in which the planar position of a state is
+   * perturbed to the world frame. A gradient dg with respect to the world
+   * position is R'*dg with respect to the position coordinates of the state.
+   *
+   * Vector states are perturbed in the world frame. Poses in SE(2) are
+   * perturbed in the body frame, i.e. g*exp(v) (see GcarManifold::Retract,
+   * Body2dManifold::Retract and Kinbody2dManifold::Retract).
+   */
+  template <typename T>
+    inline Matrix2d PositionFrame2d(const T &x) { return Matrix2d::Identity(); }
+
+  inline Matrix2d PositionFrame2d(const Matrix3d &g) { return g.topLeftCorner<2,2>(); }
+
+  inline Matrix2d PositionFrame2d(const GcarState &x) { return x.g.topLeftCorner<2,2>(); }
+
+  inline Matrix2d PositionFrame2d(const Body2dState &x) { return x.first.topLeftCorner<2,2>(); }
+}
+
+#endif
@@ -2,6 +2,7 @@
 #define GCOP_PQPDEM_H
 
 #include "constraint.h"
+#include "positionframe.h"
 #include "dem.h"
 #include "PQP/PQP.h"
 #include "body3dmanifold.h"
@@ -44,7 +45,9 @@ namespace gcop {
         Vectorcd u;
     return this->operator ()(g, t, x, u, 0, dgdx);
   }
-  
+
+  // the gradient is given by the PQP closest points
+  bool HasJacobian() const { return true; }
   
   //  virtual void ToBody3dState(Body3dState &xb, const T &x) const;
   
@@ -170,9 +173,6 @@ template <typename T, int _nx, int _nu, int _np>
   double d = dres.Distance();
   assert(d>=0);
 
-  cout << "dist=" << d << endl;
-
-
   // subtract safety distance
   d = MAX(0, d - sd);
 
@@ -191,6 +191,7 @@ template <typename T, int _nx, int _nu, int _np>
   // cout << "d=" << d << endl;
 
   if (dgdx) {
+    dgdx->setZero();
     Vector3d p2(dres.P2());
     Vector3d dp = p2 - p;
     dp.normalize();
@@ -206,10 +207,9 @@ template <typename T, int _nx, int _nu, int _np>
       }
     } 
     if (dim==2) {
-      dgdx->segment(1,2) = dp.head<2>();
-      if (in) {
-        dgdx->segment(1,2) = -dp.head<2>();
-      }
+      // position gradient in the frame in which the state is perturbed
+      Vector2d dp2 = PositionFrame2d(x).transpose()*dp.head<2>();
+      dgdx->segment(1,2) = in ? -dp2 : dp2;
     }
   }
 
@@ -0,0 +1,114 @@
+#ifndef GCOP_PYRAMIDDEM_H
+#define GCOP_PYRAMIDDEM_H
+
+#include "constraint.h"
+#include "positionframe.h"
+#include "dempyramid.h"
+#include "body3dmanifold.h"
+#include <type_traits>
+
+namespace gcop {
+
+  /**
+   * Terrain avoidance constraint for a sphere of radius cr using a min/max
+   * height pyramid of the Dem. It is a drop-in alternative to PqpDem which
+   * uses the same triangulation of the terrain but does not need to build a
+   * triangle mesh BVH, and which provides the analytic gradient of the
+   * signed distance.
+   *
+   * The constraint is g = cr + sd - d(p) <= 0, where d(p) is the signed
+   * distance from the system position p to the terrain.
+   */
+  template <typename T = VectorXd,
+    int _nx = Dynamic,
+    int _nu = Dynamic,
+    int _np = Dynamic>
+    class PyramidDem : public Constraint<T, _nx, _nu, _np, 1> {
+  public:
+
+  // function mapping from T to Body3dState and returning the workspace dimension of T (either 2 or 3)
+  typedef std::function< int(Body3dState&, const T& ) > ToBody3dState;
+
+  typedef Matrix<double, 1, 1> Vectorgd;
+  typedef Matrix<double, 1, _nx> Matrixgxd;
+  typedef Matrix<double, 1, _nu> Matrixgud;
+  typedef Matrix<double, 1, _np> Matrixgpd;
+
+  typedef Matrix<double, _nx, 1> Vectornd;
+  typedef Matrix<double, _nu, 1> Vectorcd;
+  typedef Matrix<double, _np, 1> Vectormd;
+
+  /**
+   * Terrain constraint
+   * @param pyramid height pyramid of the terrain
+   * @param cr collision radius
+   * @param sd additional safety distance
+   */
+  PyramidDem(const DemPyramid& pyramid, double cr = 0.1, double sd = 0.0);
+
+  bool operator()(Vectorgd &g,
+                  double t, const T &x, const Vectorcd &u,
+                  const Vectormd *p = 0,
+                  Matrixgxd *dgdx = 0, Matrixgud *dgdu = 0,
+                  Matrixgpd *dgdp = 0);
+
+  bool operator()(Vectorgd &g,
+                  double t, const T &x,
+                  Matrixgxd *dgdx = 0) {
+    Vectorcd u;
+    return this->operator ()(g, t, x, u, 0, dgdx);
+  }
+
+  bool HasJacobian() const { return true; }
+
+  const DemPyramid& pyramid;  ///< height pyramid of the terrain
+
+  double cr;       ///< collision radius
+  double sd;       ///< additional safety distance
+
+  Body3dState xb;  ///< body state for collision purposes
+
+  ToBody3dState func;
+  };
+
+
+  template <typename T, int _nx, int _nu, int _np>
+    PyramidDem<T, _nx, _nu, _np>::PyramidDem(const DemPyramid& pyramid, double cr, double sd) :
+    Constraint<T, _nx, _nu, _np, 1>(), pyramid(pyramid), cr(cr), sd(sd)
+  {
+  }
+
+  template <typename T, int _nx, int _nu, int _np>
+    bool PyramidDem<T, _nx, _nu, _np>::operator()(Vectorgd &g,
+                                                  double t, const T &x, const Vectorcd &u,
+                                                  const Vectormd *rho,
+                                                  Matrixgxd *dgdx, Matrixgud *dgdu,
+                                                  Matrixgpd *dgdp)
+  {
+    Vector3d p;
+    int dim = 3;
+
+    if (!std::is_same<T, Body3dState>::value) {
+      dim = func(xb, x);
+      p = xb.p;
+    } else {
+      p = ((const Body3dState&)x).p;
+    }
+
+    Vector3d dp;
+    double d = pyramid.SphereDistance(p, cr, dgdx ? &dp : 0);
+
+    g[0] = sd - d;
+
+    if (dgdx) {
+      dgdx->setZero();
+      if (dim == 3)
+        dgdx->segment(3,3) = -dp;
+      if (dim == 2)
+        dgdx->segment(1,2) = -PositionFrame2d(x).transpose()*dp.head<2>();  // in the frame in which x is perturbed
+    }
+    return (g[0] < 0);
+  }
+};
+
+#endif
@@ -28,8 +28,10 @@ namespace gcop {
                   double t, const T &x, const Vectorcd &u,
                   const Vectormd *p = 0, 
                   Matrixgxd *dgdx = 0, Matrixgud *dgdu = 0,
-                  Matrixgpd *dgdp = 0);    
-  
+                  Matrixgpd *dgdp = 0);
+
+  bool HasJacobian() const { return true; }
+
   Vector3d o;      ///< origin
   double r;        ///< radius
   double cr;       ///< collision radius
@@ -63,12 +65,10 @@ namespace gcop {
       g[0] = r - d; // must be negative for non-collision
       
       if (dgdx) {
-        dgdx->Zero();
-        if (g[0] > 0)
-          dgdx->segment(3,3) = -v/v.norm();
-        else
-          dgdx->segment(3,3) = v/v.norm();
+        dgdx->setZero();
+        dgdx->segment(3,3) = -v/v.norm();
       }
+      return g[0] <= 0;
     }
 };
 
@@ -32,7 +32,9 @@ namespace gcop {
                   const Vectormd *p = 0, 
                   Matrixgxd *dgdx = 0, Matrixgud *dgdu = 0,
                   Matrixgpd *dgdp = 0);
-  
+
+  bool HasJacobian() const { return true; }
+
   const Sphere &sphere;   ///< sphere
   double cr;              ///< collision radius
   
@@ -74,12 +76,10 @@ namespace gcop {
       g[0] = sphere.r - d; // must be negative for non-collision
       
       if (dgdx) {
-        dgdx->Zero();
-        if (g[0] > 0)
-          dgdx->segment(gi, 3) = -v/v.norm();
-        else
-          dgdx->segment(gi, 3) = v/v.norm();
+        dgdx->setZero();
+        dgdx->segment(gi, 3) = -v/v.norm();
       }
+      return g[0] <= 0;
     }
 };
 
@@ -108,3 +108,43 @@ double BaCost::L(double t, const Matrix3d &g, const Vector3d &u, double h,
   return L;
 }
 
+double BaCost::Lb(double t, const Matrix3d &g, const Vector3d &u, double h,
+                  const VectorXd *p, int b,
+                  Vector3d *Lx, Matrix3d *Lxx,
+                  Vector3d *Lu, Matrix3d *Luu,
+                  Matrix3d *Lxu,
+                  vector<int> &ls, VectorXd &Lps, MatrixXd &Lpps, MatrixX3d &Lpxs)
+{
+  assert(b == 2);
+
+  int N = pg.Is.size() - 1;
+  int k = (h < 1e-16 ? N : (int)round(t/h));
+  assert(k >=0 && k <= N);
+  const vector< pair<int, Vector2d> > &I = pg.Is[k];
+
+  // only the features visible at pose k are involved
+  ls.resize(I.size());
+  Lps.resize(2*I.size());
+  Lpps.resize(2, 2*I.size());
+  Lpxs.resize(2*I.size(), 3);
+
+  double L = this->L(t, g, u, h, p, Lx, Lxx, Lu, Luu, Lxu);
+
+  const Matrix2d &R = g.topLeftCorner<2,2>();
+  const Vector2d &x = g.block<2,1>(0,2);
+  for (int i = 0; i < I.size(); ++i) {
+    int l = I[i].first;
+    const Vector2d &z = I[i].second;
+
+    const Vector2d &pf = p->segment<2>(2*l);
+    Vector2d y = R.transpose()*(pf - x);
+    Vector2d r = (y - z)/pg.cp;
+
+    ls[i] = l;
+    Lps.segment<2>(2*i) = R*r;
+    Lpps.block<2,2>(0, 2*i) = Matrix2d::Identity()/pg.cp;
+    Lpxs.block<2,1>(2*i, 0) = -R*r2hat(z).transpose()/pg.cp;
+    Lpxs.block<2,2>(2*i, 1) = -R/pg.cp;
+  }
+  return L;
+}
@@ -26,6 +26,13 @@ namespace gcop {
              Matrix3d *Lxu = 0, 
              VectorXd *Lp = 0, MatrixXd *Lpp = 0, MatrixX3d *Lpx = 0);
 
+    double Lb(double t, const Matrix3d &x, const Vector3d &u, double h,
+              const VectorXd *p, int b,
+              Vector3d *Lx, Matrix3d *Lxx,
+              Vector3d *Lu, Matrix3d *Luu,
+              Matrix3d *Lxu,
+              vector<int> &ls, VectorXd &Lps, MatrixXd &Lpps, MatrixX3d &Lpxs);
+
     const Posegraph2d &pg;
   };  
 }
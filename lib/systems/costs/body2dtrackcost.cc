@@ -67,7 +67,7 @@ double Body2dTrackCost::L(double t, const Body2dState &x, const Vector3d &u,
 
   const Vector3d &v = x.second;               // velocity
   
-  int N = pg.Is.size() - 1;
+  int N = pg.vis.Poses() - 1;
   
   h = this->tf/N;
 
@@ -75,14 +75,14 @@ double Body2dTrackCost::L(double t, const Body2dState &x, const Vector3d &u,
 
   int k = (int)round(t/h);
   assert(k >=0 && k <= N);
-  const vector< pair<int, Vector2d> > &I = pg.Is[k];
+  const Visibility<2> &vis = pg.vis;
 
-  //  cout << "Body2dtrackCost: k=" << k << " " << I.size() << endl;
+  //  cout << "Body2dtrackCost: k=" << k << " " << vis.is[k+1] - vis.is[k] << endl;
 
   int i0 = 2*pg.extforce;
-  for (int i = 0; i < I.size(); ++i) {
-    int l = pg.cis[I[i].first];  // feature index
-    const Vector2d &z = I[i].second;
+  for (int i = vis.is[k]; i < vis.is[k+1]; ++i) {
+    int l = pg.cis[vis.ls[i]];  // feature index
+    const Vector2d &z = vis.zs[i];
 
     const Vector2d &pf = p->segment<2>(i0 + 2*l);
     Vector2d r = R.transpose()*(pf - xp);
@@ -38,7 +38,10 @@ namespace gcop {
   typedef Matrix<double, _np, _nx> Matrixmnd;
       
     /**
-     * Linear-quadratic cost on a general manifold. Use this constructor for dynamic-size
+     * Quadratic penalty b/2*|max(g,0)|^2 on a constraint g(t,x)<=0. Its
+     * Jacobian is taken from the constraint if it provides one (see
+     * Constraint::HasJacobian), and computed using central finite
+     * differences otherwise. Use this constructor for dynamic-size
      * control problem, i.e. ConstraintCost<T>(X, U, tf, xf, ...)
      * @param sys system
      * @param tf final time
@@ -119,20 +122,23 @@ namespace gcop {
                                                     Matrix<double, _np, 1> *Lp, Matrix<double, _np, _np> *Lpp,
                                                     Matrix<double, _np, _nx> *Lpx) {
 
+    // constraints which do not declare an analytic Jacobian might still
+    // provide it, which is detected by checking whether dgdx was changed
+    bool jac = con.HasJacobian();
     double q = 234234023411230; 
-    dgdx(0,0) = q;   // random number
+    if (!jac)
+      dgdx(0,0) = q;   // random number
 
     // only consider state constraints for now
     this->con(this->g, t, x, u, p, Lx ? &dgdx : 0);
     
-    T xb;
-    Vectornd dx;
-    Vectorgd gp;
-    Vectorgd gm;
-    double eps = 1e-3;
-
     // if no jacobians were provided use finite differences
-    if (Lx && fabs(dgdx(0,0) - q) < 1e-10) {
+    if (Lx && !jac && fabs(dgdx(0,0) - q) < 1e-10) {
+      T xb;
+      Vectornd dx;
+      Vectorgd gp;
+      Vectorgd gm;
+      double eps = 1e-3;
       
       for (int i = 0; i < this->sys.X.n; ++i) {
         dx.setZero();
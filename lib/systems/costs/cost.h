@@ -3,6 +3,7 @@
 
 #include <Eigen/Dense>
 #include <iostream>
+#include <vector>
 #include "system.h"
 
 namespace gcop {
@@ -76,6 +77,27 @@ namespace gcop {
                    Vectormd *Lp = 0, Matrixmd *Lpp = 0,
                    Matrixmnd *Lpx = 0);  
 
+  /**
+   * Cost function L for parameters made of independent blocks of size b
+   * (e.g. feature positions) of which only a few are involved at each time.
+   * The parameter derivatives are only returned for the involved blocks, and
+   * the second derivatives between different blocks are assumed to be zero.
+   * The default implementation calls L and extracts the nonzero blocks.
+   * @param b block size
+   * @param ls indices of the involved blocks
+   * @param Lps derivatives wrt the involved blocks (stacked b-vectors)
+   * @param Lpps second derivatives wrt each involved block (b x b blocks side by side)
+   * @param Lpxs derivatives wrt the involved blocks and x (stacked b x n blocks)
+   * other parameters are as in L
+   */
+  virtual double Lb(double t, const T &x, const Vectorcd &u, double h,
+                    const Vectormd *p, int b,
+                    Vectornd *Lx, Matrixnd* Lxx,
+                    Vectorcd *Lu, Matrixcd* Luu,
+                    Matrixncd *Lxu,
+                    vector<int> &ls, VectorXd &Lps, MatrixXd &Lpps,
+                    Matrix<double, Dynamic, _nx> &Lpxs);
+
   /**
    * Set context for the cost
    * @param c context
@@ -105,6 +127,36 @@ namespace gcop {
     cout << "[W] Cost:L: unimplemented!" << endl;
     return 0;
   }
+
+  template <typename T, int _nx, int _nu, int _np, typename Tc> 
+    double Cost<T, _nx, _nu, _np, Tc>::Lb(double t, const T& x, const Vectorcd& u, double h,
+                                          const Vectormd *p, int b,
+                                          Vectornd *Lx, Matrixnd* Lxx,
+                                          Vectorcd *Lu, Matrixcd* Luu,
+                                          Matrixncd *Lxu,
+                                          vector<int> &ls, VectorXd &Lps, MatrixXd &Lpps,
+                                          Matrix<double, Dynamic, _nx> &Lpxs) {
+    int m = p->size();
+    Vectormd Lp(m);
+    Matrixmd Lpp(m, m);
+    Matrixmnd Lpx(m, sys.X.n);
+    double L = this->L(t, x, u, h, p, Lx, Lxx, Lu, Luu, Lxu, &Lp, &Lpp, &Lpx);
+
+    ls.clear();
+    for (int l = 0; l < m/b; ++l)
+      if (!Lp.segment(b*l, b).isZero(0) || !Lpp.block(b*l, b*l, b, b).isZero(0) || !Lpx.middleRows(b*l, b).isZero(0))
+        ls.push_back(l);
+
+    Lps.resize(b*ls.size());
+    Lpps.resize(b, b*ls.size());
+    Lpxs.resize(b*ls.size(), sys.X.n);
+    for (int j = 0; j < ls.size(); ++j) {
+      Lps.segment(b*j, b) = Lp.segment(b*ls[j], b);
+      Lpps.middleCols(b*j, b) = Lpp.block(b*ls[j], b*ls[j], b, b);
+      Lpxs.middleRows(b*j, b) = Lpx.middleRows(b*ls[j], b);
+    }
+    return L;
+  }
 }
 
 #endif
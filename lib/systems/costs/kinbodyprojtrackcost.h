@@ -289,7 +289,7 @@ double KinbodyProjTrackCost<_nu>::L(double t, const Matrix4d &x, const Vectorud
   const Matrix3d &R = x.block<3,3>(0,0); // orientation
   const Vector3d &xp = x.block<3,1>(0,3);     // position
   
-  int N = pg.Is.size() - 1;
+  int N = pg.vis.Poses() - 1;
   
   h = this->tf/N;
 
@@ -297,16 +297,16 @@ double KinbodyProjTrackCost<_nu>::L(double t, const Matrix4d &x, const Vectorud
 
   int k = (int)round(t/h);
   assert(k >=0 && k <= N);
-  const vector< pair<int, Vector3d> > &I = pg.Is[k];
+  const Visibility<3> &vis = pg.vis;
 
-  //cout << "Kinbody3dtrackCost: k=" << k << " " << I.size() << endl;
+  //cout << "Kinbody3dtrackCost: k=" << k << " " << vis.is[k+1] - vis.is[k] << endl;
 
   Matrix3d eye = MatrixXd::Identity(3,3);
 
   int i0 = 3*pg.extforce;
-  for (int i = 0; i < I.size(); ++i) {
-    int l = pg.cis[I[i].first];  // feature index
-    const Vector3d &z = I[i].second;
+  for (int i = vis.is[k]; i < vis.is[k+1]; ++i) {
+    int l = pg.cis[vis.ls[i]];  // feature index
+    const Vector3d &z = vis.zs[i];
 
     const Vector3d &pf = p->segment<3>(i0 + 3*l);
     Vector3d y = R.transpose()*(pf - xp);
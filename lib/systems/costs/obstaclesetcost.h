@@ -0,0 +1,139 @@
+#ifndef GCOP_OBSTACLESETCOST_H
+#define GCOP_OBSTACLESETCOST_H
+
+#include "cost.h"
+#include "obstacleset.h"
+#include "positionframe.h"
+#include <vector>
+
+namespace gcop {
+
+  using namespace std;
+  using namespace Eigen;
+
+  /**
+   * Penalty on the penetrations into all obstacles of an ObstacleSet
+   *
+   *   L = b/2 sum_i max(0, g_i)^2
+   *
+   * which is the same cost as a MultiCost stacking one ConstraintCost per
+   * SphereConstraint/DiskConstraint, but only the obstacles near the system
+   * position are visited and the gradient and Gauss-Newton Hessian are
+   * computed analytically, so that its cost does not grow with the total
+   * number of obstacles.
+   */
+  template <typename T,
+    int _nx = Dynamic,
+    int _nu = Dynamic,
+    int _np = Dynamic> class ObstacleSetCost : public Cost<T, _nx, _nu, _np> {
+  public:
+
+  // function mapping from T to a position and returning the index where the gradient should start
+  typedef std::function< int(Vector3d&, const T& ) > ToVector3d;
+
+  typedef Matrix<double, _nx, 1> Vectornd;
+  typedef Matrix<double, _nu, 1> Vectorcd;
+  typedef Matrix<double, _np, 1> Vectormd;
+
+  typedef Matrix<double, _nx, _nx> Matrixnd;
+  typedef Matrix<double, _nx, _nu> Matrixncd;
+  typedef Matrix<double, _nu, _nx> Matrixcnd;
+  typedef Matrix<double, _nu, _nu> Matrixcd;
+
+  typedef Matrix<double, _np, _np> Matrixmd;
+  typedef Matrix<double, _nx, _np> Matrixnmd;
+  typedef Matrix<double, _np, _nx> Matrixmnd;
+
+  /**
+   * Obstacle set cost
+   * @param sys system
+   * @param tf final time
+   * @param obstacles obstacle set (already built)
+   * @param dim workspace dimension (2 for planar systems, in which case
+   *        only the x and y gradient components are used)
+   */
+  ObstacleSetCost(System<T, _nx, _nu, _np> &sys, double tf,
+                  const ObstacleSet &obstacles, int dim = 3);
+
+  virtual double L(double t, const T& x, const Vectorcd& u, double h,
+                   const Vectormd *p = 0,
+                   Vectornd *Lx = 0, Matrixnd* Lxx = 0,
+                   Vectorcd *Lu = 0, Matrixcd* Luu = 0,
+                   Matrixncd *Lxu = 0,
+                   Vectormd *Lp = 0, Matrixmd *Lpp = 0,
+                   Matrixmnd *Lpx = 0);
+
+  const ObstacleSet &obstacles;   ///< obstacles
+  int dim;                        ///< workspace dimension (2 or 3)
+  double b;                       ///< penalty coefficient (default is 1)
+
+  ToVector3d func;                ///< function converting from a generic state T to Vector3d
+
+  protected:
+  vector<ObstacleSet::Penetration> ps;   ///< penetrations at the last query
+  };
+
+  template <typename T, int _nx, int _nu, int _np>
+    ObstacleSetCost<T, _nx, _nu, _np>::ObstacleSetCost(System<T, _nx, _nu, _np> &sys, double tf,
+                                                       const ObstacleSet &obstacles, int dim) :
+    Cost<T, _nx, _nu, _np>(sys, tf), obstacles(obstacles), dim(dim), b(1)
+  {
+  }
+
+  template <typename T, int _nx, int _nu, int _np>
+    double ObstacleSetCost<T, _nx, _nu, _np>::L(double t, const T &x, const Matrix<double, _nu, 1> &u,
+                                                double h,
+                                                const Matrix<double, _np, 1> *p,
+                                                Matrix<double, _nx, 1> *Lx, Matrix<double, _nx, _nx> *Lxx,
+                                                Matrix<double, _nu, 1> *Lu, Matrix<double, _nu, _nu> *Luu,
+                                                Matrix<double, _nx, _nu> *Lxu,
+                                                Matrix<double, _np, 1> *Lp, Matrix<double, _np, _np> *Lpp,
+                                                Matrix<double, _np, _nx> *Lpx) {
+    int gi = 0; // index where gradient should start
+
+    Vector3d q;
+    if (!std::is_same<T, Vector3d>::value) {
+      gi = func(q, x);
+    } else {
+      q = (Vector3d&)x;
+    }
+
+    obstacles.Query(ps, q);
+
+    double c = 0;
+    Vector3d dq(0, 0, 0);
+    Matrix3d ddq = Matrix3d::Zero();
+    for (size_t i = 0; i < ps.size(); ++i) {
+      const ObstacleSet::Penetration &pen = ps[i];
+      c += pen.g*pen.g;
+      dq += pen.g*pen.dg;
+      ddq += pen.dg*pen.dg.transpose();  // use a GN approximation to the Hessian
+    }
+
+    if (dim == 2) {
+      // planar poses are perturbed in the body frame
+      Matrix2d R = PositionFrame2d(x);
+      dq.head<2>() = R.transpose()*dq.head<2>();
+      ddq.topLeftCorner<2,2>() = R.transpose()*ddq.topLeftCorner<2,2>()*R;
+    }
+
+    if (Lx) {
+      Lx->setZero();
+      Lx->segment(gi, dim) = b*dq.head(dim);
+    }
+    if (Lxx) {
+      Lxx->setZero();
+      Lxx->block(gi, gi, dim, dim) = b*ddq.topLeftCorner(dim, dim);
+    }
+    if (Lu)
+      Lu->setZero();
+    if (Luu)
+      Luu->setZero();
+    if (Lxu)
+      Lxu->setZero();
+
+    return b/2*c;
+  }
+}
+
+#endif
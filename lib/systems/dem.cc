@@ -7,6 +7,7 @@
 #include <stdio.h>
 #include <iostream>
 #include <fstream>
+#include <climits>
 
 using namespace gcop;
 using namespace std;
@@ -162,6 +163,39 @@ void Dem::ComputeNormals()
   //  cout << ni << " " <<  nj << endl;
 }
 
+/**
+ * Running max over windows [x-r, x+r] of a sequence of rows using the
+ * van Herk/Gil-Werman algorithm. Each "element" of the sequence is a row of m
+ * values so that the max is taken coefficient-wise over whole rows at once.
+ * The cost per value is independent of r.
+ * @param out output, only rows x in [r, n-r) are written
+ * @param in input sequence of n rows of m values (stored contiguously)
+ * @param n number of rows
+ * @param m number of values per row
+ * @param r window radius
+ * @param g workspace of n*m values (max from start of block)
+ * @param h workspace of n*m values (max to end of block)
+ */
+static void RunningMax(double *out, const double *in, int n, int m, int r,
+                       double *g, double *h)
+{
+  int k = 2*r + 1;
+  for (int b = 0; b < n; b += k) {
+    int e = MIN(b + k, n);
+    memcpy(g + b*m, in + b*m, m*sizeof(double));
+    for (int x = b + 1; x < e; ++x)
+      for (int l = 0; l < m; ++l)
+        g[x*m + l] = max(g[(x-1)*m + l], in[x*m + l]);
+    memcpy(h + (e-1)*m, in + (e-1)*m, m*sizeof(double));
+    for (int x = e - 2; x >= b; --x)
+      for (int l = 0; l < m; ++l)
+        h[x*m + l] = max(h[(x+1)*m + l], in[x*m + l]);
+  }
+  for (int x = r; x < n - r; ++x)
+    for (int l = 0; l < m; ++l)
+      out[x*m + l] = max(h[(x-r)*m + l], g[(x+r)*m + l]);
+}
+
 void Dem::Dilate(double r, bool cube) 
 {
   if (!odata) {
@@ -178,17 +212,49 @@ void Dem::Dilate(double r, bool cube)
 
   cout << "Dem::Dilate: dilating with di=" << di << endl;
 
-  for (int i = di; i < ni - di; ++i) {
-    for (int j = di; j < nj - di; ++j) {
-      // double z = odata[i*nj + j]; // height at center
-      for (int k = -di; k <= di; ++k) {
-        for (int l = -di; l <= di; ++l) {
-          int ik = i + k;
-          int jl = j + l;
-          data[ik*nj + jl] = max(data[ik*nj + jl], odata[ik*nj + jl]);
-        }        
-      }
+  // the cube max filter of the source odata (the map before this call) is
+  // separable: max along rows and then along columns. Only the cells at
+  // least di away from the boundary are dilated (the window of a cell
+  // contains the cell, so no cell is lowered).
+  if (ni > 2*di && nj > 2*di) {
+    double *rowmax = new double[ni*nj];
+    memcpy(rowmax, odata, ni*nj*sizeof(double));
+
+#pragma omp parallel
+    {
+      double *g = new double[nj];
+      double *h = new double[nj];
+#pragma omp for
+      for (int i = 0; i < ni; ++i)
+        RunningMax(rowmax + i*nj, odata + i*nj, nj, 1, di, g, h);
+      delete[] g;
+      delete[] h;
+    }
+
+    double *g = new double[ni*nj];
+    double *h = new double[ni*nj];
+    int nb = (nj + 63)/64;  // columns are processed in parallel strips
+#pragma omp parallel for
+    for (int b = 0; b < nb; ++b) {
+      int j0 = 64*b;
+      int m = MIN(64, nj - j0);
+      double *in = new double[ni*m];
+      double *out = new double[ni*m];
+      double *gb = g + ni*j0;
+      double *hb = h + ni*j0;
+      for (int i = 0; i < ni; ++i)
+        memcpy(in + i*m, rowmax + i*nj + j0, m*sizeof(double));
+      RunningMax(out, in, ni, m, di, gb, hb);
+      for (int i = di; i < ni - di; ++i)
+        for (int l = 0; l < m; ++l)
+          if (j0 + l >= di && j0 + l < nj - di)
+            data[i*nj + j0 + l] = out[i*m + l];
+      delete[] in;
+      delete[] out;
     }
+    delete[] g;
+    delete[] h;
+    delete[] rowmax;
   }
   ComputeNormals();
   //  memcpy(odata, data, ni*nj*sizeof(double));
@@ -201,37 +267,78 @@ void Dem::Convolve(double sigma, bool cn, double thresh)
     memcpy(odata, data, ni*nj*sizeof(double));
   }
 
+  if (sigma <= 0)
+    return;
+
   int a = (int)round(2*sigma/cs);
 
+  // the Gaussian kernel is separable: g(ci,cj) = g(ci)*g(cj) (the
+  // normalization constant cancels out). Values below thresh are ignored and
+  // cells outside the map have zero height.
+  double *g = new double[2*a + 1];
+  double gs = 0;
+  for (int k = -a; k <= a; ++k) {
+    g[k + a] = exp(-k*k*cs*cs/(2*sigma*sigma));
+    gs += g[k + a];
+  }
+  double pad = (0 >= thresh) ? 1 : 0;  // whether outside cells are counted
+
+  // weighted sums of heights and of weights along rows
+  double *zr = new double[ni*nj];
+  double *nr = new double[ni*nj];
+#pragma omp parallel for
   for (int i = 0; i < ni; ++i) {
+    const double *d = odata + nj*i;
     for (int j = 0; j < nj; ++j) {
-
-      //      int jl = MAX(j-a,0);
-      //      int jr = MIN(j+a,nj-1);
-      //     int il = MAX(i-a,0);
-      //     int ir = MIN(i+a,ni-1);
-      
       double z = 0;
       double n = 0;
-      
-      //      for (int ci = il; ci <= ir; ++ci) {
-      //        for (int cj = jl; cj <= jr; ++cj) {
-      for (int ci = i-a; ci <= i+a; ++ci) {
-        for (int cj = j-a; cj <= j+a; ++cj) {
-          
-          double &d = odata[cj + nj*ci];
-          if (d < thresh)
-            continue;
-          double r =  (cj-j)*(cj-j) + (ci-i)*(ci-i);
-          double g = 1/(sigma*sqrt(2*M_PI))*exp(-r*cs*cs/(2*sigma*sigma));
-          n += g;
-          if (ci >= 0 && ci < ni && cj >= 0 && cj < nj)
-            z += g*d;
+      for (int cj = j - a; cj <= j + a; ++cj) {
+        double gk = g[cj - j + a];
+        if (cj < 0 || cj >= nj) {
+          n += gk*pad;
+        } else if (d[cj] >= thresh) {
+          z += gk*d[cj];
+          n += gk;
+        }
+      }
+      zr[j + nj*i] = z;
+      nr[j + nj*i] = n;
+    }
+  }
+
+  // then along columns, accumulating whole rows at a time
+#pragma omp parallel
+  {
+    double *z = new double[nj];
+    double *n = new double[nj];
+#pragma omp for
+    for (int i = 0; i < ni; ++i) {
+      memset(z, 0, nj*sizeof(double));
+      memset(n, 0, nj*sizeof(double));
+      for (int ci = i - a; ci <= i + a; ++ci) {
+        double gk = g[ci - i + a];
+        if (ci < 0 || ci >= ni) {
+          for (int j = 0; j < nj; ++j)
+            n[j] += gk*gs*pad;
+        } else {
+          const double *zc = zr + nj*ci;
+          const double *nc = nr + nj*ci;
+          for (int j = 0; j < nj; ++j) {
+            z[j] += gk*zc[j];
+            n[j] += gk*nc[j];
+          }
         }
       }
-      data[j + nj*i] = z/n;
+      for (int j = 0; j < nj; ++j)
+        data[j + nj*i] = z[j]/n[j];
     }
+    delete[] z;
+    delete[] n;
   }
+  delete[] zr;
+  delete[] nr;
+  delete[] g;
+
   if (cn)
     ComputeNormals();
 }
@@ -310,6 +417,231 @@ double Dem::Get(double x, double y) const
   return o[2] + bilinterp(data, nj, ni, (x - o[0])/cs, (h - y - o[1])/cs);
 }
 
+/**
+ * Grid parameters used by the batch queries
+ */
+struct BatchGrid {
+  const double *data;     ///< heights
+  const double *normals;  ///< normals (optional)
+  int ni, nj;             ///< dimensions (at least 2x2)
+  double o0, o1, o2;      ///< origin
+  double w, h;            ///< width and height
+  double ics;             ///< inverse cell size
+  double eps;             ///< tolerance of IsValid
+};
+
+/**
+ * Height (and normal) at a single point, used for the remainder of the
+ * vectorized loop and when AVX2 is not available
+ * @return whether the point is valid
+ */
+static inline bool BatchPoint(const BatchGrid &g, double x, double y,
+                              double &z, double *n)
+{
+  double dx = x - g.o0;
+  double dy = y - g.o1;
+  if (!(dx >= -g.eps && dx <= g.w + g.eps && dy >= -g.eps && dy <= g.h + g.eps)) {
+    z = 0;
+    if (n) {
+      n[0] = 0; n[1] = 0; n[2] = 1;
+    }
+    return false;
+  }
+  double xi = MIN(MAX(dx*g.ics, 0.0), g.nj - 1.0);
+  double yi = MIN(MAX((g.h - y - g.o1)*g.ics, 0.0), g.ni - 1.0);
+  int j = MIN((int)xi, g.nj - 2);
+  int i = MIN((int)yi, g.ni - 2);
+  double t = xi - j;
+  double u = yi - i;
+  const double *d = g.data + (size_t)i*g.nj + j;
+  double a = d[0] + t*(d[1] - d[0]);
+  double b = d[g.nj] + t*(d[g.nj + 1] - d[g.nj]);
+  z = g.o2 + a + u*(b - a);
+  if (n) {
+    SET3(n, g.normals + 3*((size_t)yi*g.nj + (size_t)xi));
+  }
+  return true;
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define GCOP_DEM_AVX2
+
+/**
+ * Gather of 4 doubles. The masked form is used since the plain one leaves
+ * its source operand undefined, which gcc reports as uninitialized.
+ */
+__attribute__((target("avx2")))
+static inline __m256d GatherAvx2(const double *base, __m128i idx)
+{
+  return _mm256_mask_i32gather_pd(_mm256_setzero_pd(), base, idx,
+                                  _mm256_castsi256_pd(_mm256_set1_epi64x(-1)), 8);
+}
+
+/**
+ * Vectorized batch query processing 4 points at a time. The indices are
+ * clamped to the grid so that the gathers are always in bounds (NaN
+ * coordinates are clamped to 0 by max_pd), and the results of invalid
+ * points are masked out afterwards. The gathers use 32-bit indices, so
+ * the grid must satisfy BatchAvx2Fits.
+ */
+__attribute__((target("avx2")))
+static int BatchAvx2(const BatchGrid &g, double *z, double *ns,
+                     const double *x, const double *y, int n,
+                     unsigned char *valid)
+{
+  const __m256d o0 = _mm256_set1_pd(g.o0);
+  const __m256d o1 = _mm256_set1_pd(g.o1);
+  const __m256d o2 = _mm256_set1_pd(g.o2);
+  const __m256d ho1 = _mm256_set1_pd(g.h - g.o1);
+  const __m256d ics = _mm256_set1_pd(g.ics);
+  const __m256d lo = _mm256_set1_pd(-g.eps);
+  const __m256d wx = _mm256_set1_pd(g.w + g.eps);
+  const __m256d hy = _mm256_set1_pd(g.h + g.eps);
+  const __m256d zero = _mm256_setzero_pd();
+  const __m256d one = _mm256_set1_pd(1.0);
+  const __m256d xmax = _mm256_set1_pd(g.nj - 1.0);
+  const __m256d ymax = _mm256_set1_pd(g.ni - 1.0);
+  const __m256d jmax = _mm256_set1_pd(g.nj - 2.0);
+  const __m256d imax = _mm256_set1_pd(g.ni - 2.0);
+  const __m128i nj = _mm_set1_epi32(g.nj);
+  const __m128i three = _mm_set1_epi32(3);
+
+  int nv = 0;
+  int k = 0;
+  for (; k + 4 <= n; k += 4) {
+    __m256d xv = _mm256_loadu_pd(x + k);
+    __m256d yv = _mm256_loadu_pd(y + k);
+    __m256d dx = _mm256_sub_pd(xv, o0);
+    __m256d dy = _mm256_sub_pd(yv, o1);
+    __m256d m = _mm256_and_pd(_mm256_and_pd(_mm256_cmp_pd(dx, lo, _CMP_GE_OQ),
+                                            _mm256_cmp_pd(dx, wx, _CMP_LE_OQ)),
+                              _mm256_and_pd(_mm256_cmp_pd(dy, lo, _CMP_GE_OQ),
+                                            _mm256_cmp_pd(dy, hy, _CMP_LE_OQ)));
+    __m256d xi = _mm256_min_pd(_mm256_max_pd(_mm256_mul_pd(dx, ics), zero), xmax);
+    __m256d yi = _mm256_min_pd(_mm256_max_pd(_mm256_mul_pd(_mm256_sub_pd(ho1, yv), ics), zero), ymax);
+    __m256d jf = _mm256_min_pd(_mm256_floor_pd(xi), jmax);
+    __m256d if_ = _mm256_min_pd(_mm256_floor_pd(yi), imax);
+    __m256d t = _mm256_sub_pd(xi, jf);
+    __m256d u = _mm256_sub_pd(yi, if_);
+    __m128i idx = _mm_add_epi32(_mm_mullo_epi32(_mm256_cvttpd_epi32(if_), nj),
+                                _mm256_cvttpd_epi32(jf));
+
+    __m256d d00 = GatherAvx2(g.data, idx);
+    __m256d d01 = GatherAvx2(g.data + 1, idx);
+    __m256d d10 = GatherAvx2(g.data + g.nj, idx);
+    __m256d d11 = GatherAvx2(g.data + g.nj + 1, idx);
+    __m256d a = _mm256_add_pd(d00, _mm256_mul_pd(t, _mm256_sub_pd(d01, d00)));
+    __m256d b = _mm256_add_pd(d10, _mm256_mul_pd(t, _mm256_sub_pd(d11, d10)));
+    __m256d zv = _mm256_add_pd(o2, _mm256_add_pd(a, _mm256_mul_pd(u, _mm256_sub_pd(b, a))));
+    _mm256_storeu_pd(z + k, _mm256_and_pd(zv, m));
+
+    int mm = _mm256_movemask_pd(m);
+    nv += __builtin_popcount(mm);
+    if (valid) {
+      for (int l = 0; l < 4; ++l)
+        valid[k + l] = (mm >> l) & 1;
+    }
+
+    if (ns) {
+      __m128i nidx = _mm_mullo_epi32(_mm_add_epi32(_mm_mullo_epi32(_mm256_cvttpd_epi32(yi), nj),
+                                                   _mm256_cvttpd_epi32(xi)), three);
+      __m256d nx = _mm256_and_pd(GatherAvx2(g.normals, nidx), m);
+      __m256d ny = _mm256_and_pd(GatherAvx2(g.normals + 1, nidx), m);
+      __m256d nz = _mm256_blendv_pd(one, GatherAvx2(g.normals + 2, nidx), m);
+      double bx[4], by[4], bz[4];
+      _mm256_storeu_pd(bx, nx);
+      _mm256_storeu_pd(by, ny);
+      _mm256_storeu_pd(bz, nz);
+      double *nk = ns + 3*k;
+      for (int l = 0; l < 4; ++l) {
+        nk[3*l] = bx[l];
+        nk[3*l + 1] = by[l];
+        nk[3*l + 2] = bz[l];
+      }
+    }
+  }
+
+  for (; k < n; ++k) {
+    bool v = BatchPoint(g, x[k], y[k], z[k], ns ? ns + 3*k : 0);
+    nv += v;
+    if (valid)
+      valid[k] = v;
+  }
+  return nv;
+}
+
+/**
+ * Whether the element indices of the gathers (up to 3*ni*nj for the
+ * normals) fit in their signed 32-bit lanes. The gathers scale them in
+ * 64-bit arithmetic, so the byte offsets do not overflow.
+ */
+static inline bool BatchAvx2Fits(const BatchGrid &g)
+{
+  return 3*(long long)g.ni*g.nj <= INT_MAX;
+}
+#endif
+
+/**
+ * Batch query dispatching to the AVX2 implementation when available and
+ * to the scalar one for grids too large for its 32-bit indices
+ */
+static int Batch(const BatchGrid &g, double *z, double *ns,
+                 const double *x, const double *y, int n,
+                 unsigned char *valid)
+{
+#ifdef GCOP_DEM_AVX2
+  static const bool avx2 = __builtin_cpu_supports("avx2");
+  if (avx2 && BatchAvx2Fits(g))
+    return BatchAvx2(g, z, ns, x, y, n, valid);
+#endif
+  int nv = 0;
+  for (int k = 0; k < n; ++k) {
+    bool v = BatchPoint(g, x[k], y[k], z[k], ns ? ns + 3*k : 0);
+    nv += v;
+    if (valid)
+      valid[k] = v;
+  }
+  return nv;
+}
+
+int Dem::Get(double *z, const double *x, const double *y, int n,
+             unsigned char *valid) const
+{
+  if (!data || ni < 2 || nj < 2) {
+    // e.g. derived maps without dense data
+    int nv = 0;
+    for (int k = 0; k < n; ++k) {
+      bool v = IsValid(x[k], y[k]);
+      z[k] = Get(x[k], y[k]);
+      nv += v;
+      if (valid)
+        valid[k] = v;
+    }
+    return nv;
+  }
+  BatchGrid g = {data, 0, ni, nj, o[0], o[1], o[2], w, h, 1/cs, eps};
+  return Batch(g, z, 0, x, y, n, valid);
+}
+
+int Dem::GetNormal(double *z, double *ns, const double *x, const double *y, int n,
+                   unsigned char *valid) const
+{
+  if (!data || !normals || ni < 2 || nj < 2) {
+    int nv = 0;
+    for (int k = 0; k < n; ++k) {
+      bool v = IsValid(x[k], y[k]);
+      z[k] = GetNormal(ns + 3*k, x[k], y[k]);
+      nv += v;
+      if (valid)
+        valid[k] = v;
+    }
+    return nv;
+  }
+  BatchGrid g = {data, normals, ni, nj, o[0], o[1], o[2], w, h, 1/cs, eps};
+  return Batch(g, z, ns, x, y, n, valid);
+}
+
 void Dem::Point2Index(int &i, int &j, double x, double y) const
 {
   j = (x - o[0])/cs;
@@ -337,6 +669,12 @@ bool Dem::Get(double *p, int i, int j) const
   return true;
 }
 
+void Dem::GetRow(double *z, int i) const
+{
+  assert(i >= 0 && i < ni);
+  memcpy(z, data + i*nj, nj*sizeof(double));
+}
+
 void Dem::Scale(double s)
 {
   for (int i = 0; i < ni; ++i)
@@ -62,7 +62,7 @@ namespace gcop {
      * @param y y-coordinate
      * @return z-coordinate (elevation)
      */
-    double GetNormal(double n[3], double x, double y) const;
+    virtual double GetNormal(double n[3], double x, double y) const;
 
     /**
      * Return pointer to the normal at point (x,y)
@@ -70,7 +70,37 @@ namespace gcop {
      * @param y y-coordinate
      * @return pointer to normal
      */
-    const double* GetNormal(double x, double y) const;
+    virtual const double* GetNormal(double x, double y) const;
+
+    /**
+     * Get elevations at n points at once. Equivalent to calling Get(x,y)
+     * on each point, but the interpolation is vectorized (using AVX2 if
+     * the processor supports it).
+     * @param z elevations (n values, 0 for invalid points)
+     * @param x x-coordinates (n values)
+     * @param y y-coordinates (n values)
+     * @param n number of points
+     * @param valid per-point validity flags (n values, optional), set to 1
+     *        if the point is within the map bounds and to 0 otherwise
+     * @return number of valid points
+     */
+    virtual int Get(double *z, const double *x, const double *y, int n,
+                    unsigned char *valid = 0) const;
+
+    /**
+     * Get elevations and normals at n points at once. Equivalent to calling
+     * GetNormal(n,x,y) on each point (see Get for batch queries).
+     * @param z elevations (n values, 0 for invalid points)
+     * @param ns normals (3n values stored point by point, (0,0,1) for
+     *        invalid points)
+     * @param x x-coordinates (n values)
+     * @param y y-coordinates (n values)
+     * @param n number of points
+     * @param valid per-point validity flags (n values, optional)
+     * @return number of valid points
+     */
+    virtual int GetNormal(double *z, double *ns, const double *x, const double *y, int n,
+                          unsigned char *valid = 0) const;
 
     /**
      * Get point p=(x,y,z) corresponding to indices (i,j)
@@ -81,6 +111,14 @@ namespace gcop {
      */
     virtual bool Get(double *p, int i, int j) const;    
 
+    /**
+     * Get the heights (without the origin offset) of row i. Unlike the data
+     * array this also works for maps that are not stored densely (TiledDem).
+     * @param z heights (nj values)
+     * @param i i-index
+     */
+    virtual void GetRow(double *z, int i) const;
+
     /**
      * Set height at point at index (i,j)
      * @param i i-index
@@ -129,7 +167,7 @@ namespace gcop {
      * @param j j-index
      * @return pointer to 3x1 array with the normal vector
      */
-    const double* GetNormal(int i, int j) const;
+    virtual const double* GetNormal(int i, int j) const;
 
     /**
      * Compute all normals once the Dem is loaded and ready
@@ -142,7 +180,12 @@ namespace gcop {
     static double bilinterp(const double* z, int w, int h, double xi, double yi, double eps = 1e-10);
 
     /**
-     * Dilate the DEM
+     * Dilate the DEM, i.e. set each cell to the maximum height within
+     * distance r. Cells closer than r to the boundary are left unchanged.
+     * The map before the call is kept in odata and is the source of the
+     * filter, so repeated calls dilate the already dilated map.
+     * Uses a separable van Herk/Gil-Werman max filter so the cost per cell
+     * does not depend on r.
      * @param r distance (radius of ball, or half side-length of cube)
      * @param cube whether to use cube or ball
      */
@@ -155,7 +198,9 @@ namespace gcop {
     void AddBoundary(double h);
 
     /**
-     *  Apply Gaussian convolution filter with std deviation sigma
+     *  Apply Gaussian convolution filter with std deviation sigma. The filter
+     *  is applied separably along rows and then columns, with cells outside
+     *  the map treated as having zero height.
      *  @param sigma standard deviation (sigma=0) has no effect
      *  @param cn flag to recompute normals 
      *         (set to false in order to speedup processing when 
@@ -0,0 +1,401 @@
+#include "dempyramid.h"
+#include "utils.h"
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+
+using namespace gcop;
+using namespace std;
+using namespace Eigen;
+
+/**
+ * Round a double to the closest float which is not above (below) it
+ */
+static inline float FloorFloat(double v)
+{
+  float f = (float)v;
+  return (f > v) ? nextafterf(f, -INFINITY) : f;
+}
+
+static inline float CeilFloat(double v)
+{
+  float f = (float)v;
+  return (f < v) ? nextafterf(f, INFINITY) : f;
+}
+
+/**
+ * Closest point q on triangle (a,b,c) to point p
+ * (Ericson, Real-Time Collision Detection, 5.1.5)
+ */
+static void ClosestPointTriangle(Vector3d &q, const Vector3d &p,
+                                 const Vector3d &a, const Vector3d &b, const Vector3d &c)
+{
+  Vector3d ab = b - a;
+  Vector3d ac = c - a;
+  Vector3d ap = p - a;
+  double d1 = ab.dot(ap);
+  double d2 = ac.dot(ap);
+  if (d1 <= 0 && d2 <= 0) {
+    q = a;
+    return;
+  }
+  Vector3d bp = p - b;
+  double d3 = ab.dot(bp);
+  double d4 = ac.dot(bp);
+  if (d3 >= 0 && d4 <= d3) {
+    q = b;
+    return;
+  }
+  double vc = d1*d4 - d3*d2;
+  if (vc <= 0 && d1 >= 0 && d3 <= 0) {
+    q = a + d1/(d1 - d3)*ab;
+    return;
+  }
+  Vector3d cp = p - c;
+  double d5 = ab.dot(cp);
+  double d6 = ac.dot(cp);
+  if (d6 >= 0 && d5 <= d6) {
+    q = c;
+    return;
+  }
+  double vb = d5*d2 - d1*d6;
+  if (vb <= 0 && d2 >= 0 && d6 <= 0) {
+    q = a + d2/(d2 - d6)*ac;
+    return;
+  }
+  double va = d3*d6 - d5*d4;
+  if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0) {
+    q = b + (d4 - d3)/((d4 - d3) + (d5 - d6))*(c - b);
+    return;
+  }
+  double denom = 1/(va + vb + vc);
+  q = a + ab*(vb*denom) + ac*(vc*denom);
+}
+
+/**
+ * Squared distance from point p to box [x0,x1]x[y0,y1]x[z0,z1]
+ */
+static inline double BoxDistance2(const Vector3d &p, double x0, double y0, double z0,
+                                  double x1, double y1, double z1)
+{
+  double dx = MAX(0, MAX(x0 - p[0], p[0] - x1));
+  double dy = MAX(0, MAX(y0 - p[1], p[1] - y1));
+  double dz = MAX(0, MAX(z0 - p[2], p[2] - z1));
+  return dx*dx + dy*dy + dz*dz;
+}
+
+DemPyramid::DemPyramid(const Dem &dem) : dem(dem), nl(0)
+{
+  Update();
+}
+
+void DemPyramid::Update()
+{
+  if (dem.ni < 2 || dem.nj < 2) {
+    cerr << "Warning: DemPyramid::Update: dem should have at least 2x2 points" << endl;
+    nl = 0;
+    return;
+  }
+
+  nis.clear();
+  njs.clear();
+  nis.push_back(dem.ni - 1);
+  njs.push_back(dem.nj - 1);
+  while (nis.back() > 1 || njs.back() > 1) {
+    nis.push_back((nis.back() + 1)/2);
+    njs.push_back((njs.back() + 1)/2);
+  }
+  nl = nis.size();
+  zmins.resize(nl);
+  zmaxs.resize(nl);
+
+  // level 0: height range of each quad
+  int ni = nis[0], nj = njs[0];
+  zmins[0].resize(ni*nj);
+  zmaxs[0].resize(ni*nj);
+  // rows are read through GetRow, since e.g. a TiledDem has no data array
+#pragma omp parallel
+  {
+    vector<double> r0(dem.nj), r1(dem.nj);
+#pragma omp for
+    for (int i = 0; i < ni; ++i) {
+      dem.GetRow(&r0[0], i);
+      dem.GetRow(&r1[0], i + 1);
+      for (int j = 0; j < nj; ++j) {
+        double zmin = MIN(MIN(r0[j], r0[j+1]), MIN(r1[j], r1[j+1]));
+        double zmax = MAX(MAX(r0[j], r0[j+1]), MAX(r1[j], r1[j+1]));
+        zmins[0][i*nj + j] = FloorFloat(dem.o[2] + zmin);
+        zmaxs[0][i*nj + j] = CeilFloat(dem.o[2] + zmax);
+      }
+    }
+  }
+
+  // merge 2x2 nodes
+  for (int l = 1; l < nl; ++l) {
+    int pni = nis[l-1], pnj = njs[l-1];
+    ni = nis[l];
+    nj = njs[l];
+    zmins[l].resize(ni*nj);
+    zmaxs[l].resize(ni*nj);
+    const float *pmin = &zmins[l-1][0];
+    const float *pmax = &zmaxs[l-1][0];
+#pragma omp parallel for if (ni*nj > 4096)
+    for (int i = 0; i < ni; ++i) {
+      int i0 = 2*i, i1 = MIN(2*i + 1, pni - 1);
+      for (int j = 0; j < nj; ++j) {
+        int j0 = 2*j, j1 = MIN(2*j + 1, pnj - 1);
+        zmins[l][i*nj + j] = min(min(pmin[i0*pnj + j0], pmin[i0*pnj + j1]),
+                                 min(pmin[i1*pnj + j0], pmin[i1*pnj + j1]));
+        zmaxs[l][i*nj + j] = max(max(pmax[i0*pnj + j0], pmax[i0*pnj + j1]),
+                                 max(pmax[i1*pnj + j0], pmax[i1*pnj + j1]));
+      }
+    }
+  }
+}
+
+void DemPyramid::NodeBox(double &x0, double &y0, double &x1, double &y1,
+                         int l, int i, int j) const
+{
+  int i0 = i << l, j0 = j << l;
+  int i1 = MIN((i + 1) << l, nis[0]);
+  int j1 = MIN((j + 1) << l, njs[0]);
+  x0 = dem.o[0] + j0*dem.cs;
+  x1 = dem.o[0] + j1*dem.cs;
+  y0 = dem.h + dem.o[1] - i1*dem.cs;   // rows are mapped as in Dem::Get(p,i,j)
+  y1 = dem.h + dem.o[1] - i0*dem.cs;
+}
+
+double DemPyramid::QuadDistance(const Vector3d &p, int i, int j, Vector3d &q) const
+{
+  // the same vertices as the triangles of PqpDem
+  Vector3d p00, p10, p11, p01;
+  dem.Get(p00.data(), i, j);
+  dem.Get(p10.data(), i + 1, j);
+  dem.Get(p11.data(), i + 1, j + 1);
+  dem.Get(p01.data(), i, j + 1);
+
+  Vector3d q1, q2;
+  ClosestPointTriangle(q1, p, p00, p10, p11);
+  ClosestPointTriangle(q2, p, p00, p11, p01);
+  double d1 = (p - q1).squaredNorm();
+  double d2 = (p - q2).squaredNorm();
+  if (d1 <= d2) {
+    q = q1;
+    return d1;
+  }
+  q = q2;
+  return d2;
+}
+
+double DemPyramid::PointDistance(const Vector3d &p, Vector3d *q) const
+{
+  struct Node {
+    int l, i, j;
+    double d2;   ///< lower bound on the squared distance
+  };
+
+  double best = INFINITY;
+  Vector3d qb(p), qn;
+  if (!nl)
+    return best;
+
+  // depth-first branch-and-bound visiting the closest children first
+  vector<Node> stack;
+  stack.reserve(4*nl);
+  Node root = {nl - 1, 0, 0, 0};
+  stack.push_back(root);
+  while (!stack.empty()) {
+    Node n = stack.back();
+    stack.pop_back();
+    if (n.d2 >= best)
+      continue;
+    if (n.l == 0) {
+      double d2 = QuadDistance(p, n.i, n.j, qn);
+      if (d2 < best) {
+        best = d2;
+        qb = qn;
+      }
+      continue;
+    }
+    int l = n.l - 1;
+    Node cs[4];
+    int nc = 0;
+    for (int i = 2*n.i; i < MIN(2*n.i + 2, nis[l]); ++i) {
+      for (int j = 2*n.j; j < MIN(2*n.j + 2, njs[l]); ++j) {
+        double x0, y0, x1, y1;
+        NodeBox(x0, y0, x1, y1, l, i, j);
+        int k = i*njs[l] + j;
+        double d2 = BoxDistance2(p, x0, y0, zmins[l][k], x1, y1, zmaxs[l][k]);
+        if (d2 >= best)
+          continue;
+        Node c = {l, i, j, d2};
+        // insertion sort in decreasing order of distance
+        int m = nc++;
+        for (; m > 0 && cs[m-1].d2 < d2; --m)
+          cs[m] = cs[m-1];
+        cs[m] = c;
+      }
+    }
+    for (int m = 0; m < nc; ++m)
+      stack.push_back(cs[m]);
+  }
+
+  if (q)
+    *q = qb;
+  return sqrt(best);
+}
+
+double DemPyramid::SphereDistance(const Vector3d &c, double r, Vector3d *grad) const
+{
+  Vector3d q;
+  double d = PointDistance(c, &q);
+  bool in = dem.Inside(c[0], c[1], c[2]);
+
+  if (grad) {
+    if (d > 1e-12)
+      *grad = (c - q)/d;
+    else
+      grad->setZero();
+    if (in)
+      *grad = -*grad;
+  }
+
+  return (in ? -d : d) - r;
+}
+
+bool DemPyramid::QuadRange(int &i0, int &j0, int &i1, int &j1,
+                           double x0, double y0, double x1, double y1) const
+{
+  if (!nl)
+    return false;
+  double u0 = (x0 - dem.o[0])/dem.cs;
+  double u1 = (x1 - dem.o[0])/dem.cs;
+  double v0 = (dem.h + dem.o[1] - y1)/dem.cs;
+  double v1 = (dem.h + dem.o[1] - y0)/dem.cs;
+  if (u1 < 0 || v1 < 0 || u0 > njs[0] || v0 > nis[0])
+    return false;
+  j0 = MAX(0, (int)floor(u0));
+  j1 = MIN(njs[0] - 1, (int)floor(u1));
+  i0 = MAX(0, (int)floor(v0));
+  i1 = MIN(nis[0] - 1, (int)floor(v1));
+  return true;
+}
+
+void DemPyramid::HeightRange(double &zmin, double &zmax,
+                             int i0, int j0, int i1, int j1) const
+{
+  struct Node {
+    int l, i, j;
+  };
+
+  zmin = INFINITY;
+  zmax = -INFINITY;
+  vector<Node> stack;
+  stack.reserve(4*nl);
+  Node root = {nl - 1, 0, 0};
+  stack.push_back(root);
+  while (!stack.empty()) {
+    Node n = stack.back();
+    stack.pop_back();
+    // quads covered by the node
+    int ni0 = n.i << n.l, nj0 = n.j << n.l;
+    int ni1 = MIN(((n.i + 1) << n.l), nis[0]) - 1;
+    int nj1 = MIN(((n.j + 1) << n.l), njs[0]) - 1;
+    if (ni0 > i1 || nj0 > j1 || ni1 < i0 || nj1 < j0)
+      continue;
+    if (n.l == 0 || (ni0 >= i0 && nj0 >= j0 && ni1 <= i1 && nj1 <= j1)) {
+      int k = n.i*njs[n.l] + n.j;
+      zmin = min(zmin, (double)zmins[n.l][k]);
+      zmax = max(zmax, (double)zmaxs[n.l][k]);
+      continue;
+    }
+    int l = n.l - 1;
+    for (int i = 2*n.i; i < MIN(2*n.i + 2, nis[l]); ++i) {
+      for (int j = 2*n.j; j < MIN(2*n.j + 2, njs[l]); ++j) {
+        Node c = {l, i, j};
+        stack.push_back(c);
+      }
+    }
+  }
+}
+
+double DemPyramid::MaxHeight(double x0, double y0, double x1, double y1) const
+{
+  int i0, j0, i1, j1;
+  if (!QuadRange(i0, j0, i1, j1, x0, y0, x1, y1))
+    return -INFINITY;
+  double zmin, zmax;
+  HeightRange(zmin, zmax, i0, j0, i1, j1);
+  return zmax;
+}
+
+double DemPyramid::MinHeight(double x0, double y0, double x1, double y1) const
+{
+  int i0, j0, i1, j1;
+  if (!QuadRange(i0, j0, i1, j1, x0, y0, x1, y1))
+    return INFINITY;
+  double zmin, zmax;
+  HeightRange(zmin, zmax, i0, j0, i1, j1);
+  return zmin;
+}
+
+double DemPyramid::BoxDistance(const Vector3d &c, const Matrix3d &R,
+                               const Vector3d &e) const
+{
+  // axis-aligned bounding box
+  Vector3d a = R.cwiseAbs()*e;
+  Vector3d bmin = c - a;
+  Vector3d bmax = c + a;
+
+  double zmax = MaxHeight(bmin[0], bmin[1], bmax[0], bmax[1]);
+  if (zmax > bmin[2])
+    return bmin[2] - zmax;
+
+  struct Node {
+    int l, i, j;
+    double d2;
+  };
+
+  // lower bound on the distance between the bounding box and the quad boxes
+  double best = INFINITY;
+  if (!nl)
+    return best;
+  vector<Node> stack;
+  stack.reserve(4*nl);
+  Node root = {nl - 1, 0, 0, 0};
+  stack.push_back(root);
+  while (!stack.empty()) {
+    Node n = stack.back();
+    stack.pop_back();
+    if (n.d2 >= best)
+      continue;
+    if (n.l == 0) {
+      best = n.d2;
+      continue;
+    }
+    int l = n.l - 1;
+    Node cs[4];
+    int nc = 0;
+    for (int i = 2*n.i; i < MIN(2*n.i + 2, nis[l]); ++i) {
+      for (int j = 2*n.j; j < MIN(2*n.j + 2, njs[l]); ++j) {
+        double x0, y0, x1, y1;
+        NodeBox(x0, y0, x1, y1, l, i, j);
+        int k = i*njs[l] + j;
+        double dx = MAX(0, MAX(x0 - bmax[0], bmin[0] - x1));
+        double dy = MAX(0, MAX(y0 - bmax[1], bmin[1] - y1));
+        double dz = MAX(0, MAX((double)zmins[l][k] - bmax[2], bmin[2] - zmaxs[l][k]));
+        double d2 = dx*dx + dy*dy + dz*dz;
+        if (d2 >= best)
+          continue;
+        Node c = {l, i, j, d2};
+        int m = nc++;
+        for (; m > 0 && cs[m-1].d2 < d2; --m)
+          cs[m] = cs[m-1];
+        cs[m] = c;
+      }
+    }
+    for (int m = 0; m < nc; ++m)
+      stack.push_back(cs[m]);
+  }
+  return sqrt(best);
+}
@@ -0,0 +1,134 @@
+#ifndef GCOP_DEMPYRAMID_H
+#define GCOP_DEMPYRAMID_H
+
+#include "dem.h"
+#include <Eigen/Dense>
+#include <vector>
+
+namespace gcop {
+
+  /**
+   * Min/max height pyramid of a Dem for fast collision queries.
+   *
+   * Level 0 stores the minimum and maximum height of each grid quad (the
+   * four Dem points (i,j),(i+1,j),(i+1,j+1),(i,j+1)), and every following
+   * level merges 2x2 nodes of the level below until a single root remains.
+   * Each node is thus an axis-aligned box bounding the terrain surface over
+   * its footprint, which is used to prune branch-and-bound distance queries.
+   * Heights are stored as floats rounded outwards so that the bounds remain
+   * conservative.
+   *
+   * The terrain surface is triangulated in the same way as in PqpDem, so
+   * that point and sphere queries return the same distances, while building
+   * the pyramid only requires a single pass over the Dem data.
+   */
+  class DemPyramid {
+  public:
+    /**
+     * Build the pyramid of a Dem (with at least 2x2 points)
+     * @param dem digital elevation map (with data loaded)
+     */
+    DemPyramid(const Dem &dem);
+
+    /**
+     * Rebuild the pyramid after the Dem data has changed
+     */
+    void Update();
+
+    /**
+     * Unsigned distance from a point to the terrain surface
+     * @param p point
+     * @param q closest point on the surface (optional)
+     * @return distance
+     */
+    double PointDistance(const Eigen::Vector3d &p, Eigen::Vector3d *q = 0) const;
+
+    /**
+     * Signed distance between a sphere and the terrain surface, which is
+     * negative if the sphere penetrates the surface or its center is under
+     * the surface
+     * @param c center
+     * @param r radius
+     * @param grad gradient of the distance wrt c (optional)
+     * @return signed distance
+     */
+    double SphereDistance(const Eigen::Vector3d &c, double r,
+                          Eigen::Vector3d *grad = 0) const;
+
+    /**
+     * Conservative signed distance between an oriented box and the terrain.
+     * The box is replaced by its axis-aligned bounding box and the terrain
+     * over each quad by the box bounding the quad. If the bounding box is
+     * clear of all quads the returned value is a lower bound on the distance.
+     * Otherwise the negative of an upper bound on the vertical penetration,
+     * i.e. of the maximum height under the box footprint minus the bottom of
+     * the box, is returned.
+     * @param c center
+     * @param R orientation
+     * @param e half-extents along the box axes
+     * @return conservative signed distance
+     */
+    double BoxDistance(const Eigen::Vector3d &c, const Eigen::Matrix3d &R,
+                       const Eigen::Vector3d &e) const;
+
+    /**
+     * Maximum terrain height over a rectangle (an upper bound given at the
+     * resolution of the grid quads)
+     * @param x0 minimum x-coordinate
+     * @param y0 minimum y-coordinate
+     * @param x1 maximum x-coordinate
+     * @param y1 maximum y-coordinate
+     * @return maximum height (-inf if the rectangle does not overlap the Dem)
+     */
+    double MaxHeight(double x0, double y0, double x1, double y1) const;
+
+    /**
+     * Minimum terrain height over a rectangle (a lower bound given at the
+     * resolution of the grid quads)
+     * @param x0 minimum x-coordinate
+     * @param y0 minimum y-coordinate
+     * @param x1 maximum x-coordinate
+     * @param y1 maximum y-coordinate
+     * @return minimum height (inf if the rectangle does not overlap the Dem)
+     */
+    double MinHeight(double x0, double y0, double x1, double y1) const;
+
+    const Dem &dem;   ///< digital elevation map
+
+    int nl;           ///< number of levels
+
+    std::vector<int> nis;   ///< number of node rows at each level
+    std::vector<int> njs;   ///< number of node columns at each level
+
+    std::vector< std::vector<float> > zmins;  ///< minimum heights (including dem origin) at each level
+    std::vector< std::vector<float> > zmaxs;  ///< maximum heights (including dem origin) at each level
+
+  protected:
+    /**
+     * Index range of the quads covered by a rectangle
+     * @return false if the rectangle does not overlap the Dem
+     */
+    bool QuadRange(int &i0, int &j0, int &i1, int &j1,
+                   double x0, double y0, double x1, double y1) const;
+
+    /**
+     * Height range of quads [i0,i1]x[j0,j1] (inclusive)
+     */
+    void HeightRange(double &zmin, double &zmax,
+                     int i0, int j0, int i1, int j1) const;
+
+    /**
+     * Bounding box [x0,x1]x[y0,y1] of node (i,j) at level l
+     */
+    void NodeBox(double &x0, double &y0, double &x1, double &y1,
+                 int l, int i, int j) const;
+
+    /**
+     * Distance from a point to the two triangles of quad (i,j)
+     */
+    double QuadDistance(const Eigen::Vector3d &p, int i, int j,
+                        Eigen::Vector3d &q) const;
+  };
+}
+
+#endif
@@ -0,0 +1,187 @@
+#include "demsdf.h"
+#include "utils.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+
+using namespace gcop;
+using namespace std;
+using namespace Eigen;
+
+/**
+ * 1d squared distance transform of sampled function f with sample spacing
+ * sqrt(s2), i.e. d(q) = min_p s2*(q-p)^2 + f(p)
+ * (Felzenszwalb and Huttenlocher, Distance Transforms of Sampled Functions)
+ * @param d output (n values, stride sd)
+ * @param f input (n values, stride sf)
+ * @param n number of samples
+ * @param s2 squared sample spacing
+ * @param v workspace of n ints
+ * @param zb workspace of n+1 doubles
+ */
+static void Dt1(double *d, int sd, const double *f, int sf, int n, double s2,
+                int *v, double *zb)
+{
+  int k = 0;
+  v[0] = 0;
+  zb[0] = -INFINITY;
+  zb[1] = INFINITY;
+  for (int q = 1; q < n; ++q) {
+    // intersection of the parabolas rooted at q and v[k] (f is finite so
+    // that s > zb[0] always holds)
+    double s = ((f[q*sf] + s2*q*q) - (f[v[k]*sf] + s2*v[k]*v[k]))/(2*s2*(q - v[k]));
+    while (s <= zb[k]) {
+      --k;
+      s = ((f[q*sf] + s2*q*q) - (f[v[k]*sf] + s2*v[k]*v[k]))/(2*s2*(q - v[k]));
+    }
+    ++k;
+    v[k] = q;
+    zb[k] = s;
+    zb[k+1] = INFINITY;
+  }
+  k = 0;
+  for (int q = 0; q < n; ++q) {
+    while (zb[k+1] < q)
+      ++k;
+    int p = v[k];
+    d[q*sd] = s2*(q - p)*(q - p) + f[p*sf];
+  }
+}
+
+/**
+ * 2d squared distance transform of an ni x nj row-major grid (in place)
+ */
+static void Dt2(double *f, int ni, int nj, double s2, double *tmp, int *v,
+                double *zb)
+{
+  for (int i = 0; i < ni; ++i) {
+    memcpy(tmp, f + i*nj, nj*sizeof(double));
+    Dt1(f + i*nj, 1, tmp, 1, nj, s2, v, zb);
+  }
+  for (int j = 0; j < nj; ++j) {
+    for (int i = 0; i < ni; ++i)
+      tmp[i] = f[i*nj + j];
+    Dt1(f + j, nj, tmp, 1, ni, s2, v, zb);
+  }
+}
+
+DemSdf::DemSdf(const Dem &dem, double dz, double margin) :
+  dem(dem), ni(dem.ni), nj(dem.nj), nk(0), z0(0), dz(dz)
+{
+  if (this->dz <= 0)
+    this->dz = dem.cs;
+  if (margin < 0)
+    margin = 5*dem.cs;
+
+  // heights through GetRow, since e.g. a TiledDem has no data array
+  int nc = ni*nj;
+  vector<double> zs(nc);
+  for (int i = 0; i < ni; ++i)
+    dem.GetRow(&zs[i*nj], i);
+  double zmin = INFINITY, zmax = -INFINITY;
+  for (int c = 0; c < nc; ++c) {
+    zmin = min(zmin, zs[c]);
+    zmax = max(zmax, zs[c]);
+  }
+  z0 = dem.o[2] + zmin - margin;
+  nk = MAX(2, (int)ceil((zmax - zmin + 2*margin)/this->dz) + 1);
+
+  cout << "DemSdf: building " << ni << "x" << nj << "x" << nk << " field" << endl;
+
+  sdf.resize((size_t)nc*nk);
+  double s2 = dem.cs*dem.cs;
+
+#pragma omp parallel
+  {
+    double *above = new double[nc];
+    double *below = new double[nc];
+    int nm = MAX(ni, nj);
+    double *tmp = new double[nm];
+    int *v = new int[nm];
+    double *zb = new double[nm + 1];
+#pragma omp for
+    for (int k = 0; k < nk; ++k) {
+      double z = z0 + k*this->dz;
+      // squared vertical distance to each pillar (above) or to the free space
+      // above it (below)
+      for (int c = 0; c < nc; ++c) {
+        double e = z - dem.o[2] - zs[c];
+        above[c] = e > 0 ? e*e : 0;
+        below[c] = e < 0 ? e*e : 0;
+      }
+      Dt2(above, ni, nj, s2, tmp, v, zb);
+      Dt2(below, ni, nj, s2, tmp, v, zb);
+      float *s = &sdf[(size_t)k*nc];
+      for (int c = 0; c < nc; ++c)
+        s[c] = sqrt(above[c]) - sqrt(below[c]);
+    }
+    delete[] above;
+    delete[] below;
+    delete[] tmp;
+    delete[] v;
+    delete[] zb;
+  }
+}
+
+double DemSdf::Distance(double x, double y, double z, Vector3d *grad) const
+{
+  // continuous grid coordinates (same convention as Dem::Get)
+  double gc[3] = {(x - dem.o[0])/dem.cs,
+                  (dem.h - y - dem.o[1])/dem.cs,
+                  (z - z0)/dz};
+  int n[3] = {nj, ni, nk};
+  double sc[3] = {dem.cs, -dem.cs, dz};  // d(world)/d(grid)
+
+  // project onto the sampled volume
+  int i0[3];
+  double t[3];
+  Vector3d e(0, 0, 0);   // offset from the projection in world coordinates
+  for (int l = 0; l < 3; ++l) {
+    double gl = MIN(MAX(gc[l], 0.0), n[l] - 1.0);
+    e[l] = (gc[l] - gl)*sc[l];
+    i0[l] = MIN((int)floor(gl), MAX(n[l] - 2, 0));
+    t[l] = gl - i0[l];
+  }
+  int i1[3];
+  for (int l = 0; l < 3; ++l)
+    i1[l] = MIN(i0[l] + 1, n[l] - 1);
+
+  // trilinear interpolation (j, i, k) <-> (x, y, z)
+  double c[2][2][2];
+  for (int a = 0; a < 2; ++a)
+    for (int b = 0; b < 2; ++b)
+      for (int d = 0; d < 2; ++d)
+        c[a][b][d] = Get(b ? i1[1] : i0[1], a ? i1[0] : i0[0], d ? i1[2] : i0[2]);
+
+  double tx = t[0], ty = t[1], tz = t[2];
+  double c00 = c[0][0][0]*(1 - tx) + c[1][0][0]*tx;
+  double c10 = c[0][1][0]*(1 - tx) + c[1][1][0]*tx;
+  double c01 = c[0][0][1]*(1 - tx) + c[1][0][1]*tx;
+  double c11 = c[0][1][1]*(1 - tx) + c[1][1][1]*tx;
+  double c0 = c00*(1 - ty) + c10*ty;
+  double c1 = c01*(1 - ty) + c11*ty;
+  double dist = c0*(1 - tz) + c1*tz;
+
+  // below the volume the distance decreases, otherwise it increases
+  double en = e.norm();
+  double sign = (e[2] < 0) ? -1 : 1;
+  dist += sign*en;
+
+  if (grad) {
+    double dtx = ((c[1][0][0] - c[0][0][0])*(1 - ty) + (c[1][1][0] - c[0][1][0])*ty)*(1 - tz) +
+      ((c[1][0][1] - c[0][0][1])*(1 - ty) + (c[1][1][1] - c[0][1][1])*ty)*tz;
+    double dty = (c10 - c00)*(1 - tz) + (c11 - c01)*tz;
+    double dtz = c1 - c0;
+    (*grad)[0] = dtx/sc[0];
+    (*grad)[1] = dty/sc[1];
+    (*grad)[2] = dtz/sc[2];
+    // the interpolant is constant along the directions of projection
+    for (int l = 0; l < 3; ++l)
+      if (e[l] != 0)
+        (*grad)[l] = 0;
+    if (en > 1e-12)
+      *grad += sign*e/en;
+  }
+  return dist;
+}
@@ -0,0 +1,82 @@
+#ifndef GCOP_DEMSDF_H
+#define GCOP_DEMSDF_H
+
+#include "dem.h"
+#include <Eigen/Dense>
+#include <vector>
+
+namespace gcop {
+
+  /**
+   * Signed distance field (SDF) of the terrain surface of a Dem.
+   *
+   * The field is sampled on a 3d grid aligned with the Dem cells and covering
+   * the heights of the Dem (plus a margin). Each Dem cell is treated as a
+   * vertical pillar at its center, so that the distance from a grid point
+   * p=(x,y,z) to the terrain is
+   *
+   *   d(p) = min_c sqrt(|p_xy - c_xy|^2 + max(0, z - z_c)^2)     (above)
+   *   d(p) = -min_c sqrt(|p_xy - c_xy|^2 + max(0, z_c - z)^2)    (below)
+   *
+   * where z_c is the height of cell c. The vertical component is exact and
+   * the horizontal minimization is a 2d Euclidean distance transform of each
+   * height slice (Felzenszwalb-Huttenlocher), so building the field costs
+   * O(ni*nj*nk). Queries use trilinear interpolation and return the
+   * analytic gradient of the interpolant, i.e. constant time per query.
+   */
+  class DemSdf {
+  public:
+    /**
+     * Build the signed distance field of a Dem
+     * @param dem digital elevation map (with data loaded)
+     * @param dz vertical resolution (if non-positive the Dem cell size is used)
+     * @param margin extra height covered by the field below the minimum and
+     *        above the maximum terrain height (if negative 5 cells are used)
+     */
+    DemSdf(const Dem &dem, double dz = 0, double margin = -1);
+
+    /**
+     * Signed distance from a point to the terrain (negative below the
+     * surface). Points outside the sampled volume are projected onto it and
+     * the distance to the projection is added (or subtracted below it).
+     * @param x x-coordinate
+     * @param y y-coordinate
+     * @param z z-coordinate
+     * @param grad gradient of the distance wrt (x,y,z) (optional)
+     * @return signed distance
+     */
+    double Distance(double x, double y, double z,
+                    Eigen::Vector3d *grad = 0) const;
+
+    /**
+     * Signed distance from a point to the terrain
+     * @param p point
+     * @param grad gradient of the distance wrt p (optional)
+     * @return signed distance
+     */
+    double Distance(const Eigen::Vector3d &p, Eigen::Vector3d *grad = 0) const {
+      return Distance(p[0], p[1], p[2], grad);
+    }
+
+    /**
+     * Signed distance stored at grid index (i,j,k)
+     * @param i row index (as in Dem)
+     * @param j column index (as in Dem)
+     * @param k height index
+     * @return signed distance
+     */
+    double Get(int i, int j, int k) const {
+      return sdf[(size_t)k*ni*nj + (size_t)i*nj + j];
+    }
+
+    const Dem &dem;         ///< digital elevation map
+    int ni;                 ///< number of rows (same as dem)
+    int nj;                 ///< number of columns (same as dem)
+    int nk;                 ///< number of height samples
+    double z0;              ///< height of the lowest slice
+    double dz;              ///< vertical resolution
+    std::vector<float> sdf; ///< signed distances stored slice by slice
+  };
+}
+
+#endif
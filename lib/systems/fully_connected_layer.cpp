@@ -1,6 +1,8 @@
 #include "fully_connected_layer.h"
 #include "gcop_conversions.h"
 #include "load_eigen_matrix.h"
+#include "tensor_bundle.h"
+#include <memory>
 #include <sys/stat.h>
 
 using namespace gcop;
@@ -91,15 +93,51 @@ cs::MX FullyConnectedLayer::activation(const casadi::MX &x_in,
   return out;
 }
 
+void FullyConnectedLayer::fusedParameters(Eigen::MatrixXd &weights,
+                                          Eigen::VectorXd &biases) const {
+  weights = conversions::convertDMToEigen(weights_);
+  if (use_batch_normalization_) {
+    Eigen::ArrayXd gamma_inv_stdev =
+        conversions::convertDMToEigen(gamma_).array() /
+        (conversions::convertDMToEigen(moving_variance_).array() +
+         batch_norm_eps_)
+            .sqrt();
+    Eigen::ArrayXd moving_average =
+        conversions::convertDMToEigen(moving_average_).array();
+    weights = gamma_inv_stdev.matrix().asDiagonal() * weights;
+    biases = (conversions::convertDMToEigen(beta_).array() -
+              gamma_inv_stdev * moving_average)
+                 .matrix();
+  } else {
+    biases = conversions::convertDMToEigen(biases_);
+  }
+}
+
+Activation FullyConnectedLayer::activationType() const { return activation_; }
+
 void FullyConnectedLayer::loadParameters(std::string variable_folder_path,
                                          std::string layer_prefix,
                                          std::string scope_name) {
   struct stat info;
-  // If folder path does not exist or is not a directory
+  // If folder path does not exist or is neither a directory nor a bundle
   if (stat(variable_folder_path.c_str(), &info) != 0 ||
-      !(info.st_mode & S_IFDIR)) {
+      !(S_ISDIR(info.st_mode) || S_ISREG(info.st_mode))) {
     throw std::runtime_error("Cannot open folder: " + variable_folder_path);
   }
+  // A regular file is a binary tensor bundle of the variables in the folder.
+  // This avoids parsing the text files, but the variables are still copied
+  // into casadi::DM, which always owns its data.
+  std::unique_ptr<TensorBundle> bundle;
+  if (S_ISREG(info.st_mode)) {
+    bundle.reset(new TensorBundle(variable_folder_path));
+  }
+  auto loadDMFromFile = [&](const std::string &file_path) {
+    if (bundle) {
+      std::string name = file_path.substr(variable_folder_path.size() + 1);
+      return conversions::convertEigenToDM(bundle->get(name));
+    }
+    return this->loadDMFromFile(file_path);
+  };
   std::string weight_file_path = addPrefixToFilePath(
       scope_name, layer_prefix, "weights", variable_folder_path);
   weights_ = loadDMFromFile(weight_file_path)
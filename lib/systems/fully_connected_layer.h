@@ -43,7 +43,9 @@ public:
    * layer prefix 1 and variable name of weights.
    *
    * @param variable_folder_path The folder to load the weights, biases and
-   * batch normalization parameters
+   * batch normalization parameters. Can also be a tensor bundle file created
+   * from the folder using TensorBundle::convertFolder (the parameters are
+   * then copied from the mapped file rather than parsed from text)
    * @param scope_name  The scope name for variables
    * @param layer_prefix  The prefix used for layers
    * @param use_batch_normalization Flag to specify whether to perform batch
@@ -120,6 +122,22 @@ public:
    */
   cs::MX activation(const cs::MX &x_in, const Activation &activation);
 
+  /**
+   * @brief fusedParameters
+   *
+   * Fold batch normalization (if used) into the weights and biases so that
+   * the layer is given by activation(weights * x + biases)
+   * @param weights The fused weights (output size x input size)
+   * @param biases The fused biases (output size)
+   */
+  void fusedParameters(Eigen::MatrixXd &weights, Eigen::VectorXd &biases) const;
+
+  /**
+   * @brief activationType
+   * @return The activation function used by the layer
+   */
+  Activation activationType() const;
+
   /**
    * @brief loadDMFromFile
    *
@@ -0,0 +1,327 @@
+#ifndef FUSEDNETWORK_H
+#define FUSEDNETWORK_H
+#include "fully_connected_layer.h"
+#include <Eigen/Dense>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace gcop {
+using namespace Eigen;
+
+/**
+ * @brief A fully connected layer evaluated natively with Eigen
+ *
+ * Batch normalization is folded into the weights and biases when the layer is
+ * created, so evaluation is a single affine transform followed by a
+ * coefficient-wise activation. Inputs are stored column-wise so a whole batch
+ * of inputs is transformed with one matrix product.
+ *
+ * @tparam _nin The input size (Dynamic if not known at compile time)
+ * @tparam _nout The output size (Dynamic if not known at compile time)
+ */
+template <int _nin = Dynamic, int _nout = Dynamic> class FusedDenseLayer {
+public:
+  typedef Matrix<double, _nout, _nin> Matrixoid; ///< Weights/jacobian type
+  typedef Matrix<double, _nout, 1> Vectorod;     ///< Output vector type
+  typedef Matrix<double, _nout, Dynamic> Matrixobd; ///< Batch output type
+
+  FusedDenseLayer() : activation_(Activation::none) {}
+
+  /**
+   * @brief FusedDenseLayer Constructor
+   * @param weights Weights with batch normalization folded in (nout x nin)
+   * @param biases Biases with batch normalization folded in (nout)
+   * @param activation The activation applied after the affine transform
+   */
+  FusedDenseLayer(const MatrixXd &weights, const VectorXd &biases,
+                  Activation activation)
+      : activation_(activation) {
+    if ((_nin != Dynamic && weights.cols() != _nin) ||
+        (_nout != Dynamic && weights.rows() != _nout) ||
+        biases.rows() != weights.rows()) {
+      throw std::runtime_error("Fused layer size mismatch: " +
+                               std::to_string(weights.rows()) + ", " +
+                               std::to_string(weights.cols()));
+    }
+    weights_ = weights;
+    biases_ = biases;
+  }
+
+  /**
+   * @brief FusedDenseLayer Constructor from a fully connected layer
+   * @param layer The casadi fully connected layer
+   */
+  FusedDenseLayer(const FullyConnectedLayer &layer) {
+    MatrixXd weights;
+    VectorXd biases;
+    layer.fusedParameters(weights, biases);
+    *this = FusedDenseLayer(weights, biases, layer.activationType());
+  }
+
+  /**
+   * @brief transform a batch of inputs
+   * @param x Inputs stored column-wise (nin x batch size)
+   * @return Outputs stored column-wise (nout x batch size)
+   */
+  template <typename Derived>
+  Matrixobd transform(const MatrixBase<Derived> &x) const {
+    Matrixobd y = weights_ * x;
+    y.colwise() += biases_;
+    activate(y);
+    return y;
+  }
+
+  /**
+   * @brief transform a single input and compute the jacobian of the output
+   * @param x The input vector
+   * @param y The output vector
+   * @param dydx The jacobian of output wrt input if provided
+   */
+  template <typename Derived>
+  void transform(const MatrixBase<Derived> &x, Vectorod &y,
+                 Matrixoid *dydx) const {
+    y = weights_ * x + biases_;
+    activate(y);
+    if (dydx) {
+      switch (activation_) {
+      case Activation::none:
+        *dydx = weights_;
+        break;
+      case Activation::tanh:
+        *dydx = (1 - y.array().square()).matrix().asDiagonal() * weights_;
+        break;
+      case Activation::relu:
+        *dydx = (y.array() > 0).template cast<double>().matrix().asDiagonal() *
+                weights_;
+        break;
+      }
+    }
+  }
+
+  /**
+   * @brief apply activation coefficient-wise
+   * @param y The affine transformed inputs. Replaced by activated outputs
+   */
+  template <typename Derived> void activate(MatrixBase<Derived> &y) const {
+    switch (activation_) {
+    case Activation::none:
+      break;
+    case Activation::tanh:
+      y = y.array().tanh().matrix();
+      break;
+    case Activation::relu:
+      y = y.cwiseMax(0.0);
+      break;
+    }
+  }
+
+  int inputSize() const { return weights_.cols(); }
+
+  int outputSize() const { return weights_.rows(); }
+
+  const Matrixoid &weights() const { return weights_; }
+
+  const Vectorod &biases() const { return biases_; }
+
+  Activation activationType() const { return activation_; }
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+  Matrixoid weights_;     ///< Weights with batch normalization folded in
+  Vectorod biases_;       ///< Biases with batch normalization folded in
+  Activation activation_; ///< Activation applied on the outputs
+};
+
+/**
+ * @brief A feedforward network of fused dense layers with layer sizes known
+ * at compile time
+ *
+ * The template arguments are the input size followed by the output size of
+ * each layer, e.g FusedNetwork<34, 16, 8, 8> is a network with two hidden
+ * layers of size 16 and 8 and an output of size 8. Dynamic can be used for
+ * any of the sizes.
+ */
+template <int... Sizes> class FusedNetwork;
+
+/**
+ * @brief Network with a single (final) layer
+ */
+template <int _nin, int _nout> class FusedNetwork<_nin, _nout> {
+public:
+  static const int InputSize = _nin;
+  static const int OutputSize = _nout;
+  static const int NumberOfLayers = 1;
+  typedef Matrix<double, _nin, 1> Vectorid;
+  typedef Matrix<double, _nout, 1> Vectorod;
+  typedef Matrix<double, _nout, _nin> Matrixoid;
+  typedef Matrix<double, _nout, Dynamic> Matrixobd;
+
+  FusedNetwork() {}
+
+  /**
+   * @brief FusedNetwork Constructor
+   * @param layers The fully connected layers of the network
+   * @param first_layer The index of the first layer in layers used by this
+   * network
+   */
+  FusedNetwork(const std::vector<FullyConnectedLayer> &layers,
+               int first_layer = 0) {
+    if ((int)layers.size() != first_layer + NumberOfLayers) {
+      throw std::runtime_error("Number of layers should be: " +
+                               std::to_string(first_layer + NumberOfLayers));
+    }
+    layer_ = FusedDenseLayer<_nin, _nout>(layers.at(first_layer));
+  }
+
+  /**
+   * @brief transform a batch of inputs stored column-wise
+   */
+  template <typename Derived>
+  Matrixobd transform(const MatrixBase<Derived> &x) const {
+    return layer_.transform(x);
+  }
+
+  /**
+   * @brief transform a single input and compute the jacobian of the output
+   * wrt the input if dydx is provided
+   */
+  template <typename Derived>
+  void transform(const MatrixBase<Derived> &x, Vectorod &y,
+                 Matrixoid *dydx = 0) const {
+    layer_.transform(x, y, dydx);
+  }
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+  FusedDenseLayer<_nin, _nout> layer_; ///< The final layer
+};
+
+/**
+ * @brief Network with a hidden layer followed by the remaining layers
+ */
+template <int _nin, int _nhidden, int... Rest>
+class FusedNetwork<_nin, _nhidden, Rest...> {
+  typedef FusedNetwork<_nhidden, Rest...> Tail; ///< Remaining layers
+
+public:
+  static const int InputSize = _nin;
+  static const int OutputSize = Tail::OutputSize;
+  static const int NumberOfLayers = Tail::NumberOfLayers + 1;
+  typedef Matrix<double, _nin, 1> Vectorid;
+  typedef Matrix<double, OutputSize, 1> Vectorod;
+  typedef Matrix<double, OutputSize, _nin> Matrixoid;
+  typedef Matrix<double, OutputSize, Dynamic> Matrixobd;
+
+  FusedNetwork() {}
+
+  /**
+   * @brief FusedNetwork Constructor
+   * @param layers The fully connected layers of the network
+   * @param first_layer The index of the first layer in layers used by this
+   * network
+   */
+  FusedNetwork(const std::vector<FullyConnectedLayer> &layers,
+               int first_layer = 0)
+      : layer_(layers.at(first_layer)), tail_(layers, first_layer + 1) {}
+
+  /**
+   * @brief transform a batch of inputs stored column-wise
+   */
+  template <typename Derived>
+  Matrixobd transform(const MatrixBase<Derived> &x) const {
+    return tail_.transform(layer_.transform(x));
+  }
+
+  /**
+   * @brief transform a single input and compute the jacobian of the output
+   * wrt the input if dydx is provided
+   */
+  template <typename Derived>
+  void transform(const MatrixBase<Derived> &x, Vectorod &y,
+                 Matrixoid *dydx = 0) const {
+    Matrix<double, _nhidden, 1> z;
+    if (dydx) {
+      Matrix<double, _nhidden, _nin> dzdx;
+      typename Tail::Matrixoid dydz;
+      layer_.transform(x, z, &dzdx);
+      tail_.transform(z, y, &dydz);
+      dydx->noalias() = dydz * dzdx;
+    } else {
+      layer_.transform(x, z, (Matrix<double, _nhidden, _nin> *)0);
+      tail_.transform(z, y);
+    }
+  }
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+  FusedDenseLayer<_nin, _nhidden> layer_; ///< The hidden layer
+  Tail tail_;                             ///< The remaining layers
+};
+
+/**
+ * @brief A feedforward network of fused dense layers with the number of
+ * layers and their sizes known only at run time
+ */
+class FusedNetworkXd {
+public:
+  FusedNetworkXd() {}
+
+  /**
+   * @brief FusedNetworkXd Constructor
+   * @param layers The fully connected layers of the network
+   */
+  FusedNetworkXd(const std::vector<FullyConnectedLayer> &layers) {
+    for (const auto &layer : layers) {
+      layers_.emplace_back(layer);
+    }
+    for (int i = 1; i < (int)layers_.size(); ++i) {
+      if (layers_[i].inputSize() != layers_[i - 1].outputSize()) {
+        throw std::runtime_error("Layer sizes do not match at layer: " +
+                                 std::to_string(i));
+      }
+    }
+  }
+
+  /**
+   * @brief transform a batch of inputs stored column-wise
+   */
+  MatrixXd transform(const MatrixXd &x) const {
+    MatrixXd y = x;
+    for (const auto &layer : layers_) {
+      y = layer.transform(y);
+    }
+    return y;
+  }
+
+  /**
+   * @brief transform a single input and compute the jacobian of the output
+   * wrt the input if dydx is provided
+   */
+  void transform(const VectorXd &x, VectorXd &y, MatrixXd *dydx = 0) const {
+    y = x;
+    if (dydx) {
+      dydx->setIdentity(x.rows(), x.rows());
+    }
+    VectorXd z;
+    MatrixXd dzdy;
+    for (const auto &layer : layers_) {
+      layer.transform(y, z, dydx ? &dzdy : (MatrixXd *)0);
+      y.swap(z);
+      if (dydx) {
+        *dydx = dzdy * (*dydx);
+      }
+    }
+  }
+
+  int numberOfLayers() const { return layers_.size(); }
+
+private:
+  std::vector<FusedDenseLayer<>> layers_; ///< The layers of the network
+};
+}
+
+#endif // FUSEDNETWORK_H
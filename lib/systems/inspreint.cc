@@ -0,0 +1,153 @@
+#include "inspreint.h"
+#include "so3.h"
+
+using namespace gcop;
+using namespace Eigen;
+
+
+InsPreint::InsPreint(double sw, double sa,
+                     const Vector3d &bg, const Vector3d &ba) :
+  sw(sw), sa(sa)
+{
+  Reset(bg, ba);
+}
+
+
+InsPreint::InsPreint(const Ins &sys,
+                     const Vector3d &bg, const Vector3d &ba) :
+  sw(sys.sv), sa(sys.sra)
+{
+  Reset(bg, ba);
+}
+
+
+void InsPreint::Reset(const Vector3d &bg, const Vector3d &ba)
+{
+  this->bg = bg;
+  this->ba = ba;
+  dt = 0;
+  dR.setIdentity();
+  dv.setZero();
+  dp.setZero();
+  dR_bg.setZero();
+  dv_bg.setZero();
+  dv_ba.setZero();
+  dp_bg.setZero();
+  dp_ba.setZero();
+  P.setZero();
+}
+
+
+void InsPreint::Integrate(const Vector3d &w, const Vector3d &a, double h)
+{
+  SO3 &so3 = SO3::Instance();
+
+  Vector3d wc = w - bg;     // corrected angular velocity
+  Vector3d ac = a - ba;     // corrected acceleration
+  double h2 = h*h;
+
+  Matrix3d eR, Jr, ah;
+  so3.exp(eR, h*wc);
+  so3.dexp(Jr, -h*wc);      // right Jacobian of exp
+  so3.hat(ah, ac);
+  Matrix3d dRah = dR*ah;
+
+  // covariance of the (rotation, velocity, position) errors
+  Matrix9d A = Matrix9d::Identity();
+  A.block<3,3>(0,0) = eR.transpose();
+  A.block<3,3>(3,0) = -h*dRah;
+  A.block<3,3>(6,0) = -h2/2*dRah;
+  A.block<3,3>(6,3) = h*Matrix3d::Identity();
+
+  Matrix<double, 9, 3> Bg = Matrix<double, 9, 3>::Zero();
+  Matrix<double, 9, 3> Ba = Matrix<double, 9, 3>::Zero();
+  Bg.block<3,3>(0,0) = h*Jr;
+  Ba.block<3,3>(3,0) = h*dR;
+  Ba.block<3,3>(6,0) = h2/2*dR;
+
+  P = A*P*A.transpose() + (sw*sw/h)*Bg*Bg.transpose() + (sa*sa/h)*Ba*Ba.transpose();
+
+  // bias Jacobians (the position ones depend on the previous velocity ones)
+  dp_ba += h*dv_ba - h2/2*dR;
+  dp_bg += h*dv_bg - h2/2*dRah*dR_bg;
+  dv_ba -= h*dR;
+  dv_bg -= h*dRah*dR_bg;
+  dR_bg = eR.transpose()*dR_bg - h*Jr;
+
+  // relative motion
+  dp += h*dv + h2/2*(dR*ac);
+  dv += h*(dR*ac);
+  dR = dR*eR;
+  dt += h;
+}
+
+
+void InsPreint::Delta(Matrix3d &dR, Vector3d &dv, Vector3d &dp,
+                      const Vector3d &bg, const Vector3d &ba) const
+{
+  Vector3d dbg = bg - this->bg;
+  Vector3d dba = ba - this->ba;
+
+  Matrix3d eR;
+  SO3::Instance().exp(eR, dR_bg*dbg);
+  dR = this->dR*eR;
+  dv = this->dv + dv_bg*dbg + dv_ba*dba;
+  dp = this->dp + dp_bg*dbg + dp_ba*dba;
+}
+
+
+void InsPreint::Error(Vector9d &e,
+                      const Matrix3d &Ra, const Vector3d &pa, const Vector3d &va,
+                      const Matrix3d &Rb, const Vector3d &pb, const Vector3d &vb,
+                      const Vector3d &bg, const Vector3d &ba, const Vector3d &g0) const
+{
+  Matrix3d dR;
+  Vector3d dv, dp, eR;
+  Delta(dR, dv, dp, bg, ba);
+
+  SO3::Instance().log(eR, dR.transpose()*Ra.transpose()*Rb);
+  e.head<3>() = eR;
+  e.segment<3>(3) = Ra.transpose()*(vb - va + dt*g0) - dv;
+  e.tail<3>() = Ra.transpose()*(pb - pa - dt*va + dt*dt/2*g0) - dp;
+}
+
+
+void InsPreint::Predict(InsState &xb, const InsState &xa, const Ins &sys) const
+{
+  Matrix3d dR;
+  Vector3d dv, dp;
+  Delta(dR, dv, dp, xa.bg, xa.ba);
+
+  xb.R = xa.R*dR;
+  xb.bg = xa.bg;
+  xb.ba = xa.ba;
+  xb.v = xa.v - dt*sys.g0 + xa.R*dv;
+  xb.p = xa.p + dt*xa.v - dt*dt/2*sys.g0 + xa.R*dp;
+
+  // covariance, in the (R, bg, ba, p, v) coordinates of InsState
+  Matrix3d D;
+  Matrix15d F = Matrix15d::Identity();
+  F.block<3,3>(0,0) = dR.transpose();
+  F.block<3,3>(0,3) = dR_bg;
+  SO3::Instance().hat(D, dp);
+  F.block<3,3>(9,0) = -xa.R*D;
+  F.block<3,3>(9,3) = xa.R*dp_bg;
+  F.block<3,3>(9,6) = xa.R*dp_ba;
+  F.block<3,3>(9,12) = dt*Matrix3d::Identity();
+  SO3::Instance().hat(D, dv);
+  F.block<3,3>(12,0) = -xa.R*D;
+  F.block<3,3>(12,3) = xa.R*dv_bg;
+  F.block<3,3>(12,6) = xa.R*dv_ba;
+
+  // preintegration noise (in the start body frame) and bias random walks
+  Matrix<double, 15, 9> G = Matrix<double, 15, 9>::Zero();
+  G.block<3,3>(0,0).setIdentity();
+  G.block<3,3>(12,3) = xa.R;
+  G.block<3,3>(9,6) = xa.R;
+
+  Matrix15d Q = G*P*G.transpose();
+  Q.block<3,3>(3,3).diagonal().array() += sys.su*sys.su*dt;
+  Q.block<3,3>(6,6).diagonal().array() += sys.sa*sys.sa*dt;
+
+  xb.P = F*xa.P*F.transpose() + Q;
+}
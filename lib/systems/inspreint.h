@@ -0,0 +1,134 @@
+#ifndef GCOP_INSPREINT_H
+#define GCOP_INSPREINT_H
+
+#include "ins.h"
+
+namespace gcop {
+
+  using namespace std;
+  using namespace Eigen;
+
+  /**
+   * On-manifold preintegration of IMU measurements between two times
+   * (following Forster et al, "On-Manifold Preintegration for Real-Time
+   * Visual-Inertial Odometry", 2017).
+   *
+   * The gyro and accelerometer readings (w,a) are integrated once into the
+   * relative rotation dR, velocity dv and position dp expressed in the body
+   * frame at the start time, together with their covariance P and their
+   * Jacobians with respect to the gyro and acceleration biases, which are
+   * assumed constant during the interval. The relative motion for other
+   * biases is then corrected to first order without re-integration, so
+   * that steps or residuals over the whole interval cost O(1) instead of
+   * O(#measurements).
+   *
+   * The conventions are those of Ins: the bias-corrected readings are w-bg
+   * and a-ba, the acceleration in the spatial frame is R*(a-ba) - g0, and
+   * rotation errors are in the body frame (i.e. R = Rm*exp(e)).
+   */
+  class InsPreint {
+  public:
+
+  typedef Matrix<double, 9, 1> Vector9d;
+  typedef Matrix<double, 9, 9> Matrix9d;
+
+  /**
+   * @param sw gyro measurement noise stdev (spectral density)
+   * @param sa acceleration measurement noise stdev (spectral density)
+   * @param bg gyro bias used for integration
+   * @param ba acceleration bias used for integration
+   */
+  InsPreint(double sw = 3e-3, double sa = .05,
+            const Vector3d &bg = Vector3d::Zero(),
+            const Vector3d &ba = Vector3d::Zero());
+
+  /**
+   * Use the noise parameters of an Ins system
+   * @param sys Ins system (sv and sra are used as gyro and acceleration noise)
+   * @param bg gyro bias used for integration
+   * @param ba acceleration bias used for integration
+   */
+  InsPreint(const Ins &sys,
+            const Vector3d &bg = Vector3d::Zero(),
+            const Vector3d &ba = Vector3d::Zero());
+
+  /**
+   * Restart the integration
+   * @param bg gyro bias used for integration
+   * @param ba acceleration bias used for integration
+   */
+  void Reset(const Vector3d &bg, const Vector3d &ba);
+
+  /**
+   * Integrate one IMU measurement held constant over a time step
+   * @param w gyro reading
+   * @param a accelerometer reading
+   * @param h time step
+   */
+  void Integrate(const Vector3d &w, const Vector3d &a, double h);
+
+  /**
+   * Relative motion corrected to first order for different biases
+   * @param dR relative rotation
+   * @param dv relative velocity (in the start body frame, without gravity)
+   * @param dp relative position (in the start body frame, without gravity)
+   * @param bg gyro bias
+   * @param ba acceleration bias
+   */
+  void Delta(Matrix3d &dR, Vector3d &dv, Vector3d &dp,
+             const Vector3d &bg, const Vector3d &ba) const;
+
+  /**
+   * Error e = (eR, ev, ep) of the relative motion between two states, with
+   * covariance P, where
+   *   eR = log(dR'*Ra'*Rb)
+   *   ev = Ra'*(vb - va + g0*dt) - dv
+   *   ep = Ra'*(pb - pa - va*dt + g0*dt^2/2) - dp
+   * @param e error
+   * @param Ra start rotation
+   * @param pa start position
+   * @param va start velocity
+   * @param Rb end rotation
+   * @param pb end position
+   * @param vb end velocity
+   * @param bg gyro bias
+   * @param ba acceleration bias
+   * @param g0 gravity vector
+   */
+  void Error(Vector9d &e,
+             const Matrix3d &Ra, const Vector3d &pa, const Vector3d &va,
+             const Matrix3d &Rb, const Vector3d &pb, const Vector3d &vb,
+             const Vector3d &bg, const Vector3d &ba, const Vector3d &g0) const;
+
+  /**
+   * Propagate an Ins state over the whole interval in a single step (the
+   * equivalent of calling Ins::Step for each integrated measurement),
+   * including its covariance
+   * @param xb resulting state
+   * @param xa start state (its biases are used)
+   * @param sys Ins system (g0 and the bias noise parameters su and sa are used)
+   */
+  void Predict(InsState &xb, const InsState &xa, const Ins &sys) const;
+
+  double sw;     ///< gyro measurement noise stdev (spectral density)
+  double sa;     ///< acceleration measurement noise stdev (spectral density)
+
+  Vector3d bg;   ///< gyro bias used for integration
+  Vector3d ba;   ///< acceleration bias used for integration
+
+  double dt;     ///< integrated time
+  Matrix3d dR;   ///< relative rotation
+  Vector3d dv;   ///< relative velocity
+  Vector3d dp;   ///< relative position
+
+  Matrix3d dR_bg;   ///< Jacobian of log(dR) w.r.t. bg
+  Matrix3d dv_bg;   ///< Jacobian of dv w.r.t. bg
+  Matrix3d dv_ba;   ///< Jacobian of dv w.r.t. ba
+  Matrix3d dp_bg;   ///< Jacobian of dp w.r.t. bg
+  Matrix3d dp_ba;   ///< Jacobian of dp w.r.t. ba
+
+  Matrix9d P;       ///< covariance of the (rotation, velocity, position) errors
+  };
+}
+
+#endif
@@ -36,4 +36,6 @@ double Kinbody2d::Step(Matrix3d &xb, double t, const Matrix3d &xa,
 
   if (C)
     C->setZero();
+
+  return 1;
 }
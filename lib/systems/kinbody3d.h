@@ -68,6 +68,8 @@ double Kinbody3d<_nu>::Step(Matrix4d &xb, double t, const Matrix4d &xa,
 
   if (C)
     C->setZero();
+
+  return 1;
 }
 
 } // gcop
@@ -8,6 +8,7 @@
 #include <iostream>
 #include "utils.h"
 #include "kinbody3d.h"
+#include "visibility.h"
 
 namespace gcop {
   
@@ -41,6 +42,14 @@ namespace gcop {
                 bool extforce = false,
                 bool forces = false);
 
+    /**
+     * Given a sequence of poses xs, compute the optimal feature locations p
+     * (each feature is solved independently, in parallel)
+     * @param p a vector of feature locations
+     * @param xs a given vector of poses in SE(3)
+     */
+    virtual void Optp(VectorXd &p, const vector<Matrix4d> &xs);
+
     virtual void Get(Matrix4d &x, double vd, double t) const;
 
     virtual void MakeTrue();
@@ -86,9 +95,8 @@ namespace gcop {
 
     double pr;     ///< feature radius
 
-    vector< vector<pair<int, Vector3d> > > Is;  ///< N+1-vector of vectors of visible pose-to-feature indices
+    Visibility<3> vis;     ///< feature observations of each pose (and observations of each feature)
 
-    vector< vector<pair<int, Vector3d> > > Js;  ///< nf-vector of vectors of feature-to-pose indices indices
     vector<int> cis;       ///< if observed then this should map into the corresponding value in p
 
     double cp;             ///< noise covariance of poses (assume spherical)
@@ -107,16 +115,39 @@ Kinbody3dTrack<_nu>::Kinbody3dTrack(Kinbody3d<_nu> &sys, int nf, double vd0, dou
   sys(sys), t0(t0), tf(tf), r(r), w(4), h(4), dmax(20),
   extforce(extforce), forces(forces),
   ts(1,t0), ls(nf), observed(nf, false), p(extforce*3), pr(.75),
-  Is(1), Js(nf), cis(nf), cp(.01)
+  vis(nf), cis(nf), cp(.01)
 {
   Matrix4d x;
   Get(x, vd0, t0);
   xs.push_back(x);
   xos.push_back(x);
+  vis.AddPose();
   cw = MatrixXd::Constant(_nu, 1, 0.1);
 }
 
 
+template <int _nu>
+void Kinbody3dTrack<_nu>::Optp(VectorXd &p, const vector<Matrix4d> &xs)
+{
+  vis.Index();
+
+  int nf = (p.size() - extforce*3)/3;
+#pragma omp parallel for if (nf > 256)
+  for (int l = 0; l < nf; ++l) {
+    int f = pis[l];
+    int j0 = vis.js[f], j1 = vis.js[f+1];
+    assert(j1 > j0);
+    Vector3d pf = Vector3d::Zero();
+    for (int j = j0; j < j1; ++j) {
+      int i = vis.os[j];
+      const Matrix4d &x = xs[vis.ks[i]];
+      pf += x.block<3,1>(0,3) + x.block<3,3>(0,0)*vis.zs[i];
+    }
+    p.segment<3>(3*extforce + 3*l) = pf/(j1 - j0);
+  }
+}
+
+
 template <int _nu>
 void Kinbody3dTrack<_nu>::Add(const Vectorud &u, const Matrix4d &x, double h)
 {
@@ -166,45 +197,43 @@ void Kinbody3dTrack<_nu>::Add(const Vectorud &u, const Matrix4d &x, double h)
   const Matrix3d &R = x.block<3,3>(0,0);
   const Vector3d &px = x.block<3,1>(0,3);
   
-  Is.resize(Is.size()+1);
-  assert(k == Is.size()-1);
+  vis.AddPose();
+  assert(k == vis.Poses()-1);
 
-  for (int l = 0; l < ls.size(); ++l) {
+  vector<int> fs;
+  Visibility<3>::Near(fs, ls, px, dmax);
+
+  for (int j = 0; j < fs.size(); ++j) {
+    int l = fs[j];
     const Vector3d &pf = ls[l];
-    //p.segment<2>(2*extforce + 2*l);
-    
-    double d = (px - pf).norm();
-    if (d < dmax) {
-      // add to feature vector if not observed
-      Vector3d z = R.transpose()*(pf - px);
-      z(0) += sqrt(cp)*random_normal();
-      z(1) += sqrt(cp)*random_normal();
-      z(2) += sqrt(cp)*random_normal();
-
-      if (!observed[l]) {
-        if (!init) {
-          p.resize(3);
-          init= true;
-        } else {
-          p.conservativeResize(p.size() + 3);
-        }
-        const Matrix3d &Rn = xs.back().block<3,3>(0,0);
-        const Vector3d &pxn = xs.back().block<3,1>(0,3);
-         
-        // Initialize landmark position from estimated state
-        p.tail<3>() = Rn*z + pxn;
-        pis.push_back(l);
-        observed[l] = true;
-        cis[l] = p.size()/3-1;
+    // add to feature vector if not observed
+    Vector3d z = R.transpose()*(pf - px);
+    z(0) += sqrt(cp)*random_normal();
+    z(1) += sqrt(cp)*random_normal();
+    z(2) += sqrt(cp)*random_normal();
+
+    if (!observed[l]) {
+      if (!init) {
+        p.resize(3);
+        init= true;
+      } else {
+        p.conservativeResize(p.size() + 3);
       }
-
-      //        zs[k].push_back();      // add feature l to pose k
-      
-      Is[k].push_back(make_pair(l, z)); // add feature l to pose k      
-      Js[l].push_back(make_pair(k, z)); // add pose k to feature l
-      
-      //        cout << "k=" << k << " l=" << l << " d=" << d << endl;
+      const Matrix3d &Rn = xs.back().block<3,3>(0,0);
+      const Vector3d &pxn = xs.back().block<3,1>(0,3);
+       
+      // Initialize landmark position from estimated state
+      p.tail<3>() = Rn*z + pxn;
+      pis.push_back(l);
+      observed[l] = true;
+      cis[l] = p.size()/3-1;
     }
+
+    //        zs[k].push_back();      // add feature l to pose k
+    
+    vis.Add(l, z);          // add feature l to pose k
+    
+    //        cout << "k=" << k << " l=" << l << " d=" << d << endl;
   }
 }
 
@@ -253,46 +282,44 @@ void Kinbody3dTrack<_nu>::Add2(const Vectorud &u, const Matrix4d &x, double h)
   const Matrix3d &R = x.block<3,3>(0,0);
   const Vector3d &px = x.block<3,1>(0,3);
   
-  Is.resize(Is.size()+1);
-  assert(k == Is.size()-1);
+  vis.AddPose();
+  assert(k == vis.Poses()-1);
+
+  vector<int> fs;
+  Visibility<3>::Near(fs, ls, px, dmax);
 
-  for (int l = 0; l < ls.size(); ++l) {
+  for (int j = 0; j < fs.size(); ++j) {
+    int l = fs[j];
     const Vector3d &pf = ls[l];
-    //p.segment<2>(2*extforce + 2*l);
+
+    Vector3d z = R.transpose()*(pf - px);
+    z(0) += sqrt(cp)*random_normal();
+    z(1) += sqrt(cp)*random_normal();
+    z(2) += sqrt(cp)*random_normal();
     
-    double d = (px - pf).norm();
-    if (d < dmax) {
-
-      Vector3d z = R.transpose()*(pf - px);
-      z(0) += sqrt(cp)*random_normal();
-      z(1) += sqrt(cp)*random_normal();
-      z(2) += sqrt(cp)*random_normal();
-      
-      // add to feature vector if not observed
-      if (!observed[l]) {
-        if (!init) {
-          p.resize(3);
-          init= true;
-        } else {
-          p.conservativeResize(p.size() + 3);
-        }
-        const Matrix3d &Rn = xs.back().block<3,3>(0,0);
-        const Vector3d &pxn = xs.back().block<3,1>(0,3);
-         
-        // Initialize landmark position from estimated state
-        p.tail<3>() = Rn*z + pxn;
-        // Initialize landmark position with its true position
-        //p.tail<3>() = pf;
-        pis.push_back(l);
-        observed[l] = true;
-        cis[l] = p.size()/3-1;
+    // add to feature vector if not observed
+    if (!observed[l]) {
+      if (!init) {
+        p.resize(3);
+        init= true;
+      } else {
+        p.conservativeResize(p.size() + 3);
       }
-      
-      Is[k].push_back(make_pair(l, z)); // add feature l to pose k      
-      Js[l].push_back(make_pair(k, z)); // add pose k to feature l
-      
-      //        cout << "k=" << k << " l=" << l << " d=" << d << endl;
+      const Matrix3d &Rn = xs.back().block<3,3>(0,0);
+      const Vector3d &pxn = xs.back().block<3,1>(0,3);
+       
+      // Initialize landmark position from estimated state
+      p.tail<3>() = Rn*z + pxn;
+      // Initialize landmark position with its true position
+      //p.tail<3>() = pf;
+      pis.push_back(l);
+      observed[l] = true;
+      cis[l] = p.size()/3-1;
     }
+    
+    vis.Add(l, z);          // add feature l to pose k
+    
+    //        cout << "k=" << k << " l=" << l << " d=" << d << endl;
   }
 }
 
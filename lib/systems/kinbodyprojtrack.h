@@ -41,6 +41,15 @@ namespace gcop {
                 bool extforce = false,
                 bool forces = false);
 
+    /**
+     * Given a sequence of poses xs, triangulate the feature locations p from
+     * their bearings (features seen from nearly parallel directions are left
+     * unchanged)
+     * @param p a vector of feature locations
+     * @param xs a given vector of poses in SE(3)
+     */
+    virtual void Optp(VectorXd &p, const vector<Matrix4d> &xs);
+
     virtual void Get(Matrix4d &x, double vd, double t) const;
 
     virtual void MakeTrue();
@@ -72,6 +81,36 @@ KinbodyProjTrack<_nu>::KinbodyProjTrack(Kinbody3d<_nu> &sys, int nf, double vd0,
 }
 
 
+template <int _nu>
+void KinbodyProjTrack<_nu>::Optp(VectorXd &p, const vector<Matrix4d> &xs)
+{
+  Visibility<3> &vis = this->vis;
+  vis.Index();
+
+  int i0 = 3*this->extforce;
+  int nf = (p.size() - i0)/3;
+#pragma omp parallel for if (nf > 256)
+  for (int l = 0; l < nf; ++l) {
+    int f = this->pis[l];
+    // least-squares point closest to all bearing rays: sum_j (I - b_j*b_j')*(pf - x_j) = 0
+    Matrix3d A = Matrix3d::Zero();
+    Vector3d b = Vector3d::Zero();
+    for (int j = vis.js[f]; j < vis.js[f+1]; ++j) {
+      int i = vis.os[j];
+      const Matrix4d &x = xs[vis.ks[i]];
+      Vector3d d = x.block<3,3>(0,0)*vis.zs[i];
+      Matrix3d P = Matrix3d::Identity() - d*d.transpose();
+      A += P;
+      b += P*x.block<3,1>(0,3);
+    }
+    // a single ray or parallel rays do not determine the depth
+    SelfAdjointEigenSolver<Matrix3d> es(A);
+    if (es.eigenvalues()[0] > 1e-4*es.eigenvalues()[2])
+      p.segment<3>(i0 + 3*l) = A.ldlt().solve(b);
+  }
+}
+
+
 template <int _nu>
 void KinbodyProjTrack<_nu>::Add(const Vectorud &u, const Matrix4d &x, double h)
 {
@@ -101,47 +140,45 @@ void KinbodyProjTrack<_nu>::Add(const Vectorud &u, const Matrix4d &x, double h)
   const Matrix3d &R = x.block<3,3>(0,0);
   const Vector3d &px = x.block<3,1>(0,3);
   
-  this->Is.resize(this->Is.size()+1);
-  assert(k == this->Is.size()-1);
+  this->vis.AddPose();
+  assert(k == this->vis.Poses()-1);
 
-  for (int l = 0; l < this->ls.size(); ++l) {
+  vector<int> fs;
+  Visibility<3>::Near(fs, this->ls, px, this->dmax);
+
+  for (int j = 0; j < fs.size(); ++j) {
+    int l = fs[j];
     const Vector3d &pf = this->ls[l];
-    //p.segment<2>(2*extforce + 2*l);
-    
-    double d = (px - pf).norm();
-    if (d < this->dmax) {
-      Vector3d z = R.transpose()*(pf - px);
-      z /= z.norm();
-      z(0) += sqrt(this->cp)*random_normal();
-      z(1) += sqrt(this->cp)*random_normal();
-      z(2) += sqrt(this->cp)*random_normal();
-      z /= z.norm();
-
-      // add to feature vector if not observed
-      if (!this->observed[l]) {
-        if (!this->init) {
-          this->p.resize(3);
-          this->init= true;
-        } else {
-          this->p.conservativeResize(this->p.size() + 3);
-        }
-        const Matrix3d &Rn = this->xs.back().block(0,0,3,3);
-        const Vector3d &pxn = this->xs.back().block(0,3,3,1);
-         
-        // Initialize landmark position from estimated state
-        this->p.tail(3) = Rn*this->dmax*z + pxn;
-        this->pis.push_back(l);
-        this->observed[l] = true;
-        this->cis[l] = this->p.size()/3-1;
-      }
+    Vector3d z = R.transpose()*(pf - px);
+    z /= z.norm();
+    z(0) += sqrt(this->cp)*random_normal();
+    z(1) += sqrt(this->cp)*random_normal();
+    z(2) += sqrt(this->cp)*random_normal();
+    z /= z.norm();
 
-      //        zs[k].push_back();      // add feature l to pose k
-      
-      this->Is[k].push_back(make_pair(l, z)); // add feature l to pose k      
-      this->Js[l].push_back(make_pair(k, z)); // add pose k to feature l
-      
-      //        cout << "k=" << k << " l=" << l << " d=" << d << endl;
+    // add to feature vector if not observed
+    if (!this->observed[l]) {
+      if (!this->init) {
+        this->p.resize(3);
+        this->init= true;
+      } else {
+        this->p.conservativeResize(this->p.size() + 3);
+      }
+      const Matrix3d &Rn = this->xs.back().block(0,0,3,3);
+      const Vector3d &pxn = this->xs.back().block(0,3,3,1);
+       
+      // Initialize landmark position from estimated state
+      this->p.tail(3) = Rn*this->dmax*z + pxn;
+      this->pis.push_back(l);
+      this->observed[l] = true;
+      this->cis[l] = this->p.size()/3-1;
     }
+
+    //        zs[k].push_back();      // add feature l to pose k
+    
+    this->vis.Add(l, z);          // add feature l to pose k
+    
+    //        cout << "k=" << k << " l=" << l << " d=" << d << endl;
   }
 }
 
@@ -190,48 +227,46 @@ void KinbodyProjTrack<_nu>::Add2(const Vectorud &u, const Matrix4d &x, double h)
   const Matrix3d &R = x.block<3,3>(0,0);
   const Vector3d &px = x.block<3,1>(0,3);
   
-  this->Is.resize(this->Is.size()+1);
-  assert(k == this->Is.size()-1);
+  this->vis.AddPose();
+  assert(k == this->vis.Poses()-1);
+
+  vector<int> fs;
+  Visibility<3>::Near(fs, this->ls, px, this->dmax);
 
-  for (int l = 0; l < this->ls.size(); ++l) {
+  for (int j = 0; j < fs.size(); ++j) {
+    int l = fs[j];
     const Vector3d &pf = this->ls[l];
-    //p.segment<2>(2*extforce + 2*l);
+
+    Vector3d z = R.transpose()*(pf - px);
+    z /= z.norm();
+    z(0) += sqrt(this->cp)*random_normal();
+    z(1) += sqrt(this->cp)*random_normal();
+    z(2) += sqrt(this->cp)*random_normal();
+    z /= z.norm();
     
-    double d = (px - pf).norm();
-    if (d < this->dmax) {
-
-      Vector3d z = R.transpose()*(pf - px);
-      z /= z.norm();
-      z(0) += sqrt(this->cp)*random_normal();
-      z(1) += sqrt(this->cp)*random_normal();
-      z(2) += sqrt(this->cp)*random_normal();
-      z /= z.norm();
-      
-      // add to feature vector if not observed
-      if (!this->observed[l]) {
-        if (!this->init) {
-          this->p.resize(3);
-          this->init= true;
-        } else {
-          this->p.conservativeResize(this->p.size() + 3);
-        }
-        const Matrix3d &Rn = this->xs.back().block(0,0,3,3);
-        const Vector3d &pxn = this->xs.back().block(0,3,3,1);
-         
-        // Initialize landmark position from estimated state
-        this->p.tail(3) = Rn*this->dmax*z + pxn;
-        // Initialize landmark position with its true position
-        //p.tail<3>() = pf;
-        this->pis.push_back(l);
-        this->observed[l] = true;
-        this->cis[l] = this->p.size()/3-1;
+    // add to feature vector if not observed
+    if (!this->observed[l]) {
+      if (!this->init) {
+        this->p.resize(3);
+        this->init= true;
+      } else {
+        this->p.conservativeResize(this->p.size() + 3);
       }
-      
-      this->Is[k].push_back(make_pair(l, z)); // add feature l to pose k      
-      this->Js[l].push_back(make_pair(k, z)); // add pose k to feature l
-      
-      //        cout << "k=" << k << " l=" << l << " d=" << d << endl;
+      const Matrix3d &Rn = this->xs.back().block(0,0,3,3);
+      const Vector3d &pxn = this->xs.back().block(0,3,3,1);
+       
+      // Initialize landmark position from estimated state
+      this->p.tail(3) = Rn*this->dmax*z + pxn;
+      // Initialize landmark position with its true position
+      //p.tail<3>() = pf;
+      this->pis.push_back(l);
+      this->observed[l] = true;
+      this->cis[l] = this->p.size()/3-1;
     }
+    
+    this->vis.Add(l, z);          // add feature l to pose k
+    
+    //        cout << "k=" << k << " l=" << l << " d=" << d << endl;
   }
 }
 
@@ -0,0 +1,296 @@
+#include "tileddem.h"
+#include "utils.h"
+#include <cmath>
+#include <string.h>
+#include <assert.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <iostream>
+#include <fstream>
+#include <vector>
+
+using namespace gcop;
+using namespace std;
+
+static const char magic[8] = {'G', 'C', 'O', 'P', 'D', 'T', '0', '1'};
+
+static_assert(sizeof(TiledDem::Header) == 128, "TiledDem::Header should be 128 bytes");
+
+/**
+ * Octahedral encoding of a unit vector into two int16
+ */
+static void EncodeNormal(short e[2], const double n[3])
+{
+  double s = fabs(n[0]) + fabs(n[1]) + fabs(n[2]);
+  double x = n[0]/s, y = n[1]/s;
+  if (n[2] < 0) {
+    double xo = x;
+    x = (1 - fabs(y))*(xo >= 0 ? 1 : -1);
+    y = (1 - fabs(xo))*(y >= 0 ? 1 : -1);
+  }
+  e[0] = (short)round(MIN(MAX(x, -1.0), 1.0)*32767);
+  e[1] = (short)round(MIN(MAX(y, -1.0), 1.0)*32767);
+}
+
+static void DecodeNormal(double n[3], const short e[2])
+{
+  double x = e[0]/32767.0, y = e[1]/32767.0;
+  double z = 1 - fabs(x) - fabs(y);
+  if (z < 0) {
+    double xo = x;
+    x = (1 - fabs(y))*(xo >= 0 ? 1 : -1);
+    y = (1 - fabs(xo))*(y >= 0 ? 1 : -1);
+  }
+  double nn = sqrt(x*x + y*y + z*z);
+  n[0] = x/nn;
+  n[1] = y/nn;
+  n[2] = z/nn;
+}
+
+TiledDem::TiledDem(const char *fname) :
+  Dem(), ts(0), nti(0), ntj(0), hasNormals(false), map(0), size(0), tdata(0), tnormals(0)
+{
+  int fd = open(fname, O_RDONLY);
+  if (fd < 0) {
+    std::cerr << "[E]: TiledDem - failed to open " << string(fname) << std::endl;
+    return;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(Header)) {
+    std::cerr << "[E]: TiledDem - invalid file " << string(fname) << std::endl;
+    close(fd);
+    return;
+  }
+  size = info.st_size;
+  map = mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    std::cerr << "[E]: TiledDem - failed to map " << string(fname) << std::endl;
+    map = 0;
+    return;
+  }
+  // local queries touch few tiles, so avoid reading ahead
+  madvise(map, size, MADV_RANDOM);
+
+  Header hdr;
+  memcpy(&hdr, map, sizeof(Header));
+  int tsc = hdr.ts > 0 ? hdr.ts : 1;
+  size_t nt = (size_t)((hdr.ni + tsc - 1)/tsc)*((hdr.nj + tsc - 1)/tsc)*tsc*tsc;
+  if (memcmp(hdr.magic, magic, sizeof(magic)) || hdr.ni < 1 || hdr.nj < 1 || hdr.ts < 1 ||
+      sizeof(Header) + nt*sizeof(float) > size ||
+      (hdr.hasNormals && hdr.normalsOffset + nt*2*sizeof(short) > size)) {
+    std::cerr << "[E]: TiledDem - invalid file " << string(fname) << std::endl;
+    munmap(map, size);
+    map = 0;
+    return;
+  }
+
+  ni = hdr.ni;
+  nj = hdr.nj;
+  ts = hdr.ts;
+  cs = hdr.cs;
+  ds = hdr.ds;
+  w = hdr.w;
+  h = hdr.h;
+  memcpy(o, hdr.o, 3*sizeof(double));
+  nti = (ni + ts - 1)/ts;
+  ntj = (nj + ts - 1)/ts;
+  hasNormals = hdr.hasNormals;
+  tdata = (const float*)((const char*)map + sizeof(Header));
+  if (hasNormals)
+    tnormals = (const short*)((const char*)map + hdr.normalsOffset);
+}
+
+TiledDem::~TiledDem()
+{
+  if (map)
+    munmap(map, size);
+}
+
+bool TiledDem::Write(const Dem &dem, const char *fname, int ts, bool normals)
+{
+  if (ts < 1 || !dem.data) {
+    std::cerr << "[E]: TiledDem::Write - invalid dem or tile size" << std::endl;
+    return false;
+  }
+  normals = normals && dem.normals;
+
+  int nti = (dem.ni + ts - 1)/ts;
+  int ntj = (dem.nj + ts - 1)/ts;
+  size_t nt = (size_t)nti*ntj*ts*ts;
+
+  Header hdr;
+  memset(&hdr, 0, sizeof(Header));
+  memcpy(hdr.magic, magic, sizeof(magic));
+  hdr.ni = dem.ni;
+  hdr.nj = dem.nj;
+  hdr.ts = ts;
+  hdr.hasNormals = normals;
+  hdr.cs = dem.cs;
+  hdr.ds = dem.ds;
+  hdr.w = dem.w;
+  hdr.h = dem.h;
+  memcpy(hdr.o, dem.o, 3*sizeof(double));
+  hdr.normalsOffset = normals ? sizeof(Header) + nt*sizeof(float) : 0;
+
+  string tname = string(fname) + ".tmp";
+  fstream fstr(tname.c_str(), std::ios::out | std::ios::binary);
+  if (!fstr.good()) {
+    std::cerr << "[E]: TiledDem::Write - failed to open " << tname << std::endl;
+    return false;
+  }
+  fstr.write((const char*)&hdr, sizeof(Header));
+
+  // tiles are written one row of tiles at a time
+  vector<float> hrow((size_t)ntj*ts*ts);
+  for (int ti = 0; ti < nti; ++ti) {
+    for (int tj = 0; tj < ntj; ++tj) {
+      float *t = &hrow[(size_t)tj*ts*ts];
+      for (int a = 0; a < ts; ++a) {
+        int i = MIN(ti*ts + a, dem.ni - 1);
+        for (int b = 0; b < ts; ++b) {
+          int j = MIN(tj*ts + b, dem.nj - 1);
+          t[a*ts + b] = dem.data[i*dem.nj + j];
+        }
+      }
+    }
+    fstr.write((const char*)&hrow[0], hrow.size()*sizeof(float));
+  }
+
+  if (normals) {
+    vector<short> nrow((size_t)ntj*ts*ts*2);
+    for (int ti = 0; ti < nti; ++ti) {
+      for (int tj = 0; tj < ntj; ++tj) {
+        short *t = &nrow[(size_t)tj*ts*ts*2];
+        for (int a = 0; a < ts; ++a) {
+          int i = MIN(ti*ts + a, dem.ni - 1);
+          for (int b = 0; b < ts; ++b) {
+            int j = MIN(tj*ts + b, dem.nj - 1);
+            EncodeNormal(t + 2*(a*ts + b), dem.normals + 3*(i*dem.nj + j));
+          }
+        }
+      }
+      fstr.write((const char*)&nrow[0], nrow.size()*sizeof(short));
+    }
+  }
+
+  fstr.close();
+  if (!fstr.good() || rename(tname.c_str(), fname)) {
+    std::cerr << "[E]: TiledDem::Write - failed to write " << string(fname) << std::endl;
+    remove(tname.c_str());
+    return false;
+  }
+  return true;
+}
+
+double TiledDem::Interp(double xi, double yi) const
+{
+  if (xi < 0 && xi > -eps)
+    xi = 0;
+  if (xi > nj - 1 && xi < nj - 1 + eps)
+    xi = nj - 1 - eps;
+
+  if (yi < 0 && yi > -eps)
+    yi = 0;
+  if (yi > ni - 1 && yi < ni - 1 + eps)
+    yi = ni - 1 - eps;
+
+  int x1 = (int)floor(xi);
+  int y1 = (int)floor(yi);
+  int x2 = (int)ceil(xi);
+  int y2 = (int)ceil(yi);
+
+  if (x1 < 0 || x2 >= nj || y1 < 0 || y2 >= ni)
+    return 0;
+
+  double t = xi - x1;
+  double u = yi - y1;
+
+  return (1-t)*(1-u)*Height(y1, x1) + t*(1-u)*Height(y1, x2) + t*u*Height(y2, x2) + (1-t)*u*Height(y2, x1);
+}
+
+void TiledDem::Normal(double n[3], int i, int j) const
+{
+  if (tnormals) {
+    DecodeNormal(n, tnormals + 2*(((i/ts)*ntj + j/ts)*ts*ts + (i%ts)*ts + j%ts));
+    return;
+  }
+
+  // same as Dem::ComputeNormals
+  if (i == 0) {
+    n[0] = -1; n[1] = 0; n[2] = 0;
+    return;
+  }
+  if (j == nj - 1) {
+    n[0] = 0; n[1] = -1; n[2] = 0;
+    return;
+  }
+  double p[3], vx[3], vy[3];
+  Get(p, i, j);
+  Get(vx, i, j+1);
+  Get(vy, i-1, j);
+  MINUS3(vx, vx, p);
+  MINUS3(vy, vy, p);
+  CROSS(n, vx, vy);
+  double nn = NORM3(n);
+  n[0] /= nn;
+  n[1] /= nn;
+  n[2] /= nn;
+}
+
+double TiledDem::Get(double x, double y) const
+{
+  if (!tdata || !IsValid(x, y))
+    return 0;
+  return o[2] + Interp((x - o[0])/cs, (h - y - o[1])/cs);
+}
+
+bool TiledDem::Get(double *p, int i, int j) const
+{
+  if (i < 0 || i >= ni ||
+      j < 0 || j >= nj) {
+    std::cerr << "Warning: TiledDem::Get: invalid (i,j)=(" << i << "," << j << ")" << std::endl;
+    return false;
+  }
+
+  p[0] = j*cs + o[0];
+  p[1] = h - i*cs + o[1];
+  p[2] = Height(i, j) + o[2];
+  return true;
+}
+
+void TiledDem::GetRow(double *z, int i) const
+{
+  assert(i >= 0 && i < ni);
+  for (int j = 0; j < nj; ++j)
+    z[j] = Height(i, j);
+}
+
+double TiledDem::GetNormal(double n[3], double x, double y) const
+{
+  if (!tdata || !IsValid(x, y)) {
+    n[0] = 0;
+    n[1] = 0;
+    n[2] = 1;
+    return 0;
+  }
+  Normal(n, MIN((int)((h - y - o[1])/cs), ni - 1), MIN((int)((x - o[0])/cs), nj - 1));
+  return o[2] + Interp((x - o[0])/cs, (h - y - o[1])/cs);
+}
+
+const double* TiledDem::GetNormal(double x, double y) const
+{
+  if (!tdata || !IsValid(x, y))
+    return 0;
+  return GetNormal(MIN((int)((h - y - o[1])/cs), ni - 1), MIN((int)((x - o[0])/cs), nj - 1));
+}
+
+const double* TiledDem::GetNormal(int i, int j) const
+{
+  static thread_local double n[3];
+  Normal(n, i, j);
+  return n;
+}
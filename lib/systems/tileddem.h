@@ -0,0 +1,123 @@
+#ifndef GCOP_TILEDDEM_H
+#define GCOP_TILEDDEM_H
+
+#include "dem.h"
+#include <stddef.h>
+
+namespace gcop {
+
+  /**
+   * Read-only Dem stored in a tiled binary file which is memory mapped.
+   *
+   * Heights are stored as floats in square tiles (64x64 by default) so that
+   * a local query touches only a few pages of the file, and normals are
+   * optionally stored in a second channel using a 4-byte octahedral
+   * encoding. Nothing is read until it is accessed, and several processes
+   * using the same file share a single copy of it through the page cache.
+   *
+   * Get, GetRow and GetNormal behave as in Dem, so it can be used with
+   * DemSdf and DemPyramid. The dense data and normals arrays are not
+   * allocated (they are null) so methods modifying the map (Set, Clear,
+   * Dilate, Convolve, etc.) and code accessing data directly require a
+   * regular Dem.
+   *
+   * File layout (native endianness): a 128-byte header (see Header), then
+   * the height tiles in row-major tile order, each one storing ts x ts
+   * floats in row-major order (padded with the last row/column of the map),
+   * then the normal tiles in the same order with two int16 per cell.
+   */
+  class TiledDem : public Dem {
+  public:
+    /**
+     * Map a tiled Dem file
+     * @param fname file name
+     */
+    TiledDem(const char *fname);
+
+    virtual ~TiledDem();
+
+    /**
+     * Write a Dem into a tiled file
+     * @param dem digital elevation map
+     * @param fname file name
+     * @param ts tile size
+     * @param normals whether to also store the normals of dem
+     * @return true on success
+     */
+    static bool Write(const Dem &dem, const char *fname, int ts = 64, bool normals = true);
+
+    /**
+     * Height (without the origin offset) at index (i,j)
+     * @param i i-index
+     * @param j j-index
+     * @return height
+     */
+    double Height(int i, int j) const {
+      return tdata[((i/ts)*ntj + j/ts)*ts*ts + (i%ts)*ts + j%ts];
+    }
+
+    using Dem::Get;
+    using Dem::GetNormal;
+
+    double Get(double x, double y) const;
+
+    bool Get(double *p, int i, int j) const;
+
+    void GetRow(double *z, int i) const;
+
+    double GetNormal(double n[3], double x, double y) const;
+
+    /**
+     * Normal at point (x,y). The returned pointer is valid until the next
+     * call from the same thread.
+     */
+    const double* GetNormal(double x, double y) const;
+
+    /**
+     * Normal at index (i,j). The returned pointer is valid until the next
+     * call from the same thread.
+     */
+    const double* GetNormal(int i, int j) const;
+
+    /**
+     * Fixed-size file header
+     */
+    struct Header {
+      char magic[8];       ///< "GCOPDT01"
+      int ni;              ///< number of rows
+      int nj;              ///< number of columns
+      int ts;              ///< tile size
+      int hasNormals;      ///< whether normal tiles are stored
+      double cs;           ///< cell size
+      double ds;           ///< data scale
+      double w;            ///< width
+      double h;            ///< height
+      double o[3];         ///< origin
+      unsigned long long normalsOffset;  ///< byte offset of normal tiles
+      char reserved[40];
+    };
+
+    int ts;               ///< tile size
+    int nti;              ///< number of tile rows
+    int ntj;              ///< number of tile columns
+    bool hasNormals;      ///< whether normals are available
+
+  protected:
+    /**
+     * Bilinear interpolation of the tiled heights (see Dem::bilinterp)
+     */
+    double Interp(double xi, double yi) const;
+
+    /**
+     * Decode the normal at index (i,j)
+     */
+    void Normal(double n[3], int i, int j) const;
+
+    void *map;            ///< start of the mapped file
+    size_t size;          ///< size of the mapped file
+    const float *tdata;   ///< height tiles
+    const short *tnormals;  ///< normal tiles
+  };
+}
+
+#endif
@@ -0,0 +1,172 @@
+#ifndef GCOP_VISIBILITY_H
+#define GCOP_VISIBILITY_H
+
+#include <Eigen/Dense>
+#include <Eigen/StdVector>
+#include <vector>
+
+namespace gcop {
+
+  using namespace std;
+  using namespace Eigen;
+
+  /**
+   * Feature observations along a pose track, in compressed sparse row form.
+   *
+   * Observations are stored in contiguous arrays in the order in which
+   * they are added, i.e. grouped by pose: the observations of pose k are
+   * is[k],...,is[k+1]-1, observation i being of feature ls[i] from pose
+   * ks[i] with measurement zs[i].
+   *
+   * The observations of each feature are also chained in pose order as
+   * they are added, in constant time: the first one is first[l] and the
+   * one after observation i is next[i] (-1 at the end). Other threads
+   * (e.g. views) only read the chains. The transpose in contiguous form,
+   * used by the batch feature estimates, is built on demand by Index: the
+   * observations of feature l are os[js[l]],...,os[js[l+1]-1].
+   */
+  template <int _nz>
+  class Visibility {
+  public:
+    typedef Matrix<double, _nz, 1> Vectorzd;
+
+    /**
+     * Empty table
+     * @param nf number of features
+     */
+    Visibility(int nf = 0);
+
+    /**
+     * Start observations from a new pose
+     */
+    void AddPose();
+
+    /**
+     * Add an observation from the last pose
+     * @param l feature index
+     * @param z measurement
+     */
+    void Add(int l, const Vectorzd &z);
+
+    /**
+     * @return number of poses
+     */
+    int Poses() const { return is.size() - 1; }
+
+    /**
+     * @return number of observations
+     */
+    int Size() const { return ls.size(); }
+
+    /**
+     * Build the feature-to-pose index js, os (if not up to date). This
+     * takes time linear in the number of observations and features, so it
+     * should be called only before using js, os rather than after each pose.
+     */
+    void Index();
+
+    /**
+     * @return whether js, os are up to date
+     */
+    bool Indexed() const { return indexed; }
+
+    /**
+     * Find the features within a given distance from a position
+     * @param fs indices of the features (sorted)
+     * @param pfs feature positions
+     * @param x position
+     * @param d distance
+     */
+    template <typename Tfs>
+      static void Near(vector<int> &fs, const Tfs &pfs, const Vectorzd &x, double d);
+
+    int nf;                ///< number of features
+
+    vector<int> is;        ///< pose offsets (number of poses + 1 vector)
+    vector<int> ks;        ///< pose of each observation
+    vector<int> ls;        ///< feature of each observation
+    vector<Vectorzd, aligned_allocator<Vectorzd> > zs;  ///< measurement of each observation
+
+    vector<int> first;     ///< first observation of each feature (-1 if none)
+    vector<int> next;      ///< next observation of the same feature (-1 if none)
+
+    vector<int> js;        ///< feature offsets into os (nf+1 vector, see Index)
+    vector<int> os;        ///< observations sorted by feature (see Index)
+
+  protected:
+    vector<int> last;      ///< last observation of each feature (-1 if none)
+
+    bool indexed;          ///< are js, os up to date
+  };
+
+
+  template <int _nz>
+    Visibility<_nz>::Visibility(int nf) : nf(nf), is(1, 0), first(nf, -1), last(nf, -1), indexed(false)
+  {
+  }
+
+  template <int _nz>
+    void Visibility<_nz>::AddPose()
+  {
+    is.push_back(ls.size());
+    indexed = false;
+  }
+
+  template <int _nz>
+    void Visibility<_nz>::Add(int l, const Vectorzd &z)
+  {
+    assert(is.size() > 1);
+    assert(l >= 0 && l < nf);
+    int i = ls.size();
+    ks.push_back(is.size() - 2);
+    ls.push_back(l);
+    zs.push_back(z);
+    next.push_back(-1);
+    // linked last, once ks, ls, zs hold it (readers follow the chains)
+    if (last[l] < 0)
+      first[l] = i;
+    else
+      next[last[l]] = i;
+    last[l] = i;
+    ++is.back();
+    indexed = false;
+  }
+
+  template <int _nz>
+    void Visibility<_nz>::Index()
+  {
+    if (indexed)
+      return;
+
+    // counting sort by feature, which keeps each feature in pose order
+    js.assign(nf + 1, 0);
+    for (int i = 0; i < (int)ls.size(); ++i)
+      ++js[ls[i] + 1];
+    for (int l = 0; l < nf; ++l)
+      js[l + 1] += js[l];
+
+    vector<int> pos(js.begin(), js.end() - 1);
+    os.resize(ls.size());
+    for (int i = 0; i < (int)ls.size(); ++i)
+      os[pos[ls[i]]++] = i;
+
+    indexed = true;
+  }
+
+  template <int _nz> template <typename Tfs>
+    void Visibility<_nz>::Near(vector<int> &fs, const Tfs &pfs, const Vectorzd &x, double d)
+  {
+    fs.clear();
+    if (pfs.empty())
+      return;
+
+    // squared distances to all features at once (positions are contiguous)
+    Map<const Matrix<double, _nz, Dynamic> > P(pfs[0].data(), _nz, pfs.size());
+    Matrix<double, 1, Dynamic> d2 = (P.colwise() - x).colwise().squaredNorm();
+    for (int l = 0; l < d2.size(); ++l)
+      if (d2[l] < d*d)
+        fs.push_back(l);
+  }
+}
+
+#endif
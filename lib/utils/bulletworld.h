@@ -21,6 +21,7 @@
 
 #include <iostream>
 #include <stdio.h>
+#include <vector>
 
 using namespace std;
 
@@ -28,6 +29,29 @@ namespace gcop{
 	class BulletWorld
 	{
 		protected:
+      /** Discrete dynamics world giving access to the time left over from the last fixed step, which
+       * is part of the state of the world when the time step is not a multiple of the fixed step
+       */
+      class DynamicsWorld : public btDiscreteDynamicsWorld
+      {
+        public:
+          DynamicsWorld(btDispatcher *dispatcher, btBroadphaseInterface *pairCache,
+                        btConstraintSolver *constraintSolver, btCollisionConfiguration *collisionConfiguration):
+            btDiscreteDynamicsWorld(dispatcher, pairCache, constraintSolver, collisionConfiguration)
+          {
+          }
+
+          btScalar GetLocalTime() const
+          {
+            return m_localTime;
+          }
+
+          void SetLocalTime(btScalar localTime)
+          {
+            m_localTime = localTime;
+          }
+      };
+
 			class btBroadphaseInterface*	m_overlappingPairCache;///<Broadphase collision checker
 
 			class btCollisionDispatcher*	m_dispatcher;///<Collision checker
@@ -62,7 +86,7 @@ namespace gcop{
         m_dispatcher = new btCollisionDispatcher(m_collisionConfiguration);
         m_overlappingPairCache = new btAxisSweep3(worldMin,worldMax);
         m_constraintSolver = new btSequentialImpulseConstraintSolver();
-        m_dynamicsWorld = new btDiscreteDynamicsWorld(m_dispatcher,m_overlappingPairCache,m_constraintSolver,m_collisionConfiguration);
+        m_dynamicsWorld = new DynamicsWorld(m_dispatcher,m_overlappingPairCache,m_constraintSolver,m_collisionConfiguration);
         if(usezupaxis)
         {
           m_dynamicsWorld->setGravity(btVector3(0,0,-9.81));//Sets Gravity Vector
@@ -378,6 +402,125 @@ namespace gcop{
 				m_constraintSolver->reset();
       }
 
+      /** Snapshot of the dynamic state of all the rigid bodies in the world and of the constraint solver
+       */
+      struct State
+      {
+        vector<btScalar> bodies;///< Transforms, velocities and activation of each rigid body (RecordSize values per body)
+        unsigned long seed;///< Random seed of the constraint solver
+        btScalar localTime;///< Time left over from the last fixed step of the world
+      };
+
+      static const int RecordSize = 38;///< Number of values stored per rigid body
+
+			/** Save the state of the world. Bodies should not be added or removed before restoring it
+			 * @param state		Saved state
+			 * @return false if the constraint solver is not a sequential impulse solver (its seed cannot be saved)
+			 * or the dynamics world was not created by this class (its left over time cannot be saved)
+			 */
+      bool Save(State &state) const
+      {
+        const btSequentialImpulseConstraintSolver *solver = dynamic_cast<const btSequentialImpulseConstraintSolver*>(m_constraintSolver);
+        if(!solver)
+        {
+          cerr<<"[E] BulletWorld::Save: the constraint solver is not a btSequentialImpulseConstraintSolver"<<endl;
+          return false;
+        }
+        const DynamicsWorld *world = dynamic_cast<const DynamicsWorld*>(m_dynamicsWorld);
+        if(!world)
+        {
+          cerr<<"[E] BulletWorld::Save: the dynamics world was not created by BulletWorld"<<endl;
+          return false;
+        }
+        const btCollisionObjectArray &objs = m_dynamicsWorld->getCollisionObjectArray();
+        state.bodies.clear();
+        state.bodies.reserve(RecordSize*objs.size());
+        for(int i = 0; i < objs.size(); i++)
+        {
+          const btRigidBody *body = btRigidBody::upcast(objs[i]);
+          if(!body)
+            continue;
+          SaveTransform(state.bodies, body->getWorldTransform());
+          SaveTransform(state.bodies, body->getInterpolationWorldTransform());
+          SaveVector(state.bodies, body->getLinearVelocity());
+          SaveVector(state.bodies, body->getAngularVelocity());
+          SaveVector(state.bodies, body->getInterpolationLinearVelocity());
+          SaveVector(state.bodies, body->getInterpolationAngularVelocity());
+          state.bodies.push_back(body->getActivationState());
+          state.bodies.push_back(body->getDeactivationTime());
+        }
+        state.seed = solver->getRandSeed();
+        state.localTime = world->GetLocalTime();
+        return true;
+      }
+
+			/** Restore a saved state of the world. The contact caches are cleared and rebuilt from the restored
+			 * bodies at the next step, so that stepping from a restored state always gives the same result
+			 * @param state		State saved using Save
+			 * @return false if the bodies in the world do not match the state, the constraint solver is not a
+			 * sequential impulse solver or the dynamics world was not created by this class. The world is left
+			 * unchanged in that case
+			 */
+      bool Restore(const State &state)
+      {
+        btSequentialImpulseConstraintSolver *solver = dynamic_cast<btSequentialImpulseConstraintSolver*>(m_constraintSolver);
+        if(!solver)
+        {
+          cerr<<"[E] BulletWorld::Restore: the constraint solver is not a btSequentialImpulseConstraintSolver"<<endl;
+          return false;
+        }
+        DynamicsWorld *world = dynamic_cast<DynamicsWorld*>(m_dynamicsWorld);
+        if(!world)
+        {
+          cerr<<"[E] BulletWorld::Restore: the dynamics world was not created by BulletWorld"<<endl;
+          return false;
+        }
+        btCollisionObjectArray &objs = m_dynamicsWorld->getCollisionObjectArray();
+        int nb = 0;
+        for(int i = 0; i < objs.size(); i++)
+        {
+          if(btRigidBody::upcast(objs[i]))
+            nb++;
+        }
+        if(RecordSize*nb != state.bodies.size())
+        {
+          cerr<<"[E] BulletWorld::Restore: state has "<<state.bodies.size()/RecordSize<<" bodies instead of "<<nb<<endl;
+          return false;
+        }
+
+        const btScalar *data = state.bodies.empty() ? 0 : &state.bodies[0];
+        for(int i = 0; i < objs.size(); i++)
+        {
+          btRigidBody *body = btRigidBody::upcast(objs[i]);
+          if(!body)
+            continue;
+          btTransform tr, interptr;
+          data = RestoreTransform(tr, data);
+          data = RestoreTransform(interptr, data);
+          body->setCenterOfMassTransform(tr);
+          body->setInterpolationWorldTransform(interptr);
+          body->setLinearVelocity(btVector3(data[0], data[1], data[2]));
+          body->setAngularVelocity(btVector3(data[3], data[4], data[5]));
+          body->setInterpolationLinearVelocity(btVector3(data[6], data[7], data[8]));
+          body->setInterpolationAngularVelocity(btVector3(data[9], data[10], data[11]));
+          body->forceActivationState(int(data[12]));
+          body->setDeactivationTime(data[13]);
+          data += 14;
+          body->updateInertiaTensor();
+          body->clearForces();
+          if(body->getMotionState())
+            body->getMotionState()->setWorldTransform(tr);
+
+          //Remove contact points computed at the old pose
+          m_dynamicsWorld->updateSingleAabb(body);
+          m_overlappingPairCache->getOverlappingPairCache()->cleanProxyFromPairs(body->getBroadphaseHandle(), m_dispatcher);
+        }
+        Reset();
+        solver->setRandSeed(state.seed);
+        world->SetLocalTime(state.localTime);
+        return true;
+      }
+
 			/** Destructor for Bullet Physics Engine cleansup all the objects created by various functions above
 			*/
 			~BulletWorld()			
@@ -417,6 +560,32 @@ namespace gcop{
 				delete m_collisionConfiguration;
 
 			}
+
+    protected:
+      static void SaveVector(vector<btScalar> &data, const btVector3 &v)
+      {
+        data.push_back(v.x());
+        data.push_back(v.y());
+        data.push_back(v.z());
+      }
+
+      static void SaveTransform(vector<btScalar> &data, const btTransform &tr)
+      {
+        const btMatrix3x3 &basis = tr.getBasis();
+        SaveVector(data, basis[0]);
+        SaveVector(data, basis[1]);
+        SaveVector(data, basis[2]);
+        SaveVector(data, tr.getOrigin());
+      }
+
+      static const btScalar *RestoreTransform(btTransform &tr, const btScalar *data)
+      {
+        tr.getBasis().setValue(data[0], data[1], data[2],
+                               data[3], data[4], data[5],
+                               data[6], data[7], data[8]);
+        tr.setOrigin(btVector3(data[9], data[10], data[11]));
+        return data + 12;
+      }
 	};
 };
 #endif
@@ -18,7 +18,7 @@ namespace gcop {
  * exact
  * amount of data not present
  */
-Eigen::MatrixXd loadEigenMatrix(std::string in_file_path) {
+inline Eigen::MatrixXd loadEigenMatrix(std::string in_file_path) {
   std::ifstream ifile(in_file_path);
   if (!ifile.good())
     throw std::runtime_error("File not found: " + in_file_path);
@@ -0,0 +1,161 @@
+#ifndef GCOP_SLOTMAP_H
+#define GCOP_SLOTMAP_H
+
+#include <cstddef>
+#include <deque>
+#include <vector>
+#include <utility>
+#include <unordered_map>
+
+namespace gcop {
+
+  /**
+   * Dense storage of elements indexed by integer ids with a (partial)
+   * std::map interface.
+   *
+   * The elements are stored in the slots of a deque, i.e. in large
+   * contiguous blocks rather than in separate tree nodes, so that
+   * iterating over and copying them is cache-friendly. The address of an
+   * element remains valid until it is erased, and the slots of erased
+   * elements are reused by new ones. Ids are mapped to slots using a hash
+   * table, and iteration is in slot order (not in the order of ids).
+   */
+  template <typename T> class SlotMap {
+  protected:
+    /**
+     * Storage of an element
+     */
+    struct Slot {
+      int id;    ///< element id (-1 for free slots)
+      T value;   ///< element
+    };
+
+  public:
+
+    /**
+     * Iterator over the used slots (skipping free ones). As for std::map,
+     * it dereferences to an (id, element) pair whose id cannot be changed;
+     * the pair holds references into the slot.
+     */
+    template <typename V, typename I> class Iterator {
+    public:
+      typedef std::pair<const int&, V&> reference;
+
+      /**
+       * Holds the pair returned by operator-> (which refers to the slot)
+       */
+      struct pointer {
+        reference r;
+        const reference* operator->() const { return &r; }
+      };
+
+      Iterator() {}
+      Iterator(I it, I end) : it(it), end(end) { Skip(); }
+
+      template <typename V2, typename I2> Iterator(const Iterator<V2, I2> &iter) :
+      it(iter.it), end(iter.end) {}
+
+      reference operator*() const { return reference(it->id, it->value); }
+      pointer operator->() const { pointer p = { **this }; return p; }
+
+      Iterator& operator++() { ++it; Skip(); return *this; }
+      Iterator operator++(int) { Iterator iter = *this; ++*this; return iter; }
+
+      bool operator==(const Iterator &iter) const { return it == iter.it; }
+      bool operator!=(const Iterator &iter) const { return it != iter.it; }
+
+      I it;    ///< current slot
+      I end;   ///< end of slots
+
+    private:
+      void Skip() { while (it != end && it->id < 0) ++it; }
+    };
+
+    typedef Iterator<T, typename std::deque<Slot>::iterator> iterator;
+    typedef Iterator<const T, typename std::deque<Slot>::const_iterator> const_iterator;
+
+    iterator begin() { return iterator(slots.begin(), slots.end()); }
+    iterator end() { return iterator(slots.end(), slots.end()); }
+    const_iterator begin() const { return const_iterator(slots.begin(), slots.end()); }
+    const_iterator end() const { return const_iterator(slots.end(), slots.end()); }
+
+    /**
+     * @return number of elements
+     */
+    size_t size() const { return index.size(); }
+
+    bool empty() const { return index.empty(); }
+
+    /**
+     * @param id element id
+     * @return 1 if the element exists, 0 otherwise
+     */
+    size_t count(int id) const { return index.count(id); }
+
+    iterator find(int id) {
+      typename std::unordered_map<int, int>::const_iterator i = index.find(id);
+      return i == index.end() ? end() : iterator(slots.begin() + i->second, slots.end());
+    }
+
+    const_iterator find(int id) const {
+      typename std::unordered_map<int, int>::const_iterator i = index.find(id);
+      return i == index.end() ? end() : const_iterator(slots.begin() + i->second, slots.end());
+    }
+
+    /**
+     * Access an element, inserting a default one if it does not exist
+     * @param id element id (non-negative)
+     * @return element
+     */
+    T& operator[](int id) {
+      typename std::unordered_map<int, int>::const_iterator i = index.find(id);
+      if (i != index.end())
+        return slots[i->second].value;
+
+      int s;
+      if (frees.empty()) {
+        s = slots.size();
+        Slot slot = { id, T() };
+        slots.push_back(slot);   // does not move the other elements
+      } else {
+        s = frees.back();
+        frees.pop_back();
+        slots[s].id = id;
+      }
+      index[id] = s;
+      return slots[s].value;
+    }
+
+    /**
+     * Erase an element (its slot is reset to a default element and reused)
+     * @param id element id
+     * @return number of erased elements (0 or 1)
+     */
+    size_t erase(int id) {
+      typename std::unordered_map<int, int>::iterator i = index.find(id);
+      if (i == index.end())
+        return 0;
+      Slot &slot = slots[i->second];
+      slot.id = -1;
+      slot.value = T();
+      frees.push_back(i->second);
+      index.erase(i);
+      return 1;
+    }
+
+    void erase(iterator iter) { erase(iter->first); }
+
+    void clear() {
+      slots.clear();
+      frees.clear();
+      index.clear();
+    }
+
+  protected:
+    std::deque<Slot> slots;                ///< slots
+    std::vector<int> frees;                ///< free slots
+    std::unordered_map<int, int> index;    ///< slot of each id
+  };
+}
+
+#endif
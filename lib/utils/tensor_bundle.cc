@@ -0,0 +1,201 @@
+#include "tensor_bundle.h"
+#include "load_eigen_matrix.h"
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace gcop;
+
+namespace {
+const char kMagic[8] = {'G', 'C', 'O', 'P', 'T', 'B', '0', '1'};
+const uint64_t kAlignment = 64;
+
+uint64_t alignOffset(uint64_t offset) {
+  return (offset + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+/**
+ * Read a value from the mapped file checking that it lies within the file
+ */
+template <typename T>
+T readValue(const char *data, size_t size, size_t &offset,
+            const std::string &file_path) {
+  if (offset + sizeof(T) > size) {
+    throw std::runtime_error("Truncated tensor bundle: " + file_path);
+  }
+  T value;
+  std::memcpy(&value, data + offset, sizeof(T));
+  offset += sizeof(T);
+  return value;
+}
+}
+
+TensorBundle::TensorBundle(std::string file_path)
+    : file_path_(file_path), data_(0), size_(0) {
+  int fd = open(file_path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("File not found: " + file_path);
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size < (off_t)(sizeof(kMagic) + 8)) {
+    close(fd);
+    throw std::runtime_error("Invalid tensor bundle: " + file_path);
+  }
+  size_ = info.st_size;
+  data_ = mmap(0, size_, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data_ == MAP_FAILED) {
+    data_ = 0;
+    throw std::runtime_error("Cannot map tensor bundle: " + file_path);
+  }
+  const char *data = static_cast<const char *>(data_);
+  try {
+    if (std::memcmp(data, kMagic, sizeof(kMagic)) != 0) {
+      throw std::runtime_error("Invalid tensor bundle: " + file_path);
+    }
+    size_t offset = sizeof(kMagic);
+    uint64_t count = readValue<uint64_t>(data, size_, offset, file_path);
+    for (uint64_t i = 0; i < count; ++i) {
+      uint64_t name_length =
+          readValue<uint64_t>(data, size_, offset, file_path);
+      if (offset + name_length > size_) {
+        throw std::runtime_error("Truncated tensor bundle: " + file_path);
+      }
+      std::string name(data + offset, name_length);
+      offset += name_length;
+      Entry entry;
+      entry.rows = readValue<uint64_t>(data, size_, offset, file_path);
+      entry.cols = readValue<uint64_t>(data, size_, offset, file_path);
+      entry.offset = readValue<uint64_t>(data, size_, offset, file_path);
+      if (entry.offset % kAlignment != 0 ||
+          entry.offset + entry.rows * entry.cols * sizeof(double) > size_) {
+        throw std::runtime_error("Invalid tensor " + name + " in bundle: " +
+                                 file_path);
+      }
+      entries_[name] = entry;
+    }
+  } catch (...) {
+    munmap(data_, size_);
+    data_ = 0;
+    throw;
+  }
+}
+
+TensorBundle::~TensorBundle() {
+  if (data_ != 0) {
+    munmap(data_, size_);
+  }
+}
+
+bool TensorBundle::contains(const std::string &name) const {
+  return entries_.count(name) > 0;
+}
+
+TensorBundle::MatrixMap TensorBundle::get(const std::string &name) const {
+  auto it = entries_.find(name);
+  if (it == entries_.end()) {
+    throw std::runtime_error("Tensor " + name + " not found in: " +
+                             file_path_);
+  }
+  const Entry &entry = it->second;
+  const double *tensor_data = reinterpret_cast<const double *>(
+      static_cast<const char *>(data_) + entry.offset);
+  return MatrixMap(tensor_data, entry.rows, entry.cols);
+}
+
+std::vector<std::string> TensorBundle::names() const {
+  std::vector<std::string> result;
+  for (const auto &entry : entries_) {
+    result.push_back(entry.first);
+  }
+  return result;
+}
+
+void TensorBundle::write(std::string file_path,
+                         const std::map<std::string, Eigen::MatrixXd> &tensors) {
+  // Header size determines where the data starts
+  uint64_t offset = sizeof(kMagic) + sizeof(uint64_t);
+  for (const auto &tensor : tensors) {
+    offset += 4 * sizeof(uint64_t) + tensor.first.size();
+  }
+  // Write to a unique file in the same directory, so that concurrent writers
+  // do not share it and the final rename stays on one file system
+  std::vector<char> temp_template(file_path.begin(), file_path.end());
+  const char suffix[] = ".XXXXXX";
+  temp_template.insert(temp_template.end(), suffix, suffix + sizeof(suffix));
+  int fd = mkstemp(temp_template.data());
+  if (fd < 0) {
+    throw std::runtime_error("Cannot write file: " + file_path);
+  }
+  std::string temp_path = temp_template.data();
+  // mkstemp creates the file readable by the owner only. The umask is not
+  // queried since changing it is not thread safe.
+  fchmod(fd, 0644);
+  close(fd);
+  std::ofstream ofile(temp_path, std::ios::binary);
+  if (!ofile.good()) {
+    std::remove(temp_path.c_str());
+    throw std::runtime_error("Cannot write file: " + file_path);
+  }
+  auto write_value = [&ofile](uint64_t value) {
+    ofile.write(reinterpret_cast<const char *>(&value), sizeof(value));
+  };
+  ofile.write(kMagic, sizeof(kMagic));
+  write_value(tensors.size());
+  std::vector<uint64_t> data_offsets;
+  for (const auto &tensor : tensors) {
+    offset = alignOffset(offset);
+    data_offsets.push_back(offset);
+    write_value(tensor.first.size());
+    ofile.write(tensor.first.data(), tensor.first.size());
+    write_value(tensor.second.rows());
+    write_value(tensor.second.cols());
+    write_value(offset);
+    offset += tensor.second.size() * sizeof(double);
+  }
+  int index = 0;
+  for (const auto &tensor : tensors) {
+    uint64_t padding = data_offsets[index++] - (uint64_t)ofile.tellp();
+    std::vector<char> zeros(padding, 0);
+    ofile.write(zeros.data(), padding);
+    ofile.write(reinterpret_cast<const char *>(tensor.second.data()),
+                tensor.second.size() * sizeof(double));
+  }
+  ofile.close();
+  if (!ofile.good() || std::rename(temp_path.c_str(), file_path.c_str())) {
+    std::remove(temp_path.c_str());
+    throw std::runtime_error("Cannot write file: " + file_path);
+  }
+}
+
+int TensorBundle::convertFolder(std::string folder_path,
+                                std::string file_path) {
+  DIR *dir = opendir(folder_path.c_str());
+  if (dir == 0) {
+    throw std::runtime_error("Cannot open folder: " + folder_path);
+  }
+  std::map<std::string, Eigen::MatrixXd> tensors;
+  struct dirent *dir_entry;
+  while ((dir_entry = readdir(dir)) != 0) {
+    std::string name = dir_entry->d_name;
+    std::string path = folder_path + "/" + name;
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode)) {
+      continue;
+    }
+    try {
+      tensors[name] = loadEigenMatrix(path);
+    } catch (std::runtime_error &) {
+      // Not a text matrix
+    }
+  }
+  closedir(dir);
+  write(file_path, tensors);
+  return tensors.size();
+}
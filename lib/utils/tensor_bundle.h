@@ -0,0 +1,101 @@
+#ifndef TENSOR_BUNDLE_H
+#define TENSOR_BUNDLE_H
+#include <Eigen/Dense>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace gcop {
+/**
+ * @brief A read-only binary file of named matrices that is memory mapped
+ *
+ * The matrices are handed out as Eigen::Map views into the mapped file, so
+ * loading does not parse or copy any data and several processes loading the
+ * same bundle share a single copy of it in the page cache.
+ *
+ * File layout (native endianness):
+ *  - 8 byte magic "GCOPTB01" followed by the number of tensors (uint64)
+ *  - For each tensor: name length (uint64), name, rows (uint64),
+ *    cols (uint64) and byte offset of the data in the file (uint64)
+ *  - The data of each tensor as doubles in column-major order, aligned to 64
+ *    bytes
+ */
+class TensorBundle {
+public:
+  using MatrixMap = Eigen::Map<const Eigen::MatrixXd, Eigen::Aligned>;
+
+  /**
+   * @brief TensorBundle Constructor
+   *
+   * Maps the bundle file into memory. Throws a runtime error if the file
+   * cannot be opened or is not a valid bundle
+   * @param file_path The bundle file
+   */
+  TensorBundle(std::string file_path);
+
+  ~TensorBundle();
+
+  TensorBundle(const TensorBundle &) = delete;
+  TensorBundle &operator=(const TensorBundle &) = delete;
+
+  /**
+   * @brief contains
+   * @param name Name of the tensor
+   * @return True if the bundle has a tensor with the given name
+   */
+  bool contains(const std::string &name) const;
+
+  /**
+   * @brief get a zero copy view of a tensor
+   *
+   * The view is valid as long as the bundle is alive. Throws a runtime error
+   * if the tensor is not present
+   * @param name Name of the tensor
+   * @return Map into the bundle data
+   */
+  MatrixMap get(const std::string &name) const;
+
+  /**
+   * @brief names
+   * @return The names of all the tensors in the bundle
+   */
+  std::vector<std::string> names() const;
+
+  /**
+   * @brief write a set of named matrices into a bundle file
+   * @param file_path The bundle file to write
+   * @param tensors The matrices to store
+   */
+  static void write(std::string file_path,
+                    const std::map<std::string, Eigen::MatrixXd> &tensors);
+
+  /**
+   * @brief convertFolder Convert all the text matrix files in a folder (see
+   * loadEigenMatrix) into a single bundle
+   *
+   * The tensors are named after the files. Files that are not valid text
+   * matrices are skipped.
+   * @param folder_path The folder with text matrix files
+   * @param file_path The bundle file to write
+   * @return The number of converted files
+   */
+  static int convertFolder(std::string folder_path, std::string file_path);
+
+private:
+  /**
+   * @brief Location of a tensor in the mapped file
+   */
+  struct Entry {
+    uint64_t rows;   ///< Number of rows
+    uint64_t cols;   ///< Number of columns
+    uint64_t offset; ///< Byte offset of the data from start of file
+  };
+  std::string file_path_;               ///< The bundle file
+  void *data_;                          ///< Start of the mapped file
+  size_t size_;                         ///< Size of the mapped file
+  std::map<std::string, Entry> entries_; ///< Tensors by name
+};
+}
+
+#endif // TENSOR_BUNDLE_H
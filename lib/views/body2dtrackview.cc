@@ -121,10 +121,12 @@ bool Body2dTrackView::RenderFrame(int i)
     glBegin(GL_LINES);
     //    Viewer::SetColor(0, 0, 1, 0);  
     glColor3d(.5,.5,1);
+    // the observation chains are extended by the track in the simulation
+    // thread and only read here
     for (int l = 0; l < nvf; ++l) {
-      const vector< pair<int,Vector2d> > &J = pg.Js[pg.pis[l]];
-      for (int j = 0; j < J.size(); ++j) {
-        int k = J[j].first;
+      int f = pg.pis[l];
+      for (int j = pg.vis.first[f]; j >= 0; j = pg.vis.next[j]) {
+        int k = pg.vis.ks[j];
         const Vector2d &x = pg.xs[k].first.block<2,1>(0,2);
         glVertex3d(pg.p(2*l + i0), pg.p(2*l + i0 + 1), 0);
         glVertex3d(x[0], x[1], 0);
@@ -22,23 +22,18 @@ void DynVisInsView::Render()
   ((SystemView<Body3dState,Vector6d>&)bodyView).Render();
 
   //  bodyView.Render();
-  map<int, DynVisIns::Camera>::const_iterator camIter;
+  SlotMap<DynVisIns::Camera>::const_iterator camIter;
   for (camIter = vi.cams.begin(); camIter != vi.cams.end(); ++camIter) {
     const DynVisIns::Camera &cam = camIter->second;
     bodyView.Render(&cam.x);    
   }
 
-  map<int, DynVisIns::Point>::const_iterator pntIter;
+  SlotMap<DynVisIns::Point>::const_iterator pntIter;
   int j = 0;
   for (pntIter = vi.pnts.begin(); pntIter != vi.pnts.end(); ++pntIter, ++j) {
     const DynVisIns::Point &p = pntIter->second;
     glPushMatrix(); 
-    if (!vi.v) {
-      glTranslated(p.l[0], p.l[1], p.l[2]);
-    } else {
-      int ind = 12*vi.cams.size() + 3*j;
-      glTranslated(vi.v[ind], vi.v[ind + 1], vi.v[ind + 2]);
-    }
+    glTranslated(p.l[0], p.l[1], p.l[2]);
     
     glutSolidSphere(.02, 5, 5);
 
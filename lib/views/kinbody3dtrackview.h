@@ -153,10 +153,12 @@ bool Kinbody3dTrackView<_nu>::RenderFrame(int i)
     glBegin(GL_LINES);
     //    Viewer::SetColor(0, 0, 1, 0);  
     glColor3d(.5,.5,1);
+    // the observation chains are extended by the track in the simulation
+    // thread and only read here
     for (int l = 0; l < nvf; ++l) {
-      const vector< pair<int,Vector3d> > &J = pg.Js[pg.pis[l]];
-      for (int j = 0; j < J.size(); ++j) {
-        int k = J[j].first;
+      int f = pg.pis[l];
+      for (int j = pg.vis.first[f]; j >= 0; j = pg.vis.next[j]) {
+        int k = pg.vis.ks[j];
         const Vector3d &x = pg.xs[k].block(0,3,3,1);
         glVertex3d(pg.p(3*l + i0), pg.p(3*l + i0 + 1), pg.p(3*l + i0 + 2));
         glVertex3d(x[0], x[1], x[2]);
@@ -182,6 +182,40 @@ TEST_F(TestAirmResidualNetworkModel, TestTrajectoryTanh) {
   testTrajectory(Activation::tanh);
 }
 
+TEST_F(TestAirmResidualNetworkModel, TestPropagateNetworkNative) {
+  // The native network matches the casadi graph used in the step function
+  casadi::MX x_in = casadi::MX::sym("network_in", 34);
+  casadi::MX x_out = airm_model->propagateNetwork(x_in);
+  auto f = casadi::Function("network", {x_in},
+                            {x_out, casadi::MX::jacobian(x_out, x_in)});
+  int N = 16;
+  Eigen::MatrixXd inputs(34, N);
+  inputs.setRandom();
+  Eigen::MatrixXd batch_out = airm_model->propagateNetworkNative(inputs);
+  ASSERT_EQ(batch_out.rows(), 8);
+  ASSERT_EQ(batch_out.cols(), N);
+  for (int i = 0; i < N; ++i) {
+    std::vector<casadi::DM> args = {
+        conversions::convertEigenToDM(inputs.col(i))};
+    auto out_args = f(args);
+    Eigen::VectorXd cs_out = conversions::convertDMToEigen(out_args.at(0));
+    Eigen::MatrixXd cs_jac = conversions::convertDMToEigen(out_args.at(1));
+    Eigen::VectorXd out;
+    Eigen::MatrixXd jac;
+    airm_model->propagateNetworkNative(inputs.col(i), out, &jac);
+    ASSERT_EQ(out.rows(), 8);
+    ASSERT_EQ(jac.rows(), 8);
+    ASSERT_EQ(jac.cols(), 34);
+    for (int j = 0; j < 8; ++j) {
+      ASSERT_NEAR(batch_out(j, i), cs_out(j), 1e-9);
+      ASSERT_NEAR(out(j), cs_out(j), 1e-9);
+      for (int k = 0; k < 34; ++k) {
+        ASSERT_NEAR(jac(j, k), cs_jac(j, k), 1e-9);
+      }
+    }
+  }
+}
+
 /*TEST_F(TestAirmResidualNetworkModel, TestTrajectoryRelu) {
   testTrajectory(Activation::relu);
 }
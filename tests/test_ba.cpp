@@ -0,0 +1,50 @@
+#include "ba.h"
+#include "utils.h"
+#include <gtest/gtest.h>
+#include <iostream>
+
+using namespace gcop;
+using namespace Eigen;
+
+TEST(Ba, SparseMatchesDense) {
+  // eliminating the features as 2x2 blocks (pb=2) gives the same iterates
+  // as the dense parameter Hessian (pb=0), in much less time
+  int N = 50;
+  double tf = 25;
+  int nf = 5*(N + 1);
+
+  Posegraph2d pgt(N, nf);
+  Posegraph2d pg(N, nf);
+  Posegraph2d::Synthesize2(pgt, pg, tf);
+  Posegraph2d pgd = pg;
+
+  Ba ba(pg);
+  Ba bad(pgd);
+  ASSERT_EQ(ba.pddp.pb, 2);
+  bad.pddp.pb = 0;
+  ba.pddp.debug = false;
+  bad.pddp.debug = false;
+
+  struct timeval timer;
+  long ts = 0, td = 0;
+  for (int i = 0; i < 3; ++i) {
+    timer_start(timer);
+    ba.pddp.Iterate();
+    ts += timer_us(timer);
+    timer_start(timer);
+    bad.pddp.Iterate();
+    td += timer_us(timer);
+  }
+  // the sparse path is kept, i.e. the cost provides the block derivatives
+  EXPECT_EQ(ba.pddp.pb, 2);
+
+  double dg = 0;
+  for (int k = 0; k <= N; ++k)
+    dg = std::max(dg, (pg.gs[k] - pgd.gs[k]).cwiseAbs().maxCoeff());
+  double dp = (pg.p - pgd.p).cwiseAbs().maxCoeff();
+  std::cout << "max differences: poses " << dg << ", features " << dp
+            << "; time sparse " << ts << " us, dense " << td << " us" << std::endl;
+  EXPECT_LT(dg, 1e-10);
+  EXPECT_LT(dp, 1e-10);
+  EXPECT_NEAR(ba.pddp.J, bad.pddp.J, 1e-10*fabs(bad.pddp.J));
+}
@@ -0,0 +1,151 @@
+#include "bulletrccar.h"
+#include "bulletworld.h"
+#include "utils.h"
+#include <gtest/gtest.h>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+using namespace gcop;
+
+class BulletrccarSnapshotTest : public testing::Test {
+protected:
+  BulletrccarSnapshotTest() : world(true), sys(world) {
+    btCollisionShape *groundShape = world.CreateGroundPlane(50, 50);
+    btTransform tr;
+    tr.setOrigin(btVector3(0, 0, 0));
+    tr.setRotation(btQuaternion(0, 0, 0));
+    world.LocalCreateRigidBody(0, tr, groundShape);
+  }
+
+  // steps the car from its current state, recording the reduced states and
+  // the chassis transforms
+  void Rollout(std::vector<Vector4d> &xs, std::vector<btTransform> &trs) {
+    int N = 100;
+    double h = .02;
+    xs.resize(N);
+    trs.resize(N);
+    for (int k = 0; k < N; ++k) {
+      Vector2d u(k < N/2 ? .5 : -.3, k < N/2 ? .2 : -.2);
+      sys.Step(xs[k], u, h);
+      trs[k] = sys.m_carChassis->getWorldTransform();
+    }
+  }
+
+  // bitwise comparison of the states, exact comparison of the transforms
+  static void ExpectIdentical(const std::vector<Vector4d> &xas, const std::vector<btTransform> &tras,
+                              const std::vector<Vector4d> &xbs, const std::vector<btTransform> &trbs) {
+    ASSERT_EQ(xas.size(), xbs.size());
+    for (int k = 0; k < xas.size(); ++k) {
+      EXPECT_EQ(0, memcmp(xas[k].data(), xbs[k].data(), sizeof(double)*4)) << "step " << k;
+      EXPECT_TRUE(tras[k] == trbs[k]) << "step " << k;
+    }
+  }
+
+  BulletWorld world;
+  Bulletrccar sys;
+};
+
+TEST_F(BulletrccarSnapshotTest, RestoredRolloutsAreIdentical) {
+  sys.Reset(Vector4d(1, 1, 0, 0));
+  // let the suspension settle so that the wheels are in contact
+  std::vector<Vector4d> xs;
+  std::vector<btTransform> trs;
+  Rollout(xs, trs);
+
+  Bulletrccar::Snapshot snapshot;
+  ASSERT_TRUE(sys.Save(snapshot));
+
+  std::vector<Vector4d> xas, xbs;
+  std::vector<btTransform> tras, trbs;
+  ASSERT_TRUE(sys.Restore(snapshot));
+  Rollout(xas, tras);
+  ASSERT_TRUE(sys.Restore(snapshot));
+  Rollout(xbs, trbs);
+  ExpectIdentical(xas, tras, xbs, trbs);
+
+  // the car has moved
+  EXPECT_GT((xas.back().head<2>() - xs.back().head<2>()).norm(), 1e-3);
+}
+
+TEST_F(BulletrccarSnapshotTest, SnapshotReset) {
+  sys.snapshotreset = true;
+  Vector4d x0(0, 0, 0, 0);
+  std::vector<Vector4d> xs, xas, xbs;
+  std::vector<btTransform> trs, tras, trbs;
+  ASSERT_TRUE(sys.Reset(x0));   // full reset, takes the snapshot
+  EXPECT_TRUE(sys.resetsnapshotvalid);
+  Rollout(xs, trs);
+  ASSERT_TRUE(sys.Reset(x0));   // restores it
+  Rollout(xas, tras);
+  ASSERT_TRUE(sys.Reset(x0));
+  Rollout(xbs, trbs);
+  ExpectIdentical(xas, tras, xbs, trbs);
+}
+
+TEST_F(BulletrccarSnapshotTest, MismatchedSnapshot) {
+  sys.Reset(Vector4d(0, 0, 0, 0));
+  Bulletrccar::Snapshot snapshot;
+  ASSERT_TRUE(sys.Save(snapshot));
+  snapshot.world.bodies.resize(snapshot.world.bodies.size() - BulletWorld::RecordSize);
+  EXPECT_FALSE(sys.Restore(snapshot));
+
+  // a failed restore on Reset falls back to the full reset
+  sys.snapshotreset = true;
+  sys.resetsnapshot = snapshot;
+  sys.resetsnapshotvalid = true;
+  sys.resetx = Vector4d(2, 0, 0, 0);
+  ASSERT_TRUE(sys.Reset(sys.resetx));
+  // which takes a new snapshot
+  EXPECT_TRUE(sys.resetsnapshotvalid);
+  EXPECT_EQ(sys.resetsnapshot.world.bodies.size(), snapshot.world.bodies.size() + BulletWorld::RecordSize);
+}
+
+TEST_F(BulletrccarSnapshotTest, LeftOverTime) {
+  sys.Reset(Vector4d(1, 1, 0, 0));
+  std::vector<Vector4d> xs;
+  std::vector<btTransform> trs;
+  Rollout(xs, trs);
+
+  // steps of 1.5 fixed steps leave part of a fixed step for the next step,
+  // which has to be part of the snapshot (an odd number of steps ends with
+  // a different left over time than the one saved)
+  world.m_dynamicsWorld->stepSimulation(.015, 3, .01);
+  Bulletrccar::Snapshot snapshot;
+  ASSERT_TRUE(sys.Save(snapshot));
+  EXPECT_GT(snapshot.world.localTime, 0);
+
+  std::vector<btTransform> tras, trbs;
+  for (int j = 0; j < 2; ++j) {
+    ASSERT_TRUE(sys.Restore(snapshot));
+    std::vector<btTransform> &out = j ? trbs : tras;
+    for (int k = 0; k < 21; ++k) {
+      world.m_dynamicsWorld->stepSimulation(.015, 3, .01);
+      out.push_back(sys.m_carChassis->getWorldTransform());
+    }
+  }
+  for (int k = 0; k < tras.size(); ++k)
+    EXPECT_TRUE(tras[k] == trbs[k]) << "step " << k;
+}
+
+TEST_F(BulletrccarSnapshotTest, RestoreTiming) {
+  Vector4d x0(0, 0, 0, 0);
+  ASSERT_TRUE(sys.Reset(x0));
+  Bulletrccar::Snapshot snapshot;
+  ASSERT_TRUE(sys.Save(snapshot));
+
+  int n = 1000;
+  struct timeval timer;
+  timer_start(timer);
+  for (int i = 0; i < n; ++i)
+    sys.Restore(snapshot);
+  long trestore = timer_us(timer);
+
+  sys.snapshotreset = false;
+  timer_start(timer);
+  for (int i = 0; i < n; ++i)
+    sys.Reset(x0);
+  long treset = timer_us(timer);
+
+  std::cout << "Restore: " << trestore/(double)n << " us, full Reset: " << treset/(double)n << " us" << std::endl;
+}
@@ -0,0 +1,105 @@
+#include "code_generation_cache.h"
+#include "gtest/gtest.h"
+#include <dlfcn.h>
+#include <stdlib.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace gcop;
+
+class TestCodeGenerationCache : public testing::Test {
+protected:
+  virtual void SetUp() {
+    char folder_template[] = "/tmp/gcop_codegen_cache_XXXXXX";
+    ASSERT_NE(mkdtemp(folder_template), nullptr);
+    base_folder = folder_template;
+    cache_folder = base_folder + "/nested";
+  }
+  virtual void TearDown() {
+    std::string remove_command = "rm -rf '" + base_folder + "'";
+    std::system(remove_command.c_str());
+  }
+  /**
+   * Load the library and evaluate the test function
+   */
+  int evaluateLibrary(std::string library_path) {
+    void *handle = dlopen(library_path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (handle == 0) {
+      return -1;
+    }
+    typedef int (*TestFunction)();
+    TestFunction fun = (TestFunction)dlsym(handle, "gcop_cache_test");
+    int result = (fun == 0) ? -1 : fun();
+    dlclose(handle);
+    return result;
+  }
+  std::string source(int value) {
+    return "int gcop_cache_test() { return " + std::to_string(value) + "; }\n";
+  }
+  std::string base_folder;
+  std::string cache_folder;
+};
+
+TEST_F(TestCodeGenerationCache, MissThenHit) {
+  CodeGenerationCache cache(cache_folder, "gcc", "-O2");
+  std::string library_path = cache.getLibrary(source(42));
+  ASSERT_FALSE(cache.lastLookupWasHit());
+  ASSERT_EQ(library_path, cache.libraryPath(source(42)));
+  ASSERT_EQ(evaluateLibrary(library_path), 42);
+  // A new cache object mimics a new process
+  CodeGenerationCache cache2(cache_folder, "gcc", "-O2");
+  ASSERT_EQ(cache2.getLibrary(source(42)), library_path);
+  ASSERT_TRUE(cache2.lastLookupWasHit());
+}
+
+TEST_F(TestCodeGenerationCache, KeyDependsOnSourceAndFlags) {
+  CodeGenerationCache cache(cache_folder, "gcc", "-O2");
+  CodeGenerationCache cache_o3(cache_folder, "gcc", "-O3");
+  ASSERT_EQ(cache.hashKey(source(1)), cache.hashKey(source(1)));
+  ASSERT_NE(cache.hashKey(source(1)), cache.hashKey(source(2)));
+  ASSERT_NE(cache.hashKey(source(1)), cache_o3.hashKey(source(1)));
+  cache.getLibrary(source(1));
+  cache_o3.getLibrary(source(1));
+  ASSERT_FALSE(cache_o3.lastLookupWasHit());
+  ASSERT_EQ(evaluateLibrary(cache.getLibrary(source(2))), 2);
+  ASSERT_FALSE(cache.lastLookupWasHit());
+}
+
+TEST_F(TestCodeGenerationCache, CompilationFailure) {
+  CodeGenerationCache cache(cache_folder, "gcc", "-O2");
+  ASSERT_THROW(cache.getLibrary("this is not C code"), std::runtime_error);
+  // No library or temporary files are left behind
+  ASSERT_NE(access(cache.libraryPath("this is not C code").c_str(), F_OK), 0);
+  std::string count_command =
+      "test $(ls -A '" + cache_folder + "' | wc -l) -eq 0";
+  ASSERT_EQ(std::system(count_command.c_str()), 0);
+}
+
+TEST_F(TestCodeGenerationCache, ConcurrentBuilders) {
+  int n_builders = 8;
+  std::vector<std::string> library_paths(n_builders);
+  std::vector<std::thread> builders;
+  for (int i = 0; i < n_builders; ++i) {
+    builders.emplace_back([&, i]() {
+      CodeGenerationCache cache(cache_folder, "gcc", "-O2");
+      library_paths[i] = cache.getLibrary(source(7));
+    });
+  }
+  for (auto &builder : builders) {
+    builder.join();
+  }
+  for (int i = 0; i < n_builders; ++i) {
+    ASSERT_EQ(library_paths[i], library_paths[0]);
+  }
+  ASSERT_EQ(evaluateLibrary(library_paths[0]), 7);
+  // Only the installed library remains in the cache folder
+  std::string count_command =
+      "test $(ls -A '" + cache_folder + "' | wc -l) -eq 1";
+  ASSERT_EQ(std::system(count_command.c_str()), 0);
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
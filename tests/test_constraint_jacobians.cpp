@@ -0,0 +1,82 @@
+#include "diskconstraint.h"
+#include "gcarmanifold.h"
+#include "body2dmanifold.h"
+#include "kinbody2dmanifold.h"
+#include "se2.h"
+#include <gtest/gtest.h>
+
+using namespace gcop;
+
+// central differences of a constraint along the manifold retraction
+template <typename T, typename Tm, typename Tc>
+VectorXd FiniteDifference(Tc &con, Tm &X, const T &x, int n, double eps = 1e-6) {
+  typename Tc::Vectorgd ga, gb;
+  typename Tc::Vectorcd u;
+  VectorXd dg(n);
+  for (int i = 0; i < n; ++i) {
+    typename Tm::Vectornd v = Tm::Vectornd::Zero();
+    T xa = x, xb = x;
+    v[i] = eps;
+    X.Retract(xb, x, v);
+    v[i] = -eps;
+    X.Retract(xa, x, v);
+    con(gb, 0, xb, u);
+    con(ga, 0, xa, u);
+    dg[i] = (gb[0] - ga[0])/(2*eps);
+  }
+  return dg;
+}
+
+class DiskConstraintJacobianTest : public testing::Test {
+protected:
+  DiskConstraintJacobianTest() : disk(Vector2d(1.0, 2.0), 0.5) {
+    SE2::Instance().q2g(g, Vector3d(0.7, 2.5, 1.2));  // heading .7 rad
+  }
+  Disk disk;
+  Matrix3d g;
+};
+
+TEST_F(DiskConstraintJacobianTest, Gcar) {
+  DiskConstraint<GcarState, 4, 2> con(disk, 0.1);
+  con.func = [](Vector2d &p, const GcarState &x) { p = x.g.block<2,1>(0,2); return 1; };
+
+  GcarState x;
+  x.g = g;
+  x.v = 1;
+
+  DiskConstraint<GcarState, 4, 2>::Vectorgd gx;
+  DiskConstraint<GcarState, 4, 2>::Matrixgxd dgdx;
+  Vector2d u;
+  con(gx, 0, x, u, 0, &dgdx);
+
+  VectorXd dg = FiniteDifference(con, GcarManifold::Instance(), x, 4);
+  EXPECT_LT((dgdx.transpose() - dg).norm(), 1e-6);
+}
+
+TEST_F(DiskConstraintJacobianTest, Body2d) {
+  DiskConstraint<Body2dState, 6, 3> con(disk, 0.1);
+  con.func = [](Vector2d &p, const Body2dState &x) { p = x.first.block<2,1>(0,2); return 1; };
+
+  Body2dState x(g, Vector3d(.1, .2, .3));
+
+  DiskConstraint<Body2dState, 6, 3>::Vectorgd gx;
+  DiskConstraint<Body2dState, 6, 3>::Matrixgxd dgdx;
+  Vector3d u;
+  con(gx, 0, x, u, 0, &dgdx);
+
+  VectorXd dg = FiniteDifference(con, Body2dManifold::Instance(), x, 6);
+  EXPECT_LT((dgdx.transpose() - dg).norm(), 1e-6);
+}
+
+TEST_F(DiskConstraintJacobianTest, Kinbody2d) {
+  DiskConstraint<Matrix3d, 3, 3> con(disk, 0.1);
+  con.func = [](Vector2d &p, const Matrix3d &x) { p = x.block<2,1>(0,2); return 1; };
+
+  DiskConstraint<Matrix3d, 3, 3>::Vectorgd gx;
+  DiskConstraint<Matrix3d, 3, 3>::Matrixgxd dgdx;
+  Vector3d u;
+  con(gx, 0, g, u, 0, &dgdx);
+
+  VectorXd dg = FiniteDifference(con, Kinbody2dManifold::Instance(), g, 3);
+  EXPECT_LT((dgdx.transpose() - dg).norm(), 1e-6);
+}
@@ -0,0 +1,280 @@
+#include "dem.h"
+#include "dempyramid.h"
+#include "demsdf.h"
+#include "tileddem.h"
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+using namespace gcop;
+using namespace Eigen;
+
+static void Randomize(Dem &dem) {
+  for (int c = 0; c < dem.ni*dem.nj; ++c)
+    dem.data[c] = 5.0*rand()/RAND_MAX;
+}
+
+// cube dilation of the map before the call, one window at a time, never
+// lowering a cell and leaving the cells within di of the boundary unchanged
+static std::vector<double> Dilated(const Dem &dem, int di) {
+  int ni = dem.ni, nj = dem.nj;
+  std::vector<double> src(dem.data, dem.data + ni*nj), dst = src;
+  for (int i = di; i < ni - di; ++i)
+    for (int j = di; j < nj - di; ++j)
+      for (int k = -di; k <= di; ++k)
+        for (int l = -di; l <= di; ++l)
+          dst[i*nj + j] = std::max(dst[i*nj + j], src[(i + k)*nj + j + l]);
+  return dst;
+}
+
+static void ExpectData(const Dem &dem, const std::vector<double> &z) {
+  for (int c = 0; c < dem.ni*dem.nj; ++c)
+    ASSERT_EQ(dem.data[c], z[c]) << "cell " << c;
+}
+
+TEST(Dem, Dilate) {
+  srand(1);
+  Dem dem(49, 36, 0.5);   // 99 x 73 cells
+  Randomize(dem);
+  std::vector<double> z = Dilated(dem, 3);
+  dem.Dilate(1.5);
+  ExpectData(dem, z);
+}
+
+TEST(Dem, DilateRepeated) {
+  srand(2);
+  Dem dem(30, 40, 1);
+  Randomize(dem);
+  for (int n = 0; n < 3; ++n) {
+    std::vector<double> z = Dilated(dem, 2);
+    dem.Dilate(2);
+    ExpectData(dem, z);
+  }
+}
+
+TEST(Dem, DilateAfterConvolve) {
+  // Convolve leaves the unsmoothed map in odata, so this only passes if
+  // Dilate refreshes odata from data before using it as the source
+  srand(3);
+  Dem dem(30, 20, 1);
+  Randomize(dem);
+  dem.Convolve(1.5);
+  std::vector<double> z = Dilated(dem, 4);
+  dem.Dilate(4);
+  ExpectData(dem, z);
+}
+
+// the 2d Gaussian kernel Convolve used before it was made separable, with
+// the cells outside the map read as zero height (the old code read past the
+// array there)
+static std::vector<double> Convolved(const Dem &dem, double sigma, double thresh) {
+  int ni = dem.ni, nj = dem.nj;
+  int a = (int)round(2*sigma/dem.cs);
+  std::vector<double> z(ni*nj);
+  for (int i = 0; i < ni; ++i) {
+    for (int j = 0; j < nj; ++j) {
+      double zs = 0, n = 0;
+      for (int ci = i - a; ci <= i + a; ++ci) {
+        for (int cj = j - a; cj <= j + a; ++cj) {
+          bool in = (ci >= 0 && ci < ni && cj >= 0 && cj < nj);
+          double d = in ? dem.data[cj + nj*ci] : 0;
+          if (d < thresh)
+            continue;
+          double r = (cj - j)*(cj - j) + (ci - i)*(ci - i);
+          double g = 1/(sigma*sqrt(2*M_PI))*exp(-r*dem.cs*dem.cs/(2*sigma*sigma));
+          n += g;
+          z[j + nj*i] += g*d;
+        }
+      }
+      z[j + nj*i] /= n;
+    }
+  }
+  return z;
+}
+
+TEST(Dem, Convolve) {
+  double thresh[2] = {0, 2.5};   // with and without the outside cells
+  for (int t = 0; t < 2; ++t) {
+    srand(6);
+    Dem dem(23, 17, 0.5);
+    Randomize(dem);
+    std::vector<double> z = Convolved(dem, 1.2, thresh[t]);
+    dem.Convolve(1.2, false, thresh[t]);
+    for (int c = 0; c < dem.ni*dem.nj; ++c)
+      ASSERT_NEAR(dem.data[c], z[c], 1e-12*(1 + fabs(z[c]))) << "cell " << c;
+  }
+}
+
+TEST(Dem, BatchQueries) {
+  // the batch queries (vectorized with AVX2) match the scalar ones, also
+  // for points outside the map and NaN coordinates
+  srand(5);
+  Dem dem(20, 15, .5);
+  Randomize(dem);
+  dem.ComputeNormals();
+  int n = 203;   // not a multiple of the vector width
+  std::vector<double> x(n), y(n), z(n), zn(n), ns(3*n);
+  std::vector<unsigned char> valid(n), validn(n);
+  for (int k = 0; k < n; ++k) {
+    x[k] = 24.0*rand()/RAND_MAX - 2;
+    y[k] = 19.0*rand()/RAND_MAX - 2;
+  }
+  x[7] = NAN;
+  y[12] = NAN;
+  int nv = dem.Get(&z[0], &x[0], &y[0], n, &valid[0]);
+  EXPECT_EQ(dem.GetNormal(&zn[0], &ns[0], &x[0], &y[0], n, &validn[0]), nv);
+
+  int nvs = 0;
+  for (int k = 0; k < n; ++k) {
+    bool v = dem.IsValid(x[k], y[k]);
+    nvs += v;
+    EXPECT_EQ(valid[k], v) << "point " << k;
+    EXPECT_EQ(validn[k], v) << "point " << k;
+    EXPECT_NEAR(z[k], dem.Get(x[k], y[k]), 1e-12) << "point " << k;
+    EXPECT_NEAR(zn[k], z[k], 1e-12) << "point " << k;
+    double nk[3];
+    dem.GetNormal(nk, x[k], y[k]);
+    for (int l = 0; l < 3; ++l)
+      EXPECT_EQ(ns[3*k + l], nk[l]) << "point " << k;
+  }
+  EXPECT_EQ(nv, nvs);
+  EXPECT_GT(nv, n/2);
+  EXPECT_LT(nv, n);
+}
+
+TEST(Dem, DilateSmallMap) {
+  // no cell is at least di away from the boundary
+  srand(4);
+  Dem dem(6, 6, 1);
+  Randomize(dem);
+  std::vector<double> z(dem.data, dem.data + dem.ni*dem.nj);
+  dem.Dilate(4);
+  ExpectData(dem, z);
+}
+
+// closest point on segment ab to p
+static Vector3d SegmentPoint(const Vector3d &p, const Vector3d &a, const Vector3d &b) {
+  double t = (p - a).dot(b - a)/(b - a).squaredNorm();
+  return a + std::min(1.0, std::max(0.0, t))*(b - a);
+}
+
+// distance from p to triangle abc
+static double TriangleDistance(const Vector3d &p, const Vector3d &a, const Vector3d &b, const Vector3d &c) {
+  Vector3d n = (b - a).cross(c - a).normalized();
+  Vector3d q = p - n.dot(p - a)*n;
+  if ((b - a).cross(q - a).dot(n) >= 0 && (c - b).cross(q - b).dot(n) >= 0 &&
+      (a - c).cross(q - c).dot(n) >= 0)
+    return (p - q).norm();
+  return std::min((p - SegmentPoint(p, a, b)).norm(),
+                  std::min((p - SegmentPoint(p, b, c)).norm(), (p - SegmentPoint(p, c, a)).norm()));
+}
+
+// distance from p to the triangulated terrain, i.e. the two triangles of
+// each quad of Dem points as in PqpDem
+static double TerrainDistance(const Dem &dem, const Vector3d &p) {
+  double d = INFINITY;
+  double p00[3], p10[3], p11[3], p01[3];
+  for (int i = 0; i < dem.ni - 1; ++i) {
+    for (int j = 0; j < dem.nj - 1; ++j) {
+      dem.Get(p00, i, j);
+      dem.Get(p10, i + 1, j);
+      dem.Get(p11, i + 1, j + 1);
+      dem.Get(p01, i, j + 1);
+      d = std::min(d, TriangleDistance(p, Vector3d(p00), Vector3d(p10), Vector3d(p11)));
+      d = std::min(d, TriangleDistance(p, Vector3d(p00), Vector3d(p11), Vector3d(p01)));
+    }
+  }
+  return d;
+}
+
+TEST(DemPyramid, PointDistanceWithOrigin) {
+  // a nonzero origin, in particular o[1], must place the quads at the
+  // same points as Dem::Get(p,i,j), i.e. as the triangles of PqpDem
+  srand(5);
+  double o[3] = {-3.5, 7.25, 1.5};
+  Dem dem(12, 9, 0.75, 1, o);
+  Randomize(dem);
+  DemPyramid pyr(dem);
+
+  for (int n = 0; n < 200; ++n) {
+    Vector3d p(o[0] - 1 + 14.0*rand()/RAND_MAX, o[1] - 1 + 11.0*rand()/RAND_MAX,
+               o[2] + 8.0*rand()/RAND_MAX);
+    EXPECT_NEAR(pyr.PointDistance(p), TerrainDistance(dem, p), 1e-9);
+  }
+
+  // maximum height over the whole footprint of the Dem
+  double zmax = -INFINITY;
+  for (int c = 0; c < dem.ni*dem.nj; ++c)
+    zmax = std::max(zmax, dem.data[c] + o[2]);
+  double p0[3], p1[3];
+  dem.Get(p0, dem.ni - 1, 0);
+  dem.Get(p1, 0, dem.nj - 1);
+  EXPECT_NEAR(pyr.MaxHeight(p0[0], p0[1], p1[0], p1[1]), zmax, 1e-5);
+}
+
+TEST(DemSdf, TerrainDistance) {
+  // compared with the exact distance to the triangulated terrain (with
+  // o[1]=0, for which Dem::Get(x,y) and Dem::Get(p,i,j) agree)
+  double o[3] = {1, 0, .5};
+  Dem dem(15, 12, .5, 1, o);
+  for (int i = 0; i < dem.ni; ++i)
+    for (int j = 0; j < dem.nj; ++j)
+      dem.data[i*dem.nj + j] = 2 + sin(.3*i)*cos(.2*j) + .5*sin(.7*j + .1*i);
+  DemSdf sdf(dem);
+
+  srand(7);
+  double e = 0, ea = 0;
+  int n = 300;
+  for (int m = 0; m < n; ++m) {
+    // points over the interior of the map, within the sampled heights
+    Vector3d p(o[0] + 1 + 13.0*rand()/RAND_MAX, o[1] + 1 + 10.0*rand()/RAND_MAX,
+               o[2] + 6.0*rand()/RAND_MAX);
+    double d = TerrainDistance(dem, p);
+    if (p[2] < dem.Get(p[0], p[1]))
+      d = -d;
+    double ds = sdf.Distance(p);
+    e = std::max(e, fabs(ds - d));
+    ea += fabs(ds - d)/n;
+  }
+  // the pillar model and the interpolation of the field are off by less
+  // than a quarter of the cell size (.11 max and .023 mean measured for
+  // cs=.5 on this smooth terrain)
+  std::cout << "max error " << e << ", mean " << ea << std::endl;
+  EXPECT_LT(e, .3*dem.cs);
+  EXPECT_LT(ea, .1*dem.cs);
+}
+
+TEST(TiledDem, SdfAndPyramid) {
+  // DemSdf and DemPyramid read the heights of a TiledDem through GetRow
+  srand(6);
+  double o[3] = {1, -2, .5};
+  Dem dem(20, 15, .5, 1, o);
+  for (int c = 0; c < dem.ni*dem.nj; ++c)
+    dem.data[c] = (float)(5.0*rand()/RAND_MAX);   // exactly stored in the tiles
+  dem.ComputeNormals();
+  const char *fname = "test_dem_tiled.bin";
+  ASSERT_TRUE(TiledDem::Write(dem, fname, 16));
+  TiledDem tdem(fname);
+
+  std::vector<double> z(dem.nj), tz(dem.nj);
+  for (int i = 0; i < dem.ni; ++i) {
+    dem.GetRow(&z[0], i);
+    tdem.GetRow(&tz[0], i);
+    ASSERT_TRUE(z == tz) << "row " << i;
+  }
+
+  DemSdf sdf(dem), tsdf(tdem);
+  ASSERT_TRUE(sdf.sdf == tsdf.sdf);
+
+  DemPyramid pyr(dem), tpyr(tdem);
+  ASSERT_EQ(pyr.nl, tpyr.nl);
+  for (int l = 0; l < pyr.nl; ++l) {
+    EXPECT_TRUE(pyr.zmins[l] == tpyr.zmins[l]);
+    EXPECT_TRUE(pyr.zmaxs[l] == tpyr.zmaxs[l]);
+  }
+  Vector3d p(5, 3, 4);
+  EXPECT_EQ(pyr.PointDistance(p), tpyr.PointDistance(p));
+  remove(fname);
+}
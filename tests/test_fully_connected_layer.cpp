@@ -1,10 +1,14 @@
 #include "fully_connected_layer.h"
+#include "fused_network.h"
 #include "gcop_conversions.h"
 #include "load_eigen_matrix.h"
+#include "tensor_bundle.h"
 #include "gtest/gtest.h"
 #include <Eigen/Dense>
 
 #include <chrono>
+#include <stdlib.h>
+#include <unistd.h>
 
 namespace gcop {
 
@@ -36,6 +40,37 @@ TEST(TestFullyConnectedLayer, checkParameters) {
   ASSERT_FLOAT_EQ((double)layer.gamma_(6, 0), 1.0190463);
 }
 
+TEST(TestFullyConnectedLayer, loadFromBundle) {
+  std::string folder_path =
+      (std::string(DATA_PATH) + "/model_vars_testing_fc_layer");
+  char file_template[] = "/tmp/gcop_fc_layer_XXXXXX";
+  int fd = mkstemp(file_template);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  std::string bundle_path = file_template;
+  TensorBundle::convertFolder(folder_path, bundle_path);
+  FullyConnectedLayer folder_layer(folder_path, "residual_dynamics", "1",
+                                   true, Activation::tanh);
+  FullyConnectedLayer bundle_layer(bundle_path, "residual_dynamics", "1",
+                                   true, Activation::tanh);
+  // The bundle stores the parsed values, so the parameters are identical
+  ASSERT_EQ(conversions::convertDMToEigen(bundle_layer.weights_),
+            conversions::convertDMToEigen(folder_layer.weights_));
+  ASSERT_EQ(conversions::convertDMToEigen(bundle_layer.gamma_),
+            conversions::convertDMToEigen(folder_layer.gamma_));
+  ASSERT_EQ(conversions::convertDMToEigen(bundle_layer.beta_),
+            conversions::convertDMToEigen(folder_layer.beta_));
+  ASSERT_EQ(conversions::convertDMToEigen(bundle_layer.moving_average_),
+            conversions::convertDMToEigen(folder_layer.moving_average_));
+  ASSERT_EQ(conversions::convertDMToEigen(bundle_layer.moving_variance_),
+            conversions::convertDMToEigen(folder_layer.moving_variance_));
+  // Variables missing from the bundle are reported
+  EXPECT_THROW(FullyConnectedLayer(bundle_path, "residual_dynamics", "2",
+                                   true, Activation::tanh),
+               std::runtime_error);
+  unlink(bundle_path.c_str());
+}
+
 TEST(TestFullyConnectedLayer, testTransform) {
   std::string folder_path =
       (std::string(DATA_PATH) + "/model_vars_testing_fc_layer/");
@@ -64,6 +99,80 @@ TEST(TestFullyConnectedLayer, testTransform) {
     }
   }
 }
+
+TEST(TestFullyConnectedLayer, testFusedTransform) {
+  std::string folder_path =
+      (std::string(DATA_PATH) + "/model_vars_testing_fc_layer/");
+  FullyConnectedLayer layer(folder_path, "residual_dynamics", "1", true,
+                            Activation::tanh);
+  FusedDenseLayer<36, 32> fused_layer(layer);
+  Eigen::MatrixXd inputs =
+      loadEigenMatrix(folder_path + "/fc_in_0").transpose();
+  Eigen::MatrixXd outputs =
+      loadEigenMatrix(folder_path + "/residual_dynamics_dense_1_Tanh_0")
+          .transpose();
+  // Evaluate the whole batch at once
+  Eigen::MatrixXd fused_out = fused_layer.transform(inputs);
+  ASSERT_EQ(fused_out.rows(), outputs.rows());
+  ASSERT_EQ(fused_out.cols(), outputs.cols());
+  for (int i = 0; i < outputs.cols(); ++i) {
+    for (int j = 0; j < outputs.rows(); ++j) {
+      ASSERT_NEAR(fused_out(j, i), outputs(j, i), 1e-6);
+    }
+  }
+  // Fixed size layer should not accept wrong sizes
+  ASSERT_THROW((FusedDenseLayer<32, 32>(layer)), std::runtime_error);
+}
+
+TEST(TestFullyConnectedLayer, testFusedNetwork) {
+  std::string folder_path =
+      (std::string(DATA_PATH) + "/tensorflow_model_vars_16_8_tanh/");
+  std::vector<FullyConnectedLayer> layers;
+  layers.emplace_back(folder_path, "residual_dynamics", "0", true,
+                      Activation::tanh);
+  layers.emplace_back(folder_path, "residual_dynamics", "1", true,
+                      Activation::tanh);
+  layers.emplace_back(folder_path, "residual_dynamics", "final", false,
+                      Activation::none);
+  // Casadi reference with jacobian
+  cs::MX x_in = cs::MX::sym("in_state", 34);
+  cs::MX x_out = x_in;
+  for (auto &layer : layers) {
+    x_out = layer.transform(x_out);
+  }
+  auto f = cs::Function("network", {x_in},
+                        {x_out, cs::MX::jacobian(x_out, x_in)});
+  FusedNetwork<34, 16, 8, 8> fused_network(layers);
+  FusedNetworkXd fused_network_xd(layers);
+  ASSERT_EQ(fused_network_xd.numberOfLayers(), 3);
+  int N = 16;
+  Eigen::MatrixXd inputs(34, N);
+  inputs.setRandom();
+  Eigen::MatrixXd batch_out = fused_network.transform(inputs);
+  Eigen::MatrixXd batch_out_xd = fused_network_xd.transform(inputs);
+  for (int i = 0; i < N; ++i) {
+    std::vector<cs::DM> args = {conversions::convertEigenToDM(inputs.col(i))};
+    auto out_args = f(args);
+    Eigen::VectorXd cs_out = conversions::convertDMToEigen(out_args.at(0));
+    Eigen::MatrixXd cs_jac = conversions::convertDMToEigen(out_args.at(1));
+    Eigen::Matrix<double, 8, 1> out;
+    Eigen::Matrix<double, 8, 34> jac;
+    fused_network.transform(inputs.col(i), out, &jac);
+    Eigen::VectorXd out_xd;
+    Eigen::MatrixXd jac_xd;
+    fused_network_xd.transform(inputs.col(i), out_xd, &jac_xd);
+    for (int j = 0; j < 8; ++j) {
+      ASSERT_NEAR(out(j), cs_out(j), 1e-9);
+      ASSERT_NEAR(out_xd(j), cs_out(j), 1e-9);
+      ASSERT_NEAR(batch_out(j, i), cs_out(j), 1e-9);
+      ASSERT_NEAR(batch_out_xd(j, i), cs_out(j), 1e-9);
+      for (int k = 0; k < 34; ++k) {
+        ASSERT_NEAR(jac(j, k), cs_jac(j, k), 1e-9);
+        ASSERT_NEAR(jac_xd(j, k), cs_jac(j, k), 1e-9);
+      }
+    }
+  }
+}
 }
 
 int main(int argc, char **argv) {
@@ -0,0 +1,72 @@
+#include "gp.h"
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdlib>
+
+using namespace gcop;
+using namespace Eigen;
+
+// log-likelihood after retraining with parameters l, s, sigma
+static double LogL(GP &gp, double l, double s, double sigma) {
+  gp.l = l;
+  gp.s = s;
+  gp.sigma = sigma;
+  gp.Train();
+  return gp.LogL();
+}
+
+static void ExpectGradient(bool cf) {
+  srand(1);
+  // large enough for the recursive triangular inversion to split twice
+  int n = 300;
+  GP gp(2, n);
+  gp.cf = cf;
+  gp.Xs = 3*MatrixXd::Random(2, n);
+  for (int j = 0; j < n; ++j)
+    gp.fs[j] = sin(gp.Xs(0,j))*cos(gp.Xs(1,j)) + .1*(rand()/(double)RAND_MAX - .5);
+
+  double l = .8, s = 1.3, sigma = .2;
+  LogL(gp, l, s, sigma);
+  Vector3d dll;
+  gp.LogL(dll);
+
+  // central differences
+  double h = 1e-5;
+  Vector3d dfd;
+  dfd[0] = (LogL(gp, l + h, s, sigma) - LogL(gp, l - h, s, sigma))/(2*h);
+  dfd[1] = (LogL(gp, l, s + h, sigma) - LogL(gp, l, s - h, sigma))/(2*h);
+  dfd[2] = (LogL(gp, l, s, sigma + h) - LogL(gp, l, s, sigma - h))/(2*h);
+
+  for (int i = 0; i < 3; ++i)
+    EXPECT_NEAR(dll[i], dfd[i], 1e-5*(1 + fabs(dfd[i]))) << "parameter " << i;
+}
+
+TEST(GP, LogLGradient) {
+  ExpectGradient(true);
+}
+
+TEST(GP, LogLGradientInverse) {
+  ExpectGradient(false);
+}
+
+TEST(GP, OptParams) {
+  srand(2);
+  int n = 200;
+  GP gp(2, n);
+  gp.Xs = 3*MatrixXd::Random(2, n);
+  for (int j = 0; j < n; ++j)
+    gp.fs[j] = sin(gp.Xs(0,j))*cos(gp.Xs(1,j)) + .1*(rand()/(double)RAND_MAX - .5);
+  gp.sigma = .1;
+  gp.Train();
+  double ll0 = gp.LogL();
+  gp.OptParams();
+  double ll = gp.LogL();
+  EXPECT_GT(ll, ll0);
+
+  // at the optimum the gradient vanishes
+  Vector3d dll;
+  gp.LogL(dll);
+  EXPECT_LT(fabs(dll[0]*gp.l), 1e-2*n);
+  EXPECT_LT(fabs(dll[1]*gp.s), 1e-2*n);
+  EXPECT_LT(fabs(dll[2]*gp.sigma), 1e-2*n);
+}
@@ -0,0 +1,114 @@
+#include "inspreint.h"
+#include "ins.h"
+#include <gtest/gtest.h>
+#include <cmath>
+#include <vector>
+
+using namespace gcop;
+using namespace Eigen;
+
+// a smoothly varying sequence of gyro and accelerometer readings
+static void Readings(std::vector<Vector3d> &ws, std::vector<Vector3d> &as, int n, double h) {
+  ws.resize(n);
+  as.resize(n);
+  for (int i = 0; i < n; ++i) {
+    double t = i*h;
+    ws[i] << .3*sin(t), .2*cos(2*t), .5 + .1*sin(3*t);
+    as[i] << 1 + sin(t), .5*cos(t), 9.81 + .3*sin(2*t);
+  }
+}
+
+static InsState Start() {
+  InsState x;
+  Vector3d r(.1, -.2, .3);
+  SO3::Instance().exp(x.R, r);
+  x.p << 1, 2, 3;
+  x.v << .5, -.5, .2;
+  x.bg << .01, -.02, .005;
+  x.ba << .05, .1, -.08;
+  return x;
+}
+
+TEST(InsPreint, PredictMatchesSteps) {
+  // Ins::Step updates the position with the velocity at the start
+  // (semiImplicit=false) or at the end (semiImplicit=true) of the step,
+  // while the preintegration is exact for readings held over the step,
+  // i.e. the average of the two
+  int n = 200;
+  double h = .005;
+  std::vector<Vector3d> ws, as;
+  Readings(ws, as, n, h);
+
+  InsState xa = Start();
+  Ins sys, syse;
+  syse.semiImplicit = false;
+
+  InsPreint pre(sys, xa.bg, xa.ba);
+  InsState x = xa, xe = xa, xn;
+  for (int i = 0; i < n; ++i) {
+    Vector6d u;
+    u << ws[i], as[i];
+    sys.Step(xn, i*h, x, u, h);
+    x = xn;
+    syse.Step(xn, i*h, xe, u, h);
+    xe = xn;
+    pre.Integrate(ws[i], as[i], h);
+  }
+  EXPECT_NEAR(pre.dt, n*h, 1e-12);
+
+  InsState xb;
+  pre.Predict(xb, xa, sys);
+  EXPECT_LT((xb.R - x.R).norm(), 1e-12);
+  EXPECT_LT((xb.v - x.v).norm(), 1e-10);
+  EXPECT_LT((xb.p - (x.p + xe.p)/2).norm(), 1e-10);
+  EXPECT_TRUE(xb.bg == xa.bg);
+  EXPECT_TRUE(xb.ba == xa.ba);
+
+  // the predicted covariance is symmetric positive definite
+  EXPECT_LT((xb.P - xb.P.transpose()).norm(), 1e-12*xb.P.norm());
+  EXPECT_GT(SelfAdjointEigenSolver<Matrix15d>(xb.P).eigenvalues()[0], 0);
+
+  // and the error between the states is zero
+  InsState xm = x;
+  xm.p = (x.p + xe.p)/2;
+  InsPreint::Vector9d e;
+  pre.Error(e, xa.R, xa.p, xa.v, xm.R, xm.p, xm.v, xa.bg, xa.ba, sys.g0);
+  EXPECT_LT(e.norm(), 1e-10);
+}
+
+TEST(InsPreint, BiasCorrection) {
+  // the relative motion for other biases, corrected to first order, is
+  // within O(|db|^2) of the one integrated with those biases
+  int n = 200;
+  double h = .005;
+  std::vector<Vector3d> ws, as;
+  Readings(ws, as, n, h);
+
+  Vector3d bg(.01, -.02, .005), ba(.05, .1, -.08);
+  InsPreint pre(3e-3, .05, bg, ba);
+  for (int i = 0; i < n; ++i)
+    pre.Integrate(ws[i], as[i], h);
+
+  double es[2];
+  for (int s = 0; s < 2; ++s) {
+    double c = (s ? .5 : 1);
+    Vector3d dbg = c*Vector3d(.02, .01, -.03), dba = c*Vector3d(-.1, .2, .1);
+
+    InsPreint prei(3e-3, .05, bg + dbg, ba + dba);
+    for (int i = 0; i < n; ++i)
+      prei.Integrate(ws[i], as[i], h);
+
+    Matrix3d dR;
+    Vector3d dv, dp, r, r0;
+    pre.Delta(dR, dv, dp, bg + dbg, ba + dba);
+    SO3::Instance().log(r, dR.transpose()*prei.dR);
+    SO3::Instance().log(r0, pre.dR.transpose()*prei.dR);
+
+    // without the correction the errors are O(|db|)
+    EXPECT_LT(r.norm(), .1*r0.norm());
+    es[s] = r.norm() + (dv - prei.dv).norm() + (dp - prei.dp).norm();
+    EXPECT_LT(es[s], .1*((pre.dv - prei.dv).norm() + (pre.dp - prei.dp).norm()));
+  }
+  // halving the bias change divides the error by about 4
+  EXPECT_LT(es[1], es[0]/3);
+}
@@ -0,0 +1,99 @@
+#include "kalmanpredictor.h"
+#include "kalmancorrector.h"
+#include "kalmanbank.h"
+#include "point3d.h"
+#include "point3dgps.h"
+#include "utils.h"
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+using namespace gcop;
+using namespace Eigen;
+
+typedef KalmanPredictor<Point3dState, 6, 3, Dynamic> Point3dKalmanPredictor;
+typedef KalmanCorrector<Point3dState, 6, 3, Dynamic, Vector3d, 3> Point3dGpsKalmanCorrector;
+typedef KalmanBank<Point3dState, 6, 3, Dynamic, Vector3d, 3> Point3dGpsKalmanBank;
+
+// largest relative difference of the coefficients of a and b
+template <typename M>
+static double Rel(const M &a, const M &b) {
+  return ((a - b).array().abs()/(1 + b.array().abs())).maxCoeff();
+}
+
+// runs the bank and single filters on the same measurements of n targets
+// and returns the largest relative difference of their beliefs
+static double Difference(bool linear, int nt) {
+  srand(1);
+  int n = 1000;   // not a multiple of the chunk size
+  int N = 50;
+  double dt = .01;
+
+  Point3d point3d;
+  Point3dGps<> gps;
+  Point3dKalmanPredictor kp(point3d);
+  Point3dGpsKalmanCorrector kc(point3d.X, gps);
+
+  Point3dGpsKalmanBank bank(point3d, gps, n);
+  bank.linear = linear;
+  std::vector<Point3d> point3ds(nt - 1);
+  std::vector<Point3dGps<> > gpss(nt - 1);
+  for (int i = 0; i < nt - 1; ++i) {
+    bank.systems.push_back(&point3ds[i]);
+    bank.sensors.push_back(&gpss[i]);
+  }
+
+  std::vector<Point3dState> xts(n), xs(n);
+  for (int k = 0; k < n; ++k) {
+    xts[k].q << 10*(RND - .5), 10*(RND - .5), 0;
+    xts[k].v << RND - .5, RND - .5, .1*(RND - .5);
+    xs[k].P.topLeftCorner<3,3>().diagonal().setConstant(.1 + .1*RND);
+    xs[k].P.bottomRightCorner<3,3>().diagonal().setConstant(.1);
+    bank.Set(k, xs[k]);
+  }
+
+  std::vector<Vector3d> us(n, Vector3d::Zero()), zs(n);
+  for (int i = 0; i < N; ++i) {
+    double t = i*dt;
+    for (int k = 0; k < n; ++k) {
+      Point3dState xt;
+      point3d.Step(xt, t, xts[k], us[k], dt);
+      xts[k] = xt;
+      zs[k] = xt.q + Vector3d(gps.sxy*randn(), gps.sxy*randn(), gps.sz*randn());
+
+      Point3dState x;
+      kp.Predict(x, t, xs[k], us[k], dt);
+      kc.Correct(xs[k], t, x, us[k], zs[k]);
+    }
+    bank.Predict(t, us, dt);
+    bank.Correct(t, us, zs);
+  }
+
+  double e = 0;
+  for (int k = 0; k < n; ++k) {
+    Point3dState x;
+    bank.Get(x, k);
+    e = std::max(e, std::max(std::max(Rel(x.q, xs[k].q), Rel(x.v, xs[k].v)),
+                             Rel(x.P, xs[k].P)));
+  }
+  std::cout << (linear ? "linear" : "nonlinear") << ", " << nt
+            << " system(s): max difference " << e << std::endl;
+  return e;
+}
+
+// the beliefs differ by about 1e-14 (relative) after 50 steps
+
+TEST(KalmanBank, Linear) {
+  EXPECT_LT(Difference(true, 1), 1e-13);
+}
+
+TEST(KalmanBank, Nonlinear) {
+  EXPECT_LT(Difference(false, 1), 1e-13);
+}
+
+TEST(KalmanBank, PerThreadSystems) {
+  // with OpenMP the chunks are processed by 3 threads
+  EXPECT_LT(Difference(true, 3), 1e-13);
+  EXPECT_LT(Difference(false, 3), 1e-13);
+}
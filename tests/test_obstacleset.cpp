@@ -0,0 +1,116 @@
+#include "obstacleset.h"
+#include "obstaclesetconstraint.h"
+#include "obstaclesetcost.h"
+#include "gcar.h"
+#include "se2.h"
+#include <gtest/gtest.h>
+#include <cstdlib>
+
+using namespace gcop;
+
+static double Rand(double a, double b) {
+  return a + (b - a)*rand()/(double)RAND_MAX;
+}
+
+class ObstacleSetTest : public testing::Test {
+protected:
+  ObstacleSetTest() : os(.3) {
+    srand(1);
+    for (int i = 0; i < 100; ++i)
+      os.Add(Disk(Vector2d(Rand(0, 20), Rand(0, 20)), Rand(.1, 1)));
+    for (int i = 0; i < 100; ++i)
+      os.Add(Sphere(Vector3d(Rand(0, 20), Rand(0, 20), Rand(0, 2)), Rand(.1, 1)));
+    for (int i = 0; i < 100; ++i)
+      os.AddCylinder(Vector3d(Rand(0, 20), Rand(0, 20), Rand(0, 1)), Rand(.1, 1), Rand(.5, 2));
+    os.Build();
+  }
+
+  // largest penetration over all obstacles
+  double BruteForce(const Vector3d &p, Vector3d &dg) {
+    double gm = -os.cr;
+    dg.setZero();
+    Vector3d dgk;
+    for (int k = 0; k < os.obstacles.size(); ++k) {
+      double g = os.Evaluate(k, p, &dgk);
+      if (g > gm) {
+        gm = g;
+        dg = dgk;
+      }
+    }
+    return gm;
+  }
+
+  ObstacleSet os;
+};
+
+TEST_F(ObstacleSetTest, MaxPenetration) {
+  int collisions = 0;
+  for (int i = 0; i < 10000; ++i) {
+    Vector3d p(Rand(-1, 21), Rand(-1, 21), Rand(-.5, 3));
+    Vector3d dg, dgb;
+    double g = os.MaxPenetration(p, &dg);
+    double gb = BruteForce(p, dgb);
+    // the penetration is exact in collision and its sign is always exact
+    if (gb > 0) {
+      ++collisions;
+      EXPECT_DOUBLE_EQ(g, gb);
+      EXPECT_LT((dg - dgb).norm(), 1e-12);
+    } else {
+      EXPECT_LE(g, 0);
+    }
+  }
+  EXPECT_GT(collisions, 100);
+}
+
+TEST_F(ObstacleSetTest, GcarJacobian) {
+  GcarManifold &X = GcarManifold::Instance();
+  Gcar sys;
+
+  ObstacleSetConstraint<GcarState, 4, 2> con(os, 2);
+  con.func = [](Vector3d &p, const GcarState &x) {
+    p << x.g(0,2), x.g(1,2), 0;
+    return 1;
+  };
+
+  ObstacleSetCost<GcarState, 4, 2> cost(sys, 1, os, 2);
+  cost.func = con.func;
+
+  // states near the obstacles at various headings
+  int tested = 0;
+  for (int i = 0; i < 1000 && tested < 20; ++i) {
+    GcarState x;
+    SE2::Instance().q2g(x.g, Vector3d(Rand(-M_PI, M_PI), Rand(0, 20), Rand(0, 20)));
+    x.v = 1;
+
+    Vector3d q(x.g(0,2), x.g(1,2), 0), dgb;
+    if (BruteForce(q, dgb) < .05)
+      continue;
+    ++tested;
+
+    Vector2d u(0, 0);
+    Matrix<double, 1, 1> g, ga, gb;
+    Matrix<double, 1, 4> dgdx;
+    Vector4d Lx;
+    Matrix4d Lxx;
+    con(g, 0, x, u, 0, &dgdx);
+    cost.L(0, x, u, 0, 0, &Lx, &Lxx);
+
+    // central differences along the retraction g*exp(v)
+    double eps = 1e-6;
+    for (int j = 0; j < 4; ++j) {
+      Vector4d v = Vector4d::Zero();
+      GcarState xa, xb;
+      v[j] = eps;
+      X.Retract(xb, x, v);
+      v[j] = -eps;
+      X.Retract(xa, x, v);
+      con(gb, 0, xb, u);
+      con(ga, 0, xa, u);
+      EXPECT_NEAR(dgdx[j], (gb[0] - ga[0])/(2*eps), 1e-6);
+      double Lb = cost.L(0, xb, u, 0);
+      double La = cost.L(0, xa, u, 0);
+      EXPECT_NEAR(Lx[j], (Lb - La)/(2*eps), 1e-6);
+    }
+  }
+  EXPECT_EQ(tested, 20);
+}
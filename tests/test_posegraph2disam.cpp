@@ -0,0 +1,98 @@
+#include "posegraph2disam.h"
+#include "body2dforce.h"
+#include <gtest/gtest.h>
+#include <cmath>
+
+using namespace gcop;
+
+// rms position difference of the poses and features of two pose graphs
+static void Errors(double &ep, double &ef, const Posegraph2d &pga, const Posegraph2d &pgb) {
+  ep = 0;
+  for (int k = 0; k < pga.gs.size(); ++k)
+    ep += (pga.gs[k].block<2,1>(0,2) - pgb.gs[k].block<2,1>(0,2)).squaredNorm();
+  ep = sqrt(ep/pga.gs.size());
+  ef = sqrt((pga.p - pgb.p).squaredNorm()/(pga.p.size()/2));
+}
+
+static void Errors(double &ep, double &ef, const Body2dGraph &pga, const Body2dGraph &pgb) {
+  ep = 0;
+  for (int k = 0; k < pga.xs.size(); ++k)
+    ep += (pga.xs[k].first.block<2,1>(0,2) - pgb.xs[k].first.block<2,1>(0,2)).squaredNorm();
+  ep = sqrt(ep/pga.xs.size());
+  ef = sqrt((pga.p - pgb.p).squaredNorm()/(pga.p.size()/2));
+}
+
+// The synthetic graphs are random and, with few loop closures, batch
+// Gauss-Newton from the odometry sometimes ends in a different local
+// minimum than the incremental solution (seen on Synthesize2 in about one
+// of five runs). The reference is therefore the batch solution started from
+// the incremental estimate: the incremental estimate has to be a batch
+// solution up to the relinearization threshold.
+
+static const int N = 100;
+static const Vector3d co(.01, .01, .01);
+
+static void ExpectBatch(Posegraph2dIsam &isam, const Posegraph2d &pg, double tol) {
+  Posegraph2d pgi(pg), pgb(pg);
+  isam.Get(pgi);
+  isam.Batch(50);
+  isam.Get(pgb);
+
+  double ep, ef;
+  Errors(ep, ef, pgi, pgb);
+  EXPECT_LT(ep, tol);
+  EXPECT_LT(ef, tol);
+}
+
+TEST(Posegraph2dIsam, Synthesize) {
+  Posegraph2d pgt(N, 2*(N+1)), pg(N, 2*(N+1));
+  Posegraph2d::Synthesize(pgt, pg, 50);
+
+  // without loop closures small angle errors are amplified along the
+  // trajectory, so relinearize more often
+  Posegraph2dIsam isam;
+  isam.relinTol = 1e-4;
+  for (int k = 0; k <= N; ++k) {
+    isam.Add(pg, k, co);
+    isam.Update();
+    // exploring: only the end of the trajectory is eliminated again
+    EXPECT_LT(isam.neliminated, 40);
+  }
+  ExpectBatch(isam, pg, .05);
+}
+
+TEST(Posegraph2dIsam, Synthesize2) {
+  Posegraph2d pgt(N, 2*(N+1)), pg(N, 2*(N+1));
+  Posegraph2d::Synthesize2(pgt, pg, 50);
+
+  Posegraph2dIsam isam;
+  for (int k = 0; k <= N; ++k) {
+    isam.Add(pg, k, co);
+    isam.Update();
+  }
+  ExpectBatch(isam, pg, .05);
+}
+
+TEST(Posegraph2dIsam, Body2dGraph) {
+  int N = 50;
+  Body2d<> sys(new Body2dForce<>);
+  Body2dGraph pgt(sys, N, 5*(N+1)), pg(sys, N, 5*(N+1));
+  pg.odometry = true;
+  Body2dGraph::Synthesize2(pgt, pg, 25);
+
+  Posegraph2dIsam isam;
+  for (int k = 0; k <= N; ++k) {
+    isam.Add(pg, k);
+    isam.Update();
+  }
+
+  Body2dGraph pgi(pg), pgb(pg);
+  isam.Get(pgi);
+  isam.Batch(50);
+  isam.Get(pgb);
+
+  double ep, ef;
+  Errors(ep, ef, pgi, pgb);
+  EXPECT_LT(ep, .05);
+  EXPECT_LT(ef, .05);
+}
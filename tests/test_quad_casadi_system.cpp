@@ -109,6 +109,50 @@ TEST_F(TestQuadCasadiSystem, TestStep) {
   ASSERT_EQ(B.cols(), 4);
 }
 
+TEST_F(TestQuadCasadiSystem, TestBatchStep) {
+  int batch_size = 8;
+  Eigen::MatrixXd xas(15, batch_size);
+  Eigen::MatrixXd us(4, batch_size);
+  xas.setRandom();
+  us.setRandom();
+  double h = 0.01;
+  for (std::string parallelization : {"serial", "unroll", "thread"}) {
+    quad_system->instantiateBatchStepFunction(batch_size, parallelization);
+    ASSERT_EQ(quad_system->batchSize(), batch_size);
+    Eigen::MatrixXd xbs, As, Bs;
+    quad_system->batchStep(xbs, 0, xas, us, h, 0, &As, &Bs);
+    ASSERT_EQ(xbs.rows(), 15);
+    ASSERT_EQ(xbs.cols(), batch_size);
+    ASSERT_EQ(As.cols(), 15 * batch_size);
+    ASSERT_EQ(Bs.cols(), 4 * batch_size);
+    // Verify each sample against the single step function
+    for (int k = 0; k < batch_size; ++k) {
+      Eigen::VectorXd xb(15);
+      Eigen::VectorXd xa = xas.col(k);
+      Eigen::VectorXd u = us.col(k);
+      Eigen::MatrixXd A, B;
+      quad_system->Step(xb, 0, xa, u, h, 0, &A, &B);
+      ASSERT_TRUE(xbs.col(k).isApprox(xb, 1e-12));
+      ASSERT_TRUE(As.middleCols(15 * k, 15).isApprox(A, 1e-12));
+      ASSERT_TRUE(Bs.middleCols(4 * k, 4).isApprox(B, 1e-12));
+    }
+  }
+}
+
+TEST_F(TestQuadCasadiSystem, TestBatchStepErrors) {
+  Eigen::MatrixXd xbs;
+  Eigen::MatrixXd xas = Eigen::MatrixXd::Zero(15, 4);
+  Eigen::MatrixXd us = Eigen::MatrixXd::Zero(4, 4);
+  ASSERT_THROW(quad_system->batchStep(xbs, 0, xas, us, 0.01),
+               std::runtime_error);
+  ASSERT_THROW(quad_system->instantiateBatchStepFunction(4, "openmp"),
+               std::runtime_error);
+  quad_system->instantiateBatchStepFunction(4);
+  Eigen::MatrixXd us_wrong = Eigen::MatrixXd::Zero(4, 3);
+  ASSERT_THROW(quad_system->batchStep(xbs, 0, xas, us_wrong, 0.01),
+               std::runtime_error);
+}
+
 int main(int argc, char **argv) {
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
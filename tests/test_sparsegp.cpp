@@ -0,0 +1,118 @@
+#include "sparsegp.h"
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdlib>
+
+using namespace gcop;
+using namespace Eigen;
+
+static void Data(GP &gp, int n) {
+  gp.Xs = 3*MatrixXd::Random(2, n);
+  gp.fs.resize(n);
+  for (int j = 0; j < n; ++j)
+    gp.fs[j] = sin(gp.Xs(0,j))*cos(gp.Xs(1,j)) + .1*(rand()/(double)RAND_MAX - .5);
+}
+
+// log-likelihood after retraining with parameters l, s, sigma (the
+// inducing points are kept)
+static double LogL(SparseGP &gp, double l, double s, double sigma) {
+  gp.l = l;
+  gp.s = s;
+  gp.sigma = sigma;
+  gp.Train();
+  return gp.LogL();
+}
+
+static void ExpectGradient(SparseGP::Type type, double sigma, double h = 1e-5) {
+  srand(1);
+  int n = 300;
+  SparseGP gp(2, 30, n, type);
+  Data(gp, n);
+
+  double l = .8, s = 1.3;
+  LogL(gp, l, s, sigma);
+  Vector3d dll;
+  double ll = gp.LogL(dll);
+  EXPECT_EQ(ll, gp.LogL());
+
+  // central differences
+  Vector3d dfd;
+  dfd[0] = (LogL(gp, l + h, s, sigma) - LogL(gp, l - h, s, sigma))/(2*h);
+  dfd[1] = (LogL(gp, l, s + h, sigma) - LogL(gp, l, s - h, sigma))/(2*h);
+  dfd[2] = (sigma > 0 ? (LogL(gp, l, s, sigma + h) - LogL(gp, l, s, sigma - h))/(2*h) : 0);
+
+  for (int i = 0; i < 3; ++i)
+    EXPECT_NEAR(dll[i], dfd[i], 1e-5*(1 + fabs(dfd[i]))) << "parameter " << i;
+}
+
+TEST(SparseGP, LogLGradientFITC) {
+  ExpectGradient(SparseGP::FITC, .2);
+}
+
+TEST(SparseGP, LogLGradientVFE) {
+  ExpectGradient(SparseGP::VFE, .2);
+}
+
+TEST(SparseGP, LogLGradientNoNoise) {
+  // the noise variance is then jitter*s^2, and the log-likelihood is too
+  // badly conditioned for smaller difference steps
+  ExpectGradient(SparseGP::FITC, 0, 1e-4);
+}
+
+TEST(SparseGP, LogLGradientAfterAdd) {
+  // the factors are updated by Add rather than recomputed
+  srand(2);
+  int n = 100;
+  SparseGP gp(2, 20, n);
+  Data(gp, n);
+  gp.sigma = .1;
+  gp.Train();
+  for (int k = 0; k < 20; ++k)
+    gp.Add(3*Vector2d::Random(), .1*k);
+
+  Vector3d dll, dllt;
+  double ll = gp.LogL(dll);
+  gp.Train();
+  EXPECT_NEAR(ll, gp.LogL(dllt), 1e-8*fabs(ll));
+  EXPECT_LT((dll - dllt).norm(), 1e-8*dllt.norm());
+}
+
+TEST(SparseGP, MatchesGP) {
+  // with the inducing points equal to the data both approximations are GP
+  // up to the jitter of the inducing point covariance (the differences are
+  // proportional to it, e.g. 5e-7 with the default 1e-8)
+  srand(3);
+  int n = 100;
+  GP gp(2, n);
+  Data(gp, n);
+  gp.l = .8;
+  gp.s = 1.3;
+  gp.sigma = .2;
+  gp.Train();
+  Vector3d dll;
+  double ll = gp.LogL(dll);
+
+  MatrixXd X = 3*MatrixXd::Random(2, 50);
+  VectorXd ms, ss;
+  gp.Predict(ms, X, &ss);
+
+  SparseGP::Type types[2] = {SparseGP::FITC, SparseGP::VFE};
+  for (int t = 0; t < 2; ++t) {
+    SparseGP sgp(2, n, n, types[t]);
+    sgp.jitter = 1e-12;
+    sgp.l = gp.l;
+    sgp.s = gp.s;
+    sgp.sigma = gp.sigma;
+    sgp.Train(gp.Xs, gp.fs);
+    ASSERT_EQ(sgp.Zs.cols(), n);
+
+    VectorXd sms, sss;
+    sgp.Predict(sms, X, &sss);
+    EXPECT_LT((sms - ms).cwiseAbs().maxCoeff(), 1e-8) << "type " << t;
+    EXPECT_LT((sss - ss).cwiseAbs().maxCoeff(), 1e-8) << "type " << t;
+
+    Vector3d sdll;
+    EXPECT_NEAR(sgp.LogL(sdll), ll, 1e-8*fabs(ll)) << "type " << t;
+    EXPECT_LT((sdll - dll).norm(), 1e-8*dll.norm()) << "type " << t;
+  }
+}
@@ -0,0 +1,134 @@
+#include "kalmanpredictor.h"
+#include "kalmancorrector.h"
+#include "unscentedpredictor.h"
+#include "unscentedcorrector.h"
+#include "sqrtunscentedfilter.h"
+#include "point3d.h"
+#include "point3dgps.h"
+#include "ins.h"
+#include "insgps.h"
+#include "utils.h"
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+using namespace gcop;
+using namespace Eigen;
+
+TEST(SqrtUnscentedFilter, LinearMatchesKalman) {
+  // the model and sensor are linear, so the SR-UKF and the Kalman filter
+  // give the same estimates up to round-off
+  typedef KalmanPredictor<Point3dState, 6, 3, Dynamic> Point3dKalmanPredictor;
+  typedef KalmanCorrector<Point3dState, 6, 3, Dynamic, Vector3d, 3> Point3dGpsKalmanCorrector;
+  typedef SqrtUnscentedFilter<Point3dState, 6, 3, Dynamic, Vector3d, 3> Point3dGpsSrukf;
+
+  srand(1);
+  Point3d point3d;
+  Point3dGps<> gps;
+  Point3dKalmanPredictor kp(point3d);
+  Point3dGpsKalmanCorrector kc(point3d.X, gps);
+  Point3dGpsSrukf ukf(point3d, gps);
+
+  int N = 1000;
+  double dt = .01;
+  Point3dState xt, xtn;
+  xt.v << .1, 0, .2;
+  Point3dState x0;
+  x0.P.topLeftCorner<3,3>().diagonal().setConstant(.1);
+  x0.P.bottomRightCorner<3,3>().diagonal().setConstant(.1);
+  Point3dState x = x0, kx = x0;
+
+  double dx = 0, dP = 0;
+  for (int i = 0; i < N; ++i) {
+    double t = i*dt;
+    Vector3d u(0, 0, 0);
+    point3d.Step(xtn, t, xt, u, dt);
+    xt = xtn;
+    Vector3d z = xt.q + Vector3d(gps.sxy*randn(), gps.sxy*randn(), gps.sz*randn());
+
+    Point3dState xp, kxp;
+    ASSERT_TRUE(kp.Predict(kxp, t, kx, u, dt));
+    ASSERT_TRUE(kc.Correct(kx, t, kxp, u, z));
+    ASSERT_TRUE(ukf.Predict(xp, t, x, u, dt));
+    ASSERT_TRUE(ukf.Correct(x, t, xp, u, z));
+
+    dx = std::max(dx, std::max((x.q - kx.q).cwiseAbs().maxCoeff(),
+                               (x.v - kx.v).cwiseAbs().maxCoeff()));
+    dP = std::max(dP, (x.P - kx.P).cwiseAbs().maxCoeff());
+  }
+  // dP is about 5e-16 at -O2 but 1e-12 with -ffast-math
+  std::cout << "max differences: state " << dx << ", covariance " << dP << std::endl;
+  EXPECT_LT(dx, 1e-9);
+  EXPECT_LT(dP, 1e-10);
+}
+
+TEST(SqrtUnscentedFilter, InsMatchesUnscented) {
+  // on a manifold with nonlinear dynamics the SR-UKF uses the same sigma
+  // points as the UKF (the Cholesky factor is the unique triangular square
+  // root with a positive diagonal), so the two agree up to round-off
+  typedef UnscentedPredictor<InsState, 15, 6, Dynamic> InsUnscentedPredictor;
+  typedef UnscentedCorrector<InsState, 15, 6, Dynamic, Vector3d, 3> InsGpsUnscentedCorrector;
+  typedef SqrtUnscentedFilter<InsState, 15, 6, Dynamic, Vector3d, 3> InsGpsSrukf;
+
+  srand(2);
+  Ins ins;
+  InsGps<> gps;
+  InsUnscentedPredictor up(ins);
+  InsGpsUnscentedCorrector uc(ins, gps);
+  InsGpsSrukf ukf(ins, gps);
+
+  int N = 100;
+  double dt = .01;
+  InsState xt, xtn;
+  xt.bg << .1, 0, 0;
+  xt.v << 1, 0, 0;
+
+  InsState x0;
+  x0.P.topLeftCorner<3,3>().diagonal().setConstant(.1);    // R
+  x0.P.block<3,3>(3,3).diagonal().setConstant(1e-2);       // bg
+  x0.P.block<3,3>(6,6).diagonal().setConstant(1e-4);       // ba
+  x0.P.block<3,3>(9,9).diagonal().setConstant(.01);        // p
+  x0.P.block<3,3>(12,12).diagonal().setConstant(.04);      // v
+  InsState x = x0, ux = x0;
+
+  // the UKF corrector prints its intermediate results
+  testing::internal::CaptureStdout();
+  double dR = 0, dx = 0, dP = 0;
+  for (int i = 0; i < N; ++i) {
+    double t = i*dt;
+    Vector3d wt = Vector3d(.2, .1, 0) + xt.bg;
+    Vector3d at = xt.R.transpose()*ins.g0 + xt.ba;
+    Vector6d ut;
+    ut << wt, at;
+    ins.Step(xtn, t, xt, ut, dt);
+    xt = xtn;
+
+    Vector6d u;
+    u << wt + ins.sv*Vector3d(randn(), randn(), randn()),
+      at + ins.sra*Vector3d(randn(), randn(), randn());
+    Vector3d z = xt.p + Vector3d(gps.sxy*randn(), gps.sxy*randn(), gps.sz*randn());
+
+    InsState xp, uxp;
+    ASSERT_TRUE(up.Predict(uxp, t, ux, u, dt));
+    ASSERT_TRUE(uc.Correct(ux, t, uxp, u, z));
+    ASSERT_TRUE(ukf.Predict(xp, t, x, u, dt));
+    ASSERT_TRUE(ukf.Correct(x, t, xp, u, z));
+
+    Vector3d e;
+    SO3::Instance().log(e, x.R.transpose()*ux.R);
+    dR = std::max(dR, e.norm());
+    dx = std::max(dx, std::max(std::max((x.p - ux.p).cwiseAbs().maxCoeff(),
+                                        (x.v - ux.v).cwiseAbs().maxCoeff()),
+                               std::max((x.bg - ux.bg).cwiseAbs().maxCoeff(),
+                                        (x.ba - ux.ba).cwiseAbs().maxCoeff())));
+    dP = std::max(dP, (x.P - ux.P).cwiseAbs().maxCoeff()/ux.P.cwiseAbs().maxCoeff());
+  }
+  testing::internal::GetCapturedStdout();
+
+  std::cout << "max differences: rotation " << dR << ", state " << dx
+            << ", relative covariance " << dP << std::endl;
+  EXPECT_LT(dR, 1e-8);
+  EXPECT_LT(dx, 1e-8);
+  EXPECT_LT(dP, 1e-8);
+}
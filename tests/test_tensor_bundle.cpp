@@ -0,0 +1,106 @@
+#include "load_eigen_matrix.h"
+#include "tensor_bundle.h"
+#include <Eigen/Dense>
+#include <dirent.h>
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace gcop;
+
+class TestTensorBundle : public testing::Test {
+protected:
+  virtual void SetUp() {
+    char file_template[] = "/tmp/gcop_tensor_bundle_XXXXXX";
+    int fd = mkstemp(file_template);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    bundle_path = file_template;
+  }
+  virtual void TearDown() { unlink(bundle_path.c_str()); }
+  std::string bundle_path;
+};
+
+TEST_F(TestTensorBundle, UnknownFile) {
+  ASSERT_THROW(TensorBundle("unknown_file"), std::runtime_error);
+}
+
+TEST_F(TestTensorBundle, InvalidFile) {
+  // Text matrix files are not bundles
+  ASSERT_THROW(TensorBundle(std::string(DATA_PATH) +
+                            "/test_model_vars/dense_0_weights_0"),
+               std::runtime_error);
+}
+
+TEST_F(TestTensorBundle, WriteAndRead) {
+  std::map<std::string, Eigen::MatrixXd> tensors;
+  tensors["a"] = Eigen::MatrixXd::Random(3, 5);
+  tensors["vector"] = Eigen::VectorXd::Random(7);
+  tensors["scalar"] = Eigen::MatrixXd::Constant(1, 1, 2.5);
+  TensorBundle::write(bundle_path, tensors);
+  TensorBundle bundle(bundle_path);
+  ASSERT_EQ(bundle.names().size(), 3);
+  ASSERT_FALSE(bundle.contains("b"));
+  ASSERT_THROW(bundle.get("b"), std::runtime_error);
+  for (const auto &tensor : tensors) {
+    ASSERT_TRUE(bundle.contains(tensor.first));
+    TensorBundle::MatrixMap view = bundle.get(tensor.first);
+    ASSERT_EQ(view.rows(), tensor.second.rows());
+    ASSERT_EQ(view.cols(), tensor.second.cols());
+    // Data is aligned for vectorized access
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(view.data()) % 64, 0);
+    ASSERT_EQ(view, tensor.second);
+  }
+}
+
+TEST_F(TestTensorBundle, Overwrite) {
+  char dir_template[] = "/tmp/gcop_tensor_bundle_dir_XXXXXX";
+  ASSERT_TRUE(mkdtemp(dir_template) != 0);
+  std::string file_path = std::string(dir_template) + "/bundle";
+  std::map<std::string, Eigen::MatrixXd> tensors;
+  tensors["a"] = Eigen::MatrixXd::Random(3, 5);
+  TensorBundle::write(file_path, tensors);
+  tensors["a"] = Eigen::MatrixXd::Random(2, 2);
+  TensorBundle::write(file_path, tensors);
+  // The temporary files are renamed onto the bundle
+  std::vector<std::string> files;
+  DIR *dir = opendir(dir_template);
+  struct dirent *dir_entry;
+  while ((dir_entry = readdir(dir)) != 0) {
+    std::string name = dir_entry->d_name;
+    if (name != "." && name != "..") {
+      files.push_back(name);
+    }
+  }
+  closedir(dir);
+  struct stat info;
+  ASSERT_EQ(stat(file_path.c_str(), &info), 0);
+  ASSERT_EQ(info.st_mode & 0777, 0644);
+  {
+    TensorBundle bundle(file_path);
+    ASSERT_EQ(bundle.get("a"), tensors["a"]);
+  }
+  unlink(file_path.c_str());
+  rmdir(dir_template);
+  ASSERT_EQ(files.size(), 1);
+  ASSERT_EQ(files[0], "bundle");
+}
+
+TEST_F(TestTensorBundle, ConvertFolder) {
+  std::string folder_path = std::string(DATA_PATH) + "/test_model_vars";
+  // Invalid text matrices are skipped
+  ASSERT_EQ(TensorBundle::convertFolder(folder_path, bundle_path), 2);
+  TensorBundle bundle(bundle_path);
+  ASSERT_FALSE(bundle.contains("kd_rpy_wrong_data"));
+  for (std::string name : {"kd_rpy", "dense_0_weights_0"}) {
+    Eigen::MatrixXd expected = loadEigenMatrix(folder_path + "/" + name);
+    ASSERT_EQ(bundle.get(name), expected);
+  }
+  ASSERT_FLOAT_EQ(bundle.get("dense_0_weights_0")(12, 8), 0.46349743);
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
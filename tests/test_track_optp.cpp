@@ -0,0 +1,81 @@
+#include "kinbody3dtrack.h"
+#include "kinbodyprojtrack.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+using namespace gcop;
+
+// Feature estimates of the tracks given the true poses, compared with the
+// true landmarks: the errors are then due to the measurement noise only.
+
+static const int N = 100;
+static const double h = .1;
+
+// drives the track along its true poses and returns them
+template <typename T>
+static void Drive(T &pg, vector<Matrix4d> &xs) {
+  pg.MakeTrue();
+  Matrix4d x;
+  for (int k = 0; k < N; ++k) {
+    pg.Get(x, 5, (k + 1)*h);
+    pg.Add2(Matrix<double, 6, 1>::Zero(), x, h);
+  }
+  xs.resize(pg.xs.size());
+  for (int k = 0; k < (int)xs.size(); ++k)
+    pg.Get(xs[k], 5, k*h);
+}
+
+// sorted errors of the feature estimates p
+template <typename T>
+static void Errors(vector<double> &es, const T &pg, const VectorXd &p) {
+  es.clear();
+  for (int l = 0; l < (int)pg.pis.size(); ++l)
+    es.push_back((p.segment<3>(3*l) - pg.ls[pg.pis[l]]).norm());
+  sort(es.begin(), es.end());
+}
+
+TEST(Kinbody3dTrack, Optp) {
+  srand(1);
+  Kinbody3d<6> sys;
+  Kinbody3dTrack<6> pg(sys, 500, 5, 0, N*h);
+  vector<Matrix4d> xs;
+  Drive(pg, xs);
+  ASSERT_GT(pg.pis.size(), 50u);
+
+  VectorXd p = VectorXd::Zero(pg.p.size());
+  pg.Optp(p, xs);
+  EXPECT_TRUE(pg.vis.Indexed());
+
+  // each feature is the average of about 20 noisy points (stdev sqrt(cp) =
+  // .1 per coordinate), i.e. a stdev of about .02 per coordinate
+  vector<double> es;
+  Errors(es, pg, p);
+  EXPECT_LT(es[es.size()/2], .05);
+  EXPECT_LT(es.back(), .2);
+}
+
+TEST(KinbodyProjTrack, Optp) {
+  srand(1);
+  Kinbody3d<6> sys;
+  KinbodyProjTrack<6> pg(sys, 500, 5, 0, N*h);
+  vector<Matrix4d> xs;
+  Drive(pg, xs);
+  ASSERT_GT(pg.pis.size(), 50u);
+
+  // features that are not triangulated keep their initial value, which is
+  // far from the landmarks
+  VectorXd p = VectorXd::Constant(pg.p.size(), 1e3);
+  pg.Optp(p, xs);
+
+  // the bearings have a noise of about .1 rad per coordinate and the
+  // features are up to dmax = 20 away, so each ray is off by up to about 2
+  // and the intersection of about 20 rays by about .5
+  vector<double> es;
+  Errors(es, pg, p);
+  EXPECT_LT(es[es.size()/2], .8);
+  EXPECT_LT(es[9*es.size()/10], 1.5);
+  // all features are triangulated
+  EXPECT_LT(es.back(), 5);
+}
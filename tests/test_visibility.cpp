@@ -0,0 +1,95 @@
+#include "visibility.h"
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include <utility>
+#include <vector>
+
+using namespace gcop;
+
+// compares the tables with the per-pose (Is) and per-feature (Js) lists
+// of (feature or pose, measurement) pairs the tracks used before
+static void ExpectSame(const Visibility<2> &vis,
+                       const vector< vector<pair<int, Vector2d> > > &Is,
+                       const vector< vector<pair<int, Vector2d> > > &Js) {
+  ASSERT_EQ(vis.Poses(), (int)Is.size());
+  for (int k = 0; k < Is.size(); ++k) {
+    ASSERT_EQ(vis.is[k + 1] - vis.is[k], (int)Is[k].size());
+    for (int m = 0; m < Is[k].size(); ++m) {
+      int i = vis.is[k] + m;
+      EXPECT_EQ(vis.ks[i], k);
+      EXPECT_EQ(vis.ls[i], Is[k][m].first);
+      EXPECT_EQ(vis.zs[i], Is[k][m].second);
+    }
+  }
+  // the chains are always up to date
+  ASSERT_EQ(vis.first.size(), Js.size());
+  ASSERT_EQ(vis.next.size(), vis.ls.size());
+  for (int l = 0; l < Js.size(); ++l) {
+    int m = 0;
+    for (int i = vis.first[l]; i >= 0; i = vis.next[i], ++m) {
+      ASSERT_LT(m, (int)Js[l].size());
+      EXPECT_EQ(vis.ls[i], l);
+      EXPECT_EQ(vis.ks[i], Js[l][m].first);
+      EXPECT_EQ(vis.zs[i], Js[l][m].second);
+    }
+    EXPECT_EQ(m, (int)Js[l].size());
+  }
+  if (!vis.Indexed())
+    return;
+  ASSERT_EQ(vis.js.size(), Js.size() + 1);
+  for (int l = 0; l < Js.size(); ++l) {
+    ASSERT_EQ(vis.js[l + 1] - vis.js[l], (int)Js[l].size());
+    for (int m = 0; m < Js[l].size(); ++m) {
+      int i = vis.os[vis.js[l] + m];
+      EXPECT_EQ(vis.ls[i], l);
+      EXPECT_EQ(vis.ks[i], Js[l][m].first);
+      EXPECT_EQ(vis.zs[i], Js[l][m].second);
+    }
+  }
+}
+
+TEST(Visibility, Index) {
+  srand(1);
+  int nf = 50;
+  Visibility<2> vis(nf);
+  vector< vector<pair<int, Vector2d> > > Is, Js(nf);
+
+  for (int k = 0; k < 40; ++k) {
+    vis.AddPose();
+    Is.resize(Is.size() + 1);
+    EXPECT_FALSE(vis.Indexed());
+    // a random subset of features, in random order
+    int n = rand() % 10;
+    for (int m = 0; m < n; ++m) {
+      int l = rand() % nf;
+      Vector2d z(rand()/(double)RAND_MAX, rand()/(double)RAND_MAX);
+      vis.Add(l, z);
+      Is[k].push_back(make_pair(l, z));
+      Js[l].push_back(make_pair(k, z));
+    }
+    ExpectSame(vis, Is, Js);
+    // index some of the time, as the tracks do before estimating features
+    if (k % 3 == 0) {
+      vis.Index();
+      EXPECT_TRUE(vis.Indexed());
+      ExpectSame(vis, Is, Js);
+    }
+  }
+  vis.Index();
+  EXPECT_TRUE(vis.Indexed());
+  ExpectSame(vis, Is, Js);
+  EXPECT_EQ(vis.Size(), (int)vis.os.size());
+}
+
+TEST(Visibility, Near) {
+  vector<Vector2d, aligned_allocator<Vector2d> > pfs;
+  for (int l = 0; l < 100; ++l)
+    pfs.push_back(Vector2d(l % 10, l / 10));
+  vector<int> fs;
+  Visibility<2>::Near(fs, pfs, Vector2d(4.5, 4.5), 1);
+  ASSERT_EQ(fs.size(), 4u);
+  EXPECT_EQ(fs[0], 44);
+  EXPECT_EQ(fs[1], 45);
+  EXPECT_EQ(fs[2], 54);
+  EXPECT_EQ(fs[3], 55);
+}